@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  bench_burst_tagger.py
+#
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#
+#
+
+# Throughput of baz.burst_tagger across burst sizes & item types
+
+import time
+from optparse import OptionParser
+
+from gnuradio import gr, blocks
+import baz
+
+types = {
+	'complex':	(gr.sizeof_gr_complex, blocks.vector_source_c, [complex(1, -1)] * 1024),
+	'float':	(gr.sizeof_float, blocks.vector_source_f, [1.0] * 1024),
+	'short':	(gr.sizeof_short, blocks.vector_source_s, [1] * 1024),
+	'byte':		(gr.sizeof_char, blocks.vector_source_b, [1] * 1024),
+}
+
+def run(type_name, burst_size, nitems, pad_front, pad_rear, repeat):
+	(itemsize, source, data) = types[type_name]
+
+	bursts = max(1, nitems // burst_size)
+
+	tb = gr.top_block()
+	src = source(data, True)
+	head = blocks.head(itemsize, bursts * burst_size)
+	tagger = blocks.stream_to_tagged_stream(itemsize, 1, burst_size, "length")
+	burst = baz.burst_tagger("length", 1.0, pad_front, pad_rear, True, False, itemsize)
+	sink = blocks.null_sink(itemsize)
+	tb.connect(src, head, tagger, burst, sink)
+
+	best = None
+	for i in range(repeat):
+		head.reset()
+		start = time.time()
+		tb.run()
+		elapsed = time.time() - start
+		if best is None or elapsed < best:
+			best = elapsed
+
+	return (bursts * burst_size / best, bursts / best)
+
+def main():
+	parser = OptionParser(usage="%prog: [options]")
+
+	parser.add_option("-n", "--items", type="int", default=20*1000*1000, help="items per run [default=%default]")
+	parser.add_option("-r", "--repeat", type="int", default=3, help="runs per combination (best is kept) [default=%default]")
+	parser.add_option("-t", "--types", type="string", default="complex,float,byte", help="comma-separated item types (%s) [default=%%default]" % (",".join(sorted(types.keys()))))
+	parser.add_option("-f", "--pad-front", type="int", default=0, help="front padding [default=%default]")
+	parser.add_option("-p", "--pad-rear", type="int", default=0, help="rear padding [default=%default]")
+	parser.add_option("-m", "--min-burst", type="int", default=16, help="smallest burst [default=%default]")
+	parser.add_option("-M", "--max-burst", type="int", default=1024*1024, help="largest burst [default=%default]")
+
+	(options, args) = parser.parse_args()
+
+	print("%-8s %10s %12s %14s" % ("type", "burst", "Msamp/s", "bursts/s"))
+
+	for type_name in options.types.split(','):
+		burst_size = options.min_burst
+		while burst_size <= options.max_burst:
+			(rate, burst_rate) = run(type_name, burst_size, max(options.items, burst_size), options.pad_front, options.pad_rear, options.repeat)
+			print("%-8s %10d %12.1f %14.1f" % (type_name, burst_size, rate / 1e6, burst_rate))
+			burst_size *= 4
+
+	return 0
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  bench_unpacked_to_packed.py
+#
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#
+#
+
+# Throughput of baz.unpacked_to_packed_bb across bits-per-chunk & endianness
+
+import time, random
+from optparse import OptionParser
+
+from gnuradio import gr, blocks
+import baz
+
+def run(bits_per_chunk, bits_into_output, endianness, nbits, repeat):
+	random.seed(0)
+	data = [random.randint(0, 255) for i in range(4096)]
+
+	tb = gr.top_block()
+	src = blocks.vector_source_b(data, True)
+	head = blocks.head(gr.sizeof_char, nbits // bits_per_chunk)
+	pack = baz.unpacked_to_packed_bb(bits_per_chunk, bits_into_output, endianness)
+	sink = blocks.null_sink(gr.sizeof_char)
+	tb.connect(src, head, pack, sink)
+
+	best = None
+	for i in range(repeat):
+		head.reset()
+		start = time.time()
+		tb.run()
+		elapsed = time.time() - start
+		if best is None or elapsed < best:
+			best = elapsed
+
+	return nbits / best
+
+def main():
+	parser = OptionParser(usage="%prog: [options]")
+
+	parser.add_option("-n", "--bits", type="int", default=200*1000*1000, help="bits to pack per run [default=%default]")
+	parser.add_option("-r", "--repeat", type="int", default=3, help="runs per combination (best is kept) [default=%default]")
+	parser.add_option("-o", "--bits-into-output", type="string", default="8,7", help="comma-separated bits per output byte [default=%default]")
+
+	(options, args) = parser.parse_args()
+
+	endiannesses = [(gr.GR_MSB_FIRST, "MSB"), (gr.GR_LSB_FIRST, "LSB")]
+
+	print("%-6s %-6s %-6s %12s" % ("chunk", "output", "order", "Mbit/s"))
+
+	for bits_into_output in [int(x) for x in options.bits_into_output.split(',')]:
+		for bits_per_chunk in [1, 2, 3, 4]:
+			if bits_per_chunk > bits_into_output:
+				continue
+			for (endianness, endianness_name) in endiannesses:
+				rate = run(bits_per_chunk, bits_into_output, endianness, options.bits, options.repeat)
+				print("%-6d %-6d %-6s %12.1f" % (bits_per_chunk, bits_into_output, endianness_name, rate / 1e6))
+
+	return 0
+
+if __name__ == '__main__':
+	main()
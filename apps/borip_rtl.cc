@@ -0,0 +1,1058 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * Standalone BorIP server for RTL2832U dongles (native counterpart of borip_server.py + borip_RTL).
+ *
+ * Speaks the same line-based TCP control protocol (GO, STOP, DEVICE, FREQ, ANTENNA, GAIN,
+ * RATE, DEST, HEADER) and streams interleaved short I/Q in BOR_PACKET_HEADER datagrams.
+ * Each client gets its own dongle ('DEVICE <index>' or 'DEVICE rtl index=N tuner=NAME ...'),
+ * so one process serves several dongles.  Samples go from the bulk transfer buffer into
+ * packet slots in a single conversion pass, and completed packets are sent in batches
+ * (sendmmsg where available).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rtl2832.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+/////////////////////////////////////////////////
+
+#pragma pack(push)
+#pragma pack(1)
+
+typedef unsigned char BYTE;
+typedef unsigned short USHORT;
+
+typedef struct BorPacketHeader {
+	BYTE flags;
+	BYTE notification;
+	USHORT idx;
+} BOR_PACKET_HEADER, *PBOR_PACKET_HEADER;
+
+#pragma pack(pop)
+
+enum BorFlags
+{
+	BF_NONE				= 0x00,
+	BF_HARDWARE_OVERRUN	= 0x01,
+	BF_NETWORK_OVERRUN	= 0x02,
+	BF_BUFFER_OVERRUN	= 0x04,
+	BF_EMPTY_PAYLOAD	= 0x08,
+	BF_STREAM_START		= 0x10,
+	BF_STREAM_END		= 0x20,
+	BF_BUFFER_UNDERRUN	= 0x40,
+	BF_HARDWARE_TIMEOUT	= 0x80
+};
+
+/////////////////////////////////////////////////
+
+#define DEFAULT_PORT			28888
+#define DEFAULT_READLEN			(16384 * 2)	// Same as baz_rtl_source_c
+#define DEFAULT_BATCH			32	// Enough for one read of small packets
+#define DEFAULT_SAMPLE_RATE		1000000
+#define MASTER_CLOCK			3200000	// As reported by borip_RTL
+#define MAX_PAYLOAD_SIZE		((65536 - 29) - ((65536 - 29) % 512))	// As borip_server.py
+#define RAW_SAMPLE_SIZE			(1+1)
+
+struct server_options
+{
+	int listen_port;
+	int data_port;
+	std::string device;	// Opened for each new client
+	bool lock;
+	bool verbose;
+	bool command;
+	int payload_size;	// Bytes of short I/Q per packet
+	int batch;
+	int read_length;
+};
+
+static server_options g_options;
+
+static bool parse_number(const std::string& s, double& d)
+{
+	if (s.empty())
+		return false;
+
+	char* end = NULL;
+	d = strtod(s.c_str(), &end);
+
+	return ((end != NULL) && (*end == '\0'));
+}
+
+/////////////////////////////////////////////////
+
+class stderr_log : public RTL2832_NAMESPACE::log_sink
+{
+public:
+	void on_log_message_va(int level, const char* msg, va_list args)
+	{
+		if ((level > RTL2832_NAMESPACE::log_sink::LOG_LEVEL_DEFAULT) && (g_options.verbose == false))
+			return;
+
+		vfprintf(stderr, msg, args);
+	}
+};
+
+static stderr_log g_log;
+
+/*
+ * One dongle and the UDP stream it feeds
+ */
+class rtl_device
+{
+public:
+	rtl_device()
+		: d_socket(-1)
+		, d_header(true)
+		, d_running(false)
+		, d_read_length(g_options.read_length)
+		, d_frequency(0)
+		, d_frequency_requested(0)
+		, d_gain(0)
+		, d_antenna("(Default)")
+		, d_counter(0)
+		, d_flags(0)
+		, d_packet_fill(0)
+		, d_packets_sent(0)
+		, d_packets_dropped(0)
+	{
+		memset(&d_params, 0x00, sizeof(d_params));
+		memset(&d_destination, 0x00, sizeof(d_destination));
+		d_params.message_output = &g_log;
+	}
+
+	~rtl_device()
+	{
+		close();
+	}
+
+	bool open(const std::string& hint, std::string& error);
+	void close();
+	bool start(std::string& error);
+	void stop();
+	bool running() const
+	{ return d_running; }
+
+	std::string description() const;
+	bool set_destination(const std::string& host, int port, std::string& error);
+	std::string destination() const;
+	void set_header(bool header)
+	{ d_header = header; }
+	bool header() const
+	{ return d_header; }
+
+	bool set_frequency(double freq, int& limit, std::string& error);
+	double frequency() const
+	{ return d_frequency; }
+	double frequency_requested() const
+	{ return d_frequency_requested; }
+	bool set_gain(double gain, std::string& error);
+	double gain() const
+	{ return d_gain; }
+	bool set_sample_rate(double rate, std::string& error);
+	double sample_rate() const
+	{ return d_demod.sample_rate(); }
+	const std::string& antenna() const
+	{ return d_antenna; }
+	void set_antenna(const std::string& antenna)
+	{ d_antenna = antenna; }
+private:
+	RTL2832_NAMESPACE::demod d_demod;
+	RTL2832_NAMESPACE::demod::PARAMS d_params;
+	boost::mutex d_mutex;	// Tuning vs. stream start/stop
+	boost::thread d_thread;
+	int d_socket;	// Connected UDP socket
+	struct sockaddr_storage d_destination;
+	std::string d_destination_host;
+	int d_destination_port;
+	volatile bool d_header;
+	volatile bool d_running;
+	int d_read_length;	// Bytes per USB bulk read ('readlen' in the hint, else --readlen)
+	double d_frequency;
+	double d_frequency_requested;
+	double d_gain;
+	std::string d_antenna;
+	// Stream state (stream thread only)
+	std::vector<uint8_t> d_usb;
+	std::vector<uint8_t> d_packets;	// Batch of header + payload slots
+#if defined(__linux__)
+	std::vector<struct mmsghdr> d_msgs;
+	std::vector<struct iovec> d_iovs;
+#endif // __linux__
+	size_t d_slot_size;
+	USHORT d_counter;
+	volatile int d_flags;	// Pending for next packet
+	size_t d_packet_fill;	// Bytes of payload in the packet being filled
+	uint64_t d_packets_sent;
+	uint64_t d_packets_dropped;
+
+	void stream();
+	int send_packets(int count);
+	void send_end();
+};
+
+static std::string format(const char* fmt, ...)
+{
+	char buffer[1024];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+	return buffer;
+}
+
+// "-" / "" / "rtl" / "<index>" / "rtl index=N tuner=NAME vid=0x... pid=0x... readlen=N"
+bool rtl_device::open(const std::string& hint, std::string& error)
+{
+	close();
+
+	memset(&d_params, 0x00, sizeof(d_params));
+	d_params.message_output = &g_log;
+	d_params.verbose = g_options.verbose;
+	d_read_length = g_options.read_length;
+
+	size_t start = 0;
+	while (start < hint.size())
+	{
+		size_t end = hint.find(' ', start);
+		if (end == std::string::npos)
+			end = hint.size();
+
+		std::string part = hint.substr(start, end - start);
+		start = end + 1;
+
+		if ((part.empty()) || (part == "-") || (strcasecmp(part.c_str(), "rtl") == 0))
+			continue;
+
+		std::string key, value = part;
+		size_t equals = part.find('=');
+		if (equals != std::string::npos)
+		{
+			key = part.substr(0, equals);
+			value = part.substr(equals + 1);
+		}
+
+		if ((key.empty()) || (key == "index"))
+			d_params.device_index = atoi(value.c_str());
+		else if (key == "tuner")
+			strncpy(d_params.tuner_name, value.c_str(), RTL2832_TUNER_NAME_LEN - 1);
+		else if (key == "vid")
+			d_params.vid = (uint16_t)strtol(value.c_str(), NULL, 0);
+		else if (key == "pid")
+			d_params.pid = (uint16_t)strtol(value.c_str(), NULL, 0);
+		else if (key == "readlen")
+			d_read_length = atoi(value.c_str());
+		else
+		{
+			error = "Unknown device argument: " + key;
+			return false;
+		}
+	}
+
+	if (d_demod.initialise(&d_params) != RTL2832_NAMESPACE::SUCCESS)
+	{
+		error = "Failed to initialise RTL2832 device";
+		return false;
+	}
+
+	double real_rate = 0;
+	if (d_demod.set_sample_rate(DEFAULT_SAMPLE_RATE, &real_rate) != RTL2832_NAMESPACE::SUCCESS)
+		fprintf(stderr, "!!> Failed to set default sample rate\n");
+
+	d_demod.active_tuner()->set_auto_gain_mode(false);
+	d_gain = d_demod.active_tuner()->gain();
+	d_frequency = d_frequency_requested = d_demod.active_tuner()->frequency();
+
+	fprintf(stderr, "--> Opened device #%d: %s (tuner: %s)\n", d_params.device_index, d_demod.name(), d_demod.active_tuner()->name());
+
+	return true;
+}
+
+void rtl_device::close()
+{
+	stop();
+
+	d_demod.destroy();
+
+	if (d_socket >= 0)
+	{
+		::close(d_socket);
+		d_socket = -1;
+	}
+}
+
+std::string rtl_device::description() const
+{
+	RTL2832_NAMESPACE::range_t gain_range = d_demod.active_tuner()->gain_range();
+
+	return format("%s|%f|%f|%f|%f|%d|%s|%s",
+		d_demod.name(),
+		gain_range.first,
+		gain_range.second,
+		1.0,
+		(double)MASTER_CLOCK,
+		(g_options.payload_size / 2 / 2),
+		d_antenna.c_str(),
+		format("%s #%d", d_demod.active_tuner()->name(), d_params.device_index).c_str());
+}
+
+bool rtl_device::set_destination(const std::string& host, int port, std::string& error)
+{
+	struct addrinfo hints, *result = NULL;
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	std::string port_str = format("%d", port);
+	int res = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result);
+	if (res != 0)
+	{
+		error = gai_strerror(res);
+		return false;
+	}
+
+	int s = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (s < 0)
+	{
+		error = strerror(errno);
+		freeaddrinfo(result);
+		return false;
+	}
+
+	int buffer_size = 4 * 1024 * 1024;	// Room for a few batches
+	setsockopt(s, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+
+	if (connect(s, result->ai_addr, result->ai_addrlen) < 0)
+	{
+		error = strerror(errno);
+		::close(s);
+		freeaddrinfo(result);
+		return false;
+	}
+
+	freeaddrinfo(result);
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	int previous = d_socket;
+	d_socket = s;	// Stream thread picks this up on its next send
+	d_destination_host = host;
+	d_destination_port = port;
+
+	if (previous >= 0)
+		::close(previous);
+
+	return true;
+}
+
+std::string rtl_device::destination() const
+{
+	return format("%s:%d", d_destination_host.c_str(), d_destination_port);
+}
+
+bool rtl_device::set_frequency(double freq, int& limit, std::string& error)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	limit = 0;
+
+	RTL2832_NAMESPACE::range_t range = d_demod.active_tuner()->frequency_range();
+	if (RTL2832_NAMESPACE::is_valid_range(range))
+	{
+		if (freq < range.first)
+			limit = -1;
+		else if (freq > range.second)
+			limit = 1;
+	}
+
+	if (d_demod.active_tuner()->set_frequency(freq) != RTL2832_NAMESPACE::SUCCESS)
+	{
+		error = "Failed to set frequency";
+		return false;
+	}
+
+	d_frequency_requested = freq;
+	d_frequency = d_demod.active_tuner()->frequency();
+
+	return true;
+}
+
+bool rtl_device::set_gain(double gain, std::string& error)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	if (d_demod.active_tuner()->set_gain(gain) != RTL2832_NAMESPACE::SUCCESS)
+	{
+		error = "Failed to set gain";
+		return false;
+	}
+
+	d_gain = d_demod.active_tuner()->gain();
+
+	return true;
+}
+
+bool rtl_device::set_sample_rate(double rate, std::string& error)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	if ((rate <= 0) || (d_demod.set_sample_rate((uint32_t)rate) != RTL2832_NAMESPACE::SUCCESS))
+	{
+		error = "Failed to set sample rate";
+		return false;
+	}
+
+	return true;
+}
+
+bool rtl_device::start(std::string& error)
+{
+	if ((d_running == false) && (d_thread.joinable()))
+		d_thread.join();	// Stream ended by itself (read failed): reap it before starting another
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	if (d_running)
+		return true;
+
+	if (d_demod.reset() != RTL2832_NAMESPACE::SUCCESS)
+	{
+		error = "Failed to reset device";
+		return false;
+	}
+
+	size_t read_length = std::max(512, d_read_length - (d_read_length % 512));	// Whole USB packets
+	d_usb.resize(read_length);
+
+	d_slot_size = sizeof(BOR_PACKET_HEADER) + g_options.payload_size;
+	d_packets.resize(d_slot_size * g_options.batch);
+#if defined(__linux__)
+	d_msgs.resize(g_options.batch);
+	d_iovs.resize(g_options.batch);
+#endif // __linux__
+
+	d_counter = 0;
+	d_flags = BF_STREAM_START;
+	d_packet_fill = 0;
+	d_packets_sent = 0;
+	d_packets_dropped = 0;
+
+	d_running = true;	// Before the thread starts (otherwise it would exit)
+	d_thread = boost::thread(boost::bind(&rtl_device::stream, this));
+
+	return true;
+}
+
+void rtl_device::stop()
+{
+	bool was_running;
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+
+		was_running = d_running;
+		d_running = false;	// Stream thread exits after its current read
+	}
+
+	if (d_thread.joinable())
+		d_thread.join();	// Also reaps a stream that ended by itself
+
+	if (was_running == false)
+		return;	// Never started, or the stream thread already sent the end
+
+	send_end();
+
+	fprintf(stderr, "--> Stream stopped: %llu packets sent, %llu dropped\n", (unsigned long long)d_packets_sent, (unsigned long long)d_packets_dropped);
+}
+
+// Sends the first 'count' slots of the batch, returns the number the network took
+int rtl_device::send_packets(int count)
+{
+	if (count == 0)
+		return 0;
+
+	boost::mutex::scoped_lock lock(d_mutex);	// DEST may swap the socket
+
+	int s = d_socket;
+	if (s < 0)
+		return count;	// Nowhere to send: discard, as udp_sink does without a connection
+
+	const size_t offset = (d_header ? 0 : sizeof(BOR_PACKET_HEADER));
+	const size_t length = d_slot_size - offset;
+	int sent = 0;
+
+#if defined(__linux__)
+	struct mmsghdr* msgs = &d_msgs[0];
+	memset(msgs, 0x00, sizeof(struct mmsghdr) * count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		d_iovs[i].iov_base = &d_packets[(i * d_slot_size) + offset];
+		d_iovs[i].iov_len = length;
+		msgs[i].msg_hdr.msg_iov = &d_iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while (sent < count)
+	{
+		int res = sendmmsg(s, msgs + sent, count - sent, 0);
+		if (res <= 0)
+			break;
+		sent += res;
+	}
+#else
+	for (; sent < count; ++sent)
+	{
+		if (send(s, &d_packets[(sent * d_slot_size) + offset], length, 0) < 0)
+			break;
+	}
+#endif // __linux__
+
+	if (sent < count)
+	{
+		if (errno == ECONNREFUSED)	// Receiver not listening yet
+			return count;
+
+		d_packets_dropped += (count - sent);
+		d_flags |= BF_NETWORK_OVERRUN;
+	}
+
+	d_packets_sent += sent;
+
+	return sent;
+}
+
+void rtl_device::send_end()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	if ((d_socket < 0) || (d_header == false))
+		return;
+
+	BOR_PACKET_HEADER end_packet;
+	memset(&end_packet, 0x00, sizeof(end_packet));
+	end_packet.flags = BF_STREAM_END | BF_EMPTY_PAYLOAD;
+	end_packet.idx = d_counter++;
+
+	send(d_socket, &end_packet, sizeof(end_packet), 0);
+}
+
+void rtl_device::stream()
+{
+	const size_t payload_size = g_options.payload_size;
+	int slot = 0;	// Slot being filled
+
+	while (d_running)
+	{
+		int read = 0;
+		int res = d_demod.read_samples(&d_usb[0], d_usb.size(), &read);
+
+		if (res == LIBUSB_ERROR_OVERFLOW)
+			d_flags |= BF_HARDWARE_OVERRUN;
+		else if (res == LIBUSB_ERROR_TIMEOUT)
+			d_flags |= BF_HARDWARE_TIMEOUT;
+		else if (res < 0)
+		{
+			fprintf(stderr, "!!> Read failed: %s\n", libusb_result_to_string(res));
+			break;
+		}
+
+		const uint8_t* in = &d_usb[0];
+		const uint8_t* in_end = in + (read - (read % RAW_SAMPLE_SIZE));
+
+		while (in < in_end)
+		{
+			uint8_t* packet = &d_packets[slot * d_slot_size];
+			int16_t* out = (int16_t*)(packet + sizeof(BOR_PACKET_HEADER) + d_packet_fill);
+			size_t n = std::min((size_t)(in_end - in), (payload_size - d_packet_fill) / sizeof(int16_t));
+
+			for (size_t i = 0; i < n; ++i)	// No range expansion (as baz_rtl_source_c short output)
+				out[i] = (int16_t)in[i] - 128;
+
+			in += n;
+			d_packet_fill += n * sizeof(int16_t);
+
+			if (d_packet_fill < payload_size)
+				break;	// Rest of this packet comes with the next read
+
+			PBOR_PACKET_HEADER header = (PBOR_PACKET_HEADER)packet;
+			header->flags = (BYTE)__sync_fetch_and_and(&d_flags, 0);
+			header->notification = 0;
+			header->idx = d_counter++;
+
+			d_packet_fill = 0;
+
+			if (++slot == g_options.batch)
+			{
+				send_packets(slot);
+				slot = 0;
+			}
+		}
+
+		if (slot > 0)	// Don't hold finished packets back past one read (bounds latency at low rates)
+		{
+			send_packets(slot);
+
+			if (d_packet_fill > 0)	// Carry the packet being filled over to the first slot
+				memmove(&d_packets[sizeof(BOR_PACKET_HEADER)], &d_packets[(slot * d_slot_size) + sizeof(BOR_PACKET_HEADER)], d_packet_fill);
+
+			slot = 0;
+		}
+	}
+
+	send_packets(slot);
+
+	bool failed;	// Whoever clears d_running sends the end packet
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+
+		failed = d_running;	// Still set: the read failed, and nobody is going to call stop()
+		d_running = false;
+	}
+
+	if (failed)
+		send_end();
+}
+
+/////////////////////////////////////////////////
+
+class client_session
+{
+public:
+	client_session(int socket, const struct sockaddr_in& address)
+		: d_socket(socket)
+		, d_address(inet_ntoa(address.sin_addr))
+		, d_device(NULL)
+	{
+	}
+
+	~client_session()
+	{
+		close_device();
+		::close(d_socket);
+	}
+
+	void run();
+private:
+	int d_socket;
+	std::string d_address;
+	rtl_device* d_device;
+
+	bool send_line(const std::string& line);
+	bool process(const std::string& line);
+	std::string open_device(const std::string& hint);
+	void close_device();
+};
+
+bool client_session::send_line(const std::string& line)
+{
+	if (g_options.command)
+		fprintf(stderr, "< %s\n", line.c_str());
+
+	std::string data = line + "\n";
+	return (send(d_socket, data.c_str(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size());
+}
+
+void client_session::close_device()
+{
+	delete d_device;
+	d_device = NULL;
+}
+
+// Returns an error (empty on success)
+std::string client_session::open_device(const std::string& hint)
+{
+	close_device();
+
+	std::string error;
+	rtl_device* device = new rtl_device();
+	if ((device->open(hint, error) == false) || (device->set_destination(d_address, g_options.data_port, error) == false))
+	{
+		delete device;
+		return (error.empty() ? "Failed to create device" : error);
+	}
+
+	d_device = device;
+
+	return "";
+}
+
+void client_session::run()
+{
+	fprintf(stderr, "==> Connection from: %s\n", d_address.c_str());
+
+	if (g_options.device.empty() == false)
+	{
+		std::string error = open_device(g_options.device);
+		if (error.empty() == false)
+			fprintf(stderr, "!!> Failed to create initial device with hint: %s (%s)\n", g_options.device.c_str(), error.c_str());
+	}
+
+	if (send_line("DEVICE " + (d_device ? d_device->description() : std::string("-"))))
+	{
+		std::string buffer;
+		char data[1024];
+
+		while (true)
+		{
+			ssize_t res = recv(d_socket, data, sizeof(data), 0);
+			if (res <= 0)
+				break;
+
+			buffer.append(data, res);
+
+			bool keep_going = true;
+			size_t newline;
+			while ((keep_going) && ((newline = buffer.find('\n')) != std::string::npos))
+			{
+				std::string line = buffer.substr(0, newline);
+				buffer.erase(0, newline + 1);
+
+				size_t first = line.find_first_not_of(" \t\r");
+				size_t last = line.find_last_not_of(" \t\r");
+				line = ((first == std::string::npos) ? "" : line.substr(first, last - first + 1));
+
+				keep_going = process(line);
+			}
+
+			if (keep_going == false)
+				break;
+		}
+	}
+
+	fprintf(stderr, "==> Disconnection from: %s\n", d_address.c_str());
+}
+
+bool client_session::process(const std::string& line)
+{
+	if (g_options.command)
+		fprintf(stderr, "> %s\n", line.c_str());
+
+	std::string command = line, data;
+	bool has_data = false;
+	size_t space = line.find(' ');
+	if (space != std::string::npos)
+	{
+		command = line.substr(0, space);
+		data = line.substr(space + 1);
+		size_t first = data.find_first_not_of(' ');
+		data = ((first == std::string::npos) ? "" : data.substr(first));
+		has_data = true;
+	}
+	std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+
+	std::string result = "OK", error;
+
+	if (command == "GO")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (d_device->running())
+			result += " RUNNING";
+		else if (d_device->start(error) == false)
+			result = "FAIL " + error;
+	}
+	else if (command == "STOP")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else
+		{
+			if (d_device->running())
+				result += " STOPPED";
+			d_device->stop();
+		}
+	}
+	else if (command == "DEVICE")
+	{
+		if ((g_options.lock == false) && (has_data) && (data.empty() == false))
+		{
+			if (data == "!")
+				close_device();
+			else
+				error = open_device(data);
+		}
+
+		result = (d_device ? d_device->description() : std::string("-"));
+		if (error.empty() == false)
+			result += " " + error;
+	}
+	else if (command == "FREQ")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (has_data == false)
+			result = format("%f", d_device->frequency());
+		else
+		{
+			double freq = 0;
+			parse_number(data, freq);
+
+			int limit = 0;
+			if (d_device->set_frequency(freq, limit, error) == false)
+				result = "FAIL " + error;
+			else
+			{
+				if (limit < 0)
+					result = "LOW";
+				else if (limit > 0)
+					result = "HIGH";
+
+				result += format(" %f %f %f %f", d_device->frequency_requested(), d_device->frequency(), 0.0, 0.0);
+			}
+		}
+	}
+	else if (command == "ANTENNA")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (has_data == false)
+			result = d_device->antenna();
+		else if (data.empty())
+			result = "FAIL";
+		else
+			d_device->set_antenna(data);
+	}
+	else if (command == "GAIN")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (has_data == false)
+			result = format("%f", d_device->gain());
+		else
+		{
+			double gain = 0;
+			parse_number(data, gain);
+
+			if (d_device->set_gain(gain, error) == false)
+				result = "FAIL " + error;
+		}
+	}
+	else if (command == "RATE")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (has_data == false)
+			result = format("%f", d_device->sample_rate());
+		else
+		{
+			double rate = 0;
+			parse_number(data, rate);
+
+			if (d_device->set_sample_rate(rate, error) == false)
+				result = "FAIL " + error;
+			else
+				result += format(" %f", d_device->sample_rate());
+		}
+	}
+	else if (command == "DEST")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (has_data == false)
+			result = d_device->destination();
+		else
+		{
+			std::string host = ((data == "-") ? d_address : data);
+			int port = g_options.data_port;
+
+			size_t colon = host.find(':');
+			if (colon != std::string::npos)
+			{
+				port = atoi(host.substr(colon + 1).c_str());
+				host = host.substr(0, colon);
+			}
+
+			if ((host.empty()) || (port <= 0) || (d_device->set_destination(host, port, error) == false))
+				result = "FAIL Failed to set destination";
+			else
+				result += " " + d_device->destination();
+		}
+	}
+	else if (command == "HEADER")
+	{
+		if (d_device == NULL)
+			result = "DEVICE";
+		else if (has_data == false)
+			result = (d_device->header() ? "ON" : "OFF");
+		else
+			d_device->set_header(strcasecmp(data.c_str(), "OFF") != 0);
+	}
+	else
+		result = "UNKNOWN";
+
+	return send_line(command + " " + result);
+}
+
+static void run_session(client_session* session)
+{
+	session->run();
+	delete session;
+}
+
+/////////////////////////////////////////////////
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+		"  -l, --listen PORT     server listen port [default=%d]\n"
+		"  -p, --port PORT       default data port [default=%d]\n"
+		"  -d, --device HINT     device to create for each new client (e.g. \"0\", \"index=1 tuner=r820t\")\n"
+		"  -L, --lock            lock device (ignore DEVICE changes)\n"
+		"  -s, --payload BYTES   short I/Q bytes per packet [default=%d]\n"
+		"  -b, --batch N         packets per batched send [default=%d]\n"
+		"  -r, --readlen BYTES   USB bulk read length [default=%d]\n"
+		"  -c, --command         command output\n"
+		"  -v, --verbose         verbose output\n",
+		name, DEFAULT_PORT, DEFAULT_PORT, MAX_PAYLOAD_SIZE, DEFAULT_BATCH, DEFAULT_READLEN);
+}
+
+int main(int argc, char* argv[])
+{
+	g_options.listen_port = DEFAULT_PORT;
+	g_options.data_port = DEFAULT_PORT;
+	g_options.lock = false;
+	g_options.verbose = false;
+	g_options.command = false;
+	g_options.payload_size = MAX_PAYLOAD_SIZE;	// borip_server.py clamps samples_per_packet * 4 to this
+	g_options.batch = DEFAULT_BATCH;
+	g_options.read_length = DEFAULT_READLEN;
+
+	static struct option long_options[] = {
+		{ "listen",		required_argument,	NULL, 'l' },
+		{ "port",		required_argument,	NULL, 'p' },
+		{ "device",		required_argument,	NULL, 'd' },
+		{ "lock",		no_argument,		NULL, 'L' },
+		{ "payload",	required_argument,	NULL, 's' },
+		{ "batch",		required_argument,	NULL, 'b' },
+		{ "readlen",	required_argument,	NULL, 'r' },
+		{ "command",	no_argument,		NULL, 'c' },
+		{ "verbose",	no_argument,		NULL, 'v' },
+		{ "help",		no_argument,		NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int c;
+	while ((c = getopt_long(argc, argv, "l:p:d:Ls:b:r:cvh", long_options, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'l':	g_options.listen_port = atoi(optarg);	break;
+			case 'p':	g_options.data_port = atoi(optarg);	break;
+			case 'd':	g_options.device = optarg;	break;
+			case 'L':	g_options.lock = true;	break;
+			case 's':	g_options.payload_size = atoi(optarg);	break;
+			case 'b':	g_options.batch = atoi(optarg);	break;
+			case 'r':	g_options.read_length = atoi(optarg);	break;
+			case 'c':	g_options.command = true;	break;
+			case 'v':	g_options.verbose = true;	break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	g_options.payload_size = std::min(std::max(g_options.payload_size - (g_options.payload_size % 4), 4), MAX_PAYLOAD_SIZE);	// Whole I/Q samples
+	g_options.batch = std::max(g_options.batch, 1);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		perror("socket");
+		return 1;
+	}
+
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in address;
+	memset(&address, 0x00, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(g_options.listen_port);
+
+	if ((bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0) || (listen(listener, 8) < 0))
+	{
+		perror("bind");
+		return 1;
+	}
+
+	fprintf(stderr, "==> TCP server running on port: %d (payload: %d bytes, batch: %d packets)\n", g_options.listen_port, g_options.payload_size, g_options.batch);
+
+	while (true)
+	{
+		struct sockaddr_in client;
+		socklen_t length = sizeof(client);
+		int s = accept(listener, (struct sockaddr*)&client, &length);
+		if (s < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+
+		int nodelay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+		boost::thread(boost::bind(&run_session, new client_session(s, client))).detach();
+	}
+
+	::close(listener);
+
+	return 0;
+}
@@ -22,30 +22,36 @@
 #  
 #  
 
-import sys, math
+import sys, math, os
 import numpy
 import matplotlib.pyplot as pyplot
 from optparse import OptionParser
 
-def moving_average(values, window):
-	weights = numpy.repeat(1.0, window) / window
-	sma = numpy.convolve(values, weights, 'same')	# 'valid'
-	#print len(values), len(sma)
-	return sma
+import baz
+
+FORMATS = {
+	'c8':	(baz.papr.FORMAT_COMPLEX_FLOAT, 8),
+	'sc16':	(baz.papr.FORMAT_COMPLEX_SHORT, 4),
+}
+
+def to_db(values):
+	return 10.0 * numpy.log10(values)
 
 def main():
 	parser = OptionParser(usage="%prog: [options] <input file>")
 	
-	parser.add_option("-t", "--type", type="string", default="c8", help="data type [default=%default]")
+	parser.add_option("-t", "--type", type="string", default="c8", help="data type (%s) [default=%%default]" % (", ".join(sorted(FORMATS.keys()))))
 	parser.add_option("-T", "--trim", type="int", default=None, help="max # of samples to use [default=%default]")
 	parser.add_option("-d", "--decim", type="int", default=None, help="decimation [default=%default]")
 	parser.add_option("-l", "--length", type="int", default="2048", help="target window length [default=%default]")
 	parser.add_option("-a", "--average", type="int", default="128", help="moving average window length [default=%default]")
 	parser.add_option("-m", "--max-length", type="int", default="1024", help="max window length [default=%default]")
 	parser.add_option("-D", "--max-decim", type="int", default=None, help="max decimation [default=%default]")
+	parser.add_option("-j", "--threads", type="int", default=0, help="analysis threads (0: one per core) [default=%default]")
+	parser.add_option("-r", "--resolution", type="float", default=0.05, help="CCDF resolution (dB) [default=%default]")
 	parser.add_option("-L", "--log", action="store_true", default=False, help="log scale [default=%default]")
 	parser.add_option("-M", "--show-mag", action="store_true", default=False, help="show magnitude plot [default=%default]")
-	#parser.add_option("-T", "--mag-trim", type="int", default=None, help="max # of samples to show in mag plot [default=%default]")
+	parser.add_option("-C", "--show-ccdf", action="store_true", default=False, help="show CCDF plot [default=%default]")
 	
 	(options, args) = parser.parse_args()
 	
@@ -55,138 +61,110 @@ def main():
 	
 	input_file = args[0]
 	
-	dtype = numpy.dtype(options.type)
+	if options.type not in FORMATS:
+		print "Unsupported data type:", options.type
+		return
+	(sample_format, item_size) = FORMATS[options.type]
 	
-	print "Opening", input_file, "as", dtype
-	data = numpy.fromfile(input_file, dtype)
-	print "File samples:", len(data)
+	file_samples = os.path.getsize(input_file) / item_size
+	print "Opening", input_file, "as", options.type
+	print "File samples:", file_samples
 	
+	samples = file_samples
 	if options.trim is not None:
 		print "Trimming to", options.trim
-		data = data[:options.trim]
-	
-	print "Min,mean,max:", data.min(), data.mean(), data.max()
+		samples = min(samples, options.trim)
 	
 	if options.decim is not None:
 		decim = options.decim	# FIXME: Validate
 	else:
-		decim = len(data) / options.length
+		decim = samples / options.length
 	print "Decim:", decim
 	new_length = decim * options.length
-	print "New length:", new_length, ", skipping:", (len(data) - new_length)
-	data = data[:new_length]
+	print "New length:", new_length, ", skipping:", (samples - new_length)
 	
-	data_mag = numpy.abs(data)
-	data_mag_min = data_mag.min()
+	if options.max_decim is None:
+		assert((new_length % options.max_length) == 0)
+		decim_max = new_length / options.max_length
+	else:
+		decim_max = options.max_decim
+	print "Max decim:", decim_max
+	
+	if (decim_max % decim) != 0:
+		print "Max decimation must be a multiple of the decimation"
+		return
+	
+	print "Moving average window length:", options.average
+	
+	# Single pass over the mapped file: only per-window results come back
+	analyser = baz.papr(decim, decim_max, options.average, options.resolution)
+	analyser.analyse_file(input_file, sample_format, 0, new_length, options.threads)
+	
+	data_mag_min = analyser.min_magnitude()
 	if data_mag_min == 0.0:
 		print "Mag min: %f" % (data_mag_min)
 	else:
 		print "Mag min: %f (%f dB)" % (data_mag_min, 10.0*math.log10(data_mag_min))
-	data_mag_mean = data_mag.mean()
+	data_mag_mean = analyser.mean_magnitude()
 	print "Mag mean: %f (%f dB)" % (data_mag_mean, 10.0*math.log10(data_mag_mean))
-	data_mag_max = data_mag.max()
+	data_mag_max = analyser.max_magnitude()
 	print "Mag max: %f (%f dB)" % (data_mag_max, 10.0*math.log10(data_mag_max))
 	
-	data_mag_squared = data_mag ** 2.0
-	mean_rms = math.sqrt(data_mag_squared.mean())
+	mean_rms = math.sqrt(analyser.mean_power())
 	print "Mean RMS:", mean_rms, "(%f dB)" % (10.0*math.log10(mean_rms))
-	print "Moving average window length:", options.average
-	data_mag_squared_ma = moving_average(data_mag_squared, options.average)
-	#print len(data_mag_ma)
-	#len_diff = new_length - len(data_mag_ma)
-	
-	#if options.decim is not None:
-	#	decim = len(data_mag_ma) / options.length
-	#else:
-	#	decim = len(data) / options.length
-	#print "Decim:", decim
-	#new_length = decim * options.length
-	#print "New length:", new_length
-	#data_mag_ma = data_mag_ma[:new_length]
-	
-	#print "Moving average decim:", decim
-	#new_length = decim * options.length
-	#data_mag_ma = data_mag_ma[:new_length]
-	#print "New length:", len(data_mag_ma)
-	
-	if decim > 1:
-		data_mag_ma_mat = data_mag_squared_ma.reshape(-1, decim)
-		data_mag_ma_mean = data_mag_ma_mat.mean(axis=1)
-	else:
-		data_mag_ma_mean = data_mag_squared_ma
 	
+	data_mag_ma_mean = numpy.array(analyser.power(), numpy.float32)
 	print "Mean moving-average data length:", len(data_mag_ma_mean)
 	print "Min,mean,max: %f, %f, %f" % (data_mag_ma_mean.min(), data_mag_ma_mean.mean(), data_mag_ma_mean.max())
 	
-	if options.max_decim is None:
-		assert((new_length % options.max_length) == 0)
-		decim_max = new_length / options.max_length
-	else:
-		decim_max = options.max_decim
-	print "Max decim:", decim_max
-	#new_length_max = decim_max * options.max_length
-	
-	#data_mag_decim = data_mag[new_length/2:]
-	#len_diff = len(data_mag_decim) - new_length
-	#data_mag_decim = data_mag_decim[:-len_diff+1]
-	data_mag_decim = data_mag
-	
-	if decim_max > 1:
-		data_mag_decim_mat = data_mag_decim.reshape(-1, decim_max)
-		data_mag_decim_max = data_mag_decim_mat.max(axis=1)
-	else:
-		data_mag_decim_max = data_mag_decim
-	
-	repeat = options.length / options.max_length
+	data_mag_decim_max = numpy.array(analyser.envelope(), numpy.float32)
+	repeat = decim_max / decim
 	print "Max repeat:", repeat
-	if repeat > 1:
-		data_mag_decim_max = numpy.repeat(data_mag_decim_max, repeat)
-	
 	print "Min,mean,max: %f, %f, %f" % (data_mag_decim_max.min(), data_mag_decim_max.mean(), data_mag_decim_max.max())
 	
-	data_mag_decim_max_squared = data_mag_decim_max ** 2.0
-	
-	ratio = data_mag_decim_max_squared / data_mag_ma_mean
+	ratio = numpy.array(analyser.papr(), numpy.float32)
 	ratio_filtered = ratio[~numpy.isnan(ratio)]
 	print "NaNs:", (len(ratio) - len(ratio_filtered))
 	ratio_filtered2 = ratio_filtered[~numpy.isinf(ratio_filtered)]
 	print "Infs:", (len(ratio_filtered) - len(ratio_filtered2))
 	print "Min,mean,max: %f, %f, %f" % (ratio_filtered2.min(), ratio_filtered2.mean(), ratio_filtered2.max())
-	#print ratio
-	#print ratio_filtered
 	
 	orig_ratio_len = len(ratio)
-	#trim = options.average - 1
-	#ratio = ratio[trim:-trim]
-	trim = 0
-	x = numpy.linspace(trim, trim + len(ratio), len(ratio), False)
-	#print len(x), len(ratio)
+	x = numpy.arange(len(ratio))
 	
 	mean_ratio = ratio_filtered2.mean()
 	print "Mean ratio:", mean_ratio, "(%f dB)" % (10.0*math.log10(mean_ratio))
 	
-	ratio_db = 10.0 * numpy.log10(ratio)
-	ratio_filtered_db = 10.0 * numpy.log10(ratio_filtered2)
+	ratio_db = to_db(ratio)
+	ratio_filtered_db = to_db(ratio_filtered2)
 	print "Min,mean,max ratio (dB): %f, %f, %f" % (ratio_filtered_db.min(), ratio_filtered_db.mean(), ratio_filtered_db.max())
 	
+	ccdf_levels = numpy.array(analyser.ccdf_levels(), numpy.float32)
+	ccdf = numpy.array(analyser.ccdf(), numpy.float32)
+	for probability in [1e-1, 1e-2, 1e-3, 1e-4]:
+		above = numpy.nonzero(ccdf >= probability)[0]
+		if len(above) > 0:
+			print "CCDF %g: %f dB" % (probability, ccdf_levels[above[-1]])
+	
 	if options.show_mag:
 		subplot = pyplot.subplot(111)
 		subplot.grid(True)
 		
-		print "Showing magnitude plot..."
-		#subplot.set_ylim(ymin=0.0)
-		#subplot.plot(data)
-		
-		subplot.plot(data_mag)
+		print "Showing magnitude plot (per window)..."
 		
-		data_mag_rms_ma = data_mag_squared_ma ** 0.5
-		subplot.plot(data_mag_rms_ma)
+		subplot.plot(data_mag_ma_mean ** 0.5)
+		subplot.plot(numpy.repeat(data_mag_decim_max, repeat))
 		
-		data_mag_rms_ma_mean = numpy.repeat(data_mag_ma_mean, decim) ** 0.5
-		subplot.plot(data_mag_rms_ma_mean)
+		pyplot.show()
+	
+	if options.show_ccdf:
+		subplot = pyplot.subplot(111)
+		subplot.set_yscale('log')
+		subplot.grid(True)
 		
-		data_mag_decim_max_repeat = numpy.repeat(data_mag_decim_max, decim)
-		subplot.plot(data_mag_decim_max_repeat)
+		print "Showing CCDF plot..."
+		subplot.set_xlabel("dB above mean power")
+		subplot.plot(ccdf_levels, ccdf)
 		
 		pyplot.show()
 	
@@ -195,10 +173,6 @@ def main():
 		subplot.set_yscale('log')
 	subplot.grid(True)
 	
-	#subplot.set_ylim(ymin=(10.0**-18.), ymax=(10.0**-8.))
-	#plot, = subplot.plot(data_mag_mean)
-	#plot, = subplot.plot(data_mag_decim_max)
-	
 	print "Showing PAPR plot..."
 	subplot.set_ylim(ymin=0.0, ymax=ratio_filtered_db.max())
 	subplot.set_xlim(xmax=orig_ratio_len)
@@ -0,0 +1,229 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2004 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_acars_assembler.h>
+#include <gnuradio/blocks/count_bits.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static const uint64_t PREAMBLE = 0x3FFE5C5C;	// Air interface encoded! (0: same, 1: change)
+
+baz_acars_assembler::baz_acars_assembler(bool verbose /*= true*/)
+	: d_search(PREAMBLE, PREAMBLE_LENGTH, 3, 1, true)	// 1: soft <= 0
+	, d_verbose(verbose)
+{
+	reset();
+}
+
+void baz_acars_assembler::reset()
+{
+	d_state = STATE_SEARCHING;
+	d_search_length = 0;
+	d_bit_counter = 0;
+	d_current_byte = 0x00;
+	d_byte_counter = 0;
+	d_flags = FLAG_NONE;
+	d_prev_bit = 0;
+
+	memset(&d_current_packet, 0x00, sizeof(d_current_packet));
+}
+
+// 'soft' points at the bit that completed the preamble
+void baz_acars_assembler::begin_packet(const float* soft, const float* level)
+{
+	// Before this: 128 1's - won't see them all
+if ((d_verbose) && (d_search.errors() > 0)) fprintf(stderr, "ACARS: %i wrong (threshold %i)\n", d_search.errors(), d_search.threshold());
+	memset(&d_current_packet, 0x00, sizeof(d_current_packet));
+
+	const float* preamble = soft - (PREAMBLE_LENGTH - 1);	// The bits the sync search matched
+	const float* prekey = preamble - PREKEY_LENGTH;
+
+	float ave = 0.0f;
+	int ones = 0;
+	int continuous_zeroes = 0;
+	for (int i = 0; i < PREKEY_LENGTH; ++i)
+	{
+		ave += prekey[i];
+		unsigned char current = (prekey[i] > 0.0 ? 0x00 : 0x01);
+		if (current == 0x01)
+		{
+			++ones;
+			continuous_zeroes = 0;
+		}
+		else
+			++continuous_zeroes;
+	}
+
+	ave /= (float)PREKEY_LENGTH;
+
+	float ref_level = 0.0f;
+	if (level)
+	{
+		const float* preamble_level = level - (PREAMBLE_LENGTH - 1);
+		for (int i = 0; i < PREAMBLE_LENGTH; ++i)
+			ref_level += preamble_level[i];
+	}
+
+	ref_level /= (float)PREAMBLE_LENGTH;
+if ((d_verbose) && (ones > 0)) fprintf(stderr, "ACARS: %i ones of %i (%i continuous zeroes), ave: %f, ref level: %f\n", ones, PREKEY_LENGTH, continuous_zeroes, ave, ref_level);
+	d_current_packet.reference_level = ref_level;
+	d_current_packet.prekey_average = ave;
+	d_current_packet.prekey_ones = ones;
+
+	d_state = STATE_ASSEMBLE;
+	d_bit_counter = /*1*/0;	// FIXME: Why are we off by one?
+	d_current_byte = 0x00;
+	d_byte_counter = 0;
+	d_flags = FLAG_NONE;
+	d_prev_bit = 0;	// Parity bit of SYN
+}
+
+int baz_acars_assembler::search(const float* soft, const float* level, int count)
+{
+	int found = d_search.search(soft, count, d_search_length);
+	if (found < 0)
+	{
+		d_search_length = std::min(d_search_length + count, (int)PREAMBLE_LENGTH);	// Only the last preamble's worth matters
+		return -1;
+	}
+
+	begin_packet(soft + found, (level ? (level + found) : NULL));
+
+	return found;
+}
+
+int baz_acars_assembler::run(const float* soft, const float* level, int count)
+{
+	for (int n = 0; n < count; ++n)
+	{
+		if (d_state == STATE_SEARCHING)
+		{
+			int found = search(soft + n, (level ? (level + n) : NULL), count - n);
+			if (found < 0)
+				break;
+
+			n += found;
+			continue;
+		}
+
+		if (process(soft + n, (level ? (level + n) : NULL)))
+			return n;
+	}
+
+	return -1;
+}
+
+bool baz_acars_assembler::process(const float* soft, const float* level)
+{
+	if (d_state == STATE_SEARCHING)
+	{
+		search(soft, level, 1);
+		return false;
+	}
+
+	unsigned char bit = (*soft > 0.0 ? 0x00 : 0x01);	// Hard decision at the moment
+
+	switch (d_state)
+	{
+		case STATE_ASSEMBLE:
+		{
+			unsigned char decoded_bit = d_prev_bit;
+			if (bit)
+				decoded_bit = 1 - d_prev_bit;
+			d_prev_bit = decoded_bit;	// This is not normal differential decoding (actually 'encoding' here)
+
+			d_current_byte <<= 1;
+			d_current_byte |= decoded_bit;
+
+			++d_bit_counter;
+			if (d_bit_counter < 8)
+				break;
+
+			int ones = gr::blocks::count_bits8(d_current_byte);
+			if ((ones % 2) == 0)
+			{
+				d_current_packet.byte_error[d_byte_counter] = 0x01;
+				++d_current_packet.parity_error_count;
+			}
+
+			d_current_byte = ((d_current_byte * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL >> 32;	// Reverse bits: http://graphics.stanford.edu/~seander/bithacks.html#ReverseByteWith64Bits
+			d_current_byte &= 0x7F;	// FIXME: What's going on here? Wasn't parity on the end?
+			d_current_packet.byte_data[d_byte_counter] = d_current_byte;
+
+			if ((d_byte_counter == 0) && (d_current_byte == 0x01))	// SOH
+				d_flags |= FLAG_SOH;
+
+			if ((d_byte_counter == (1 + 1 + 7 + 1 + 2 + 1)) && (d_current_byte == 0x02))	// STX
+				d_flags |= FLAG_STX;
+
+			// FIXME: Can add 10 for air-ground (Seq # & flight #)
+			if ((d_byte_counter > (1 + 1 + 7 + 1 + 2 + 1)) && d_current_byte == 0x03)	// ETX
+			{
+				d_flags |= FLAG_ETX;
+				d_current_packet.etx_index = d_byte_counter;
+			}
+
+			if (((d_current_packet.etx_index > 0) && (d_byte_counter == (d_current_packet.etx_index + 1 + 2))) && (d_current_byte == 0x7F))	// DEL
+				d_flags |= FLAG_DEL;
+
+			d_current_packet.flags = d_flags;
+
+			++d_byte_counter;
+			++d_current_packet.byte_count;
+			d_bit_counter = 0;
+			d_current_byte = 0x00;
+
+			if ((d_flags & FLAG_DEL) || (d_byte_counter == MAX_PACKET_SIZE))
+			{
+if ((d_verbose) && ((d_flags & FLAG_ETX) == FLAG_NONE)) fprintf(stderr, "ACARS: Missing ETX!\n");
+if ((d_verbose) && ((d_flags & FLAG_DEL) == FLAG_NONE)) fprintf(stderr, "ACARS: Missing DEL!\n");
+				d_state = STATE_SEARCHING;
+				d_search_length = 0;
+
+				return true;
+			}
+
+			break;
+		}
+
+		default:	// Searching is handled above
+			break;
+	}
+
+	return false;
+}
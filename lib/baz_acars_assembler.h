@@ -0,0 +1,118 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2004 Free Software Foundation, Inc.
+ * 
+ * This file is part of GNU Radio
+ * 
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+
+#ifndef INCLUDED_BAZ_ACARS_ASSEMBLER_H
+#define INCLUDED_BAZ_ACARS_ASSEMBLER_H
+
+#include <gnuradio/types.h>
+#include <baz_sync_search.h>
+
+#define MAX_PACKET_SIZE 252
+
+/*!
+ * \brief ACARS preamble search & packet assembly on hard bit decisions
+ *
+ * Shared by baz_acars_decoder (one demodulated stream) and
+ * baz_acars_multi_decoder (many channels demodulated internally).
+ */
+class baz_acars_assembler
+{
+public:
+	static const int PREKEY_LENGTH = (16 * 8);
+	static const int PREAMBLE_LENGTH = ((2 + 2) * 8);
+	static const int HISTORY_OFFSET = (PREKEY_LENGTH + PREAMBLE_LENGTH);	// Pre-key, bit sync, char sync
+
+	enum flags_t
+	{
+		FLAG_NONE	= 0x00,
+		FLAG_SOH	= 0x01,
+		FLAG_STX	= 0x02,
+		FLAG_ETX	= 0x04,
+		FLAG_DEL	= 0x08
+	};
+
+#pragma pack(push)
+#pragma pack(1)
+	struct packet	// Layout is relied upon by acars_printer.py
+	{
+		float reference_level;
+		float prekey_average;
+		int prekey_ones;
+		unsigned char byte_data[MAX_PACKET_SIZE];
+		unsigned char byte_error[MAX_PACKET_SIZE];
+		int parity_error_count;
+		int byte_count;
+		unsigned char flags;
+		int etx_index;
+	};
+#pragma pack(pop)
+
+private:
+	enum state_t
+	{
+		STATE_SEARCHING,
+		STATE_ASSEMBLE
+	};
+
+	state_t d_state;
+	baz_sync_search d_search;
+	int d_search_length;	// Bits searched since the last packet (bits before it can't start a preamble)
+	struct packet d_current_packet;
+	int d_bit_counter;
+	unsigned char d_current_byte;
+	int d_byte_counter;
+	unsigned char d_flags;
+	unsigned char d_prev_bit;
+	bool d_verbose;
+
+	void begin_packet(const float* soft, const float* level);
+public:
+	baz_acars_assembler(bool verbose = true);
+
+	void reset();
+
+	void set_preamble_threshold(int threshold)
+	{ d_search.set_threshold(threshold); }
+	inline int preamble_threshold() const
+	{ return d_search.threshold(); }
+	inline bool searching() const
+	{ return (d_state == STATE_SEARCHING); }
+	inline const packet& current_packet() const
+	{ return d_current_packet; }
+
+	// 'soft' points at the current bit (> 0: 2400 Hz (same), < 0: 1200 Hz (change)) and must have
+	// HISTORY_OFFSET valid items before it, as must 'level' (if not NULL).
+	// Returns true when the current packet is complete.
+	bool process(const float* soft, const float* level);
+	// Jumps to the bit that completes the next preamble: returns its index in [0, count) or -1.
+	int search(const float* soft, const float* level, int count);
+	// Searches & assembles: returns the index of the bit that completes a packet or -1 (all 'count' consumed).
+	int run(const float* soft, const float* level, int count);
+};
+
+#endif /* INCLUDED_BAZ_ACARS_ASSEMBLER_H */
@@ -30,6 +30,7 @@
 
 #include <gnuradio/sync_block.h>
 #include <gnuradio/msg_queue.h>
+#include <baz_acars_assembler.h>
 #include <string>
 
 class baz_acars_decoder;
@@ -71,53 +72,8 @@ private:
 
 	baz_acars_decoder (gr::msg_queue::sptr msgq);  	// private constructor
 
-	enum state_t
-	{
-		STATE_SEARCHING,
-		//STATE_BITSYNC,
-		//STATE_CHARSYNC,
-		STATE_ASSEMBLE,
-		//STATE_DLE,
-		//STATE_END
-	};
-	
-#define MAX_PACKET_SIZE 252
-	
-	enum flags_t
-	{
-		FLAG_NONE	= 0x00,
-		FLAG_SOH	= 0x01,
-		FLAG_STX	= 0x02,
-		FLAG_ETX	= 0x04,
-		FLAG_DEL	= 0x08
-	};
-
-#pragma pack(push)
-#pragma pack(1)
-	struct packet
-	{
-		float reference_level;
-		float prekey_average;
-		int prekey_ones;
-		unsigned char byte_data[MAX_PACKET_SIZE];
-		unsigned char byte_error[MAX_PACKET_SIZE];
-		int parity_error_count;
-		int byte_count;
-		unsigned char flags;
-		int etx_index;
-	};
-#pragma pack(pop)
-
-	state_t d_state;
-	unsigned long d_preamble_state;
-	int d_preamble_threshold;
-	struct packet d_current_packet;
-	int d_bit_counter;
-	unsigned char d_current_byte;
-	int d_byte_counter;
-	unsigned char d_flags;
+	baz_acars_assembler d_assembler;
 	gr::msg_queue::sptr d_msgq;
-	unsigned char d_prev_bit;
 	float d_frequency;
 	std::string d_station_name;
 
@@ -129,7 +85,7 @@ public:
 	void set_station_name(const char* station_name);
 
 	inline int preamble_threshold() const
-	{ return d_preamble_threshold; }
+	{ return d_assembler.preamble_threshold(); }
 	inline float frequency() const
 	{ return d_frequency; }
 	inline const char* station_name() const
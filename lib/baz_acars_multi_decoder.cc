@@ -0,0 +1,470 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_acars_multi_decoder.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+
+static const double BIT_RATE = 2400.0;
+static const double TARGET_CHANNEL_RATE = 24000.0;	// 10 samples per bit
+static const double CHANNEL_CUTOFF = 6000.0;	// AM audio tones & their sidebands
+static const double CHANNEL_TRANSITION = 4000.0;
+static const double CARRIER_TIME_CONSTANT = 0.01;	// Seconds
+static const float DPLL_GAIN = 0.25f;
+static const int NCO_RESYNC = 1024;	// Samples between re-computing the NCO phasor
+static const int MAX_BIT_BACKLOG = 4096;	// Before old soft decisions are dropped
+
+static const int HISTORY_OFFSET = baz_acars_assembler::HISTORY_OFFSET;
+
+/*
+ * Create a new instance of baz_acars_multi_decoder and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_acars_multi_decoder_sptr baz_make_acars_multi_decoder (double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads /*= 1*/, bool verbose /*= false*/)
+{
+	return baz_acars_multi_decoder_sptr (new baz_acars_multi_decoder (sample_rate, baseband_freq, frequencies, threads, verbose));
+}
+
+/*
+ * The private constructor
+ */
+baz_acars_multi_decoder::baz_acars_multi_decoder (double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads, bool verbose)
+	: gr::sync_block ("acars_multi_decoder",
+		gr::io_signature::make (1, 1, sizeof(gr_complex)),
+		gr::io_signature::make (0, 0, 0))
+	, d_sample_rate(sample_rate)
+	, d_baseband_freq(baseband_freq)
+	, d_threads(threads)
+	, d_verbose(verbose)
+	, d_preamble_threshold(3)
+	, d_running(false)
+	, d_job_input(NULL)
+	, d_job_length(0)
+	, d_job_offset(0)
+	, d_next_channel(0)
+	, d_channels_done(0)
+	, d_job_active(false)
+{
+	if (d_sample_rate < TARGET_CHANNEL_RATE)
+		throw std::invalid_argument("acars_multi_decoder: sample rate too low");
+
+	if (d_threads <= 0)
+		d_threads = std::max((int)boost::thread::hardware_concurrency(), 1);
+
+	d_fir_decimation = 8;
+	d_dump_length = std::max((int)floor((d_sample_rate / (TARGET_CHANNEL_RATE * d_fir_decimation)) + 0.5), 1);
+	double intermediate_rate = d_sample_rate / (double)d_dump_length;
+	d_fir_decimation = std::max((int)floor((intermediate_rate / TARGET_CHANNEL_RATE) + 0.5), 1);
+	d_channel_rate = intermediate_rate / (double)d_fir_decimation;
+
+	// Hamming-windowed sinc at the intermediate rate, unity DC gain (including the dump)
+	int length = ((int)ceil(3.3 * intermediate_rate / CHANNEL_TRANSITION)) | 1;
+	double fc = CHANNEL_CUTOFF / intermediate_rate;
+	d_taps.resize(length);
+	double sum = 0.0;
+	for (int n = 0; n < length; ++n)
+	{
+		double x = (double)n - (double)(length - 1) / 2.0;
+		double sinc = ((x == 0.0) ? (2.0 * fc) : (sin(2.0 * M_PI * fc * x) / (M_PI * x)));
+		double window = 0.54 - 0.46 * cos(2.0 * M_PI * (double)n / (double)(length - 1));
+		d_taps[n] = sinc * window;
+		sum += d_taps[n];
+	}
+	for (int n = 0; n < length; ++n)
+		d_taps[n] /= (sum * (double)d_dump_length);
+
+	d_bit_length = std::max((int)floor((d_channel_rate / BIT_RATE) + 0.5), 2);
+	d_tone_1200.resize(d_bit_length);
+	d_tone_2400.resize(d_bit_length);
+	for (int k = 0; k < d_bit_length; ++k)
+	{
+		d_tone_1200[k] = std::polar(1.0f, (float)(-2.0 * M_PI * 1200.0 * (double)k / d_channel_rate));
+		d_tone_2400[k] = std::polar(1.0f, (float)(-2.0 * M_PI * 2400.0 * (double)k / d_channel_rate));
+	}
+
+	d_bit_step = (float)(BIT_RATE / d_channel_rate);
+
+	fprintf(stderr, "[%s<%i>] sample rate: %f, dump: %d, FIR: %d taps / %d, channel rate: %f (%d samples per bit), threads: %d\n", name().c_str(), unique_id(),
+		d_sample_rate, d_dump_length, length, d_fir_decimation, d_channel_rate, d_bit_length, d_threads);
+
+	set_frequencies(frequencies);
+
+	message_port_register_out(pmt::mp("pdu"));
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_acars_multi_decoder::~baz_acars_multi_decoder ()
+{
+	stop();
+
+	clear_channels();
+}
+
+void baz_acars_multi_decoder::clear_channels()
+{
+	for (size_t i = 0; i < d_channels.size(); ++i)
+		delete d_channels[i];
+	d_channels.clear();
+}
+
+void baz_acars_multi_decoder::retune(channel& ch)
+{
+	ch.phase_inc = -2.0 * M_PI * (ch.freq - d_baseband_freq) / d_sample_rate;
+
+	if (fabs(ch.freq - d_baseband_freq) > ((d_sample_rate / 2.0) - CHANNEL_CUTOFF))
+		fprintf(stderr, "[%s<%i>] %f is outside the input band\n", name().c_str(), unique_id(), ch.freq);
+}
+
+void baz_acars_multi_decoder::set_frequencies(const std::vector<double>& frequencies)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	std::vector<channel*> channels;
+
+	for (size_t f = 0; f < frequencies.size(); ++f)
+	{
+		channel* ch = NULL;
+
+		for (size_t i = 0; i < d_channels.size(); ++i)
+		{
+			if ((d_channels[i] != NULL) && (d_channels[i]->freq == frequencies[f]))	// Keep state of existing channels
+			{
+				ch = d_channels[i];
+				d_channels[i] = NULL;
+				break;
+			}
+		}
+
+		if (ch == NULL)
+		{
+			ch = new channel(d_verbose);
+			ch->freq = frequencies[f];
+			ch->phase = 0.0;
+			ch->accumulator = gr_complex(0, 0);
+			ch->accumulated = 0;
+			ch->delay_line.assign(2 * d_taps.size(), gr_complex(0, 0));
+			ch->delay_index = 0;
+			ch->fir_countdown = d_fir_decimation;
+			ch->carrier = 0.0f;
+			ch->audio.assign(2 * d_bit_length, 0.0f);
+			ch->audio_index = 0;
+			ch->last_soft = 0.0f;
+			ch->bit_phase = 0.0f;
+			ch->bits.assign(HISTORY_OFFSET, 0.0f);	// So the first bits are searched too
+			ch->levels.assign(HISTORY_OFFSET, 0.0f);
+			ch->assembler.set_preamble_threshold(d_preamble_threshold);
+			retune(*ch);
+
+			if (d_verbose)
+				fprintf(stderr, "[%s<%i>] added channel: %f\n", name().c_str(), unique_id(), ch->freq);
+		}
+
+		channels.push_back(ch);
+	}
+
+	clear_channels();	// Those not carried over
+	d_channels.swap(channels);
+}
+
+std::vector<double> baz_acars_multi_decoder::frequencies()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	std::vector<double> result;
+	for (size_t i = 0; i < d_channels.size(); ++i)
+		result.push_back(d_channels[i]->freq);
+
+	return result;
+}
+
+void baz_acars_multi_decoder::set_baseband_freq(double baseband_freq)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	d_baseband_freq = baseband_freq;
+
+	for (size_t i = 0; i < d_channels.size(); ++i)
+		retune(*d_channels[i]);
+}
+
+void baz_acars_multi_decoder::set_preamble_threshold(int threshold)
+{
+	if (threshold < 0)
+		return;
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	d_preamble_threshold = threshold;
+
+	for (size_t i = 0; i < d_channels.size(); ++i)
+		d_channels[i]->assembler.set_preamble_threshold(threshold);
+}
+
+void baz_acars_multi_decoder::set_station_name(const char* station_name)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	d_station_name = station_name;
+}
+
+bool baz_acars_multi_decoder::start()
+{
+	boost::mutex::scoped_lock lock(d_pool_mutex);
+
+	if ((d_running == false) && (d_threads > 1))
+	{
+		d_running = true;
+
+		for (int i = 0; i < d_threads; ++i)
+			d_workers.create_thread(boost::bind(&baz_acars_multi_decoder::worker, this));
+	}
+
+	return gr::sync_block::start();
+}
+
+bool baz_acars_multi_decoder::stop()
+{
+	{
+		boost::mutex::scoped_lock lock(d_pool_mutex);
+
+		if (d_running == false)
+			return true;
+
+		d_running = false;
+		d_pool_cond.notify_all();
+	}
+
+	d_workers.join_all();
+
+	return gr::sync_block::stop();
+}
+
+void baz_acars_multi_decoder::worker()
+{
+	boost::mutex::scoped_lock lock(d_pool_mutex);
+
+	while (d_running)
+	{
+		if ((d_job_active == false) || (d_next_channel >= (int)d_channels.size()))
+		{
+			d_pool_cond.wait(lock);
+			continue;
+		}
+
+		channel* ch = d_channels[d_next_channel++];
+
+		lock.unlock();
+
+		process(*ch, d_job_input, d_job_length, d_job_offset);
+
+		lock.lock();
+
+		++d_channels_done;
+		d_pool_cond.notify_all();
+	}
+}
+
+void baz_acars_multi_decoder::emit(channel& ch, uint64_t offset)
+{
+	const baz_acars_assembler::packet& packet = ch.assembler.current_packet();
+
+	pmt::pmt_t meta = pmt::make_dict();
+	meta = pmt::dict_add(meta, pmt::mp("frequency"), pmt::from_double(ch.freq));
+	meta = pmt::dict_add(meta, pmt::mp("station_name"), pmt::mp(d_station_name));
+	meta = pmt::dict_add(meta, pmt::mp("reference_level"), pmt::from_double(packet.reference_level));
+	meta = pmt::dict_add(meta, pmt::mp("prekey_average"), pmt::from_double(packet.prekey_average));
+	meta = pmt::dict_add(meta, pmt::mp("prekey_ones"), pmt::from_long(packet.prekey_ones));
+	meta = pmt::dict_add(meta, pmt::mp("parity_error_count"), pmt::from_long(packet.parity_error_count));
+	meta = pmt::dict_add(meta, pmt::mp("flags"), pmt::from_long(packet.flags));
+	meta = pmt::dict_add(meta, pmt::mp("etx_index"), pmt::from_long(packet.etx_index));
+	meta = pmt::dict_add(meta, pmt::mp("byte_error"), pmt::init_u8vector(packet.byte_count, packet.byte_error));
+	meta = pmt::dict_add(meta, pmt::mp("offset"), pmt::from_uint64(offset));
+
+	ch.pdus.push_back(pmt::cons(meta, pmt::init_u8vector(packet.byte_count, packet.byte_data)));
+
+	if (d_verbose)
+		fprintf(stderr, "[%s<%i>] %f: packet of %d bytes (%d parity errors, flags: 0x%02x)\n", name().c_str(), unique_id(), ch.freq, packet.byte_count, packet.parity_error_count, packet.flags);
+}
+
+void baz_acars_multi_decoder::process(channel& ch, const gr_complex* in, int length, uint64_t offset)
+{
+	const int taps = d_taps.size();
+	const float carrier_alpha = (float)(1.0 - exp(-1.0 / (CARRIER_TIME_CONSTANT * d_channel_rate)));
+	const gr_complex rotation = std::polar(1.0f, (float)ch.phase_inc);
+
+	gr_complex phasor;
+
+	for (int j = 0; j < length; ++j)
+	{
+		if ((j % NCO_RESYNC) == 0)
+			phasor = std::polar(1.0f, (float)fmod(ch.phase + ch.phase_inc * (double)j, 2.0 * M_PI));
+
+		ch.accumulator += in[j] * phasor;
+		phasor *= rotation;
+
+		if (++ch.accumulated < d_dump_length)
+			continue;
+
+		ch.delay_index = (ch.delay_index + 1) % taps;
+		ch.delay_line[ch.delay_index] = ch.delay_line[ch.delay_index + taps] = ch.accumulator;	// Newest at [index + taps], oldest at [index + 1]
+		ch.accumulator = gr_complex(0, 0);
+		ch.accumulated = 0;
+
+		if (--ch.fir_countdown > 0)
+			continue;
+		ch.fir_countdown = d_fir_decimation;
+
+		const gr_complex* x = &ch.delay_line[ch.delay_index + 1];
+		gr_complex z(0, 0);
+		for (int m = 0; m < taps; ++m)
+			z += d_taps[m] * x[m];
+
+		// AM demodulation
+
+		float envelope = std::abs(z);
+		ch.carrier += (envelope - ch.carrier) * carrier_alpha;
+
+		ch.audio_index = (ch.audio_index + 1) % d_bit_length;
+		ch.audio[ch.audio_index] = ch.audio[ch.audio_index + d_bit_length] = (envelope - ch.carrier);
+
+		// Tone energy over the last bit period
+
+		const float* a = &ch.audio[ch.audio_index + 1];
+		gr_complex s1200(0, 0), s2400(0, 0);
+		for (int k = 0; k < d_bit_length; ++k)
+		{
+			s1200 += a[k] * d_tone_1200[k];
+			s2400 += a[k] * d_tone_2400[k];
+		}
+
+		float e1200 = std::norm(s1200), e2400 = std::norm(s2400);
+		float soft = (e2400 - e1200) / (e2400 + e1200 + 1e-20f);	// > 0: 2400 Hz (same)
+
+		// Window straddles a tone change half way between decisions
+
+		if ((soft > 0.0f) != (ch.last_soft > 0.0f))
+			ch.bit_phase -= (ch.bit_phase - 0.5f) * DPLL_GAIN;
+		ch.last_soft = soft;
+
+		ch.bit_phase += d_bit_step;
+		if (ch.bit_phase < 1.0f)
+			continue;
+		ch.bit_phase -= 1.0f;
+
+		ch.bits.push_back(soft);
+		ch.levels.push_back(ch.carrier);
+		ch.offsets.push_back(offset + j);
+	}
+
+	ch.phase = fmod(ch.phase + ch.phase_inc * (double)length, 2.0 * M_PI);
+
+	// Decisions are assembled in one go so idle stretches are skipped by the preamble search
+
+	const int count = ch.offsets.size();
+	const int first = ch.bits.size() - count;
+
+	for (int n = 0; n < count; ++n)
+	{
+		int done = ch.assembler.run(&ch.bits[first + n], &ch.levels[first + n], count - n);
+		if (done < 0)
+			break;
+
+		n += done;
+		emit(ch, ch.offsets[n]);
+	}
+
+	ch.offsets.clear();
+
+	if ((int)ch.bits.size() >= MAX_BIT_BACKLOG)
+	{
+		ch.bits.erase(ch.bits.begin(), ch.bits.end() - HISTORY_OFFSET);
+		ch.levels.erase(ch.levels.begin(), ch.levels.end() - HISTORY_OFFSET);
+	}
+}
+
+int baz_acars_multi_decoder::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	const gr_complex* in = (const gr_complex*)input_items[0];
+	const uint64_t offset = nitems_read(0);
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	int first_serial = 0;	// Channels left for this thread
+	{
+		boost::mutex::scoped_lock pool_lock(d_pool_mutex);
+
+		if ((d_running) && (d_channels.size() > 1))
+		{
+			d_job_input = in;
+			d_job_length = noutput_items;
+			d_job_offset = offset;
+			d_next_channel = 0;
+			d_channels_done = 0;
+			d_job_active = true;
+			d_pool_cond.notify_all();
+
+			while ((d_running) && (d_channels_done < (int)d_channels.size()))
+				d_pool_cond.wait(pool_lock);
+
+			d_job_active = false;
+
+			// If stopped part way through, let channels in progress finish and do the rest here
+			while (d_channels_done < d_next_channel)
+				d_pool_cond.wait(pool_lock);
+
+			first_serial = d_next_channel;
+		}
+	}
+
+	for (size_t i = first_serial; i < d_channels.size(); ++i)
+		process(*d_channels[i], in, noutput_items, offset);
+
+	for (size_t i = 0; i < d_channels.size(); ++i)
+	{
+		channel& ch = *d_channels[i];
+		for (size_t p = 0; p < ch.pdus.size(); ++p)
+			message_port_pub(pmt::mp("pdu"), ch.pdus[p]);
+		ch.pdus.clear();
+	}
+
+	return noutput_items;
+}
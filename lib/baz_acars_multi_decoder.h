@@ -0,0 +1,171 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2004 Free Software Foundation, Inc.
+ * 
+ * This file is part of GNU Radio
+ * 
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+
+#ifndef INCLUDED_BAZ_ACARS_MULTI_DECODER_H
+#define INCLUDED_BAZ_ACARS_MULTI_DECODER_H
+
+#include <gnuradio/sync_block.h>
+#include <baz_acars_assembler.h>
+
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+class BAZ_API baz_acars_multi_decoder;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_acars_multi_decoder> baz_acars_multi_decoder_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_acars_multi_decoder.
+ *
+ * To avoid accidental use of raw pointers, baz_acars_multi_decoder's
+ * constructor is private.  baz_make_acars_multi_decoder is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_acars_multi_decoder_sptr baz_make_acars_multi_decoder (double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads = 1, bool verbose = false);
+
+/*!
+ * \brief ACARS decoder for every channel in one complex baseband stream
+ * \ingroup block
+ *
+ * Each channel is tuned (NCO), decimated (integrate & dump, then a low-pass FIR) to
+ * about 24 kHz, AM demodulated and split into 1200/2400 Hz tones one bit long, with a
+ * simple DPLL picking one decision per bit for the same preamble search & packet
+ * assembly as baz_acars_decoder.
+ *
+ * Packets are published on 'pdu': the data is the packet's bytes, the metadata has
+ * 'frequency', 'station_name', 'reference_level', 'prekey_average', 'prekey_ones',
+ * 'parity_error_count', 'flags', 'etx_index', 'byte_error' (u8vector) and 'offset' (input sample index).
+ *
+ * With 'threads' > 1, channels are spread across a pool of worker threads.
+ */
+class BAZ_API baz_acars_multi_decoder : public gr::sync_block
+{
+private:
+	// The friend declaration allows baz_make_acars_multi_decoder to
+	// access the private constructor.
+	friend BAZ_API baz_acars_multi_decoder_sptr baz_make_acars_multi_decoder (double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads, bool verbose);
+
+	baz_acars_multi_decoder (double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads, bool verbose);  	// private constructor
+
+	struct channel
+	{
+		channel(bool verbose)
+			: assembler(verbose)
+		{ }
+
+		double freq;
+		double phase;		// NCO
+		double phase_inc;
+		gr_complex accumulator;	// Integrate & dump
+		int accumulated;
+		std::vector<gr_complex> delay_line;	// FIR input (doubled up to avoid wrapping)
+		int delay_index;
+		int fir_countdown;
+		float carrier;		// Slow average of the envelope (DC & reference level)
+		std::vector<float> audio;	// Last bit period of AM audio (doubled up)
+		int audio_index;
+		float last_soft;
+		float bit_phase;	// 0..1 through the current bit
+		std::vector<float> bits;	// Soft decisions (with HISTORY_OFFSET before the current one)
+		std::vector<float> levels;
+		std::vector<uint64_t> offsets;	// Sample index of each decision made in the current work call
+		baz_acars_assembler assembler;
+		std::vector<pmt::pmt_t> pdus;	// Completed in the current work call
+	};
+
+	double d_sample_rate;
+	double d_baseband_freq;
+	int d_threads;
+	bool d_verbose;
+	int d_dump_length;	// Integrate & dump decimation
+	int d_fir_decimation;
+	double d_channel_rate;
+	std::vector<float> d_taps;
+	int d_bit_length;	// Channel samples per bit (tone correlator length)
+	std::vector<gr_complex> d_tone_1200;
+	std::vector<gr_complex> d_tone_2400;
+	float d_bit_step;	// Bits per channel sample
+	int d_preamble_threshold;
+	std::string d_station_name;
+	std::vector<channel*> d_channels;
+	boost::mutex d_mutex;	// Channel list
+
+	// Worker pool: one job per work call, one channel at a time
+	boost::thread_group d_workers;
+	boost::mutex d_pool_mutex;
+	boost::condition_variable d_pool_cond;
+	bool d_running;
+	const gr_complex* d_job_input;
+	int d_job_length;
+	uint64_t d_job_offset;
+	int d_next_channel;
+	int d_channels_done;
+	bool d_job_active;
+
+	void worker();
+	void process(channel& ch, const gr_complex* in, int length, uint64_t offset);
+	void emit(channel& ch, uint64_t offset);
+	void retune(channel& ch);
+	void clear_channels();
+public:
+	~baz_acars_multi_decoder ();	// public destructor
+
+	void set_frequencies(const std::vector<double>& frequencies);
+	std::vector<double> frequencies();
+	void set_baseband_freq(double baseband_freq);
+	double baseband_freq() const
+	{ return d_baseband_freq; }
+	double channel_rate() const
+	{ return d_channel_rate; }
+	void set_preamble_threshold(int threshold);
+	int preamble_threshold() const
+	{ return d_preamble_threshold; }
+	void set_station_name(const char* station_name);
+	const char* station_name() const
+	{ return d_station_name.c_str(); }
+
+	bool start();
+	bool stop();
+
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_ACARS_MULTI_DECODER_H */
@@ -38,6 +38,7 @@
 #include <gnuradio/io_signature.h>
 
 #include <stdio.h>
+#include <string.h>
 
 /*
  * Create a new instance of baz_block_status and return
@@ -92,29 +93,21 @@ baz_block_status::work (int noutput_items,
 			gr_vector_const_void_star &input_items,
 			gr_vector_void_star &output_items)
 {
-  const char *in = (const char*) input_items[0];
-  char* out = NULL;
   if (output_items.size() > 0)
-    out = (char*)output_items[0];
+    memcpy(output_items[0], input_items[0], (size_t)noutput_items * d_size);
 
-  for (int i = 0; i < noutput_items; i++) {
-    if (out != NULL)
-      memcpy(out + (i * d_size), in + (i * d_size), d_size);
-
-    if (d_samples_processed > 0)
-    {
-      --d_samples_processed;
-      if (d_samples_processed == 0)
-      {
+  if ((d_samples_processed > 0) && (d_samples_processed <= (unsigned long)noutput_items))
+  {
+    d_samples_processed = 0;
 fprintf(stderr, "[%s] Status change: samples processed\n", name().c_str()/*, d_work_iterations, d_samples_processed*/);
-        if (d_queue)
-        {
-          gr::message::sptr msg = gr::message::make(0, d_work_iterations, d_samples_processed);
-          d_queue->insert_tail(msg);
-        }
-      }
+    if (d_queue)
+    {
+      gr::message::sptr msg = gr::message::make(0, d_work_iterations, d_samples_processed);
+      d_queue->insert_tail(msg);
     }
   }
+  else if (d_samples_processed > 0)
+    d_samples_processed -= noutput_items;
 
   if (d_work_iterations > 0)
   {
@@ -32,7 +32,7 @@ class BAZ_API burst_tagger : virtual public gr::block {
 public:
 	typedef boost::shared_ptr<burst_tagger> sptr;
 
-	static sptr make(const std::string& tag_name = "length", float mult = 1.0f, unsigned int pad_front = 0, unsigned int pad_rear = 0, bool drop_residue = true, bool verbose = true);
+	static sptr make(const std::string& tag_name = "length", float mult = 1.0f, unsigned int pad_front = 0, unsigned int pad_rear = 0, bool drop_residue = true, bool verbose = true, size_t itemsize = sizeof(gr_complex));
 };
 
 } // namespace baz
@@ -27,14 +27,15 @@
 #include <gnuradio/io_signature.h>
 #include <boost/format.hpp>
 #include <cstdio>
+#include <algorithm>
 
 namespace gr {
 namespace baz {
 
-burst_tagger_impl::burst_tagger_impl(const std::string& tag_name /*= "length"*/, float mult/* = 1*/, unsigned int pad_front/* = 0*/, unsigned int pad_rear/* = 0*/, bool drop_residue/* = true*/, bool verbose/* = true*/)
+burst_tagger_impl::burst_tagger_impl(const std::string& tag_name /*= "length"*/, float mult/* = 1*/, unsigned int pad_front/* = 0*/, unsigned int pad_rear/* = 0*/, bool drop_residue/* = true*/, bool verbose/* = true*/, size_t itemsize/* = sizeof(gr_complex)*/)
 		: gr::block("burst_tagger",
-			gr::io_signature::make(1, 1, sizeof(gr_complex)),	// FIXME: Custom type
-			gr::io_signature::make(1, 1, sizeof(gr_complex)))
+			gr::io_signature::make(1, 1, itemsize),
+			gr::io_signature::make(1, 1, itemsize))
 		, d_tag_name(pmt::intern(tag_name))
 		, d_copy(0)
 		, d_mult(mult)
@@ -49,11 +50,24 @@ burst_tagger_impl::burst_tagger_impl(const std::string& tag_name /*= "length"*/,
 		, d_ignore_name(pmt::intern("ignore"))
 		, d_work_count(0)
 		, d_verbose(verbose)
+		, d_itemsize(itemsize)
+		, d_burst_start(0)
+		, d_next_tag_item(0)
 {
 	if(d_mult <= 0)
 		throw std::out_of_range("multiplier must be > 0");
 	
-	fprintf(stderr, "<%s[%d]> tag name: %s, multiplier: %f, tag front: %d, tag rear: %d, drop residue: %s, verbose: %s\n", name().c_str(), unique_id(), tag_name.c_str(), mult, pad_front, pad_rear, (drop_residue ? "yes" : "no"), (verbose ? "yes" : "no"));
+	switch (d_itemsize)
+	{
+		case 1:		d_work = &burst_tagger_impl::work_items<1>;	break;
+		case 2:		d_work = &burst_tagger_impl::work_items<2>;	break;
+		case 4:		d_work = &burst_tagger_impl::work_items<4>;	break;
+		case 8:		d_work = &burst_tagger_impl::work_items<8>;	break;
+		case 16:	d_work = &burst_tagger_impl::work_items<16>;	break;
+		default:	d_work = &burst_tagger_impl::work_items<0>;	break;
+	}
+	
+	fprintf(stderr, "<%s[%d]> tag name: %s, multiplier: %f, tag front: %d, tag rear: %d, drop residue: %s, verbose: %s, item size: %lu\n", name().c_str(), unique_id(), tag_name.c_str(), mult, pad_front, pad_rear, (drop_residue ? "yes" : "no"), (verbose ? "yes" : "no"), itemsize);
 	
 	set_relative_rate(1);
 	set_tag_propagation_policy(block::TPP_DONT);
@@ -97,258 +111,203 @@ void burst_tagger_impl::forecast (int noutput_items, gr_vector_int &ninput_items
 	}
 }
 
-int burst_tagger_impl::general_work(int noutput_items, gr_vector_int& ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+void burst_tagger_impl::start_burst(const tag_t& tag, const std::vector<tag_t>& tags, uint64_t out_item)
 {
-	++d_work_count;
+	d_next_tag_item = tag.offset + 1;	// Don't restart it if its first item hasn't been consumed by the end of this call
 	
-	/*{
-		std::vector<gr::tag_t> all_tags;
-		uint64_t nread = nitems_read(0);
-		get_tags_in_range(all_tags, 0, nread, nread + noutput_items);
-		if (all_tags.empty() == false)
-		{
-			std::sort(all_tags.begin(), all_tags.end(), tag_t::offset_compare);
-			fprintf(stderr, "[%llu] Encountered %lu tags (work started reading at: %llu)\n", d_work_count, all_tags.size(), nread);
-			BOOST_FOREACH(tag_t& tag, all_tags)
-			{
-				std::string key = pmt::symbol_to_string(tag.key);
-				fprintf(stderr, "\t%llu: %s\n", tag.offset, key.c_str());
-			}
-		}
-	}*/
+	double new_len = (double)d_mult * (double)pmt::to_uint64(tag.value);
+	if (((uint64_t)new_len + d_pad_front + d_pad_rear) == 0)
+	{
+		if (d_verbose) fprintf(stderr, "! Skipping empty burst at %llu\n", tag.offset);
+		return;
+	}
 	
-	const gr_complex *in = (const gr_complex*)input_items[0];
-	gr_complex *out = (gr_complex*)output_items[0];
-
-	bool sob = false;
-
-	if (d_copy == 0)
+	if (d_in_burst)
 	{
-		std::vector<gr::tag_t> tags;
-		//std::vector<gr::tag_t> all_tags;
-		std::vector<gr::tag_t> ignore_tags;
-		const uint64_t nread = nitems_read(0);
-		
-		get_tags_in_range(tags, 0, nread, nread + noutput_items, d_tag_name);
-		std::sort(tags.begin(), tags.end(), tag_t::offset_compare);
-		
-		//get_tags_in_range(all_tags, 0, nread, nread + noutput_items);
-		//std::sort(all_tags.begin(), all_tags.end(), tag_t::offset_compare);
+		fprintf(stderr, "! Starting burst when already in one!\n");
+	}
+	else
+		++d_count;
+	
+	d_current_length = (uint64_t)new_len;
+	d_copy = d_current_length + d_pad_rear;
+	d_burst_start = tag.offset;
+	
+	add_sob(out_item);
+	
+	BOOST_FOREACH(const tag_t& ignore_tag, tags)	// Follows the burst's first item
+	{
+		if ((ignore_tag.offset != tag.offset) || (pmt::eq(ignore_tag.key, d_ignore_name) == false))
+			continue;
 		
-		get_tags_in_range(ignore_tags, 0, nread, nread + noutput_items, d_ignore_name);
-		std::sort(ignore_tags.begin(), ignore_tags.end(), tag_t::offset_compare);
+		tag_t moved = ignore_tag;
+		moved.offset = out_item;
+		add_item_tag(0, moved);
 		
-		if (tags.size() > 0)
+		break;
+	}
+	
+	d_to_pad_front = d_pad_front;
+}
+
+// Complain about tags in input items [start, end) other than the current burst's own
+void burst_tagger_impl::check_tags(const std::vector<tag_t>& tags, uint64_t start, uint64_t end)
+{
+	std::vector<tag_t> found;
+	BOOST_FOREACH(const tag_t& tag, tags)
+	{
+		if ((tag.offset >= start) && (tag.offset < end) && (tag.offset != d_burst_start))
+			found.push_back(tag);
+	}
+	
+	if (found.empty())
+		return;
+	
+	if (d_in_burst)
+	{
+		// FIXME: Polyphase resampler didn't output all expected bits - if length/ignore tags found here, truncate burst.
+		fprintf(stderr, "[%llu] ! Encountered %lu tags during burst #%llu (copying from: %llu to %llu)\n", d_work_count, found.size(), d_count, start, end);
+		BOOST_FOREACH(tag_t& tag, found)
 		{
-			tag_t tag = tags.front();
-			
-			if (tag.offset == nread)
-			{
-				if (d_in_burst)
-				{
-					fprintf(stderr, "! Starting burst when already in one!\n");
-				}
-				else
-					++d_count;
-				
-				double new_len = (double)d_mult * (double)pmt::to_uint64(tag.value);
-				d_current_length = (uint64_t)new_len;
-				if (new_len != (double)d_current_length)
-				{
-					//fprintf(stderr, "! Burst #%llu: will miss %f of a sample\n", d_count, (new_len - (double)d_current_length));
-				}
-				d_copy = d_current_length + d_pad_rear;
-				
-//				fprintf(stderr, "[%llu] Starting #%llu of %llu items (current length: %llu, tag value: %llu, items read: %llu)\n", d_work_count, d_count, d_copy, d_current_length, pmt::to_uint64(tag.value), nread);
-				
-				add_sob(nitems_written(0));
-				
-				sob = true;
-				
-				BOOST_FOREACH(tag_t& ignore_tag, ignore_tags)
-				{
-					if (ignore_tag.offset != nread)
-					{
-						fprintf(stderr, "! Burst #%llu: Ignoring 'ignore' tag at %llu (expecting %llu)\n", d_count, ignore_tag.offset, nread);
-						continue;
-					}
-					
-					ignore_tag.offset = nitems_written(0);
-					add_item_tag(0, ignore_tag);
-					
-					//static const pmt::pmt_t ignore_key = pmt::string_to_symbol("ignore");
-					//static const pmt::pmt_t value = pmt::PMT_T;
-					//static const pmt::pmt_t srcid = pmt::string_to_symbol(alias());
-					//add_item_tag(0, nitems_written(0), ignore_key, value, srcid);
-					
-					break;
-				}
-				
-				if (d_pad_front)
-					d_to_pad_front = d_pad_front;
-			}
-			else	// Copy until the first tag
-			{
-				BOOST_FOREACH(tag_t& ignore_tag, ignore_tags)
-				{
-					bool found = false;
-					BOOST_FOREACH(tag_t& _tag, tags)
-					{
-						if (ignore_tag.offset == _tag.offset)
-						{
-							found = true;
-							break;
-						}
-					}
-					
-					if (found == false)
-					{
-						fprintf(stderr, "! Burst #%llu (%s): Bad 'ignore' tag at %llu\n", d_count, (d_in_burst ? "inside" : "outside"), ignore_tag.offset);	//" (expecting %llu for '%s')", tag.offset, pmt::symbol_to_string(tag.key).c_str()
-						break;
-					}
-				}
-				
-				uint64_t offset = (tag.offset - nread);
-				uint64_t cpy = std::min((uint64_t)noutput_items, offset);
-				std::memcpy(out, in, cpy * sizeof(gr_complex));
-				
-				consume(0, cpy);
-				
-				if (d_in_burst == false)
-				{
-					if (d_drop_residue)
-					{
-						if (d_verbose) fprintf(stderr, "[%llu] ! Dropping %llu items outside burst (after #%llu) waiting for tag in %llu items time (noutput_items: %d)\n", d_work_count, cpy, d_count, offset, noutput_items);
-						return 0;
-					}
-					
-					if (d_verbose) fprintf(stderr, "Copied %llu items outside burst (after #%llu) waiting for tag\n", cpy, d_count);
-				}
-				
-				return cpy;
-			}
+			std::string key = pmt::symbol_to_string(tag.key);
+			fprintf(stderr, "\t%llu: %s\n", tag.offset, key.c_str());
 		}
-		else
+	}
+	else
+	{
+		BOOST_FOREACH(tag_t& tag, found)
 		{
-			// If no tags, will consume below
+			if (pmt::eq(tag.key, d_ignore_name))
+				fprintf(stderr, "! Burst #%llu (outside): Bad 'ignore' tag at %llu\n", d_count, tag.offset);
 		}
 	}
+}
+
+/*
+ * Runs bursts back to back until input, output space or tags run out:
+ * [SOB] front padding, 'length' x multiplier items, rear padding [EOB], then
+ * residue up to the next length tag (dropped or copied through).
+ */
+template<size_t N>
+int burst_tagger_impl::work_items(int noutput_items, int ninput, const char* in, char* out)
+{
+	const size_t itemsize = (N ? N : d_itemsize);
 	
-	assert(d_copy >= 0);
+	const uint64_t nread = nitems_read(0);
+	const uint64_t nwritten = nitems_written(0);
 	
-	if (sob == false)	// Re-detect SOB after padding front
-	{
-		if (d_copy == (d_current_length + d_pad_rear))
-			sob = true;
-	}
+	std::vector<gr::tag_t> tags;	// Everything in view, fetched & sorted once
+	get_tags_in_range(tags, 0, nread, nread + ninput);
+	std::sort(tags.begin(), tags.end(), tag_t::offset_compare);
 	
-	if (d_to_pad_front)
-	{
-		int cpy = std::min((int)d_to_pad_front, noutput_items);
-		//fprintf(stderr, "Padding front: %d\n", cpy);
-		std::memset(out, 0x00, cpy * sizeof(gr_complex));
-		d_to_pad_front -= cpy;
-		
-		// Nothing consumed
-		
-		return cpy;	// FIXME: If output buffer space remains, begin copying into that below in same call to work
-	}
+	size_t next_tag = 0;	// Next candidate length tag
+	int consumed = 0, produced = 0;
 	
-	if (d_copy)
+	while (true)
 	{
-		uint64_t nread = nitems_read(0);
-		int copy_start = d_copy;
-		
-		int cpy = std::min(d_copy, noutput_items);
-		
-		if ((d_copy > d_pad_rear) && ((d_copy - cpy) < d_pad_rear))
+		if ((d_copy == 0) && (d_to_pad_front == 0))	// Between bursts
 		{
-			//fprintf(stderr, ">>> %d,%d - ", d_copy, cpy);
+			while ((next_tag < tags.size()) && ((tags[next_tag].offset < std::max(nread + consumed, d_next_tag_item)) || (pmt::eq(tags[next_tag].key, d_tag_name) == false)))
+				++next_tag;
 			
-			cpy -= (d_pad_rear - (d_copy - cpy));
+			bool have_tag = (next_tag < tags.size());
 			
-			//fprintf(stderr, "%d\n", cpy);
-		}
-		
-		assert(cpy >= 0);
-		
-		if (d_copy > d_pad_rear)
-		{
-			std::vector<gr::tag_t> all_tags;
-			uint64_t start = nread + (sob ? 1 : 0);
-			get_tags_in_range(all_tags, 0, start, start + cpy - (sob ? 1 : 0));
-			if (all_tags.empty() == false)
+			if ((have_tag) && (tags[next_tag].offset == (nread + consumed)))
 			{
-				std::sort(all_tags.begin(), all_tags.end(), tag_t::offset_compare);
-				// FIXME: Polyphase resampler didn't output all expected bits - if length/ignore tags found here, truncate burst.
-				fprintf(stderr, "[%llu] ! Encountered %lu tags during burst #%llu (work started reading at: %llu, copying: %d)\n", d_work_count, all_tags.size(), d_count, nread, cpy);
-				BOOST_FOREACH(tag_t& tag, all_tags)
-				{
-					std::string key = pmt::symbol_to_string(tag.key);
-					fprintf(stderr, "\t%llu: %s\n", tag.offset, key.c_str());
-				}
+				if (produced == noutput_items)
+					break;	// SOB belongs on an item we can't write yet
+				
+				start_burst(tags[next_tag], tags, nwritten + produced);
+				++next_tag;
+				continue;
 			}
 			
-			//fprintf(stderr, "Copying: %d (d_copy = %d)\n", cpy, d_copy);
+			int residue = (have_tag ? (int)(tags[next_tag].offset - nread) : ninput) - consumed;
 			
-			std::memcpy(out, in, cpy * sizeof(gr_complex));
+			if ((d_in_burst == false) && (d_drop_residue))
+			{
+				if (residue == 0)
+					break;
+				
+				check_tags(tags, nread + consumed, nread + consumed + residue);
+				
+				if (d_verbose) fprintf(stderr, "[%llu] ! Dropping %d items outside burst (after #%llu)%s\n", d_work_count, residue, d_count, (have_tag ? "" : " waiting for tag"));
+				consumed += residue;
+				continue;
+			}
 			
-			consume(0, cpy);
-		}
-		else
-		{
-			//fprintf(stderr, "Padding rear: %d (d_copy = %d)\n", cpy, d_copy);
+			int cpy = std::min(residue, noutput_items - produced);
+			if (cpy == 0)
+				break;
+			
+			if ((d_verbose) && (d_in_burst == false)) fprintf(stderr, "Copied %d items outside burst (after #%llu)\n", cpy, d_count);
 			
-			std::memset(out, 0x00, cpy * sizeof(gr_complex));
+			copy_items<N>(out + (produced * itemsize), in + (consumed * itemsize), cpy);
+			consumed += cpy;
+			produced += cpy;
+			continue;
 		}
 		
-		d_copy -= cpy;
-		
-		assert(d_copy >= 0);
-		
-		if (d_copy == 0)
+		if (d_to_pad_front)
 		{
-			uint64_t eob_time = nitems_written(0) + cpy - 1;
+			int cpy = std::min((int)d_to_pad_front, noutput_items - produced);
+			if (cpy == 0)
+				break;
 			
-//			fprintf(stderr, "[%llu] EOB at %llu (noutput_items: %d, work started reading at: %llu, copied: %d, d_copy was: %d)\n", d_work_count, eob_time, noutput_items, nread, cpy, copy_start);
+			zero_items<N>(out + (produced * itemsize), cpy);
+			d_to_pad_front -= cpy;
+			produced += cpy;
 			
-			add_eob(eob_time);
+			if ((d_to_pad_front == 0) && (d_copy == 0))	// Empty burst: padding is all there is
+				add_eob(nwritten + produced - 1);
+			
+			// Nothing consumed
+			continue;
 		}
 		
-		return cpy;
-	}
-	else
-	{
-		uint64_t read = nitems_read(0);
-		
-		if (noutput_items > ninput_items[0])
+		int cpy;
+		if (d_copy > (int)d_pad_rear)	// Burst body
 		{
-			fprintf(stderr, "noutput_items: %d > ninput_items: %d\n", noutput_items, ninput_items[0]);
+			cpy = std::min(std::min(d_copy - (int)d_pad_rear, noutput_items - produced), ninput - consumed);
+			if (cpy == 0)
+				break;
+			
+			check_tags(tags, nread + consumed, nread + consumed + cpy);
+			
+			copy_items<N>(out + (produced * itemsize), in + (consumed * itemsize), cpy);
+			consumed += cpy;
 		}
-		
-		if (d_in_burst == false)
+		else	// Rear padding
 		{
-			if (d_drop_residue)
-			{
-				consume(0, noutput_items);
-				fprintf(stderr, "[%llu] ! Dropping %d items outside burst (after #%llu) waiting for tag (work with no tags) (work started reading at: %llu)\n", d_work_count, noutput_items, d_count, read);
-				return 0;
-			}
+			cpy = std::min(d_copy, noutput_items - produced);
+			if (cpy == 0)
+				break;
 			
-			if (d_verbose) fprintf(stderr, "Copied %lu items outside burst (after #%llu, work with no tags)\n", noutput_items, d_count);
+			zero_items<N>(out + (produced * itemsize), cpy);
 		}
 		
-		std::memcpy(out, in, noutput_items * sizeof(gr_complex));
-		
-		consume(0, noutput_items);
+		produced += cpy;
+		d_copy -= cpy;
 		
-		return noutput_items;
+		if (d_copy == 0)
+			add_eob(nwritten + produced - 1);
 	}
+	
+	consume(0, consumed);
+	
+	return produced;
+}
+
+int burst_tagger_impl::general_work(int noutput_items, gr_vector_int& ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	++d_work_count;
+	
+	return (this->*d_work)(noutput_items, ninput_items[0], (const char*)input_items[0], (char*)output_items[0]);
 }
 
-burst_tagger::sptr burst_tagger::make(const std::string& tag_name /*= "length"*/, float mult/* = 1*/, unsigned int pad_front/* = 0*/, unsigned int pad_rear/* = 0*/, bool drop_residue/* = true*/, bool verbose/*= true*/)
+burst_tagger::sptr burst_tagger::make(const std::string& tag_name /*= "length"*/, float mult/* = 1*/, unsigned int pad_front/* = 0*/, unsigned int pad_rear/* = 0*/, bool drop_residue/* = true*/, bool verbose/*= true*/, size_t itemsize/* = sizeof(gr_complex)*/)
 {
-	return gnuradio::get_initial_sptr(new burst_tagger_impl(tag_name, mult, pad_front, pad_rear, drop_residue, verbose));
+	return gnuradio::get_initial_sptr(new burst_tagger_impl(tag_name, mult, pad_front, pad_rear, drop_residue, verbose, itemsize));
 }
 
 } /* namespace baz */
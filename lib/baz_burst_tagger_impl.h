@@ -24,13 +24,26 @@
 
 #include <baz_burst_tagger.h>
 
+#include <cstring>
+
 namespace gr {
 namespace baz {
 
 class burst_tagger_impl : public burst_tagger {
 private:
+	typedef int (burst_tagger_impl::*work_fn)(int noutput_items, int ninput, const char* in, char* out);
+
+	// Fixed sizes let the compiler specialise the copies (0: any other size, uses d_itemsize)
+	template<size_t N> inline void copy_items(char* out, const char* in, int n) const
+	{ std::memcpy(out, in, n * (N ? N : d_itemsize)); }
+	template<size_t N> inline void zero_items(char* out, int n) const
+	{ std::memset(out, 0x00, n * (N ? N : d_itemsize)); }
+	template<size_t N> int work_items(int noutput_items, int ninput, const char* in, char* out);
+
 	void add_eob(uint64_t item);
 	void add_sob(uint64_t item);
+	void start_burst(const tag_t& tag, const std::vector<tag_t>& tags, uint64_t out_item);
+	void check_tags(const std::vector<tag_t>& tags, uint64_t start, uint64_t end);
 
 	pmt::pmt_t d_tag_name, d_ignore_name;
 	int d_copy, d_current_length;
@@ -39,8 +52,12 @@ private:
 	unsigned int d_to_pad_front/*, d_to_pad_rear*/;
 	bool d_in_burst, d_drop_residue, d_verbose;
 	uint64_t d_count, d_work_count;
+	size_t d_itemsize;
+	work_fn d_work;
+	uint64_t d_burst_start;	// Input item carrying the current burst's length tag
+	uint64_t d_next_tag_item;	// Earliest input item that may start the next burst
 public:
-	burst_tagger_impl(const std::string& tag_name = "length", float mult = 1, unsigned int pad_front = 0, unsigned int pad_rear = 0, bool drop_residue = true, bool verbose = true);
+	burst_tagger_impl(const std::string& tag_name = "length", float mult = 1, unsigned int pad_front = 0, unsigned int pad_rear = 0, bool drop_residue = true, bool verbose = true, size_t itemsize = sizeof(gr_complex));
 	~burst_tagger_impl();
 
 	void forecast (int noutput_items, gr_vector_int &ninput_items_required);
@@ -0,0 +1,311 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_channelizer_ccf.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Create a new instance of baz_channelizer_ccf and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_channelizer_ccf_sptr baz_make_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq /*= 0.0*/)
+{
+	return baz_channelizer_ccf_sptr (new baz_channelizer_ccf (sample_rate, channels, decimation, taps, outputs, baseband_freq));
+}
+
+/*
+ * The private constructor
+ */
+baz_channelizer_ccf::baz_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq)
+	: gr::sync_decimator ("channelizer_ccf",
+		gr::io_signature::make (1, 1, sizeof(gr_complex)),
+		gr::io_signature::make (1, std::max(outputs, 1), sizeof(gr_complex)),
+		std::max(decimation, 1))
+	, d_sample_rate(sample_rate)
+	, d_channels(channels)
+	, d_decimation(decimation)
+	, d_baseband_freq(baseband_freq)
+	, d_fft(NULL)
+{
+	if (d_channels <= 0)
+		throw std::invalid_argument("channelizer: channel count must be positive");
+	if ((d_decimation <= 0) || (d_decimation > d_channels))
+		throw std::invalid_argument("channelizer: decimation must be between 1 and the channel count");
+	if (taps.empty())
+		throw std::invalid_argument("channelizer: no taps");
+	if (outputs <= 0)
+		throw std::invalid_argument("channelizer: output count must be positive");
+
+	int length = ((taps.size() + d_channels - 1) / d_channels) * d_channels;
+	d_taps.assign(length, 0.0f);
+	std::copy(taps.begin(), taps.end(), d_taps.begin());
+
+	set_history(length);
+
+	d_fft = new gr::fft::fft_complex(d_channels, false);	// exp(+j...): pulls bin k down to DC (see work)
+
+	d_rotation.resize(d_channels);
+	for (int r = 0; r < d_channels; ++r)
+		d_rotation[r] = std::polar(1.0f, (float)(-2.0 * M_PI * (double)r / (double)d_channels));
+
+	output_channel idle;
+	idle.enabled = false;
+	idle.freq = 0.0;
+	idle.bin = 0;
+	idle.phase = 0.0;
+	idle.phase_inc = 0.0;
+	d_outputs.assign(outputs, idle);
+
+	fprintf(stderr, "[%s<%i>] sample rate: %f, channels: %d (spacing: %f), decimation: %d (output rate: %f), taps: %d (%d per phase)\n", name().c_str(), unique_id(),
+		sample_rate, channels, channel_spacing(), decimation, output_rate(), (int)taps.size(), (length / d_channels));
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_channelizer_ccf::~baz_channelizer_ccf ()
+{
+	delete d_fft;
+}
+
+void baz_channelizer_ccf::retune(output_channel& output)
+{
+	double offset = output.freq - d_baseband_freq;
+
+	if (fabs(offset) > (d_sample_rate / 2.0))
+		fprintf(stderr, "[%s<%i>] %f is outside the input band (offset: %f)\n", name().c_str(), unique_id(), output.freq, offset);
+
+	double spacing = channel_spacing();
+	int bin = (int)floor((offset / spacing) + 0.5);
+	double residual = offset - ((double)bin * spacing);
+
+	output.bin = ((bin % d_channels) + d_channels) % d_channels;
+	output.phase_inc = 2.0 * M_PI * residual / output_rate();
+	if (fabs(residual) <= 1e-3)
+		output.phase_inc = 0.0;
+
+	if ((fabs(residual) > 1e-3) && (fabs(residual) > ((output_rate() - spacing) / 2.0)))
+		fprintf(stderr, "[%s<%i>] %f is %f Hz off-grid: channel edge will be lost in the filterbank\n", name().c_str(), unique_id(), output.freq, residual);
+}
+
+void baz_channelizer_ccf::set_baseband_freq(double baseband_freq)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	d_baseband_freq = baseband_freq;
+
+	for (size_t i = 0; i < d_outputs.size(); ++i)
+	{
+		if (d_outputs[i].enabled)
+			retune(d_outputs[i]);
+	}
+}
+
+void baz_channelizer_ccf::set_channel(int output, double freq)
+{
+	if ((output < 0) || (output >= (int)d_outputs.size()))
+		throw std::out_of_range("channelizer: invalid output");
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	output_channel& channel = d_outputs[output];
+	channel.enabled = true;
+	channel.freq = freq;
+	channel.phase = 0.0;
+	retune(channel);
+}
+
+void baz_channelizer_ccf::clear_channel(int output)
+{
+	if ((output < 0) || (output >= (int)d_outputs.size()))
+		throw std::out_of_range("channelizer: invalid output");
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	d_outputs[output].enabled = false;
+}
+
+double baz_channelizer_ccf::channel_freq(int output) const
+{
+	if ((output < 0) || (output >= (int)d_outputs.size()) || (d_outputs[output].enabled == false))
+		return 0.0;
+
+	return d_outputs[output].freq;
+}
+
+bool baz_channelizer_ccf::channel_enabled(int output) const
+{
+	if ((output < 0) || (output >= (int)d_outputs.size()))
+		return false;
+
+	return d_outputs[output].enabled;
+}
+
+std::vector<int> baz_channelizer_ccf::set_frequencies(const std::vector<double>& freqs)
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	std::vector<int> assigned(freqs.size(), -1);
+	std::vector<bool> keep(d_outputs.size(), false);
+
+	for (size_t f = 0; f < freqs.size(); ++f)
+	{
+		for (size_t i = 0; i < d_outputs.size(); ++i)
+		{
+			if ((d_outputs[i].enabled) && (keep[i] == false) && (d_outputs[i].freq == freqs[f]))
+			{
+				keep[i] = true;
+				assigned[f] = i;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < d_outputs.size(); ++i)
+	{
+		if (keep[i] == false)
+			d_outputs[i].enabled = false;
+	}
+
+	for (size_t f = 0; f < freqs.size(); ++f)
+	{
+		if (assigned[f] > -1)
+			continue;
+
+		for (size_t i = 0; i < d_outputs.size(); ++i)
+		{
+			if (d_outputs[i].enabled)
+				continue;
+
+			output_channel& channel = d_outputs[i];
+			channel.enabled = true;
+			channel.freq = freqs[f];
+			channel.phase = 0.0;
+			retune(channel);
+
+			assigned[f] = i;
+			break;
+		}
+
+		if (assigned[f] == -1)
+			fprintf(stderr, "[%s<%i>] no free output for %f\n", name().c_str(), unique_id(), freqs[f]);
+	}
+
+	return assigned;
+}
+
+/*
+ * Output n of bin k is:
+ *   sum_m h[m] x[t-m] exp(-j*2*pi*k*(t-m)/M)	(mix bin down, low-pass, keep every D'th)
+ * = exp(-j*2*pi*k*t/M) * IFFT(w)[k], where w[r] = sum_q h[r+qM] x[t-r-qM]
+ * with t being the newest input sample of the n'th decimation period.
+ */
+int baz_channelizer_ccf::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	const gr_complex* in = (const gr_complex*)input_items[0];
+	const int length = d_taps.size();
+	const int nconnected = std::min(output_items.size(), d_outputs.size());
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	bool any = false;
+	for (int i = 0; i < nconnected; ++i)
+	{
+		if (d_outputs[i].enabled)
+			any = true;
+		else
+			memset(output_items[i], 0x00, noutput_items * sizeof(gr_complex));
+	}
+
+	if (any == false)
+		return noutput_items;
+
+	gr_complex* fft_in = d_fft->get_inbuf();
+	const gr_complex* fft_out = d_fft->get_outbuf();
+
+	// Absolute index of the newest sample of the first period (history sits in front of nitems_read)
+	uint64_t t = nitems_read(0) + d_decimation - 1;
+
+	for (int n = 0; n < noutput_items; ++n, t += d_decimation)
+	{
+		const gr_complex* newest = in + (n * d_decimation) + (d_decimation - 1) + (length - 1);
+
+		for (int r = 0; r < d_channels; ++r)
+			fft_in[r] = gr_complex(0, 0);
+
+		for (int q = 0; q < length; q += d_channels)
+		{
+			const float* h = &d_taps[q];
+			const gr_complex* x = newest - q;
+			for (int r = 0; r < d_channels; ++r)
+				fft_in[r] += h[r] * x[-r];
+		}
+
+		d_fft->execute();
+
+		const uint64_t t_mod = t % (uint64_t)d_channels;
+
+		for (int i = 0; i < nconnected; ++i)
+		{
+			output_channel& channel = d_outputs[i];
+			if (channel.enabled == false)
+				continue;
+
+			gr_complex y = fft_out[channel.bin] * d_rotation[(int)(((uint64_t)channel.bin * t_mod) % (uint64_t)d_channels)];
+
+			if (channel.phase_inc != 0.0)
+			{
+				y *= std::polar(1.0f, (float)-channel.phase);
+
+				channel.phase += channel.phase_inc;
+				if (channel.phase > M_PI)
+					channel.phase -= 2.0 * M_PI;
+				else if (channel.phase < -M_PI)
+					channel.phase += 2.0 * M_PI;
+			}
+
+			((gr_complex*)output_items[i])[n] = y;
+		}
+	}
+
+	return noutput_items;
+}
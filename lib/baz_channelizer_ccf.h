@@ -0,0 +1,129 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+
+#ifndef INCLUDED_BAZ_CHANNELIZER_CCF_H
+#define INCLUDED_BAZ_CHANNELIZER_CCF_H
+
+#include <gnuradio/sync_decimator.h>
+#include <gnuradio/fft/fft.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+class BAZ_API baz_channelizer_ccf;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_channelizer_ccf> baz_channelizer_ccf_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_channelizer_ccf.
+ *
+ * To avoid accidental use of raw pointers, baz_channelizer_ccf's
+ * constructor is private.  baz_make_channelizer_ccf is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_channelizer_ccf_sptr baz_make_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq = 0.0);
+
+/*!
+ * \brief Polyphase filterbank channeliser with per-output fine tuning
+ * \ingroup block
+ *
+ * Splits the input into 'channels' bins spaced sample_rate/channels apart in one
+ * pass (weighted overlap-add: 'taps' is the low-pass prototype at the input rate,
+ * folded into one FFT per output sample), decimating by 'decimation'
+ * (== channels for critical sampling, channels/2 to leave room for off-grid tuning).
+ *
+ * Each of the 'outputs' ports is tuned to an absolute frequency: the nearest bin
+ * is picked and the remainder removed with a per-output NCO. Unassigned outputs
+ * produce zeros. Outputs can be (re)assigned while running.
+ */
+class BAZ_API baz_channelizer_ccf : public gr::sync_decimator
+{
+private:
+	// The friend declaration allows baz_make_channelizer_ccf to
+	// access the private constructor.
+	friend BAZ_API baz_channelizer_ccf_sptr baz_make_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq);
+
+	baz_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq);  	// private constructor
+
+	struct output_channel
+	{
+		bool enabled;
+		double freq;
+		int bin;
+		double phase;		// Fine-tune NCO (radians)
+		double phase_inc;	// Per output sample
+	};
+
+	double d_sample_rate;
+	int d_channels;
+	int d_decimation;
+	std::vector<float> d_taps;	// Prototype in natural order, zero-padded to a multiple of 'channels'
+	double d_baseband_freq;
+	gr::fft::fft_complex* d_fft;
+	std::vector<gr_complex> d_rotation;	// exp(-j*2*pi*r/channels)
+	std::vector<output_channel> d_outputs;
+	boost::mutex d_mutex;
+
+	void retune(output_channel& output);
+public:
+	~baz_channelizer_ccf ();	// public destructor
+
+	void set_baseband_freq(double baseband_freq);
+	double baseband_freq() const
+	{ return d_baseband_freq; }
+	double output_rate() const
+	{ return (d_sample_rate / (double)d_decimation); }
+	double channel_spacing() const
+	{ return (d_sample_rate / (double)d_channels); }
+	int output_count() const
+	{ return (int)d_outputs.size(); }
+
+	void set_channel(int output, double freq);
+	void clear_channel(int output);
+	double channel_freq(int output) const;	// 0 if unassigned
+	bool channel_enabled(int output) const;
+	// Keeps outputs already on a listed frequency, frees the rest, and assigns new ones to free outputs.
+	// Returns output index for each entry in 'freqs' (-1 if no output was free).
+	std::vector<int> set_frequencies(const std::vector<double>& freqs);
+
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_CHANNELIZER_CCF_H */
@@ -0,0 +1,320 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_correlator.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Create a new instance of baz_correlator and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_correlator_sptr baz_make_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold /*= 0.5*/, int width /*= 1024*/, int sync_window_length /*= 500*/, bool verbose /*= false*/)
+{
+	return baz_correlator_sptr (new baz_correlator (window_length, sync, threshold, width, sync_window_length, verbose));
+}
+
+/*
+ * The private constructor
+ */
+baz_correlator::baz_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold, int width, int sync_window_length, bool verbose)
+	: gr::block ("correlator",
+		gr::io_signature::make (1, 1, sizeof(gr_complex)),
+		gr::io_signature::make (1, 1, sizeof(float)))
+	, d_window_length(window_length)
+	, d_threshold(threshold)
+	, d_width(width)
+	, d_sync_window_length(std::max(sync_window_length, 1))
+	, d_verbose(verbose)
+	, d_sync_length(sync.size())
+	, d_fft_size(1024)
+	, d_fwd(NULL)
+	, d_inv(NULL)
+	, d_synced(false)
+	, d_next_window(0)
+	, d_scanline_count(0)
+	, d_peak_tag(pmt::mp("corr_peak"))
+{
+	if (d_sync_length == 0)
+		throw std::invalid_argument("correlator: empty sync sequence");
+	if (d_width <= 0)
+		throw std::invalid_argument("correlator: width must be positive");
+
+	// Each overlap-save block yields (FFT size - sync length + 1) lags
+	while (d_fft_size < (4 * d_sync_length))
+		d_fft_size *= 2;
+
+	d_acquire_length = std::max(4 * d_fft_size, d_width + d_sync_length);
+
+	d_fwd = new gr::fft::fft_complex(d_fft_size, true);
+	d_inv = new gr::fft::fft_complex(d_fft_size, false);
+
+	gr_complex* fft_in = d_fwd->get_inbuf();
+	std::fill(fft_in, fft_in + d_fft_size, gr_complex(0, 0));
+	std::copy(sync.begin(), sync.end(), fft_in);
+	d_fwd->execute();
+
+	d_sync_spectrum.resize(d_fft_size);
+	const gr_complex* fft_out = d_fwd->get_outbuf();
+	const float scale = 1.0f / (float)d_fft_size;	// Inverse FFT is unnormalised
+	for (int i = 0; i < d_fft_size; ++i)
+		d_sync_spectrum[i] = std::conj(fft_out[i]) * scale;
+
+	d_corr.resize(d_acquire_length);
+
+	set_output_multiple(d_width);
+	set_relative_rate((double)d_width / (double)std::max(d_window_length, 1));
+	set_tag_propagation_policy(TPP_DONT);
+
+	if (d_window_length < (d_width + d_sync_length))
+		fprintf(stderr, "[%s<%i>] window length %d is shorter than width + sync length: windows will overlap and lock will be lost\n", name().c_str(), unique_id(), d_window_length);
+
+	fprintf(stderr, "[%s<%i>] window length: %d, sync length: %d, threshold: %f, width: %d, sync window: %d, FFT size: %d\n", name().c_str(), unique_id(),
+		window_length, d_sync_length, threshold, width, sync_window_length, d_fft_size);
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_correlator::~baz_correlator ()
+{
+	delete d_fwd;
+	delete d_inv;
+}
+
+void baz_correlator::set_threshold(float threshold)
+{
+	d_threshold = threshold;
+}
+
+/*
+ * |numpy.correlate(in[0:length], sync, mode='same')| into d_corr, by overlap-save.
+ * Lag j lines sync[0] up with in[j - sync_length/2], with zeros outside 'in'.
+ */
+void baz_correlator::correlate(const gr_complex* in, int length)
+{
+	const int half = d_sync_length / 2;
+	const int valid = d_fft_size - d_sync_length + 1;
+
+	for (int p = 0; p < length; p += valid)
+	{
+		gr_complex* fft_in = d_fwd->get_inbuf();
+
+		// Segment covers in[p - half, p - half + FFT size), zero-padded at either end
+		int first = p - half;
+		int begin = std::max(first, 0);
+		int end = std::min(first + d_fft_size, length);
+
+		std::fill(fft_in, fft_in + d_fft_size, gr_complex(0, 0));
+		if (end > begin)
+			std::copy(in + begin, in + end, fft_in + (begin - first));
+
+		d_fwd->execute();
+
+		const gr_complex* spectrum = d_fwd->get_outbuf();
+		gr_complex* inv_in = d_inv->get_inbuf();
+		for (int i = 0; i < d_fft_size; ++i)
+			inv_in[i] = spectrum[i] * d_sync_spectrum[i];
+
+		d_inv->execute();
+
+		const gr_complex* r = d_inv->get_outbuf();
+		int n = std::min(valid, length - p);
+		for (int k = 0; k < n; ++k)
+			d_corr[p + k] = std::abs(r[k]);
+	}
+}
+
+// First lag in [start, end) at or above threshold, or -1
+int baz_correlator::find_crossing(int start, int end) const
+{
+	for (int i = start; i < end; ++i)
+	{
+		if (d_corr[i] >= d_threshold)
+			return i;
+	}
+
+	return -1;
+}
+
+// Largest lag in [start, end)
+int baz_correlator::find_max(int start, int end) const
+{
+	int peak = start;
+	for (int i = start + 1; i < end; ++i)
+	{
+		if (d_corr[i] > d_corr[peak])
+			peak = i;
+	}
+
+	return peak;
+}
+
+void baz_correlator::forecast(int noutput_items, gr_vector_int &ninput_items_required)
+{
+	if (d_synced == false)
+	{
+		ninput_items_required[0] = d_acquire_length;
+		return;
+	}
+
+	const int length = d_width + d_sync_length;
+	const uint64_t segment_start = d_next_window - (d_sync_length / 2);
+	const uint64_t nread = nitems_read(0);
+
+	if (nread < segment_start)
+		ninput_items_required[0] = (int)std::min((uint64_t)length, segment_start - nread);
+	else
+		ninput_items_required[0] = length;
+}
+
+int baz_correlator::general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	const gr_complex* in = (const gr_complex*)input_items[0];
+	float* out = (float*)output_items[0];
+
+	const int half = d_sync_length / 2;
+	const uint64_t nread = nitems_read(0);
+	const int ninput = ninput_items[0];
+
+	// Lags in [half, length - sync_length + half] see the whole sync sequence inside the buffer
+
+	if (d_synced == false)
+	{
+		const int length = std::min(ninput, d_acquire_length);
+		if (length < (2 * d_sync_length))
+		{
+			consume(0, 0);
+			return 0;
+		}
+
+		const int end = length - d_sync_length + half + 1;
+
+		correlate(in, length);
+
+		int first = find_crossing(half, end);
+		if (first < 0)
+		{
+			consume(0, end - half);	// Next buffer's first complete lag follows on from this one's last
+			return 0;
+		}
+
+		if (((first + d_sync_window_length) > end) && (first > half))
+		{
+			consume(0, first - half);	// Re-run with the whole search window in view
+			return 0;
+		}
+
+		int peak = find_max(first, std::min(first + d_sync_window_length, end));
+
+		uint64_t peak_index = nread + peak;
+		d_next_window = peak_index + d_window_length - (d_width / 2);
+		d_synced = true;
+
+		fprintf(stderr, "[%s<%i>] found first peak: %f (sample: %llu)\n", name().c_str(), unique_id(), d_corr[peak], (unsigned long long)peak_index);
+
+		uint64_t segment_start = d_next_window - half;
+		consume(0, (int)std::min((uint64_t)length, (segment_start > nread) ? (segment_start - nread) : 0));
+
+		return 0;
+	}
+
+	const int length = d_width + d_sync_length;	// Expected peak sits in the middle
+	const uint64_t segment_start = d_next_window - half;
+
+	if (nread > segment_start)
+	{
+		fprintf(stderr, "[%s<%i>] missed window (sample: %llu, expected: %llu)\n", name().c_str(), unique_id(), (unsigned long long)nread, (unsigned long long)segment_start);
+
+		d_synced = false;
+		consume(0, 0);
+		return 0;
+	}
+
+	if (nread < segment_start)
+	{
+		consume(0, (int)std::min((uint64_t)ninput, segment_start - nread));
+		return 0;
+	}
+
+	if (ninput < length)
+	{
+		consume(0, 0);
+		return 0;
+	}
+
+	const int end = d_width + half + 1;
+
+	correlate(in, length);
+
+	int first = find_crossing(half, end);
+	if (first < 0)
+	{
+		fprintf(stderr, "[%s<%i>] failed to find expected peak (window: %llu)\n", name().c_str(), unique_id(), (unsigned long long)d_next_window);
+
+		d_synced = false;
+		consume(0, 0);	// Re-acquire on the same samples
+		return 0;
+	}
+
+	int peak = find_max(first, std::min(first + d_sync_window_length, end));
+
+	uint64_t peak_index = segment_start + peak;
+	d_next_window = peak_index + d_window_length - (d_width / 2);
+
+	if (d_verbose)
+		fprintf(stderr, "[%s<%i>] peak: %f (sample: %llu, offset: %d)\n", name().c_str(), unique_id(), d_corr[peak], (unsigned long long)peak_index, (peak - (length / 2)));
+
+	// Scanline centred on the peak
+	int start = peak - (d_width / 2);
+	for (int i = 0; i < d_width; ++i)
+	{
+		int j = start + i;
+		out[i] = (((j >= 0) && (j < length)) ? d_corr[j] : 0.0f);
+	}
+
+	add_item_tag(0, nitems_written(0) + (d_width / 2), d_peak_tag, pmt::make_tuple(pmt::from_uint64(peak_index), pmt::from_double(d_corr[peak])), pmt::mp(alias()));
+
+	++d_scanline_count;
+
+	uint64_t next_segment_start = d_next_window - half;
+	consume(0, (int)std::min((uint64_t)ninput, (next_segment_start > nread) ? (next_segment_start - nread) : 0));
+
+	return d_width;
+}
@@ -0,0 +1,114 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_CORRELATOR_H
+#define INCLUDED_BAZ_CORRELATOR_H
+
+#include <gnuradio/block.h>
+#include <gnuradio/fft/fft.h>
+
+#include <vector>
+
+class BAZ_API baz_correlator;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_correlator> baz_correlator_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_correlator.
+ *
+ * To avoid accidental use of raw pointers, baz_correlator's
+ * constructor is private.  baz_make_correlator is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_correlator_sptr baz_make_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold = 0.5, int width = 1024, int sync_window_length = 500, bool verbose = false);
+
+/*!
+ * \brief Sync sequence correlator (native version of python/correlator.py)
+ * \ingroup block
+ *
+ * Correlates against 'sync' with FFT overlap-save (numpy.correlate 'same' alignment).
+ * Once the first peak is found, only a 'width'-wide window around where the next
+ * sync sequence is predicted ('window_length' samples later) is searched.
+ * Each found peak produces one 'width'-long scanline of correlation magnitude,
+ * centred on the peak, and a 'corr_peak' tag on the centre item: (sample index, magnitude).
+ */
+class BAZ_API baz_correlator : public gr::block
+{
+private:
+	// The friend declaration allows baz_make_correlator to
+	// access the private constructor.
+	friend BAZ_API baz_correlator_sptr baz_make_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold, int width, int sync_window_length, bool verbose);
+
+	baz_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold, int width, int sync_window_length, bool verbose);  	// private constructor
+
+	int d_window_length;
+	float d_threshold;
+	int d_width;
+	int d_sync_window_length;
+	bool d_verbose;
+	int d_sync_length;
+	int d_fft_size;
+	int d_acquire_length;
+	gr::fft::fft_complex* d_fwd;
+	gr::fft::fft_complex* d_inv;
+	std::vector<gr_complex> d_sync_spectrum;	// conj(FFT(sync)) / FFT size
+	std::vector<float> d_corr;
+	bool d_synced;
+	uint64_t d_next_window;	// Absolute sample index where next scanline is predicted to start
+	uint64_t d_scanline_count;
+	pmt::pmt_t d_peak_tag;
+
+	void correlate(const gr_complex* in, int length);
+	int find_crossing(int start, int end) const;
+	int find_max(int start, int end) const;
+public:
+	~baz_correlator ();	// public destructor
+
+	void set_threshold(float threshold);
+	float threshold() const
+	{ return d_threshold; }
+	bool synced() const
+	{ return d_synced; }
+	uint64_t scanline_count() const
+	{ return d_scanline_count; }
+
+	void forecast(int noutput_items, gr_vector_int &ninput_items_required);
+	int general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_CORRELATOR_H */
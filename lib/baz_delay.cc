@@ -35,43 +35,261 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdexcept>
+#include <algorithm>
 
 using namespace std;
 
-baz_delay_sptr baz_make_delay (size_t itemsize, int delay)
+#define CENTRE_TAP	((BAZ_DELAY_TAPS / 2) - 1)	// Interpolator group delay at phase 0
+#define HISTORY		(BAZ_DELAY_TAPS - 1)
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	if ((a % b) && ((a < 0) != (b < 0)))
+		--q;
+	return q;
+}
+
+static int64_t to_phases(double delay)
 {
-	return baz_delay_sptr (new baz_delay (itemsize, delay));
+	return (int64_t)llround(delay * BAZ_DELAY_PHASES);
 }
 
-baz_delay::baz_delay (size_t itemsize, int delay)
+// out[i] = sum(taps[k] * x[i - k]), where x[-HISTORY..-1] come from 'history'
+template<typename T>
+static void fir_items(void* out, const void* history, const void* in, int n, const float* taps)
+{
+	T* o = (T*)out;
+	const T* h = (const T*)history;
+	const T* x = (const T*)in;
+	
+	int i = 0;
+	for (; (i < n) && (i < HISTORY); ++i)
+	{
+		T acc = T();
+		for (int k = 0; k < BAZ_DELAY_TAPS; ++k)
+		{
+			int j = i - k;
+			acc += taps[k] * ((j >= 0) ? x[j] : h[HISTORY + j]);
+		}
+		o[i] = acc;
+	}
+	
+	for (; i < n; ++i)
+	{
+		const T* p = x + i;
+		T acc = T();
+		for (int k = 0; k < BAZ_DELAY_TAPS; ++k)
+			acc += taps[k] * p[-k];
+		o[i] = acc;
+	}
+}
+
+baz_delay_sptr baz_make_delay (size_t itemsize, int delay, bool fractional /*= false*/)
+{
+	return baz_delay_sptr (new baz_delay (itemsize, delay, fractional));
+}
+
+baz_delay::baz_delay (size_t itemsize, int delay, bool fractional)
   : gr::block ("variable_delay",
 		gr::io_signature::make (1, 1, itemsize),
 		gr::io_signature::make (1, 1, itemsize))
 	, d_itemsize(itemsize)
+	, d_fractional(fractional)
+	, d_fir(NULL)
+	, d_pending_write(0)
+	, d_pending_read(0)
+	, d_immediate(0)
+	, d_immediate_seq(0)
+	, d_requested(0)
+	, d_applied(0)
+	, d_immediate_seen(0)
 	, d_delay(0)
+	, d_phase(0)
+	, d_align(0)
+	, d_tag_horizon(0)
+	, d_history(HISTORY * itemsize, 0)
+	, d_delay_tag(pmt::mp("delay"))
+{
+	if (d_fractional)
+	{
+		if (itemsize == sizeof(float))
+			d_fir = fir_items<float>;
+		else if (itemsize == sizeof(gr_complex))
+			d_fir = fir_items<gr_complex>;
+		else
+			throw std::invalid_argument("delay: fractional delays need float or complex items");
+		
+		// Blackman-windowed sinc, one row per phase. Phase 0 is a pure (CENTRE_TAP) delay.
+		d_taps.resize(BAZ_DELAY_PHASES * BAZ_DELAY_TAPS);
+		for (int p = 0; p < BAZ_DELAY_PHASES; ++p)
+		{
+			float* row = &d_taps[p * BAZ_DELAY_TAPS];
+			double sum = 0;
+			for (int k = 0; k < BAZ_DELAY_TAPS; ++k)
+			{
+				double t = (double)(k - CENTRE_TAP) - ((double)p / BAZ_DELAY_PHASES);
+				double sinc = ((t == 0) ? 1.0 : (sin(M_PI * t) / (M_PI * t)));
+				double w = 0.42 + 0.5 * cos(2 * M_PI * t / BAZ_DELAY_TAPS) + 0.08 * cos(4 * M_PI * t / BAZ_DELAY_TAPS);
+				row[k] = (float)(sinc * w);
+				sum += row[k];
+			}
+			for (int k = 0; k < BAZ_DELAY_TAPS; ++k)
+				row[k] = (float)(row[k] / sum);	// Unity gain at DC
+		}
+	}
+	
+	fprintf(stderr, "[%s<%i>] item size: %d, delay: %d, fractional: %s\n", name().c_str(), unique_id(), (int)itemsize, delay, (d_fractional ? "yes" : "no"));
+
+	d_requested = (int64_t)delay * BAZ_DELAY_PHASES;
+	apply(d_requested);
+}
+
+int baz_delay::delay() const
 {
-	fprintf(stderr, "[%s<%i>] item size: %d, delay: %d\n", name().c_str(), unique_id(), itemsize, delay);
+	return (int)floor_div(__sync_add_and_fetch(const_cast<int64_t*>(&d_requested), 0), BAZ_DELAY_PHASES);
+}
 
-	set_delay(delay);
+double baz_delay::fractional_delay() const
+{
+	return (double)__sync_add_and_fetch(const_cast<int64_t*>(&d_requested), 0) / BAZ_DELAY_PHASES;
+}
+
+double baz_delay::applied_delay() const
+{
+	return (double)__sync_add_and_fetch(const_cast<int64_t*>(&d_applied), 0) / BAZ_DELAY_PHASES;
 }
 
 void baz_delay::set_delay(int delay)	// +ve: past, -ve: future
 {
-	boost::mutex::scoped_lock guard(d_mutex);
+	push_change((int64_t)delay * BAZ_DELAY_PHASES);
+}
 
-	//fprintf(stderr, "[%s<%i>] delay: %d (was: %d)\n", name().c_str(), unique_id(), delay, d_delay);
+void baz_delay::set_fractional_delay(double delay)
+{
+	push_change(to_phases(delay));
+}
 
-	d_delay = delay;
+void baz_delay::schedule_delay(double delay, uint64_t sample)
+{
+	push_change(to_phases(delay), sample);
 }
 
-void baz_delay::forecast(int noutput_items, gr_vector_int &ninput_items_required)
+void baz_delay::push_change(int64_t phases)
+{
+	__sync_lock_test_and_set(&d_immediate, phases);
+	__sync_fetch_and_add(&d_immediate_seq, 1);	// Published after the value
+	
+	__sync_lock_test_and_set(&d_requested, phases);
+}
+
+void baz_delay::push_change(int64_t phases, uint64_t sample)
 {
-	boost::mutex::scoped_lock guard(d_mutex);
+	boost::mutex::scoped_lock guard(d_setter_mutex);
 	
-	const int64_t diff = ((int64_t)nitems_written(0) - (int64_t)nitems_read(0)) - d_delay;
+	if ((d_pending_write - d_pending_read) >= BAZ_DELAY_PENDING)
+		throw std::runtime_error("delay: too many pending delay changes");
 	
-	//if (diff != 0)
-	//	fprintf(stderr, "[%s<%i>] forecast diff: %d (noutput_items: %d)\n", name().c_str(), unique_id(), diff, noutput_items);
+	delay_change& change = d_pending[d_pending_write % BAZ_DELAY_PENDING];
+	change.phases = phases;
+	change.sample = sample;
+	
+	__sync_synchronize();	// Slot contents before it is published
+	
+	++d_pending_write;
+	
+	__sync_lock_test_and_set(&d_requested, phases);
+}
+
+void baz_delay::insert_change(const delay_change& change)
+{
+	std::deque<delay_change>::iterator it = d_changes.end();
+	while ((it != d_changes.begin()) && ((it - 1)->sample > change.sample))	// Stable: equal samples keep arrival order
+		--it;
+	d_changes.insert(it, change);
+}
+
+void baz_delay::drain_pending()
+{
+	const uint64_t end = d_pending_write;
+	
+	__sync_synchronize();
+	
+	for (uint64_t i = d_pending_read; i < end; ++i)
+	{
+		delay_change change = d_pending[i % BAZ_DELAY_PENDING];
+		if (change.sample < nitems_read(0))
+			fprintf(stderr, "[%s<%i>] delay change for sample %llu arrived late (now at: %llu)\n", name().c_str(), unique_id(), (unsigned long long)change.sample, (unsigned long long)nitems_read(0));
+		insert_change(change);
+	}
+	
+	__sync_synchronize();	// Done with the slots before handing them back
+	
+	d_pending_read = end;
+	
+	const uint32_t seq = d_immediate_seq;
+	if (seq != d_immediate_seen)
+	{
+		__sync_synchronize();
+		
+		delay_change change;
+		change.phases = __sync_add_and_fetch(&d_immediate, 0);
+		change.sample = nitems_read(0);
+		insert_change(change);	// After anything else due now, so it wins
+		
+		d_immediate_seen = seq;
+	}
+}
+
+void baz_delay::apply(int64_t phases)
+{
+	if (d_fractional == false)
+		phases = floor_div(phases + (BAZ_DELAY_PHASES / 2), BAZ_DELAY_PHASES) * BAZ_DELAY_PHASES;
+	
+	d_delay = (int)floor_div(phases, BAZ_DELAY_PHASES);
+	d_phase = (int)(phases - ((int64_t)d_delay * BAZ_DELAY_PHASES));
+	d_align = d_delay - (d_phase ? CENTRE_TAP : 0);	// Interpolator output lags its newest input by CENTRE_TAP + fraction
+	
+	__sync_lock_test_and_set(&d_applied, phases);
+}
+
+void baz_delay::push_history(const char* in, int n)
+{
+	const size_t length = HISTORY * d_itemsize;
+	char* history = &d_history[0];
+	
+	if (n >= HISTORY)
+	{
+		memcpy(history, in + ((n - HISTORY) * d_itemsize), length);
+	}
+	else
+	{
+		memmove(history, history + (n * d_itemsize), length - (n * d_itemsize));
+		memcpy(history + length - (n * d_itemsize), in, n * d_itemsize);
+	}
+}
+
+// Replicate one item n times, doubling the copied span each pass
+void baz_delay::fill(char* out, const char* item, int n)
+{
+	if (n <= 0)
+		return;
+	
+	memcpy(out, item, d_itemsize);
+	
+	int done = 1;
+	while (done < n)
+	{
+		int count = std::min(done, n - done);
+		memcpy(out + (done * d_itemsize), out, count * d_itemsize);
+		done += count;
+	}
+}
+
+void baz_delay::forecast(int noutput_items, gr_vector_int &ninput_items_required)
+{
+	const int64_t diff = ((int64_t)nitems_written(0) - (int64_t)nitems_read(0)) - d_align;
 	
 	for (size_t i = 0; i < ninput_items_required.size(); ++i)
 		ninput_items_required[i] = ((diff >= 0) ? noutput_items : 0);
@@ -79,27 +297,91 @@ void baz_delay::forecast(int noutput_items, gr_vector_int &ninput_items_required
 
 int baz_delay::general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
 {
-	boost::mutex::scoped_lock guard(d_mutex);
+	const char* in = (const char*)input_items[0];
+	char* out = (char*)output_items[0];
+	
+	const int ninput = ninput_items[0];
+	const uint64_t nread = nitems_read(0);
+	const uint64_t nwritten = nitems_written(0);
 	
-	const int64_t diff = ((int64_t)nitems_written(0) - (int64_t)nitems_read(0)) - d_delay;
+	if ((d_pending_read != d_pending_write) || (d_immediate_seq != d_immediate_seen))
+		drain_pending();
 	
-	if (diff < 0)	// -ve: past
+	if (d_tag_horizon < (nread + ninput))
 	{
-		int64_t to_copy = std::min(-diff, (int64_t)ninput_items[0]);
-		for (int64_t i = 0; i < to_copy; ++i)
-			memcpy((char*)output_items[0] + (d_itemsize * i), input_items[0], d_itemsize);
-		return to_copy;
+		std::vector<gr::tag_t> tags;
+		get_tags_in_range(tags, 0, std::max(nread, d_tag_horizon), nread + ninput, d_delay_tag);
+		for (size_t i = 0; i < tags.size(); ++i)
+		{
+			if (pmt::is_number(tags[i].value) == false)
+			{
+				fprintf(stderr, "[%s<%i>] ignoring non-numeric delay tag at %llu\n", name().c_str(), unique_id(), (unsigned long long)tags[i].offset);
+				continue;
+			}
+			
+			delay_change change;
+			change.phases = to_phases(pmt::to_double(tags[i].value));
+			change.sample = tags[i].offset;
+			insert_change(change);
+		}
+		
+		d_tag_horizon = nread + ninput;
 	}
-	else if (diff > 0)	// +ve: future
+	
+	int consumed = 0, produced = 0;
+	
+	while (true)
 	{
-		int64_t to_consume = std::min(diff, (int64_t)ninput_items[0]);
-		consume(0, to_consume);
-		return 0;
+		const uint64_t position = nread + consumed;
+		
+		while ((d_changes.empty() == false) && (d_changes.front().sample <= position))
+		{
+			apply(d_changes.front().phases);
+			d_changes.pop_front();
+		}
+		
+		int available = ninput - consumed;
+		if (d_changes.empty() == false)	// Stop on the next change's sample
+			available = (int)std::min((uint64_t)available, d_changes.front().sample - position);
+		
+		const int64_t diff = ((int64_t)(nwritten + produced) - (int64_t)position) - d_align;
+		
+		if (diff < 0)	// Delay grew: repeat the last consumed item
+		{
+			int n = (int)std::min(-diff, (int64_t)(noutput_items - produced));
+			if (n == 0)
+				break;
+			
+			fill(out + (produced * d_itemsize), &d_history[(HISTORY - 1) * d_itemsize], n);
+			produced += n;
+			continue;
+		}
+		else if (diff > 0)	// Delay shrank: drop
+		{
+			int n = (int)std::min(diff, (int64_t)available);
+			if (n == 0)
+				break;
+			
+			push_history(in + (consumed * d_itemsize), n);
+			consumed += n;
+			continue;
+		}
+		
+		int n = std::min(noutput_items - produced, available);
+		if (n == 0)
+			break;
+		
+		if (d_phase)
+			d_fir(out + (produced * d_itemsize), &d_history[0], in + (consumed * d_itemsize), n, &d_taps[d_phase * BAZ_DELAY_TAPS]);
+		else
+			memcpy(out + (produced * d_itemsize), in + (consumed * d_itemsize), n * d_itemsize);
+		
+		push_history(in + (consumed * d_itemsize), n);
+		consumed += n;
+		produced += n;
 	}
 	
-	memcpy(output_items[0], input_items[0], (d_itemsize * noutput_items));
-	
-	consume(0, noutput_items);
+	consume(0, consumed);
 	
-	return noutput_items;
+	return produced;
 }
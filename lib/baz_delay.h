@@ -30,29 +30,90 @@
 
 #include <gnuradio/sync_block.h>
 #include <boost/thread.hpp>
+#include <deque>
+#include <vector>
+
+#define BAZ_DELAY_PHASES	64	// Fractional delay resolution (1/phases of a sample)
+#define BAZ_DELAY_TAPS		8	// Interpolator taps per phase
+#define BAZ_DELAY_PENDING	64	// Delay changes that can be waiting for the work thread
 
 class BAZ_API baz_delay;
 typedef boost::shared_ptr<baz_delay> baz_delay_sptr;
 
-BAZ_API baz_delay_sptr baz_make_delay (size_t itemsize, int delay);
+BAZ_API baz_delay_sptr baz_make_delay (size_t itemsize, int delay, bool fractional = false);
 
 /*!
  * \brief delay the input by a certain number of samples
  * \ingroup misc_blk
+ *
+ * Delay changes are handed to the work thread through a lock-free ring, and
+ * take effect either at the next work call or at an absolute input sample
+ * index (schedule_delay, or a 'delay' stream tag carrying the new value).
+ * From that sample on the output is the input delayed by the new amount:
+ * a longer delay repeats the sample before the change, a shorter one drops.
+ *
+ * With 'fractional' set the items must be single floats or complex samples
+ * (item size 4 or 8), and fractional delays are applied with a windowed-sinc
+ * polyphase interpolator. Otherwise items are opaque and every delay is
+ * rounded to the nearest whole sample.
+ *
+ * Before the first input item is consumed, any delay is padded with zeros.
  */
 class BAZ_API baz_delay : public gr::block
 {
-	friend BAZ_API baz_delay_sptr baz_make_delay (size_t itemsize, int delay);
+	friend BAZ_API baz_delay_sptr baz_make_delay (size_t itemsize, int delay, bool fractional);
+
+	baz_delay (size_t itemsize, int delay, bool fractional);
+
+	struct delay_change
+	{
+		int64_t phases;	// Delay in 1/BAZ_DELAY_PHASES samples
+		uint64_t sample;	// Absolute input index it applies from
+	};
 
-	baz_delay (size_t itemsize, int delay);
+	typedef void (*fir_fn)(void* out, const void* history, const void* in, int n, const float* taps);
 
-	boost::mutex d_mutex;
 	size_t d_itemsize;
-	int d_delay;
+	bool d_fractional;	// Items are samples that can be interpolated
+	fir_fn d_fir;
+
+	// Setter side: writers serialise among themselves, never against work
+	boost::mutex d_setter_mutex;
+	delay_change d_pending[BAZ_DELAY_PENDING];	// Scheduled changes
+	volatile uint64_t d_pending_write;
+	volatile uint64_t d_pending_read;
+	volatile int64_t d_immediate;	// Latest unscheduled change (last one wins)
+	volatile uint32_t d_immediate_seq;
+	volatile int64_t d_requested;	// Most recently requested delay (phases)
+	volatile int64_t d_applied;	// Delay the work thread is currently running
+
+	// Work thread only
+	uint32_t d_immediate_seen;
+	std::deque<delay_change> d_changes;	// Sorted by sample
+	int d_delay;	// Whole samples
+	int d_phase;	// Fraction index (0: plain copy)
+	int64_t d_align;	// Target written - read
+	uint64_t d_tag_horizon;	// Input tagged items before this have been scanned
+	std::vector<char> d_history;	// Last (taps - 1) consumed items
+	std::vector<float> d_taps;	// [phase][tap]
+	pmt::pmt_t d_delay_tag;
+
+	void push_change(int64_t phases);
+	void push_change(int64_t phases, uint64_t sample);
+	void drain_pending();
+	void insert_change(const delay_change& change);
+	void apply(int64_t phases);
+	void push_history(const char* in, int n);
+	void fill(char* out, const char* item, int n);
 
 public:
-	int delay () const { return d_delay; }
+	int delay () const;
+	double fractional_delay () const;
+	double applied_delay () const;
 	void set_delay (int delay);
+	void set_fractional_delay (double delay);
+	void schedule_delay (double delay, uint64_t sample);
+	bool fractional () const { return d_fractional; }
 
 	void forecast(int noutput_items, gr_vector_int &ninput_items_required);
 	int general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
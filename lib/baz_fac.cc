@@ -0,0 +1,245 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_fac.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Create a new instance of baz_fac and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_fac_sptr baz_make_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha /*= 1.0*/)
+{
+	return baz_fac_sptr (new baz_fac (fac_size, input_is_real, sample_rate, fac_rate, msgq, alpha));
+}
+
+/*
+ * The private constructor
+ */
+baz_fac::baz_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha)
+	: gr::sync_block ("fac",
+		gr::io_signature::make (1, 1, (input_is_real ? sizeof(float) : sizeof(gr_complex))),
+		gr::io_signature::make (0, 0, 0))
+	, d_fac_size(fac_size)
+	, d_input_is_real(input_is_real)
+	, d_sample_rate(sample_rate)
+	, d_fac_rate(fac_rate)
+	, d_msgq(msgq)
+	, d_alpha(1.0f)
+	, d_fft(NULL)
+	, d_real_fft(NULL)
+	, d_fac_fft(NULL)
+	, d_frames(0)
+	, d_frames_per_output(1)
+	, d_primed(false)
+	, d_frame_count(0)
+	, d_output_count(0)
+	, d_dropped_count(0)
+{
+	if (fac_size < 2)
+		throw std::invalid_argument("fac: size must be at least 2");
+
+	if (input_is_real)
+		d_real_fft = new gr::fft::fft_real_fwd(fac_size);
+	else
+		d_fft = new gr::fft::fft_complex(fac_size, true);
+	d_fac_fft = new gr::fft::fft_real_fwd(fac_size);
+
+	d_sum.resize(fac_size);
+	d_average.resize(fac_size);
+
+	set_alpha(alpha);
+	update_frames_per_output();
+
+	set_output_multiple(fac_size);	// Whole frames only
+
+	fprintf(stderr, "[%s<%i>] size: %d, input: %s, sample rate: %f, rate: %f, alpha: %f, frames per output: %d\n", name().c_str(), unique_id(),
+		fac_size, (input_is_real ? "real" : "complex"), sample_rate, fac_rate, alpha, d_frames_per_output);
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_fac::~baz_fac ()
+{
+	delete d_fft;
+	delete d_real_fft;
+	delete d_fac_fft;
+}
+
+void baz_fac::update_frames_per_output()
+{
+	double frames = ((d_fac_rate > 0) ? (d_sample_rate / (double)d_fac_size / d_fac_rate) : 1.0);
+
+	d_frames_per_output = std::max(1, (int)frames);	// As keep_one_in_n was set up by facsink
+}
+
+void baz_fac::set_sample_rate(double sample_rate)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_sample_rate = sample_rate;
+	update_frames_per_output();
+}
+
+void baz_fac::set_fac_rate(double fac_rate)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_fac_rate = fac_rate;
+	update_frames_per_output();
+}
+
+void baz_fac::set_alpha(float alpha)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_alpha = (((alpha > 0) && (alpha <= 1)) ? alpha : 1.0f);
+}
+
+void baz_fac::reset()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	std::fill(d_sum.begin(), d_sum.end(), 0.0f);
+	d_frames = 0;
+	d_primed = false;
+}
+
+// Adds |FFT(|FFT(frame)|)| to d_sum
+void baz_fac::process_frame(const void* in)
+{
+	const int n = d_fac_size;
+	const int half = n / 2;
+	float* mag = d_fac_fft->get_inbuf();	// First stage writes straight into the second's input
+
+	if (d_input_is_real)
+	{
+		memcpy(d_real_fft->get_inbuf(), in, n * sizeof(float));
+		d_real_fft->execute();
+
+		const gr_complex* spectrum = d_real_fft->get_outbuf();	// Bins [0, n/2]: the rest mirror them
+		for (int k = 0; k <= half; ++k)
+			mag[k] = std::abs(spectrum[k]);
+		for (int k = half + 1; k < n; ++k)
+			mag[k] = mag[n - k];
+	}
+	else
+	{
+		memcpy(d_fft->get_inbuf(), in, n * sizeof(gr_complex));
+		d_fft->execute();
+
+		const gr_complex* spectrum = d_fft->get_outbuf();
+		for (int k = 0; k < n; ++k)
+			mag[k] = std::abs(spectrum[k]);
+	}
+
+	d_fac_fft->execute();	// Things go off into the weeds if we try for an inverse FFT so a forward FFT will have to do...
+
+	const gr_complex* fac = d_fac_fft->get_outbuf();	// Real input: only [0, n/2] is computed
+	float* sum = &d_sum[0];
+	for (int k = 0; k <= half; ++k)
+		sum[k] += std::abs(fac[k]);
+
+	++d_frames;
+	++d_frame_count;
+}
+
+void baz_fac::emit()
+{
+	const int n = d_fac_size;
+	const int half = n / 2;
+	const float scale = 1.0f / (float)d_frames;
+
+	for (int k = 0; k <= half; ++k)
+	{
+		float mean = d_sum[k] * scale;
+		d_average[k] = (d_primed ? ((d_alpha * mean) + ((1.0f - d_alpha) * d_average[k])) : mean);
+	}
+	d_primed = true;
+
+	std::fill(d_sum.begin(), d_sum.end(), 0.0f);
+	d_frames = 0;
+
+	++d_output_count;
+
+	if (!d_msgq)
+		return;
+
+	if (d_msgq->full_p())
+	{
+		++d_dropped_count;
+		return;
+	}
+
+	const size_t length = n * sizeof(float);
+	gr::message::sptr msg = gr::message::make(0, length, 1, length);	// As blocks.message_sink: arg1 item size, arg2 item count
+	float* out = (float*)msg->msg();
+
+	// FIXME  We need to add 3dB to all bins but the DC bin
+	const float offset = 20.0f * log10f((float)n);
+	for (int k = 0; k <= half; ++k)
+		out[k] = (20.0f * log10f(std::max(d_average[k], 1e-20f))) - offset;	// Silent bins would otherwise be -inf
+	for (int k = half + 1; k < n; ++k)	// |FFT| of a real sequence is symmetric
+		out[k] = out[n - k];
+
+	d_msgq->insert_tail(msg);
+}
+
+int baz_fac::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	const char* in = (const char*)input_items[0];
+	const size_t frame_length = d_fac_size * (d_input_is_real ? sizeof(float) : sizeof(gr_complex));
+	const int frames = noutput_items / d_fac_size;
+
+	for (int i = 0; i < frames; ++i)
+	{
+		process_frame(in + (i * frame_length));
+
+		if (d_frames >= d_frames_per_output)
+			emit();
+	}
+
+	return (frames * d_fac_size);
+}
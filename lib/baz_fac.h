@@ -0,0 +1,128 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_FAC_H
+#define INCLUDED_BAZ_FAC_H
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/msg_queue.h>
+#include <gnuradio/thread/thread.h>
+#include <gnuradio/fft/fft.h>
+
+#include <vector>
+
+class BAZ_API baz_fac;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_fac> baz_fac_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_fac.
+ *
+ * To avoid accidental use of raw pointers, baz_fac's
+ * constructor is private.  baz_make_fac is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_fac_sptr baz_make_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha = 1.0);
+
+/*!
+ * \brief Fast auto-correlation (native version of the chain in python/facsink.py)
+ * \ingroup block
+ *
+ * Every 'fac_size' frame goes through |FFT(|FFT(x)|)| in the FFT objects' own buffers and
+ * is summed, so nothing is thrown away to meet the display rate.  Every
+ * sample_rate / fac_size / fac_rate frames the mean is put through a single-pole IIR
+ * ('alpha', 1: off) and posted to 'msgq' in dB (20.log10(x) - 20.log10(fac_size)), as
+ * 'fac_size' floats laid out as blocks.message_sink would (dropped if the queue is full).
+ */
+class BAZ_API baz_fac : public gr::sync_block
+{
+private:
+	// The friend declaration allows baz_make_fac to
+	// access the private constructor.
+	friend BAZ_API baz_fac_sptr baz_make_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha);
+
+	baz_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha);  	// private constructor
+
+	int d_fac_size;
+	bool d_input_is_real;
+	double d_sample_rate;
+	double d_fac_rate;
+	gr::msg_queue::sptr d_msgq;
+	float d_alpha;
+	gr::thread::mutex d_mutex;
+	gr::fft::fft_complex* d_fft;	// Complex input
+	gr::fft::fft_real_fwd* d_real_fft;	// Real input
+	gr::fft::fft_real_fwd* d_fac_fft;	// Second stage: input is always a real magnitude spectrum
+	std::vector<float> d_sum;	// |FAC| summed over the frames so far
+	std::vector<float> d_average;	// IIR output (linear)
+	int d_frames;	// Frames in d_sum
+	int d_frames_per_output;
+	bool d_primed;	// d_average holds a frame
+	uint64_t d_frame_count;
+	uint64_t d_output_count;
+	uint64_t d_dropped_count;
+
+	void update_frames_per_output();
+	void process_frame(const void* in);
+	void emit();
+public:
+	~baz_fac ();	// public destructor
+
+	void set_sample_rate(double sample_rate);
+	double sample_rate() const
+	{ return d_sample_rate; }
+	void set_fac_rate(double fac_rate);
+	double fac_rate() const
+	{ return d_fac_rate; }
+	void set_alpha(float alpha);
+	float alpha() const
+	{ return d_alpha; }
+	int frames_per_output() const
+	{ return d_frames_per_output; }
+	uint64_t frame_count() const
+	{ return d_frame_count; }
+	uint64_t output_count() const
+	{ return d_output_count; }
+	uint64_t dropped_count() const
+	{ return d_dropped_count; }
+	void reset();
+
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_FAC_H */
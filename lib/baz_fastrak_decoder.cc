@@ -38,6 +38,8 @@
 #include <gnuradio/io_signature.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <boost/format.hpp>
 
 /*
@@ -54,6 +56,10 @@ static const int MAX_IN = 2;	// maximum number of input streams
 static const int MIN_OUT = 0;	// minimum number of output streams
 static const int MAX_OUT = 2;	// maximum number of output streams
 
+static const int FASTRAK_RATE = 300000;
+static const uint64_t SYNC_WORD = 0xAAC;
+static const int SYNC_LENGTH = 12;
+
 /*
  * The private constructor
  */
@@ -63,16 +69,19 @@ baz_fastrak_decoder::baz_fastrak_decoder(int sample_rate)
 		gr::io_signature::make(MIN_OUT, MAX_OUT, sizeof(float)))
   , d_sample_rate(sample_rate)
   , d_state(STATE_SEARCHING)
+  , d_sync_search(SYNC_WORD, SYNC_LENGTH, 0, std::max(sample_rate / FASTRAK_RATE, 1))
+  , d_search_length(0)
   , d_last_id(-1)
   , d_id(-1)
   , d_last_id_count(0)
 {
-	const int fastrak_rate = 300000;
-	d_oversampling = sample_rate / fastrak_rate;
+	d_oversampling = d_sync_search.stride();
 	
 	fprintf(stderr, "[%s<%i>] sample rate: %d, oversampling: %d\n", name().c_str(), unique_id(), sample_rate, d_oversampling);
 	
 	d_type_length_map[PT_ID] = 32;
+	
+	set_history(d_sync_search.span());	// Header can start in the previous buffer
 }
 
 /*
@@ -94,6 +103,9 @@ void baz_fastrak_decoder::enter_state(state_t state)
 	d_state = state;
 	d_bit_counter = 0;
 	d_bit_buffer = 0;
+	
+	if (state == STATE_SEARCHING)
+		d_search_length = 0;
 }
 
 static uint16_t crc16_compute(uint8_t data, uint16_t init)
@@ -140,8 +152,9 @@ unsigned int baz_fastrak_decoder::last_id_count(bool reset /*= false*/)
 
 int baz_fastrak_decoder::work(int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
 {
-	const float *in = (const float*)input_items[0];
-	const float *sync = (const float*)input_items[1];
+	const int lookback = d_sync_search.span() - 1;
+	const float *in = (const float*)input_items[0] + lookback;
+	const float *sync = (const float*)input_items[1] + lookback;
 	float *out = NULL;
 	float *samp = NULL;
 	if (output_items.size() > 0)
@@ -149,31 +162,53 @@ int baz_fastrak_decoder::work(int noutput_items, gr_vector_const_void_star &inpu
 	if (output_items.size() > 1)
 		samp = (float*)output_items[1];
 
+	if (out)
+		memcpy(out, in, noutput_items * sizeof(float));
+	if (samp)
+		memset(samp, 0x00, noutput_items * sizeof(float));
+
 	for (int i = 0; i < noutput_items; i++)
 	{
-		if (out)
-			out[i] = in[i];
-		if (samp)
-			samp[i] = 0.0f;
-		
 		unsigned char bit = ((in[i] >= 0.0f) ? 0x1 : 0x0);
 		
 		switch (d_state)
 		{
 			case STATE_SEARCHING:
-				if (sync[i] >= d_sync_threshold)
+			{
+				// Jump to where the whole header has been seen (peak aligned with sampling point on first bit)
+				int found = d_sync_search.search(in + i, noutput_items - i, std::min(d_search_length, lookback));
+				if (found < 0)
 				{
-					enter_state(STATE_SYNC);
-					--i;
-					d_sub_symbol_counter = 0;
-					d_crc = 0x0000;	// NOT 0xFFFF (spec bug)
-					d_total_bit_counter = 0;
-					d_crc_buffer = 0;
-					d_compute_crc = false;
+					d_search_length = std::min(d_search_length + (noutput_items - i), lookback);
+					i = noutput_items;
+					continue;
+				}
+				
+				i += found;
+				d_search_length = std::min(d_search_length + (found + 1), lookback);
+				
+				int first = i - lookback;	// First header bit
+				if (sync[first] < d_sync_threshold)
 					continue;
+				
+				if (samp)
+				{
+					for (int j = first; j <= i; j += d_oversampling)
+					{
+						if (j >= 0)	// Earlier ones went out with the last buffer
+							samp[j] = (in[j] >= 0.0f ? 1.0f : -1.0f);
+					}
 				}
+				
+				enter_state(STATE_TYPE);
+				d_sub_symbol_counter = d_oversampling - 1;
+				d_crc = 0x0000;	// NOT 0xFFFF (spec bug)
+				d_total_bit_counter = SYNC_LENGTH;
+				d_crc_buffer = 0;
+				d_compute_crc = true;
+				d_crc_bit_counter = 0;
 				break;
-			case STATE_SYNC:	// Peak aligned with sampling point on first bit
+			}
 			case STATE_TYPE:
 			case STATE_DECODE:
 			case STATE_CRC:
@@ -212,21 +247,7 @@ int baz_fastrak_decoder::work(int noutput_items, gr_vector_const_void_star &inpu
 					}
 				}
 				
-				if (d_state == STATE_SYNC)
-				{
-					if (d_bit_counter == 12)
-					{
-						if (d_bit_buffer == 0xAAC)
-						{
-							d_compute_crc = true;
-							d_crc_bit_counter = 0;
-							enter_state(STATE_TYPE);
-						}
-						else
-							enter_state(STATE_SEARCHING);
-					}
-				}
-				else if (d_state == STATE_TYPE)
+				if (d_state == STATE_TYPE)
 				{
 					if (d_bit_counter == 16)
 					{
@@ -29,6 +29,7 @@
 #define INCLUDED_BAZ_FASTRAK_DECODER_H
 
 #include <gnuradio/sync_block.h>
+#include <baz_sync_search.h>
 
 class BAZ_API baz_fastrak_decoder;
 
@@ -91,6 +92,8 @@ private:
 	typedef std::map<packet_type_t,int> TypeLengthMap;
 	TypeLengthMap d_type_length_map;
 	state_t d_state;
+	baz_sync_search d_sync_search;	// Header (bits sampled 'oversampling' apart)
+	int d_search_length;	// Samples searched since the last packet
 	unsigned long long d_bit_buffer;
 	int d_bit_counter;
 	int d_sub_symbol_counter;
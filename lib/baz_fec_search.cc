@@ -0,0 +1,508 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_fec_search.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Create a new instance of baz_fec_search and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_fec_search_sptr baz_make_fec_search (int window_length, const std::vector<int>& matrix, float threshold /*= 0.5*/, int threads /*= 0*/, bool continuous /*= false*/, int poly_a /*= 0x4f*/, int poly_b /*= 0x6d*/, bool verbose /*= false*/)
+{
+	return baz_fec_search_sptr (new baz_fec_search (window_length, matrix, threshold, threads, continuous, poly_a, poly_b, verbose));
+}
+
+static inline int parity(int x)
+{
+	x ^= (x >> 4);
+	x ^= (x >> 2);
+	x ^= (x >> 1);
+	return (x & 1);
+}
+
+/*
+ * The private constructor
+ */
+baz_fec_search::baz_fec_search (int window_length, const std::vector<int>& matrix, float threshold, int threads, bool continuous, int poly_a, int poly_b, bool verbose)
+	: gr::sync_block ("fec_search",
+		gr::io_signature::make (1, 1, sizeof(gr_complex)),
+		gr::io_signature::make (0, 0, 0))
+	, d_window_length(window_length)
+	, d_threshold(threshold)
+	, d_thread_count(threads)
+	, d_continuous(continuous)
+	, d_verbose(verbose)
+	, d_rotations(4)
+	, d_running(false)
+	, d_busy(false)
+	, d_locked(false)
+	, d_next_hypothesis(0)
+	, d_done(0)
+	, d_search_count(0)
+	, d_windows_skipped(0)
+	, d_last_error_rate(1.0f)
+{
+	if (d_window_length < 64)
+		throw std::invalid_argument("fec_search: window length too short");
+
+	if (d_thread_count <= 0)
+		d_thread_count = std::max((int)boost::thread::hardware_concurrency(), 1);
+
+	for (int reg = 0; reg < 128; ++reg)
+	{
+		int a = parity(reg & abs(poly_a)) ^ (poly_a < 0 ? 1 : 0);
+		int b = parity(reg & abs(poly_b)) ^ (poly_b < 0 ? 1 : 0);
+		d_outputs[reg] = (unsigned char)(a | (b << 1));
+	}
+
+	// Inverting every symbol inverts both outputs when both taps have odd weight, which is the
+	// same code with inverted data: 180/270 are then copies of 0/90
+	if (parity(abs(poly_a) & 0x7f) && parity(abs(poly_b) & 0x7f))
+		d_rotations = 2;
+
+	d_window.reserve(d_window_length);
+
+	add_matrix(matrix);
+
+	message_port_register_out(pmt::mp("xform"));
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_fec_search::~baz_fec_search ()
+{
+	stop();
+}
+
+void baz_fec_search::build_hypotheses()
+{
+	d_hypotheses.clear();
+
+	for (size_t m = 0; m < d_matrices.size(); ++m)
+	{
+		for (int puncture_delay = 0; puncture_delay < (int)d_matrices[m].size(); ++puncture_delay)
+		{
+			for (int conjugate = 0; conjugate < 2; ++conjugate)
+			{
+				for (int rotation = 0; rotation < d_rotations; ++rotation)
+				{
+					for (int viterbi_delay = 0; viterbi_delay < 2; ++viterbi_delay)
+					{
+						for (int viterbi_swap = 0; viterbi_swap < 2; ++viterbi_swap)
+						{
+							hypothesis h;
+							h.matrix = m;
+							h.conjugate = (conjugate != 0);
+							h.rotation = rotation;
+							h.puncture_delay = puncture_delay;
+							h.viterbi_delay = (viterbi_delay != 0);
+							h.viterbi_swap = (viterbi_swap != 0);
+							d_hypotheses.push_back(h);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	d_scores.resize(d_hypotheses.size());
+}
+
+void baz_fec_search::add_matrix(const std::vector<int>& matrix)
+{
+	if (matrix.empty())
+		return;
+
+	std::vector<char> m(matrix.size());
+	bool any = false;
+	for (size_t i = 0; i < matrix.size(); ++i)
+	{
+		m[i] = (matrix[i] ? 1 : 0);
+		if (matrix[i])
+			any = true;
+	}
+
+	if (any == false)
+		throw std::invalid_argument("fec_search: puncture matrix has no ones");
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	while (d_busy)
+		d_job_ready.wait(lock);
+
+	d_matrices.push_back(m);
+	build_hypotheses();
+}
+
+void baz_fec_search::clear_matrices()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	while (d_busy)
+		d_job_ready.wait(lock);
+
+	d_matrices.clear();
+	build_hypotheses();
+}
+
+int baz_fec_search::matrix_count()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	return d_matrices.size();
+}
+
+int baz_fec_search::hypothesis_count()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	return d_hypotheses.size();
+}
+
+void baz_fec_search::set_threshold(float threshold)
+{
+	d_threshold = threshold;
+}
+
+void baz_fec_search::set_continuous(bool continuous)
+{
+	d_continuous = continuous;
+}
+
+void baz_fec_search::reset()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	d_locked = false;
+	d_window.clear();
+}
+
+bool baz_fec_search::start()
+{
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	if (d_running == false)
+	{
+		d_running = true;
+
+		for (int i = 0; i < d_thread_count; ++i)
+			d_workers.create_thread(boost::bind(&baz_fec_search::worker, this));
+	}
+
+	return gr::sync_block::start();
+}
+
+bool baz_fec_search::stop()
+{
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+
+		if (d_running == false)
+			return true;
+
+		d_running = false;
+		d_job_ready.notify_all();
+	}
+
+	d_workers.join_all();
+
+	d_busy = false;
+
+	return gr::sync_block::stop();
+}
+
+void baz_fec_search::worker()
+{
+	scratch s;
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	while (d_running)
+	{
+		if ((d_busy == false) || (d_next_hypothesis >= (int)d_hypotheses.size()))
+		{
+			d_job_ready.wait(lock);
+			continue;
+		}
+
+		int index = d_next_hypothesis++;
+		hypothesis h = d_hypotheses[index];
+
+		lock.unlock();
+
+		score result;
+		evaluate(h, d_job, s, result);	// d_job & d_hypotheses are left alone while busy
+
+		lock.lock();
+
+		d_scores[index] = result;
+
+		if (++d_done == (int)d_hypotheses.size())
+			finish_job();
+	}
+}
+
+void baz_fec_search::finish_job()
+{
+	// Wrong hypotheses for high-rate matrices still re-encode with few errors,
+	// so each is judged against the median of its own matrix
+	std::vector<float> medians(d_matrices.size());
+	std::vector<float> rates;
+	for (size_t m = 0; m < d_matrices.size(); ++m)
+	{
+		rates.clear();
+		for (size_t i = 0; i < d_hypotheses.size(); ++i)
+		{
+			if (d_hypotheses[i].matrix == (int)m)
+				rates.push_back(d_scores[i].error_rate);
+		}
+
+		std::nth_element(rates.begin(), rates.begin() + (rates.size() / 2), rates.end());
+		medians[m] = std::max(rates[rates.size() / 2], 1e-6f);
+	}
+
+	int best = 0;
+	float best_ratio = 2.0f;
+	for (int i = 0; i < (int)d_scores.size(); ++i)
+	{
+		float ratio = d_scores[i].error_rate / medians[d_hypotheses[i].matrix];
+		if ((ratio < best_ratio) ||
+			((ratio == best_ratio) && (d_scores[i].metric > d_scores[best].metric)))
+		{
+			best = i;
+			best_ratio = ratio;
+		}
+	}
+
+	const hypothesis& h = d_hypotheses[best];
+	const score& result = d_scores[best];
+
+	bool locked = (best_ratio <= d_threshold);
+	double elapsed = (double)(boost::posix_time::microsec_clock::universal_time() - d_job_start).total_microseconds() / 1e6;
+
+	++d_search_count;
+	d_last_error_rate = result.error_rate;
+
+	if ((d_verbose) || (locked != d_locked))
+	{
+		fprintf(stderr, "[%s<%i>] best of %d hypotheses in %.3f s: matrix %d, conjugate %d, rotation %d, puncture delay %d, viterbi delay %d, viterbi swap %d, error rate %f (%f of median), metric %f%s\n", name().c_str(), unique_id(),
+			(int)d_hypotheses.size(), elapsed, h.matrix, (int)h.conjugate, h.rotation, h.puncture_delay, (int)h.viterbi_delay, (int)h.viterbi_swap, result.error_rate, best_ratio, result.metric, (locked ? " (locked)" : ""));
+	}
+
+	d_locked = locked;
+
+	pmt::pmt_t msg = pmt::make_dict();
+	msg = pmt::dict_add(msg, pmt::mp("matrix"), pmt::from_long(h.matrix));
+	msg = pmt::dict_add(msg, pmt::mp("conjugate"), pmt::from_bool(h.conjugate));
+	msg = pmt::dict_add(msg, pmt::mp("rotation"), pmt::from_long(h.rotation));
+	msg = pmt::dict_add(msg, pmt::mp("puncture_delay"), pmt::from_long(h.puncture_delay));
+	msg = pmt::dict_add(msg, pmt::mp("viterbi_delay"), pmt::from_bool(h.viterbi_delay));
+	msg = pmt::dict_add(msg, pmt::mp("viterbi_swap"), pmt::from_bool(h.viterbi_swap));
+	msg = pmt::dict_add(msg, pmt::mp("error_rate"), pmt::from_double(result.error_rate));
+	msg = pmt::dict_add(msg, pmt::mp("median_error_rate"), pmt::from_double(medians[h.matrix]));
+	msg = pmt::dict_add(msg, pmt::mp("metric"), pmt::from_double(result.metric));
+	msg = pmt::dict_add(msg, pmt::mp("hypotheses"), pmt::from_long(d_hypotheses.size()));
+	msg = pmt::dict_add(msg, pmt::mp("locked"), pmt::from_bool(locked));
+	message_port_pub(pmt::mp("xform"), msg);
+
+	d_busy = false;
+	d_job_ready.notify_all();
+}
+
+/*
+ * Same chain as auto_fec: conjugate -> rotate -> interleave I/Q -> delay (puncture)
+ * -> depuncture -> delay (Viterbi) -> swap, then a full-window Viterbi pass from an
+ * unknown start state, and a trace back that re-encodes the survivor path.
+ */
+void baz_fec_search::evaluate(const hypothesis& h, const std::vector<gr_complex>& symbols, scratch& s, score& result) const
+{
+	const std::vector<char>& matrix = d_matrices[h.matrix];
+	const int matrix_length = matrix.size();
+
+	std::vector<float>& delayed = s.delayed;
+	delayed.assign(h.puncture_delay, 0.0f);
+	for (size_t i = 0; i < symbols.size(); ++i)
+	{
+		gr_complex c = (h.conjugate ? std::conj(symbols[i]) : symbols[i]);
+		switch (h.rotation)
+		{
+			case 1: c = gr_complex(-c.imag(), c.real()); break;	// * j
+			case 2: c = -c; break;
+			case 3: c = gr_complex(c.imag(), -c.real()); break;	// * -j
+		}
+		delayed.push_back(c.real());
+		delayed.push_back(c.imag());
+	}
+
+	std::vector<float>& soft = s.soft;
+	soft.assign((h.viterbi_delay ? 1 : 0), 0.0f);
+	int index = 0;
+	for (size_t i = 0; i < delayed.size(); ++i)
+	{
+		while (matrix[index] == 0)
+		{
+			soft.push_back(0.0f);	// Erasure
+			index = (index + 1) % matrix_length;
+		}
+		soft.push_back(delayed[i]);
+		index = (index + 1) % matrix_length;
+	}
+
+	const int steps = soft.size() / 2;
+
+	if (h.viterbi_swap)
+	{
+		for (int t = 0; t < steps; ++t)
+			std::swap(soft[2*t], soft[2*t+1]);
+	}
+
+	std::vector<uint64_t>& decisions = s.decisions;
+	decisions.resize(steps);
+
+	float metrics[64], next[64];
+	std::fill(metrics, metrics + 64, 0.0f);
+
+	for (int t = 0; t < steps; ++t)
+	{
+		const float x0 = soft[2*t], x1 = soft[2*t+1];
+		const float branch[4] = { (-x0 - x1), (x0 - x1), (-x0 + x1), (x0 + x1) };	// Indexed by expected pair (positive soft symbol is a 1)
+
+		uint64_t decision = 0;
+		float best = -1e30f;
+		for (int state = 0; state < 64; ++state)
+		{
+			// Register is (previous state << 1) | input, and the next state is its low 6 bits
+			float m0 = metrics[state >> 1] + branch[d_outputs[state]];
+			float m1 = metrics[(state >> 1) | 32] + branch[d_outputs[state | 64]];
+			if (m1 > m0)
+			{
+				next[state] = m1;
+				decision |= ((uint64_t)1 << state);
+			}
+			else
+				next[state] = m0;
+
+			best = std::max(best, next[state]);
+		}
+
+		for (int state = 0; state < 64; ++state)
+			metrics[state] = next[state] - best;	// Keep the best at 0
+
+		decisions[t] = decision;
+	}
+
+	int state = 0;
+	for (int i = 1; i < 64; ++i)
+	{
+		if (metrics[i] > metrics[state])
+			state = i;
+	}
+
+	int errors = 0, compared = 0;
+	double path = 0.0, total = 0.0;
+	for (int t = steps - 1; t >= 0; --t)
+	{
+		int reg = state | ((decisions[t] >> state) & 1 ? 64 : 0);
+		int expected = d_outputs[reg];
+
+		for (int j = 0; j < 2; ++j)
+		{
+			float x = soft[2*t+j];
+			if (x == 0.0f)
+				continue;
+
+			bool bit = ((expected >> j) & 1);
+			if ((x > 0.0f) != bit)
+				++errors;
+			++compared;
+
+			path += (bit ? x : -x);
+			total += fabs(x);
+		}
+
+		state = reg >> 1;
+	}
+
+	result.error_rate = (compared ? ((float)errors / (float)compared) : 1.0f);
+	result.metric = (total > 0.0 ? (float)(path / total) : 0.0f);
+}
+
+int baz_fec_search::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	const gr_complex* in = (const gr_complex*)input_items[0];
+
+	boost::mutex::scoped_lock lock(d_mutex);
+
+	if ((d_locked) && (d_continuous == false))
+		return noutput_items;
+
+	int i = 0;
+	while (i < noutput_items)
+	{
+		int n = std::min(noutput_items - i, d_window_length - (int)d_window.size());
+		d_window.insert(d_window.end(), in + i, in + i + n);
+		i += n;
+
+		if ((int)d_window.size() < d_window_length)
+			break;
+
+		if ((d_busy) || (d_running == false) || (d_hypotheses.empty()))
+		{
+			++d_windows_skipped;	// Still searching the last one
+		}
+		else
+		{
+			d_job.swap(d_window);
+
+			d_busy = true;
+			d_next_hypothesis = 0;
+			d_done = 0;
+			d_job_start = boost::posix_time::microsec_clock::universal_time();
+			d_job_ready.notify_all();
+		}
+
+		d_window.clear();
+	}
+
+	return noutput_items;
+}
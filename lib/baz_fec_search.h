@@ -0,0 +1,182 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+
+#ifndef INCLUDED_BAZ_FEC_SEARCH_H
+#define INCLUDED_BAZ_FEC_SEARCH_H
+
+#include <gnuradio/sync_block.h>
+
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <vector>
+
+class BAZ_API baz_fec_search;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_fec_search> baz_fec_search_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_fec_search.
+ *
+ * To avoid accidental use of raw pointers, baz_fec_search's
+ * constructor is private.  baz_make_fec_search is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_fec_search_sptr baz_make_fec_search (int window_length, const std::vector<int>& matrix, float threshold = 0.5, int threads = 0, bool continuous = false, int poly_a = 0x4f, int poly_b = 0x6d, bool verbose = false);
+
+/*!
+ * \brief Parallel FEC parameter search (K=7 rate 1/2 convolutional code)
+ * \ingroup block
+ *
+ * Takes 'window_length' complex symbols (post MPSK receiver) and tries every combination
+ * of the transforms applied in auto_fec/fec_sync (conjugation, rotation, puncture delay,
+ * Viterbi delay & swap) for every puncture matrix on a pool of threads.
+ * When both polynomials have odd weight, 180/270 degrees only invert the decoded bits of
+ * 0/90 degrees, so just those two rotations are tried; otherwise all four are.
+ * Each hypothesis is depunctured, Viterbi decoded and re-encoded: its error rate is the
+ * fraction of (non-erased) soft symbols that disagree with the re-encoded best path.
+ * As wrong hypotheses of high-rate matrices still score low, the winner is the one with
+ * the lowest error rate relative to the median of its matrix, and lock is declared when
+ * that ratio is at or below 'threshold'.
+ *
+ * The best hypothesis of each window is published on 'xform' as a dict:
+ * matrix (index in the order added), conjugate, rotation (multiples of 90 degrees), puncture_delay, viterbi_delay,
+ * viterbi_swap, error_rate, median_error_rate, metric, hypotheses, locked.
+ * Unless 'continuous', searching stops once locked until reset() is called.
+ *
+ * Polynomials are in the same form as decode_ccsds_27_fb (POLYA/POLYB): negative inverts that output.
+ */
+class BAZ_API baz_fec_search : public gr::sync_block
+{
+private:
+	// The friend declaration allows baz_make_fec_search to
+	// access the private constructor.
+	friend BAZ_API baz_fec_search_sptr baz_make_fec_search (int window_length, const std::vector<int>& matrix, float threshold, int threads, bool continuous, int poly_a, int poly_b, bool verbose);
+
+	baz_fec_search (int window_length, const std::vector<int>& matrix, float threshold, int threads, bool continuous, int poly_a, int poly_b, bool verbose);  	// private constructor
+
+	struct hypothesis
+	{
+		int matrix;
+		bool conjugate;
+		int rotation;
+		int puncture_delay;
+		bool viterbi_delay;
+		bool viterbi_swap;
+	};
+
+	struct score
+	{
+		float error_rate;
+		float metric;	// Best path metric / sum of |soft symbol| (1 is perfect)
+	};
+
+	struct scratch
+	{
+		std::vector<float> delayed;
+		std::vector<float> soft;
+		std::vector<uint64_t> decisions;
+	};
+
+	int d_window_length;
+	float d_threshold;
+	int d_thread_count;
+	bool d_continuous;
+	bool d_verbose;
+	int d_rotations;
+	unsigned char d_outputs[128];	// Expected symbol pair for each 7-bit encoder register (bit 0: POLYA, bit 1: POLYB)
+
+	std::vector<std::vector<char> > d_matrices;
+	std::vector<hypothesis> d_hypotheses;
+	std::vector<score> d_scores;
+	std::vector<gr_complex> d_window;
+	std::vector<gr_complex> d_job;
+
+	boost::mutex d_mutex;
+	boost::condition_variable d_job_ready;
+	boost::thread_group d_workers;
+	bool d_running;
+	bool d_busy;
+	bool d_locked;
+	int d_next_hypothesis;
+	int d_done;
+	boost::posix_time::ptime d_job_start;
+
+	uint64_t d_search_count;
+	uint64_t d_windows_skipped;
+	float d_last_error_rate;
+
+	void build_hypotheses();
+	void worker();
+	void evaluate(const hypothesis& h, const std::vector<gr_complex>& symbols, scratch& s, score& result) const;
+	void finish_job();	// With d_mutex held
+public:
+	~baz_fec_search ();	// public destructor
+
+	void add_matrix(const std::vector<int>& matrix);
+	void clear_matrices();
+	int matrix_count();
+	int hypothesis_count();
+	int rotation_count() const
+	{ return d_rotations; }
+
+	void set_threshold(float threshold);
+	float threshold() const
+	{ return d_threshold; }
+	void set_continuous(bool continuous);
+	bool continuous() const
+	{ return d_continuous; }
+
+	void reset();	// Search again
+	bool locked() const
+	{ return d_locked; }
+	uint64_t search_count() const
+	{ return d_search_count; }
+	uint64_t windows_skipped() const
+	{ return d_windows_skipped; }
+	float last_error_rate() const
+	{ return d_last_error_rate; }
+
+	bool start();
+	bool stop();
+
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_FEC_SEARCH_H */
@@ -39,6 +39,9 @@
 #include <pmt/pmt.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
 //#include <typeinfo>
 
 /*
@@ -46,25 +49,67 @@
  * a boost shared_ptr.  This is effectively the public constructor.
  */
 baz_gate_sptr
-baz_make_gate (int item_size, bool block /*= true*/, float threshold /*= 0.0*/, int trigger_length /*= 0*/, bool tag /*= false*/, double delay /*= 0.0*/, int sample_rate /*= 0*/, bool no_delay /*= false*/, bool verbose /*= true*/, bool retriggerable /*= false*/)
+baz_make_gate (int item_size, bool block /*= true*/, float threshold /*= 0.0*/, int trigger_length /*= 0*/, bool tag /*= false*/, double delay /*= 0.0*/, int sample_rate /*= 0*/, bool no_delay /*= false*/, bool verbose /*= true*/, bool retriggerable /*= false*/, int channels /*= 1*/)
 {
-  return baz_gate_sptr (new baz_gate (item_size, block, threshold, trigger_length, tag, delay, sample_rate, no_delay, verbose, retriggerable));
+  return baz_gate_sptr (new baz_gate (item_size, block, threshold, trigger_length, tag, delay, sample_rate, no_delay, verbose, retriggerable, channels));
+}
+
+static gr::io_signature::sptr make_input_signature(int item_size, int channels)
+{
+  if (channels <= 1)
+    return gr::io_signature::make3 (2, 4, item_size, sizeof(/*char*/float), item_size);
+
+  std::vector<int> sizes(channels + 1, item_size);
+  sizes[1] = sizeof(float);
+
+  return gr::io_signature::makev (channels + 1, channels + 1, sizes);
+}
+
+static gr::io_signature::sptr make_output_signature(int item_size, int channels)
+{
+  if (channels <= 1)
+    return gr::io_signature::make2 (1, 2, item_size, item_size);
+
+  return gr::io_signature::make (channels, channels, item_size);
 }
 
 /*
  * The private constructor
  */
-baz_gate::baz_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable)
+baz_gate::baz_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable, int channels)
 	: gr::block ("gate",
-		gr::io_signature::make3 (2, 4, item_size, sizeof(/*char*/float), item_size),
-		gr::io_signature::make2 (1, 2, item_size, item_size))
-	, d_item_size(item_size), d_threshold(threshold), d_trigger_length(trigger_length), d_block(block), d_tag(tag), d_delay(delay), d_sample_rate(sample_rate), d_no_delay(no_delay)
+		make_input_signature(item_size, channels),
+		make_output_signature(item_size, channels))
+	, d_item_size(item_size), d_channels(std::max(channels, 1)), d_params_changed(false)
 	, d_trigger_count(0), d_time_offset(-1), d_in_burst(false), d_output_index(0), d_verbose(verbose), d_retriggerable(retriggerable)
 	, d_flush_length(0), d_flush_count(0)	// FIXME: Expose flush length
 {
+  if (item_size <= 0)
+    throw std::invalid_argument("gate: item size must be positive");
+
+  d_params.block = block;
+  d_params.threshold = threshold;
+  d_params.trigger_length = trigger_length;
+  d_params.tag = tag;
+  d_params.delay = delay;
+  d_params.sample_rate = sample_rate;
+  d_params.no_delay = no_delay;
+  d_staged = d_params;
+
+  switch (item_size)
+  {
+    case 4:	d_gate = &baz_gate::gate_items<4>;	break;
+    case 8:	d_gate = &baz_gate::gate_items<8>;	break;
+    case 16:	d_gate = &baz_gate::gate_items<16>;	break;
+    default:	d_gate = &baz_gate::gate_items<0>;	break;
+  }
+
+  d_ins.resize(std::max(d_channels, 2));
+  d_outs.resize(std::max(d_channels, 2));
+
   memset(&d_last_time, 0x00, sizeof(uhd::time_spec_t));
 
-  fprintf(stderr, "[%s<%i>] Threshold: %.1f, length: %d, item size: %d, blocking: %s, tag: %s, delay: %.6f, sample rate: %d, no delay: %s, verbose: %s, retriggerable: %s\n", name().c_str(), unique_id(), threshold, trigger_length, item_size, (block ? "yes" : "no"), (tag ? "yes" : "no"), delay, sample_rate, (no_delay ? "yes" : "no"), (verbose ? "yes" : "no"), (retriggerable ? "yes" : "no"));
+  fprintf(stderr, "[%s<%i>] Threshold: %.1f, length: %d, item size: %d, blocking: %s, tag: %s, delay: %.6f, sample rate: %d, no delay: %s, verbose: %s, retriggerable: %s, channels: %d\n", name().c_str(), unique_id(), threshold, trigger_length, item_size, (block ? "yes" : "no"), (tag ? "yes" : "no"), delay, sample_rate, (no_delay ? "yes" : "no"), (verbose ? "yes" : "no"), (retriggerable ? "yes" : "no"), d_channels);
 }
 
 /*
@@ -90,47 +135,62 @@ void baz_gate::forecast(int noutput_items, gr_vector_int &ninput_items_required)
 	}
 }
 
+// Setters only stage: work picks the whole set up at its next buffer boundary
+
 void baz_gate::set_blocking(bool enable)
 {
   fprintf(stderr, "[%s<%i>] Blocking: %s\n", name().c_str(), unique_id(), (enable ? "yes" : "no"));
   gr::thread::scoped_lock guard(d_mutex);
-  d_block = enable;
+  d_staged.block = enable;
+  d_params_changed = true;
 }
 
 void baz_gate::set_threshold(float threshold)
 {
   fprintf(stderr, "[%s<%i>] Threshold: %.1f\n", name().c_str(), unique_id(), threshold);
-  d_threshold = threshold;
+  gr::thread::scoped_lock guard(d_mutex);
+  d_staged.threshold = threshold;
+  d_params_changed = true;
 }
 
 void baz_gate::set_trigger_length(int trigger_length)
 {
   fprintf(stderr, "[%s<%i>] Length: %d\n", name().c_str(), unique_id(), trigger_length);
-  d_trigger_length = trigger_length;
+  gr::thread::scoped_lock guard(d_mutex);
+  d_staged.trigger_length = trigger_length;
+  d_params_changed = true;
 }
 
 void baz_gate::set_tagging(bool enable)
 {
   fprintf(stderr, "[%s<%i>] Tag: %s\n", name().c_str(), unique_id(), (enable ? "yes" : "no"));
-  d_tag = enable;
+  gr::thread::scoped_lock guard(d_mutex);
+  d_staged.tag = enable;
+  d_params_changed = true;
 }
 
 void baz_gate::set_delay(double delay)
 {
   fprintf(stderr, "[%s<%i>] Delay: %.6f\n", name().c_str(), unique_id(), delay);
-  d_delay = delay;
+  gr::thread::scoped_lock guard(d_mutex);
+  d_staged.delay = delay;
+  d_params_changed = true;
 }
 
 void baz_gate::set_sample_rate(int sample_rate)
 {
   fprintf(stderr, "[%s<%i>] Sample rate: %d\n", name().c_str(), unique_id(), sample_rate);
-  d_sample_rate = sample_rate;
+  gr::thread::scoped_lock guard(d_mutex);
+  d_staged.sample_rate = sample_rate;
+  d_params_changed = true;
 }
 
 void baz_gate::set_no_delay(bool no_delay)
 {
-  fprintf(stderr, "[%s<%i>] Delay: %.6f\n", name().c_str(), unique_id(), (no_delay ? "yes" : "no"));
-  d_no_delay = no_delay;
+  fprintf(stderr, "[%s<%i>] No delay: %s\n", name().c_str(), unique_id(), (no_delay ? "yes" : "no"));
+  gr::thread::scoped_lock guard(d_mutex);
+  d_staged.no_delay = no_delay;
+  d_params_changed = true;
 }
 
 static const pmt::pmt_t SOB_KEY = pmt::string_to_symbol("tx_sob");
@@ -139,70 +199,49 @@ static const pmt::pmt_t TX_TIME_KEY = pmt::string_to_symbol("tx_time");
 static const pmt::pmt_t RX_TIME_KEY = pmt::string_to_symbol("rx_time");
 static const pmt::pmt_t IGNORE_KEY = pmt::string_to_symbol("ignore");
 
-static bool _first = true;
-static gr_complex _first_c = gr_complex(-1,-1);
-
-int
-baz_gate::general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+template<size_t N>
+inline void baz_gate::copy_run(int in_start, int out_start, int n)
 {
-	gr::thread::scoped_lock guard(d_mutex);
-	
-	int work_eob_count = 0;
-	
-	//if (d_in_burst)
-	//	fprintf(stderr, "[%s] In burst (trigger count: %d)\n", name().c_str(), d_trigger_count);
-
-	const char *in = (char*)input_items[0];
-	const float *level = (float*)input_items[1];
-	char *out = (char*)output_items[0];
-	const char* thru = NULL;
-	if (input_items.size() >= 4)
-		thru = (const char*)input_items[3];
-	char* thru_out = NULL;
-	if (output_items.size() >= 2)
-		thru_out = (char*)output_items[1];
+	const size_t item_size = (N ? N : (size_t)d_item_size);
 	
-	////////////////////////////////////////////////////////////////////////////
-	
-	if (d_flush_count)
+	for (size_t c = 0; c < d_outs.size(); ++c)
 	{
-		int to_go = std::min(noutput_items, d_flush_count);
-		
-		if (d_flush_count == d_flush_length)
-		{
-			fprintf(stderr, "[%s<%i>] Starting flush at head of work (noutput_items: %d)\n", name().c_str(), unique_id(), noutput_items);
-			
-			add_item_tag(0, nitems_written(0), SOB_KEY, pmt::from_bool(true));
-			add_item_tag(0, nitems_written(0), IGNORE_KEY, pmt::from_bool(true));
-		}
-		
-		memset(out, 0x00, d_item_size * to_go);
-		if (thru_out)
-			memset(thru_out, 0x00, d_item_size * to_go);
+		if (d_outs[c] == NULL)
+			continue;
 		
-		//fprintf(stderr, "[%s<%i>] -\n", name().c_str(), unique_id());
-		
-		if (to_go == d_flush_count)
-		{
-			fprintf(stderr, "[%s<%i>] Finishing flush in work (noutput_items: %d, to_go: %d)\n", name().c_str(), unique_id(), noutput_items, to_go);
-			
-			add_item_tag(0, nitems_written(0)+to_go-1, EOB_KEY, pmt::from_bool(true));
-		}
-		
-		d_flush_count -= to_go;
-		
-		return to_go;
+		if (d_ins[c] == NULL)
+			memset(d_outs[c] + (out_start * item_size), 0x00, n * item_size);
+		else
+			memcpy(d_outs[c] + (out_start * item_size), d_ins[c] + (in_start * item_size), n * item_size);
 	}
+}
+
+template<size_t N>
+inline void baz_gate::zero_run(int out_start, int n)
+{
+	const size_t item_size = (N ? N : (size_t)d_item_size);
 	
-/*
-for (int k = 0; k < min(10,ninput_items[0]); ++k) {
-	gr_complex* c = (gr_complex*)(in + d_item_size * k);
-	fprintf(stderr, "\t-> %.5f,%.5f\n", )
-}*/
+	for (size_t c = 0; c < d_outs.size(); ++c)
+	{
+		if (d_outs[c] != NULL)
+			memset(d_outs[c] + (out_start * item_size), 0x00, n * item_size);
+	}
+}
 
-	////////////////////////////////////////////////////////////////////////////
+void baz_gate::zero_outputs(int out_start, int n)
+{
+	zero_run<0>(out_start, n);
+}
 
-	int tag_channel = ((ninput_items.size() >= 3) ? 2 : 1);
+/*
+ * One pass over the level input: per-item gate decisions (and burst tags on out 0),
+ * with items copied/zeroed in runs across every gated channel.
+ */
+template<size_t N>
+int baz_gate::gate_items(int noutput_items, const float* level, int tag_channel, int& work_eob_count)
+{
+	const params& p = d_params;
+	
 	const uint64_t nread = nitems_read(tag_channel);
 	std::vector<gr::tag_t> tags;
 
@@ -210,22 +249,18 @@ for (int k = 0; k < min(10,ninput_items[0]); ++k) {
 	uint64_t next_tag_offset = -1;
 	get_tags_in_range(tags, tag_channel, nread, nread + /*ninput_items[tag_channel]*/noutput_items, RX_TIME_KEY);
 	std::sort(tags.begin(), tags.end(), gr::tag_t::offset_compare);
-	for (int i = 0; i < tags.size(); ++i) {
-//		fprintf(stderr, "[%s] Tag #%d %s\n", name().c_str(), i, pmt::write_string(tags[i].key).c_str());
-	}
 	if (tags.size() > 0) {
 		next_tag_offset = tags[0].offset;
 //   	fprintf(stderr, "[%s] Tags: %d (next offset: %d)\n", name().c_str(), tags.size(), next_tag_offset);
 	}
 
-//fprintf(stderr, "[%s] Work %d, %d, %d\n", name().c_str(), noutput_items, ninput_items[0], ninput_items[1]);
-
-	int noutput = 0, j = 0;
+	int j = 0;
+	int run = RUN_NONE, run_in = 0, run_out = 0;
 	for (int i = 0; i < noutput_items; i++) {
 
 	////////////////////////////////////////////////////////////////////////////
 
-		if (next_tag_offset == (nitems_read(tag_channel) + i)) {
+		if (next_tag_offset == (nread + i)) {
 			gr::tag_t tag = tags[tag_index_offset++];	// Initially -1, so will start at 0
 
 			uint64_t _next = -1;
@@ -244,41 +279,28 @@ for (int k = 0; k < min(10,ninput_items[0]); ++k) {
 			++d_time_offset;
 
 	////////////////////////////////////////////////////////////////////////////
-//		gr_complex* c = (gr_complex*)(in + (i * d_item_size));
-//fprintf(stderr, "[%s] Sample %.1f, %.1f\n, level %.1f", name().c_str(), c->real(), c->imag(), level[i]);
-		if ((level[i] >= d_threshold) || (d_trigger_count > 0)) {
-			bool was_in_burst = d_in_burst;
-/*
-			tags.clear();
-			get_tags_in_range(tags, 0, nread+i, nread+i+1);
-			if (tags.size() > 0)
-				fprintf(stderr, "[%s] Tag offset %d\n", name().c_str(), tags[0].offset);
-*/
+
+		int action;
+		
+		if ((level[i] >= p.threshold) || (d_trigger_count > 0)) {
 			if (d_trigger_count > 0)
 				--d_trigger_count;
 			
-			if ((((d_trigger_count == 0) && (d_in_burst == false)) || (d_retriggerable)) && (level[i] >= d_threshold)) { // 'else' to avoid double trigger and offset in incoming repeating vector
+			if ((((d_trigger_count == 0) && (d_in_burst == false)) || (d_retriggerable)) && (level[i] >= p.threshold)) { // 'else' to avoid double trigger and offset in incoming repeating vector
 				if (d_verbose) {
 					fprintf(stderr, "[%s<%i>] Triggered: %.1f, current count: %d\n", name().c_str(), unique_id(), level[i], d_trigger_count);
 				}
 				
-				if (d_trigger_length > 0)
-					d_trigger_count = (d_trigger_length - 1);
-/*
-				uhd::tx_metadata_t md;
-				md.start_of_burst = true;
-				md.end_of_burst = false;
-				md.has_time_spec = true;
-				md.time_spec = uhd::time_spec_t(seconds_in_future);
-				add_item_tag(0, offset, key, value);
-*/
+				if (p.trigger_length > 0)
+					d_trigger_count = (p.trigger_length - 1);
+
 				if (d_in_burst == false) {
 					//assert(d_in_burst == false);  // FIXME: This can fail if changing d_tag at runtime
 
-					if (d_tag) {
+					if (p.tag) {
 						add_item_tag(0, nitems_written(0)+j, SOB_KEY, pmt::from_bool(true));
-						if (d_no_delay == false) {
-							uhd::time_spec_t next = (d_last_time + uhd::time_spec_t(0, d_time_offset, d_sample_rate)) + uhd::time_spec_t(d_delay);
+						if (p.no_delay == false) {
+							uhd::time_spec_t next = (d_last_time + uhd::time_spec_t(0, d_time_offset, p.sample_rate)) + uhd::time_spec_t(p.delay);
 							add_item_tag(0, nitems_written(0)+j, TX_TIME_KEY, pmt::make_tuple(pmt::from_uint64(next.get_full_secs()), pmt::from_double(next.get_frac_secs())));
 						}
 					}
@@ -287,15 +309,8 @@ for (int k = 0; k < min(10,ninput_items[0]); ++k) {
 				}
 			}
 			else if (d_trigger_count == 0) {
-/*
-				uhd::tx_metadata_t md;
-				md.start_of_burst = false;
-				md.end_of_burst = true;
-				md.has_time_spec = false;
-				add_item_tag(0, offset, key, value);
-*/
 				if (d_in_burst) {
-					if (d_tag) {
+					if (p.tag) {
 						if (d_verbose) {
 							fprintf(stderr, "[%s<%i>] EOB %d + %d\n", name().c_str(), unique_id(), nitems_written(0), j);
 						}
@@ -307,56 +322,115 @@ for (int k = 0; k < min(10,ninput_items[0]); ++k) {
 				}
 			}
 
-if (d_in_burst == false) {
-	gr_complex* c = (gr_complex*)(in + ((noutput-1) * d_item_size));
-	//fprintf(stderr, ">>> #%05d %.1f,%.1f (%d)\n", noutput, c->real(), c->imag(), d_trigger_count);
-}
+			action = RUN_COPY;
+		}
+		else if (p.block == false)
+			action = RUN_ZERO;
+		else
+			action = RUN_DROP;
 
-			memcpy(out + (j * d_item_size), in + (/*noutput*/i * d_item_size), d_item_size);
-			if (thru && thru_out)
-				memcpy(thru_out + (j * d_item_size), thru + (/*noutput*/i * d_item_size), d_item_size);
+	////////////////////////////////////////////////////////////////////////////
 
+		if (action != run) {
+			if (run == RUN_COPY)
+				copy_run<N>(run_in, run_out, i - run_in);
+			else if (run == RUN_ZERO)
+				zero_run<N>(run_out, i - run_in);
+			
+			run = action;
+			run_in = i;
+			run_out = j;
+		}
+		
+		if (action != RUN_DROP)
 			j++;
-			++noutput;
-
-			////////////////////////////////////////////////////////////////////
-			if ((d_in_burst || was_in_burst) && _first) {
-				gr_complex* c = (gr_complex*)(in + ((noutput-1) * d_item_size));
-          //if (*c != _first_c) {
-//            fprintf(stderr, "#%05d %.5f,%.5f (trig: %d, i: %d)\n", noutput, c->real(), c->imag(), d_trigger_count, i);
-          //  _first_c = *c;
-          //}
-			}
-			else if (d_in_burst == false && _first) {
-				gr_complex* c = (gr_complex*)(in + ((noutput-1) * d_item_size));
-//          	fprintf(stderr, "!!! #%05d %.1f,%.1f (%d)\n", noutput, c->real(), c->imag(), d_trigger_count);
-			}
-			if ((d_in_burst == false) && was_in_burst && _first)
-			_first = false;
+	}
+	
+	if (run == RUN_COPY)
+		copy_run<N>(run_in, run_out, noutput_items - run_in);
+	else if (run == RUN_ZERO)
+		zero_run<N>(run_out, noutput_items - run_in);
+	
+	return j;
+}
+
+int
+baz_gate::general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	if (d_params_changed)	// Buffer boundary: take the staged set as a whole
+	{
+		gr::thread::scoped_lock guard(d_mutex);
+		d_params = d_staged;
+		d_params_changed = false;
+	}
+	
+	int work_eob_count = 0;
+	
+	const float *level = (float*)input_items[1];
+	int tag_channel;
+	
+	if (d_channels > 1)
+	{
+		d_ins[0] = (const char*)input_items[0];
+		d_outs[0] = (char*)output_items[0];
+		for (int c = 1; c < d_channels; ++c)
+		{
+			d_ins[c] = (const char*)input_items[c + 1];
+			d_outs[c] = (char*)output_items[c];
 		}
+		
+		tag_channel = 1;
+	}
+	else
+	{
+		d_ins[0] = (const char*)input_items[0];
+		d_outs[0] = (char*)output_items[0];
+		d_ins[1] = ((input_items.size() >= 4) ? (const char*)input_items[3] : NULL);	// Thru
+		d_outs[1] = ((output_items.size() >= 2) ? (char*)output_items[1] : NULL);
+		
+		tag_channel = ((ninput_items.size() >= 3) ? 2 : 1);
+	}
+	
 	////////////////////////////////////////////////////////////////////////////
-		else if (d_block == false) {
-			memset(out + (j * d_item_size), 0x00, d_item_size);
-			if (thru_out)
-				memset(thru_out + (j * d_item_size), 0x00, d_item_size);
-			j++;
+	
+	if (d_flush_count)
+	{
+		int to_go = std::min(noutput_items, d_flush_count);
+		
+		if (d_flush_count == d_flush_length)
+		{
+			fprintf(stderr, "[%s<%i>] Starting flush at head of work (noutput_items: %d)\n", name().c_str(), unique_id(), noutput_items);
+			
+			add_item_tag(0, nitems_written(0), SOB_KEY, pmt::from_bool(true));
+			add_item_tag(0, nitems_written(0), IGNORE_KEY, pmt::from_bool(true));
+		}
+		
+		zero_outputs(0, to_go);
+		
+		if (to_go == d_flush_count)
+		{
+			fprintf(stderr, "[%s<%i>] Finishing flush in work (noutput_items: %d, to_go: %d)\n", name().c_str(), unique_id(), noutput_items, to_go);
+			
+			add_item_tag(0, nitems_written(0)+to_go-1, EOB_KEY, pmt::from_bool(true));
 		}
+		
+		d_flush_count -= to_go;
+		
+		return to_go;
 	}
+	
 	////////////////////////////////////////////////////////////////////////////
 
-	assert((d_block) || (j == noutput_items));    // Triggers if changed during work (no thread safety)
+	int j = (this->*d_gate)(noutput_items, level, tag_channel, work_eob_count);
+
+	assert((d_params.block) || (j == noutput_items));
 	/*if (noutput_items != ninput_items[1]) { // This is not true
 		fprintf(stderr, "[%s] noutput items: %d, gate control input items: %d\n", name().c_str(), noutput_items, ninput_items[1]);
 	}*/
 
-	consume(0, /*noutput*/noutput_items);
-	consume(1, noutput_items);
-	if (ninput_items.size() >= 3)
-		consume(2, noutput_items);
-	if (thru != NULL)
-		consume(3, noutput_items);
+	consume_each(noutput_items);	// Every input (signal(s), level, time, thru) advances together
 	
-	if ((d_block) && (d_in_burst == false) && (work_eob_count > 0) && (d_flush_length > 0))	// If we're blocking and had at least one EOB go out
+	if ((d_params.block) && (d_in_burst == false) && (work_eob_count > 0) && (d_flush_length > 0))	// If we're blocking and had at least one EOB go out
 	{
 		int remaining = noutput_items - j;
 		
@@ -367,9 +441,7 @@ if (d_in_burst == false) {
 			add_item_tag(0, nitems_written(0)+j, SOB_KEY, pmt::from_bool(true));
 			add_item_tag(0, nitems_written(0)+j, IGNORE_KEY, pmt::from_bool(true));
 			
-			memset(out + (j * d_item_size), 0x00, d_item_size * remaining);
-			if (thru_out)
-				memset(thru_out + (j * d_item_size), 0x00, d_item_size * remaining);
+			zero_outputs(j, remaining);
 			j += remaining;
 		}
 		
@@ -33,6 +33,8 @@
 #include <uhd/types/time_spec.hpp>
 #include <gnuradio/thread/thread.h>
 
+#include <vector>
+
 class BAZ_API baz_gate;
 
 /*
@@ -55,13 +57,18 @@ typedef boost::shared_ptr<baz_gate> baz_gate_sptr;
  * constructor is private.  howto_make_square2_ff is the public
  * interface for creating new instances.
  */
-BAZ_API baz_gate_sptr baz_make_gate (int item_size, bool block = true, float threshold = 1.0, int trigger_length = 0, bool tag = false, double delay = 0.0, int sample_rate = 0, bool no_delay = false, bool verbose = true, bool retriggerable = false);
+BAZ_API baz_gate_sptr baz_make_gate (int item_size, bool block = true, float threshold = 1.0, int trigger_length = 0, bool tag = false, double delay = 0.0, int sample_rate = 0, bool no_delay = false, bool verbose = true, bool retriggerable = false, int channels = 1);
 
 /*!
- * \brief square2 a stream of floats.
+ * \brief Gate one or more streams on a level input
  * \ingroup block
  *
- * This uses the preferred technique: subclassing gr::sync_block.
+ * Single channel (channels = 1): in 0 = signal, in 1 = level, optional in 2 = time tag source, optional in 3 = thru;
+ * out 0 = gated signal, optional out 1 = gated thru.
+ * Multi-channel (channels = N > 1): in 0 = signal 0, in 1 = level, in 2..N = signals 1..N-1; out 0..N-1.
+ * Every channel is gated identically in the same pass over the level input (rx_time and burst tags: level input / out 0).
+ *
+ * Setters stage their values: they take effect together at the start of the next work call.
  */
 class BAZ_API baz_gate : public gr::block
 {
@@ -69,29 +76,57 @@ private:
   // The friend declaration allows howto_make_square2_ff to
   // access the private constructor.
 
-  friend BAZ_API baz_gate_sptr baz_make_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable);
+  friend BAZ_API baz_gate_sptr baz_make_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable, int channels);
+
+  baz_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable, int channels);  	// private constructor
+
+  struct params
+  {
+    bool block;
+    float threshold;
+    int trigger_length;
+    bool tag;
+    double delay;
+    int sample_rate;
+    bool no_delay;
+  };
 
-  baz_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable);  	// private constructor
+  enum run_type
+  {
+    RUN_NONE,
+    RUN_COPY,	// Gate open
+    RUN_ZERO,	// Gate closed, not blocking
+    RUN_DROP	// Gate closed, blocking
+  };
+
+  typedef int (baz_gate::*gate_fn)(int noutput_items, const float* level, int tag_channel, int& work_eob_count);
+
+  // Fixed sizes let the compiler specialise the copy (0: any other size, uses d_item_size)
+  template<size_t N> inline void copy_run(int in_start, int out_start, int n);
+  template<size_t N> inline void zero_run(int out_start, int n);
+  template<size_t N> int gate_items(int noutput_items, const float* level, int tag_channel, int& work_eob_count);
 
   int d_item_size;
-  bool d_block;
-  float d_threshold;
-  int d_trigger_length;
+  int d_channels;
+  params d_params;	// Used by work
+  params d_staged;	// Written by setters (d_mutex)
+  volatile bool d_params_changed;
+  gate_fn d_gate;
+  std::vector<const char*> d_ins;	// Per gated channel for the current work call (NULL: no input, output zeroed)
+  std::vector<char*> d_outs;
   int d_trigger_count;
-  bool d_tag;
-  double d_delay;
   uhd::time_spec_t d_last_time;
   uint64_t d_time_offset;
-  int d_sample_rate;
   bool d_in_burst;
   int d_output_index;
-  bool d_no_delay;
   gr::thread::mutex d_mutex;
   bool d_verbose;
   bool d_retriggerable;
   int d_flush_length;
   int d_flush_count;
 
+  void zero_outputs(int out_start, int n);
+
 public:
   ~baz_gate ();	// public destructor
 
@@ -102,6 +137,8 @@ public:
   void set_delay(double delay);
   void set_sample_rate(int sample_rate);
   void set_no_delay(bool no_delay);
+  int channels() const
+  { return d_channels; }
 
   void forecast(int noutput_items, gr_vector_int &ninput_items_required);
 
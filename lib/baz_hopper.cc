@@ -37,8 +37,45 @@
 #include <baz_hopper.h>
 #include <gnuradio/io_signature.h>
 #include <pmt/pmt.h>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+double baz_hopper_device::clock()
+{
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+	
+	return ((double)(boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() * 1e-6);
+}
+
+class baz_multi_usrp_hopper_device : public baz_hopper_device
+{
+public:
+	baz_multi_usrp_hopper_device(::uhd::usrp::multi_usrp::sptr dev)
+		: d_dev(dev)
+	{ }
+	void tune_at(const uhd::time_spec_t& time, double freq)
+	{
+		d_dev->set_command_time(time);
+		uhd::tune_request_t tune_request = uhd::tune_request_t(freq);
+		d_dev->set_rx_freq(tune_request);
+		d_dev->clear_command_time();
+	}
+private:
+	::uhd::usrp::multi_usrp::sptr d_dev;
+};
+
+baz_hopper_device_sptr
+baz_make_hopper_device(::uhd::usrp::multi_usrp::sptr dev)
+{
+	if (not dev)
+		throw std::runtime_error("No USRP device");
+	
+	return baz_hopper_device_sptr(new baz_multi_usrp_hopper_device(dev));
+}
 
 /*
  * Create a new instance of baz_hopper and return
@@ -55,13 +92,39 @@ baz_make_hopper(
 		bool verbose /*= false*/
 )
 {
+	::gr::uhd::usrp_source::sptr usrp_src = boost::dynamic_pointer_cast< ::gr::uhd::usrp_source>(source);
+	if (not usrp_src)
+		throw std::runtime_error("Could not dynamic cast to USRP source");
+	
 	return baz_hopper_sptr(new baz_hopper(
 		item_size,
 		sample_rate,
 		chunk_length,
 		drop_length,
 		freqs,
-		source,
+		baz_make_hopper_device(usrp_src->get_device()),
+		verbose
+	));
+}
+
+baz_hopper_sptr
+baz_make_hopper_with_device(
+		size_t item_size,
+		int sample_rate,
+		int chunk_length,
+		int drop_length,
+		std::vector<std::vector<double> > freqs,
+		baz_hopper_device_sptr dev,
+		bool verbose /*= false*/
+)
+{
+	return baz_hopper_sptr(new baz_hopper(
+		item_size,
+		sample_rate,
+		chunk_length,
+		drop_length,
+		freqs,
+		dev,
 		verbose
 	));
 }
@@ -75,7 +138,7 @@ baz_hopper::baz_hopper(
 		int chunk_length,
 		int drop_length,
 		std::vector<std::vector<double> > freqs,
-		::gr::basic_block_sptr source,
+		baz_hopper_device_sptr dev,
 		bool verbose /*= false*/
 )
 	: gr::block("baz_hopper",
@@ -84,8 +147,11 @@ baz_hopper::baz_hopper(
 	, d_item_size(item_size), d_sample_rate(sample_rate), d_chunk_length(chunk_length), d_drop_length(drop_length)
 	, d_freqs(freqs), d_verbose(verbose)
 	, d_last_time_seconds(0), d_last_time_fractional_seconds(0)
-	, d_time_offset(-1), d_seen_time(false)
+	, d_time_offset(-1), d_dev(dev), d_seen_time(false)
+	, d_hop_head(0), d_hop_count(0)
 	, d_chunk_counter(0), d_freq_idx(0), d_zero_counter(0), d_reset(false)
+	, d_max_ahead(8), d_ahead(3)
+	, d_command_head(0), d_command_tail(0), d_command_latency(0), d_commands_issued(0), d_commands_dropped(0), d_command_generation(0), d_command_stop(false)
 {
 	fprintf(stderr, "[%s<%i>] item size: %d, sample rate: %d, chunk length: %d, drop length: %d, # freq sets: %d\n", name().c_str(), unique_id(),
 		item_size,
@@ -95,11 +161,8 @@ baz_hopper::baz_hopper(
 		freqs.size()
 	);
 	
-	::gr::uhd::usrp_source::sptr usrp_src = boost::dynamic_pointer_cast< ::gr::uhd::usrp_source>(source);
-	if (not usrp_src)
-		throw std::runtime_error("Could not dynamic cast to USRP source");
-	
-	d_dev = usrp_src->get_device();
+	if (not d_dev)
+		throw std::runtime_error("No USRP device");
 	
 	for (size_t i = 0; i < freqs.size(); ++i)
 	{
@@ -117,6 +180,141 @@ baz_hopper::baz_hopper(
  */
 baz_hopper::~baz_hopper ()
 {
+	stop();
+}
+
+bool baz_hopper::start()
+{
+	if (d_command_thread.joinable() == false)
+	{
+		d_command_stop = false;
+		d_command_thread = boost::thread(boost::bind(&baz_hopper::command_loop, this));
+	}
+	
+	return true;
+}
+
+bool baz_hopper::stop()
+{
+	if (d_command_thread.joinable())
+	{
+		d_command_stop = true;
+		d_command_cond.notify_one();
+		d_command_thread.join();
+	}
+	
+	return true;
+}
+
+void baz_hopper::set_max_ahead(int max_ahead)
+{
+	d_max_ahead = std::max(1, std::min(max_ahead, BAZ_HOPPER_RING_SIZE));
+}
+
+double baz_hopper::command_latency() const
+{
+	return ((double)__sync_fetch_and_add(const_cast<volatile uint64_t*>(&d_command_latency), 0) * 1e-9);
+}
+
+void baz_hopper::set_command_latency(double latency)
+{
+	__sync_lock_test_and_set(&d_command_latency, (uint64_t)std::max(llround(latency * 1e9), 1LL));
+	
+	update_ahead();
+}
+
+uint64_t baz_hopper::commands_issued() const
+{
+	return __sync_fetch_and_add(const_cast<volatile uint64_t*>(&d_commands_issued), 0);
+}
+
+uint64_t baz_hopper::commands_dropped() const
+{
+	return __sync_fetch_and_add(const_cast<volatile uint64_t*>(&d_commands_dropped), 0);
+}
+
+int baz_hopper::pending_commands() const
+{
+	return (int)(d_command_tail - d_command_head);
+}
+
+// Work thread only
+bool baz_hopper::queue_tune(const uhd::time_spec_t& time, double freq)
+{
+	const uint64_t tail = d_command_tail;
+	if ((tail - d_command_head) >= BAZ_HOPPER_RING_SIZE)
+		return false;
+	
+	tune_command& cmd = d_commands[tail & (BAZ_HOPPER_RING_SIZE - 1)];
+	cmd.time = time;
+	cmd.freq = freq;
+	cmd.generation = d_command_generation;
+	
+	__sync_synchronize();	// Slot must be visible before the tail moves
+	d_command_tail = tail + 1;
+	
+	d_command_cond.notify_one();
+	
+	return true;
+}
+
+// Issues the queued timed tunes, one control transaction at a time
+void baz_hopper::command_loop()
+{
+	while (true)
+	{
+		const uint64_t head = d_command_head;
+		__sync_synchronize();
+		
+		if (head == d_command_tail)
+		{
+			if (d_command_stop)
+				break;
+			
+			boost::mutex::scoped_lock lock(d_command_mutex);
+			if ((d_command_tail == head) && (d_command_stop == false))
+				d_command_cond.timed_wait(lock, boost::posix_time::milliseconds(1));	// Notify can race the check: poll as a fallback
+			
+			continue;
+		}
+		
+		const tune_command cmd = d_commands[head & (BAZ_HOPPER_RING_SIZE - 1)];
+		__sync_synchronize();
+		d_command_head = head + 1;	// Slot can be reused
+		
+		if (cmd.generation != d_command_generation)	// Its hop was cleared by a timestamp reset
+		{
+			__sync_fetch_and_add(&d_commands_dropped, 1);
+			continue;
+		}
+		
+		const double start = d_dev->clock();
+		
+		d_dev->tune_at(cmd.time, cmd.freq);
+		
+		int64_t latency = llround((d_dev->clock() - start) * 1e9);
+		int64_t smoothed = (int64_t)d_command_latency;
+		if (smoothed == 0)
+			smoothed = latency;
+		else
+			smoothed += (latency - smoothed) / 8;
+		
+		__sync_lock_test_and_set(&d_command_latency, (uint64_t)std::max(smoothed, (int64_t)1));
+		__sync_fetch_and_add(&d_commands_issued, 1);
+	}
+}
+
+// Hops to keep scheduled: enough that each queued tune has twice its latency in hand before its hop
+void baz_hopper::update_ahead()
+{
+	const double latency = command_latency();
+	const double hop_period = (double)(d_drop_length + d_chunk_length) / (double)d_sample_rate;
+	
+	int ahead = 3;	// Until the first tune has been timed
+	if ((latency > 0) && (hop_period > 0))
+		ahead = (int)ceil((2.0 * latency) / hop_period) + 1;
+	
+	d_ahead = std::max(std::min(2, d_max_ahead), std::min(ahead, d_max_ahead));
 }
 
 static const pmt::pmt_t RX_TIME_KEY = pmt::string_to_symbol("rx_time");
@@ -149,15 +347,14 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 	if (d_zero_counter > 0)
 	{
 		int to_copy = std::min(noutput_items, d_zero_counter);
-		uint64_t scheduled = d_scheduled[0];
-		uint64_t dest = d_dest[scheduled];
+		uint64_t scheduled = front_hop().time;
+		int dest = front_hop().dest;
 		memset(output_items[dest], 0x00, d_item_size * to_copy);
 		produce(dest, to_copy);
 		d_zero_counter -= to_copy;
 		if (d_zero_counter == 0)
 		{
-			d_scheduled.pop_front();
-			d_dest.erase(scheduled);
+			pop_hop();
 			fprintf(stderr, "[%s<%i>] Finished zeroing %lld\n", name().c_str(), unique_id(), scheduled);
 		}
 		return WORK_CALLED_PRODUCE;
@@ -256,7 +453,7 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 	{
 		d_reset = false;
 		
-		const double ahead_s = 0.01;	// MAGIC
+		const double ahead_s = std::max(0.01, 2.0 * d_ahead * command_latency());	// MAGIC (minimum)
 		
 		//uhd::time_spec_t prev_last_hop = d_last_hop;
 		
@@ -268,12 +465,12 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 		
 		if (d_chunk_counter == 0)	// If in chunk, then need to execute zeroing code first below
 		{
-			int currently_scheduled_count = d_scheduled.size();
+			int currently_scheduled_count = d_hop_count;
 			if (currently_scheduled_count > 0)
 			{
 				// We could zero fill up to next future existing scheduled chunk, but easier for now to dump them all and restart
 				
-				uint64_t last_scheduled = d_scheduled[currently_scheduled_count - 1];
+				uint64_t last_scheduled = d_hops[(d_hop_head + d_hop_count - 1) & (BAZ_HOPPER_RING_SIZE - 1)].time;
 				//uint64_t prev_last_hop_ticks = prev_last_hop.to_ticks(d_sample_rate);
 				uint64_t last_hop_ticks = d_last_hop.to_ticks(d_sample_rate);
 				if (last_scheduled > last_hop_ticks)
@@ -282,8 +479,8 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 					d_last_hop = uhd::time_spec_t::from_ticks(last_scheduled, d_sample_rate) + uhd::time_spec_t(ahead_s);	// MAGIC (could smaller - total tune transaction process time)
 				}
 				
-				d_scheduled.clear();
-				d_dest.clear();
+				d_hop_count = 0;
+				__sync_fetch_and_add(&d_command_generation, 1);	// Tunes still queued for the cleared hops are stale
 				
 				//d_freq_idx = (d_freq_idx - currently_scheduled_count) % (d_freq_dest.size());
 				d_freq_idx = (d_freq_idx - currently_scheduled_count);
@@ -295,8 +492,9 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 		}
 	}
 	
-	const size_t ahead_limit = 3;	// MAGIC (depends on FIFO depth)
-	while (d_scheduled.size() < ahead_limit)
+	update_ahead();
+	
+	while (d_hop_count < (size_t)d_ahead)
 	{
 		//const uint64_t ahead = (uint64_t)(ahead_d * (double)sample_rate);
 		
@@ -304,21 +502,16 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 		const double& freq = p.first;
 		const int& dest = p.second;
 		
-		d_freq_idx = (d_freq_idx + 1) % (d_freq_dest.size());
-		
 		uhd::time_spec_t next_hop = d_last_hop;
 		if (hop_time_reset == false)
 			next_hop += uhd::time_spec_t::from_ticks((d_drop_length + d_chunk_length), d_sample_rate);
 		
-		d_dev->set_command_time(next_hop);
-		uhd::tune_request_t tune_request = uhd::tune_request_t(freq);
-		d_dev->set_rx_freq(tune_request);
-		d_dev->clear_command_time();
+		if (queue_tune(next_hop, freq) == false)	// Command thread is behind: try again next time
+			break;
 		
-		uint64_t scheduled = next_hop.to_ticks(d_sample_rate);
+		d_freq_idx = (d_freq_idx + 1) % (d_freq_dest.size());
 		
-		d_scheduled.push_back(scheduled);
-		d_dest[scheduled] = dest;
+		push_hop(next_hop.to_ticks(d_sample_rate), dest);
 		hop_time_reset = false;
 		d_last_hop = next_hop;
 	}
@@ -328,14 +521,13 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 	uint64_t scheduled_offset = 0;
 	if (d_chunk_counter == 0)
 	{
-		while (d_scheduled.size() > 0)	// FIXME: if (not looping)
+		while (d_hop_count > 0)	// FIXME: if (not looping)
 		{
-			uint64_t scheduled = d_scheduled[0];
+			uint64_t scheduled = front_hop().time;
 			
 			if (scheduled < time_begin)	// Might have overrun
 			{
-				//d_scheduled.pop_front();
-				//d_dest.erase(scheduled);
+				//pop_hop();
 				fprintf(stderr, "[%s<%i>] Too late for %lld (begin: %lld, diff: %lld)\n", name().c_str(), unique_id(), scheduled, time_begin, (time_begin - scheduled));
 				//noutput_items = 0;
 				d_reset = true;	// Will cause it to be removed
@@ -360,7 +552,7 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 	
 	if ((d_chunk_counter > 0) && (scheduled_offset == 0))
 	{
-		uint64_t scheduled = d_scheduled[0];
+		uint64_t scheduled = front_hop().time;
 		
 		int done = (d_drop_length + d_chunk_length) - d_chunk_counter;
 		
@@ -378,7 +570,7 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 			}
 			else
 			{
-				uint64_t dest = d_dest[scheduled];
+				int dest = front_hop().dest;
 				
 				//fprintf(stderr, "[%s<%i>] Copying for %lld samples to %lld: %lld (done: %d)\n", name().c_str(), unique_id(), scheduled, dest, to_copy, done);
 				
@@ -390,8 +582,7 @@ int baz_hopper::general_work(int noutput_items, gr_vector_int &ninput_items, gr_
 			
 			if (d_chunk_counter == 0)
 			{
-				d_scheduled.pop_front();
-				d_dest.erase(scheduled);
+				pop_hop();
 				//fprintf(stderr, "[%s<%i>] Removed %lld (begin: %lld)\n", name().c_str(), unique_id(), scheduled, time_begin);
 			}
 			
@@ -38,6 +38,24 @@
 
 #include <gnuradio/uhd/usrp_source.h>
 
+/*!
+ * \brief Where baz_hopper sends its timed retunes
+ *
+ * baz_make_hopper_device wraps a multi_usrp. Anything else (e.g. a device that records the commands)
+ * can be handed to baz_make_hopper_with_device.
+ */
+class BAZ_API baz_hopper_device
+{
+public:
+	virtual ~baz_hopper_device() { }
+	virtual void tune_at(const uhd::time_spec_t& time, double freq) = 0;	// Returns once the device has the command
+	virtual double clock();	// Seconds, for timing each tune_at (host clock unless the device keeps its own)
+};
+
+typedef boost::shared_ptr<baz_hopper_device> baz_hopper_device_sptr;
+
+BAZ_API baz_hopper_device_sptr baz_make_hopper_device(::uhd::usrp::multi_usrp::sptr dev);
+
 class BAZ_API baz_hopper;
 typedef boost::shared_ptr<baz_hopper> baz_hopper_sptr;
 
@@ -51,9 +69,25 @@ BAZ_API baz_hopper_sptr baz_make_hopper(
 	bool verbose = false
 );
 
+// Same, but tuning 'dev' directly (e.g. a stand-in device for testing the hop schedule)
+BAZ_API baz_hopper_sptr baz_make_hopper_with_device(
+	size_t item_size,
+	int sample_rate,
+	int chunk_length,
+	int drop_length,
+	std::vector<std::vector<double> > freqs,
+	baz_hopper_device_sptr dev,
+	bool verbose = false
+);
+
+#define BAZ_HOPPER_RING_SIZE	64	// Power of two: scheduled hops, and tune commands waiting for the command thread
+
 /*!
  * \brief hop
  * \ingroup misc_blk
+ *
+ * Timed tunes are issued by a command thread (fed through a single-producer ring), so work never waits
+ * on a control transaction. The number of hops scheduled ahead follows the measured command latency.
  */
 class BAZ_API baz_hopper : public gr::block
 {
@@ -66,6 +100,15 @@ class BAZ_API baz_hopper : public gr::block
 		::gr::basic_block_sptr source,
 		bool verbose
 	);
+	friend BAZ_API baz_hopper_sptr baz_make_hopper_with_device(
+		size_t item_size,
+		int sample_rate,
+		int chunk_length,
+		int drop_length,
+		std::vector<std::vector<double> > freqs,
+		baz_hopper_device_sptr dev,
+		bool verbose
+	);
 
 	baz_hopper(
 		size_t item_size,
@@ -73,10 +116,23 @@ class BAZ_API baz_hopper : public gr::block
 		int chunk_length,
 		int drop_length,
 		std::vector<std::vector<double> > freqs,
-		::gr::basic_block_sptr source,
+		baz_hopper_device_sptr dev,
 		bool verbose = false
 	);
 
+	struct scheduled_hop
+	{
+		uint64_t time;	// Ticks
+		int dest;	// Output
+	};
+
+	struct tune_command
+	{
+		uhd::time_spec_t time;
+		double freq;
+		uint32_t generation;	// Hop schedule it belongs to
+	};
+
 	//boost::mutex d_mutex;
 	size_t d_item_size;
 	int d_sample_rate;
@@ -86,16 +142,41 @@ class BAZ_API baz_hopper : public gr::block
 	uint64_t d_last_time_seconds;
 	double d_last_time_fractional_seconds;
 	uint64_t d_time_offset;
-	::uhd::usrp::multi_usrp::sptr d_dev;
+	baz_hopper_device_sptr d_dev;
 	bool d_seen_time;
-	std::deque<uint64_t> d_scheduled;
-	std::map<uint64_t,uint64_t> d_dest;
+	scheduled_hop d_hops[BAZ_HOPPER_RING_SIZE];	// Ring, oldest at d_hop_head
+	size_t d_hop_head, d_hop_count;
 	int d_chunk_counter;
 	uhd::time_spec_t d_last_hop;
 	std::vector<std::pair<double,int> > d_freq_dest;
 	int d_freq_idx;
 	int d_zero_counter;
 	bool d_reset;
+	int d_max_ahead;
+	int d_ahead;	// Hops currently kept scheduled
+	// Command thread
+	tune_command d_commands[BAZ_HOPPER_RING_SIZE];
+	volatile uint64_t d_command_head;	// Consumer (command thread)
+	volatile uint64_t d_command_tail;	// Producer (work)
+	volatile uint64_t d_command_latency;	// ns, smoothed
+	volatile uint64_t d_commands_issued;
+	volatile uint64_t d_commands_dropped;
+	volatile uint32_t d_command_generation;	// Bumped when the hop schedule is thrown away
+	volatile bool d_command_stop;
+	boost::thread d_command_thread;
+	boost::mutex d_command_mutex;
+	boost::condition_variable d_command_cond;
+
+	inline const scheduled_hop& front_hop() const
+	{ return d_hops[d_hop_head]; }
+	inline void push_hop(uint64_t time, int dest)
+	{ scheduled_hop& h = d_hops[(d_hop_head + d_hop_count) & (BAZ_HOPPER_RING_SIZE - 1)]; h.time = time; h.dest = dest; ++d_hop_count; }
+	inline void pop_hop()
+	{ d_hop_head = (d_hop_head + 1) & (BAZ_HOPPER_RING_SIZE - 1); --d_hop_count; }
+
+	bool queue_tune(const uhd::time_spec_t& time, double freq);
+	void command_loop();
+	void update_ahead();
 
 public:
 	~baz_hopper();
@@ -103,6 +184,20 @@ public:
 	//int delay () const { return d_delay; }
 	//void set_delay (int delay);
 
+	void set_max_ahead(int max_ahead);	// Upper bound on hops scheduled ahead (device command FIFO depth)
+	int max_ahead() const
+	{ return d_max_ahead; }
+	int ahead() const
+	{ return d_ahead; }
+	double command_latency() const;	// Seconds per timed tune (smoothed)
+	void set_command_latency(double latency);	// Seeds the estimate (e.g. known from a previous run)
+	uint64_t commands_issued() const;
+	uint64_t commands_dropped() const;	// Queued for a hop schedule that was since reset
+	int pending_commands() const;	// Queued, not yet sent to the device
+
+	bool start();
+	bool stop();
+
 	void forecast(int noutput_items, gr_vector_int &ninput_items_required);
 	int general_work(int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
 };
@@ -39,6 +39,10 @@
 
 #include <stdio.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
 /*
  * Create a new instance of baz_native_callback_x and return
  * a boost shared_ptr.  This is effectively the public constructor.
@@ -70,10 +74,12 @@ baz_native_callback_x::baz_native_callback_x (int size, baz_native_callback_targ
   : gr::sync_block ("native_callback_x",
 		   gr::io_signature::make (MIN_IN, MAX_IN, size),
 		   gr::io_signature::make (MIN_OUT, MAX_OUT, 0))
-  , d_size(size), d_target(target), d_threshold_enable(threshold_enable), d_threshold_level(threshold_level)
+  , d_size(size), d_target_ptr(NULL), d_threshold_enable(threshold_enable), d_threshold_level(threshold_level)
   , d_triggered(false), d_samples_processed(0)
 {
   fprintf(stderr, "[%s] Size: %d, threshold enabled: %s (%.1f)\n", name().c_str(), size, (threshold_enable ? "yes" : "no"), threshold_level);
+
+  set_target(target);
 }
 
 /*
@@ -90,7 +96,12 @@ void baz_native_callback_x::set_size(int size)
 
 void baz_native_callback_x::set_target(baz_native_callback_target_sptr target)
 {
-    d_target = target;
+  baz_native_callback_target* p = dynamic_cast<baz_native_callback_target*>(target.get());
+  if ((target) && (p == NULL))
+    fprintf(stderr, "[%s] Target is not a native callback target\n", name().c_str());
+
+  d_target = target;  // Keeps 'd_target_ptr' alive
+  d_target_ptr = p;
 }
 
 void baz_native_callback_x::set_threshold_enable(bool enable)
@@ -103,6 +114,38 @@ void baz_native_callback_x::set_threshold_level(float threshold_level)
   d_threshold_level = threshold_level;
 }
 
+// Index of first sample at or above 'level' in [start, end), or 'end'
+static inline int find_rising(const float* in, int start, int end, float level)
+{
+  int i = start;
+#ifdef __SSE2__
+  const __m128 l = _mm_set1_ps(level);
+  for (; (i + 4) <= end; i += 4) {
+    int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(in + i), l));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif // __SSE2__
+  for (; (i < end) && !(in[i] >= level); ++i);
+  return i;
+}
+
+// Index of first sample below 'level' in [start, end), or 'end'
+static inline int find_falling(const float* in, int start, int end, float level)
+{
+  int i = start;
+#ifdef __SSE2__
+  const __m128 l = _mm_set1_ps(level);
+  for (; (i + 4) <= end; i += 4) {
+    int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(in + i), l));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif // __SSE2__
+  for (; (i < end) && !(in[i] < level); ++i);
+  return i;
+}
+
 int
 baz_native_callback_x::work (int noutput_items,
 			gr_vector_const_void_star &input_items,
@@ -110,23 +153,45 @@ baz_native_callback_x::work (int noutput_items,
 {
   const float *in = (const float*) input_items[0];  // FIXME
 
-  for (int i = 0; i < noutput_items; i++) {
-    bool trigger = false;
-
-    if ((d_triggered == false) && (in[i] >= d_threshold_level)) {
-      trigger = d_triggered = true;
-      //fprintf(stderr, "[%s] Triggered\n", name().c_str());
-    }
-    else if ((d_triggered) && (in[i] < d_threshold_level)) {
-      d_triggered = false;
-    }
+  if (d_threshold_enable == false) {
+    if (d_target_ptr)
+      d_target_ptr->callback_batch(in, noutput_items, d_samples_processed);
 
-    if ((d_threshold_enable == false) || (trigger)) {
-      dynamic_cast<baz_native_callback_target*>(d_target.get())->callback(in[i], d_samples_processed); // FIXME: Could use return value for one-shot/continuous/re-trigger
+    // Trigger state after any sample is simply whether it was at or above the level (NaNs leave it unchanged)
+    int last = noutput_items - 1;
+    while ((last >= 0) && (in[last] != in[last]))
+      --last;
+    if (last >= 0)
+      d_triggered = (in[last] >= d_threshold_level);
+  }
+  else {
+    // Only visit the edges: callback on rising, re-arm on falling
+    int i = 0;
+    while (i < noutput_items) {
+      if (d_triggered == false) {
+        i = find_rising(in, i, noutput_items, d_threshold_level);
+        if (i == noutput_items)
+          break;
+
+        d_triggered = true;
+        //fprintf(stderr, "[%s] Triggered\n", name().c_str());
+
+        if (d_target_ptr)
+          d_target_ptr->callback(in[i], d_samples_processed + i); // FIXME: Could use return value for one-shot/continuous/re-trigger
+      }
+      else {
+        i = find_falling(in, i, noutput_items, d_threshold_level);
+        if (i == noutput_items)
+          break;
+
+        d_triggered = false;
+      }
+
+      ++i;
     }
-
-    ++d_samples_processed;
   }
 
+  d_samples_processed += noutput_items;
+
   return noutput_items;
 }
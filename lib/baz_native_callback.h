@@ -48,7 +48,14 @@ typedef boost::shared_ptr<baz_native_callback_x> baz_native_callback_x_sptr;
 class BAZ_API baz_native_callback_target
 {
 public:
+  virtual ~baz_native_callback_target() {}
   virtual void callback(float f, unsigned long samples_processed)=0; // FIXME: Item size
+  // Called once per work with 'count' samples, the first of which is 'samples_processed' (default: per-sample callback)
+  virtual void callback_batch(const float* f, int count, unsigned long samples_processed)
+  {
+    for (int i = 0; i < count; ++i)
+      callback(f[i], samples_processed + i);
+  }
 };
 
 //typedef boost::shared_ptr<baz_native_callback_target> baz_native_callback_target_sptr;
@@ -81,6 +88,7 @@ private:
 
   int d_size;
   baz_native_callback_target_sptr d_target;
+  baz_native_callback_target* d_target_ptr;  // Cast once when target is set
   bool d_threshold_enable;
   float d_threshold_level;
 
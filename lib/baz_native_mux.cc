@@ -38,6 +38,8 @@
 #include <gnuradio/io_signature.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 //#include <typeinfo>
 
 /*
@@ -60,6 +62,7 @@ baz_native_mux::baz_native_mux (int item_size, int input_count, int trigger_coun
   , d_item_size(item_size), d_input_count(input_count), d_trigger_count(trigger_count)
   , d_selected_input(0), d_trigger_countdown(0), d_value_index(0)
   , d_last_noutput_items(0)
+  , d_samples_processed(0)
 {
   fprintf(stderr, "[%s] Trigger count %d\n", name().c_str(), trigger_count);
 
@@ -68,6 +71,8 @@ baz_native_mux::baz_native_mux (int item_size, int input_count, int trigger_coun
   d_values.push_back(1.3);
 }
 
+static const unsigned long SWITCH_LATENCY = 16384*2*2*2 + 2048; // samples
+
 void baz_native_mux::callback(float f, unsigned long samples_processed)
 {/*
   int i = (int)f;
@@ -90,11 +95,48 @@ void baz_native_mux::callback(float f, unsigned long samples_processed)
   }
   //fprintf(stderr, "[%s] Selecting input %d (countdown: %d)\n", name().c_str(), d_selected_input, d_trigger_countdown);
 */
-  const unsigned long latency = 16384*2*2*2 + 2048; // samples
-  d_switch_time.push_back(samples_processed + latency);
+  gr::thread::scoped_lock guard(d_pending_mutex);
+
+  d_pending_switch.push_back(samples_processed + SWITCH_LATENCY);
   //fprintf(stderr, "[%s] Scheduling %d (sample: %d, local: %d)\n", name().c_str(), (samples_processed + latency), samples_processed, d_samples_processed);
 }
 
+void baz_native_mux::callback_batch(const float* f, int count, unsigned long samples_processed)
+{
+  gr::thread::scoped_lock guard(d_pending_mutex);
+
+  d_pending_switch.reserve(d_pending_switch.size() + count);
+  for (int i = 0; i < count; ++i)
+    d_pending_switch.push_back(samples_processed + i + SWITCH_LATENCY);
+}
+
+void baz_native_mux::schedule_switch(unsigned long time)
+{
+  if ((d_switch_time.empty()) || (d_switch_time.back() <= time))
+    d_switch_time.push_back(time);  // Usual case: callbacks arrive in order
+  else
+    d_switch_time.insert(std::upper_bound(d_switch_time.begin(), d_switch_time.end(), time), time);
+}
+
+// Drop switch times that have passed and apply one due now
+void baz_native_mux::apply_switch_times()
+{
+  while ((d_switch_time.empty() == false) && (d_switch_time.front() < d_samples_processed))
+  {
+    unsigned long next_time = d_switch_time.front();
+    fprintf(stderr, "[%s] Late %d (processed: %lu, next time: %lu)\n", name().c_str(), ((int)d_samples_processed - (int)next_time), d_samples_processed, next_time);
+    d_switch_time.pop_front();
+  }
+
+  if ((d_switch_time.empty() == false) && (d_switch_time.front() == d_samples_processed))
+  {
+    d_selected_input = 1;
+    d_trigger_countdown = d_trigger_count;
+    d_value_index = (d_value_index + 1) % d_values.size();
+    d_switch_time.pop_front();
+  }
+}
+
 /*
  * Our virtual destructor.
  */
@@ -122,53 +164,53 @@ baz_native_mux::general_work (int noutput_items,
         fprintf(stderr, "[%s] Not enough input items\n", name().c_str());
   }
 
-  for (int i = 0; i < noutput_items; i++) {
+  {
+    gr::thread::scoped_lock guard(d_pending_mutex);
 
-    /////////////////////////////////////////////
+    for (size_t j = 0; j < d_pending_switch.size(); ++j)
+      schedule_switch(d_pending_switch[j]);
 
-    for (int j = 0; j < d_switch_time.size(); ++j)
-    {
-      unsigned long next_time = d_switch_time[j];
-      if (next_time < d_samples_processed)
-      {
-        fprintf(stderr, "[%s] Late %d (processed: %d, next time: %d)\n", name().c_str(), ((int)d_samples_processed - (int)next_time), d_samples_processed, next_time);
-        d_switch_time.erase(d_switch_time.begin());
-        --j;
-        continue;
-      }
-      else if (next_time > d_samples_processed)
-        break;
-
-      d_selected_input = 1;
-      d_trigger_countdown = d_trigger_count;
-      d_value_index = (d_value_index + 1) % d_values.size();
-      d_switch_time.erase(d_switch_time.begin());
-      break;
-    }
+    d_pending_switch.clear();
+  }
 
-    /////////////////////////////////////////////
+  // Copy runs of the selected input, stopping only at switch instants and when the trigger countdown expires
+  int i = 0;
+  while (i < noutput_items) {
+
+    apply_switch_times();
+
+    int run = noutput_items - i;
+
+    if (d_switch_time.empty() == false)
+      run = std::min((unsigned long)run, std::max(d_switch_time.front() - d_samples_processed, 1UL));
 
     if (d_trigger_count > -1) {
       if (d_trigger_countdown == 0)
         d_selected_input = 0;
-      else
-        --d_trigger_countdown;
+      else {
+        run = std::min(run, d_trigger_countdown);
+        d_trigger_countdown -= run;
+      }
     }
 
     const char *in = (char*)input_items[d_selected_input];
-    memcpy(out + (i * d_item_size), in + (i * d_item_size), d_item_size);
+    memcpy(out + (i * d_item_size), in + (i * d_item_size), run * d_item_size);
 
     /////////////////////////////////////////////
     if (d_selected_input == 1)
     {
-        float* f = (float*)(out + (i * d_item_size));
+      for (int j = 0; j < run; ++j)
+      {
+        float* f = (float*)(out + ((i + j) * d_item_size));
         *f = d_values[d_value_index];
+      }
     }
     /////////////////////////////////////////////
 
-    used[d_selected_input] += 1;
+    used[d_selected_input] += run;
 
-    ++d_samples_processed;
+    i += run;
+    d_samples_processed += run;
   }
 
   consume(0, noutput_items);
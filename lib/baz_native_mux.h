@@ -29,8 +29,11 @@
 #define INCLUDED_BAZ_NATIVE_MUX_H
 
 #include <gnuradio/sync_block.h>
+#include <gnuradio/thread/thread.h>
 #include <baz_native_callback.h>
 
+#include <deque>
+
 class BAZ_API baz_native_mux;
 
 /*
@@ -81,7 +84,12 @@ private:
   int d_last_noutput_items;
 
   unsigned long d_samples_processed;
-  std::vector<unsigned long> d_switch_time;
+  std::deque<unsigned long> d_switch_time;      // Sorted, only touched in work
+  std::vector<unsigned long> d_pending_switch;  // Filled by callbacks, merged at start of work
+  gr::thread::mutex d_pending_mutex;
+
+  void schedule_switch(unsigned long time);
+  void apply_switch_times();
 
  public:
   ~baz_native_mux ();	// public destructor
@@ -92,6 +100,7 @@ private:
 
 public:
   void callback(float f, unsigned long samples_processed);
+  void callback_batch(const float* f, int count, unsigned long samples_processed);
 };
 
 #endif /* INCLUDED_BAZ_NATIVE_MUX_H */
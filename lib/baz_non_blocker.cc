@@ -36,8 +36,13 @@
 
 #include <baz_non_blocker.h>
 #include <gnuradio/io_signature.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
 //#include <typeinfo>
 
 /*
@@ -45,22 +50,35 @@
  * a boost shared_ptr.  This is effectively the public constructor.
  */
 baz_non_blocker_sptr
-baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking /*= false*/)
+baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking /*= false*/, int high_watermark /*= 0*/, int low_watermark /*= 0*/, int overload_mode /*= 0*/, int decimation /*= 2*/)
 {
-  return baz_non_blocker_sptr (new baz_non_blocker (item_size, /*queue, */blocking));
+  return baz_non_blocker_sptr (new baz_non_blocker (item_size, /*queue, */blocking, high_watermark, low_watermark, overload_mode, decimation));
 }
 
 /*
  * The private constructor
  */
-baz_non_blocker::baz_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking)
+baz_non_blocker::baz_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking, int high_watermark, int low_watermark, int overload_mode, int decimation)
   : gr::block ("non_blocker",
 		   gr::io_signature::make (1, 1, item_size),
 		   gr::io_signature::make (1, 1, item_size))
   , d_item_size(item_size), /*d_queue(queue), */d_blocking(blocking)
   , d_blocking_forecasted(blocking)
+  , d_high_watermark(0), d_low_watermark(0)
+  , d_input_capacity(0)
+  , d_overload_mode(OVERLOAD_DROP_OLDEST), d_decimation(2)
+  , d_overloaded(false)
+  , d_pending_drop(0)
+  , d_dropped(0), d_drop_events(0)
+  , d_filled(0), d_fill_events(0)
+  , d_overloads(0)
+  , d_drop_tag(pmt::mp("drop")), d_fill_tag(pmt::mp("fill"))
 {
-  fprintf(stderr, "[%s] Blocking: %s\n", name().c_str(), (blocking ? "yes" : "no"));
+  set_watermarks(high_watermark, low_watermark);
+  set_overload_mode(overload_mode);
+  set_decimation(decimation);
+
+  fprintf(stderr, "[%s] Blocking: %s, watermarks: %d/%d, overload: %s (decimation: %d)\n", name().c_str(), (blocking ? "yes" : "no"), d_high_watermark, d_low_watermark, ((d_overload_mode == OVERLOAD_DECIMATE) ? "decimate" : "drop oldest"), d_decimation);
 }
 
 /*
@@ -77,6 +95,60 @@ void baz_non_blocker::set_blocking(bool enable /*= true*/)
   d_blocking = enable;
 }
 
+void baz_non_blocker::set_watermarks(int high, int low)
+{
+  if (high < 0)
+    high = 0;
+  if ((d_input_capacity > 0) && (high >= d_input_capacity))
+  {
+    fprintf(stderr, "[%s] High watermark %d can never be exceeded (input buffer holds %d items): using %d\n", name().c_str(), high, d_input_capacity, (d_input_capacity - 1));
+    high = d_input_capacity - 1;
+  }
+  if ((low < 0) || (low > high))
+    low = high / 2;
+
+  d_high_watermark = high;
+  d_low_watermark = low;
+
+  if (high == 0)
+    d_overloaded = false;
+}
+
+bool baz_non_blocker::start()
+{
+  d_input_capacity = detail()->input(0)->max_possible_items_available();
+
+  set_watermarks(d_high_watermark, d_low_watermark);  // Now the input buffer is known
+
+  return true;
+}
+
+void baz_non_blocker::set_overload_mode(int mode)
+{
+  if ((mode != OVERLOAD_DROP_OLDEST) && (mode != OVERLOAD_DECIMATE))
+    throw std::invalid_argument("non_blocker: unknown overload mode");
+
+  d_overload_mode = mode;
+}
+
+void baz_non_blocker::set_decimation(int decimation)
+{
+  d_decimation = std::max(decimation, 2);
+}
+
+void baz_non_blocker::reset_stats()
+{
+  d_dropped = d_drop_events = 0;
+  d_filled = d_fill_events = 0;
+  d_overloads = 0;
+}
+
+void baz_non_blocker::tag_drop(uint64_t item)
+{
+  add_item_tag(0, item, d_drop_tag, pmt::from_uint64(d_pending_drop), pmt::mp(alias()));
+  d_pending_drop = 0;
+}
+
 /*
     Problem is can't change from blocking back to non-blocking when upstream is blocked:
     - runtime will be waiting for more samples to arrive before calling 'forecast'
@@ -104,28 +176,72 @@ baz_non_blocker::general_work (int noutput_items,
 {
   const char *in = (char*)input_items[0];
   char *out = (char*)output_items[0];
+  const int available = ninput_items[0];
+  const uint64_t nwritten = nitems_written(0);
+
+  if (d_high_watermark > 0)
+  {
+    if ((d_overloaded == false) && (available > d_high_watermark))
+    {
+      d_overloaded = true;
+      ++d_overloads;
+      fprintf(stderr, "[%s] Overloaded: %d items waiting (#%llu)\n", name().c_str(), available, (unsigned long long)d_overloads);
+    }
+    else if ((d_overloaded) && (available <= d_low_watermark))
+      d_overloaded = false;
+  }
+
+  int skip = 0;  // Oldest items discarded before copying
+  int step = 1;
+  if (d_overloaded)
+  {
+    if (d_overload_mode == OVERLOAD_DECIMATE)
+      step = d_decimation;
+    else
+      skip = std::max(available - noutput_items - d_low_watermark, 0);  // Leave no more than the low watermark after this call
+  }
 
-  //for (int i = 0; i < noutput_items; i++) {
-  //  memcpy(out + (i * d_item_size), in + (i * d_item_size), d_item_size);
-  //}
+  const int remaining = available - skip;
+  const int to_copy = std::min(noutput_items, ((remaining + step - 1) / step));
+  int consumed;
 
-  if ((d_blocking_forecasted) && (noutput_items <= ninput_items[0]))
+  if (step == 1)
   {
-    memcpy(out, in, d_item_size * noutput_items);
-    consume(0, noutput_items);
+    memcpy(out, in + (skip * d_item_size), d_item_size * to_copy);
+    consumed = skip + to_copy;
   }
   else
   {
-    //if (d_blocking_forecasted)    // This will happen when blocking but upstream is blocked
-    //  fprintf(stderr, "[%s] Not enough items (%d requested, %d available)\n", name().c_str(), noutput_items, ninput_items[0]);
-    int to_copy = std::min(noutput_items, ninput_items[0]); // Should always be the latter
-    if (/*ninput_items[0]*/to_copy > 0) {  // Although forecast requires 0, this still continually consumes samples
-      //fprintf(stderr, "[%s] Discarding %d unused items\n", name().c_str(), ninput_items[0]);  // FIXME: Could output these...
-      memcpy(out, in, d_item_size * to_copy);
-      consume(0, ninput_items[0]);
-    }
+    for (int i = 0; i < to_copy; ++i)
+      memcpy(out + (i * d_item_size), in + (i * step * d_item_size), d_item_size);
+    consumed = std::min(to_copy * step, remaining);
+  }
+
+  // Without watermarks, keep the original behaviour: whatever didn't fit is discarded
+  if ((d_high_watermark == 0) && ((d_blocking_forecasted == false) || (noutput_items > available)))
+    consumed = available;
+
+  const int discarded = consumed - skip - to_copy;  // Decimated away, or left over after this call's output
+  if ((skip + discarded) > 0)
+  {
+    d_dropped += (skip + discarded);
+    ++d_drop_events;
+  }
+
+  d_pending_drop += skip;
+  if (d_pending_drop > 0)
+    tag_drop(nwritten);
+  d_pending_drop += discarded;  // Tagged on the next call's first item
+
+  if (to_copy < noutput_items)
+  {
     memset(out + (to_copy * d_item_size), 0x00, d_item_size * (noutput_items - to_copy));
+    add_item_tag(0, nwritten + to_copy, d_fill_tag, pmt::from_uint64(noutput_items - to_copy), pmt::mp(alias()));
+    d_filled += (noutput_items - to_copy);
+    ++d_fill_events;
   }
 
+  consume(0, consumed);
+
   return noutput_items;
 }
@@ -53,13 +53,22 @@ typedef boost::shared_ptr<baz_non_blocker> baz_non_blocker_sptr;
  * constructor is private.  howto_make_square2_ff is the public
  * interface for creating new instances.
  */
-BAZ_API baz_non_blocker_sptr baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking = false);
+BAZ_API baz_non_blocker_sptr baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking = false, int high_watermark = 0, int low_watermark = 0, int overload_mode = 0, int decimation = 2);
 
 /*!
- * \brief square2 a stream of floats.
+ * \brief Always produces what downstream asks for, zero-filling when input runs short
  * \ingroup block
  *
- * This uses the preferred technique: subclassing gr::sync_block.
+ * Without watermarks (high_watermark 0) any input beyond what fits in the output is
+ * discarded, as before.  With them, the number of items waiting on the input decides:
+ * above 'high_watermark' the block is overloaded until the backlog falls to
+ * 'low_watermark'.  The backlog is bounded by the upstream buffer, so once running a
+ * high watermark it could never exceed is lowered to fit (with a warning).  Overloaded, it either discards the oldest items so that no more than
+ * the low watermark is left waiting after each call (OVERLOAD_DROP_OLDEST), or keeps one
+ * in 'decimation' (OVERLOAD_DECIMATE).
+ * The first item written after items were discarded carries a 'drop' tag (uint64 items
+ * discarded since the last one: when decimating, those from the previous call), and the
+ * first zero inserted carries a 'fill' tag (uint64 zeros).  Both are counted.
  */
 class BAZ_API baz_non_blocker : public gr::block
 {
@@ -67,15 +76,33 @@ private:
   // The friend declaration allows howto_make_square2_ff to
   // access the private constructor.
 
-  friend BAZ_API baz_non_blocker_sptr baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking);
+  friend BAZ_API baz_non_blocker_sptr baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking, int high_watermark, int low_watermark, int overload_mode, int decimation);
 
-  baz_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking);  	// private constructor
+  baz_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking, int high_watermark, int low_watermark, int overload_mode, int decimation);  	// private constructor
 
   int d_item_size;
   //gr::msg_queue::sptr d_queue;
   bool d_blocking, d_blocking_forecasted;
+  int d_high_watermark, d_low_watermark;
+  int d_input_capacity;  // Most items that can ever be waiting (0 until started)
+  int d_overload_mode;
+  int d_decimation;
+  bool d_overloaded;
+  uint64_t d_pending_drop;  // Not yet tagged (discarded after the last item written)
+  uint64_t d_dropped, d_drop_events;
+  uint64_t d_filled, d_fill_events;
+  uint64_t d_overloads;
+  pmt::pmt_t d_drop_tag, d_fill_tag;
+
+  void tag_drop(uint64_t item);
 
 public:
+  enum overload_mode_t
+  {
+    OVERLOAD_DROP_OLDEST  = 0,
+    OVERLOAD_DECIMATE     = 1
+  };
+
   ~baz_non_blocker ();	// public destructor
 
   int general_work (int noutput_items, gr_vector_int &ninput_items,
@@ -84,7 +111,34 @@ public:
 
   void forecast(int noutput_items, gr_vector_int &ninput_items_required);
 
+  bool start();
+
   void set_blocking(bool enable = true);
+  void set_watermarks(int high, int low);
+  void set_overload_mode(int mode);
+  void set_decimation(int decimation);
+
+  inline int high_watermark() const
+  { return d_high_watermark; }
+  inline int low_watermark() const
+  { return d_low_watermark; }
+  inline int overload_mode() const
+  { return d_overload_mode; }
+  inline int decimation() const
+  { return d_decimation; }
+  inline bool overloaded() const
+  { return d_overloaded; }
+  inline uint64_t dropped_count() const
+  { return d_dropped; }
+  inline uint64_t drop_events() const
+  { return d_drop_events; }
+  inline uint64_t filled_count() const
+  { return d_filled; }
+  inline uint64_t fill_events() const
+  { return d_fill_events; }
+  inline uint64_t overload_count() const
+  { return d_overloads; }
+  void reset_stats();
 };
 
 #endif /* INCLUDED_BAZ_NATIVE_MUX_H */
@@ -0,0 +1,536 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_papr.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#define HISTOGRAM_MIN_DB	(-200.0)
+#define HISTOGRAM_MAX_DB	(100.0)
+
+/*
+ * Moving average, window/envelope reduction and histogram for one contiguous run of samples.
+ * Input m yields the centred moving average for sample m - half.
+ */
+struct baz_papr::accumulator
+{
+	int window;
+	int envelope_window;
+	int average;
+	int half;	// (average - 1) / 2, as numpy.convolve(..., 'same')
+	double bin_scale;	// Bins per dB
+	// Moving average
+	std::vector<float> ring;
+	size_t ring_pos;
+	double running;
+	uint64_t inputs;
+	// Reduction
+	double window_sum;
+	int window_fill;
+	float block_max;	// |x|^2
+	int block_fill;
+	std::vector<float> power;
+	std::vector<float> envelope;
+	std::vector<uint64_t> histogram;
+	uint64_t count;
+	double power_sum;
+	double magnitude_sum;
+	float min_magnitude;
+	float max_magnitude;
+
+	accumulator(int window_, int envelope_window_, int average_, double resolution)
+		: window(window_)
+		, envelope_window(envelope_window_)
+		, average(average_)
+		, half((average_ - 1) / 2)
+		, bin_scale(1.0 / resolution)
+		, ring(average_, 0.0f)
+		, histogram((size_t)ceil((HISTOGRAM_MAX_DB - HISTOGRAM_MIN_DB) * bin_scale), 0)
+		, count(0)
+		, power_sum(0)
+		, magnitude_sum(0)
+		, min_magnitude(0)
+		, max_magnitude(0)
+	{
+		restart();
+	}
+
+	// Forget moving average & partial window/block (results are kept)
+	void restart()
+	{
+		std::fill(ring.begin(), ring.end(), 0.0f);
+		ring_pos = 0;
+		running = 0;
+		inputs = 0;
+		window_sum = 0;
+		window_fill = 0;
+		block_max = 0;
+		block_fill = 0;
+	}
+
+	inline void stats(float p)
+	{
+		float magnitude = sqrtf(p);
+
+		if (count == 0)
+			min_magnitude = max_magnitude = magnitude;
+		else
+		{
+			min_magnitude = std::min(min_magnitude, magnitude);
+			max_magnitude = std::max(max_magnitude, magnitude);
+		}
+
+		++count;
+		power_sum += p;
+		magnitude_sum += magnitude;
+
+		int bin = 0;
+		if (p > 0)
+			bin = std::max(0, std::min((int)histogram.size() - 1, (int)floor(((10.0 * log10f(p)) - HISTOGRAM_MIN_DB) * bin_scale)));
+		++histogram[bin];
+
+		block_max = std::max(block_max, p);
+		if (++block_fill == envelope_window)
+		{
+			envelope.push_back(sqrtf(block_max));
+			block_max = 0;
+			block_fill = 0;
+		}
+	}
+
+	inline void input(float p, bool emit)
+	{
+		running += (double)p - (double)ring[ring_pos];
+		ring[ring_pos] = p;
+		if (++ring_pos == ring.size())
+			ring_pos = 0;
+		++inputs;
+
+		if (emit == false)
+			return;
+
+		window_sum += std::max(running, 0.0) / (double)average;	// Guard against rounding below zero
+		if (++window_fill == window)
+		{
+			power.push_back((float)(window_sum / (double)window));
+			window_sum = 0;
+			window_fill = 0;
+		}
+	}
+
+	// Live stream: every sample counts
+	inline void push(float p)
+	{
+		stats(p);
+		input(p, (inputs >= (uint64_t)half));
+	}
+
+	// Zero-pad the end of the stream
+	void flush()
+	{
+		for (int i = 0; i < half; ++i)
+			input(0.0f, (inputs >= (uint64_t)half));
+	}
+
+	// Samples [begin, end) of 'data' (length 'length'), with enough either side for the moving average
+	template<typename T>
+	void process(const T* data, uint64_t length, uint64_t begin, uint64_t end)
+	{
+		uint64_t first = (((begin + half) >= (uint64_t)(average - 1)) ? (begin + half - (average - 1)) : 0);
+		uint64_t last = std::min(end + half, length);
+
+		for (uint64_t m = first; m < last; ++m)
+		{
+			float i = (float)data[2 * m], q = (float)data[(2 * m) + 1];
+			float p = (i * i) + (q * q);
+
+			if ((m >= begin) && (m < end))
+				stats(p);
+
+			input(p, (m >= (begin + half)));
+		}
+
+		for (uint64_t m = std::max(last, first); m < (end + half); ++m)
+			input(0.0f, (m >= (begin + half)));
+	}
+
+	// Appends a following run's results
+	void append(const accumulator& next)
+	{
+		power.insert(power.end(), next.power.begin(), next.power.end());
+		envelope.insert(envelope.end(), next.envelope.begin(), next.envelope.end());
+
+		for (size_t i = 0; i < histogram.size(); ++i)
+			histogram[i] += next.histogram[i];
+
+		if (next.count > 0)
+		{
+			min_magnitude = ((count > 0) ? std::min(min_magnitude, next.min_magnitude) : next.min_magnitude);
+			max_magnitude = ((count > 0) ? std::max(max_magnitude, next.max_magnitude) : next.max_magnitude);
+		}
+
+		count += next.count;
+		power_sum += next.power_sum;
+		magnitude_sum += next.magnitude_sum;
+	}
+};
+
+/*
+ * Create a new instance of baz_papr and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_papr_sptr baz_make_papr (int window /*= 2048*/, int envelope_window /*= 0*/, int average /*= 128*/, double resolution /*= 0.05*/, int history /*= 0*/)
+{
+	return baz_papr_sptr (new baz_papr (window, envelope_window, average, resolution, history));
+}
+
+/*
+ * The private constructor
+ */
+baz_papr::baz_papr (int window, int envelope_window, int average, double resolution, int history)
+	: gr::sync_block ("papr",
+		gr::io_signature::make (1, 1, sizeof(gr_complex)),
+		gr::io_signature::make (0, 0, 0))
+	, d_window(window)
+	, d_envelope_window((envelope_window > 0) ? envelope_window : window)
+	, d_average(average)
+	, d_resolution(resolution)
+	, d_history(std::max(history, 0))
+	, d_acc(NULL)
+	, d_windows_dropped(0)
+{
+	if (d_window <= 0)
+		throw std::invalid_argument("papr: window must be positive");
+	if ((d_envelope_window % d_window) != 0)
+		throw std::invalid_argument("papr: envelope window must be a multiple of the window");
+	if (d_average <= 0)
+		throw std::invalid_argument("papr: moving average length must be positive");
+	if ((d_resolution <= 0) || (d_resolution > 10))
+		throw std::invalid_argument("papr: histogram resolution must be in (0, 10] dB");
+
+	d_acc = new accumulator(d_window, d_envelope_window, d_average, d_resolution);
+
+	fprintf(stderr, "[%s<%i>] window: %d, envelope window: %d, moving average: %d, resolution: %f dB, history: %d\n", name().c_str(), unique_id(),
+		d_window, d_envelope_window, d_average, d_resolution, d_history);
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_papr::~baz_papr ()
+{
+	delete d_acc;
+}
+
+void baz_papr::reset()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	delete d_acc;
+	d_acc = new accumulator(d_window, d_envelope_window, d_average, d_resolution);
+	d_windows_dropped = 0;
+}
+
+static void analyse_chunk(baz_papr::accumulator* acc, const void* data, int format, uint64_t length, uint64_t begin, uint64_t end)
+{
+	if (format == baz_papr::FORMAT_COMPLEX_SHORT)
+		acc->process((const int16_t*)data, length, begin, end);
+	else
+		acc->process((const float*)data, length, begin, end);
+}
+
+uint64_t baz_papr::analyse_file(const std::string& path, int format /*= FORMAT_COMPLEX_FLOAT*/, uint64_t offset /*= 0*/, uint64_t count /*= 0*/, int threads /*= 0*/)
+{
+#ifdef _WIN32
+	throw std::runtime_error("papr: file analysis is not supported on this platform");
+#else
+	size_t item_size;
+	switch (format)
+	{
+		case FORMAT_COMPLEX_FLOAT:	item_size = 2 * sizeof(float);		break;
+		case FORMAT_COMPLEX_SHORT:	item_size = 2 * sizeof(int16_t);	break;
+		default:
+			throw std::invalid_argument("papr: unknown sample format");
+	}
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "[%s<%i>] failed to open \"%s\": %s\n", name().c_str(), unique_id(), path.c_str(), strerror(errno));
+		throw std::runtime_error("papr: failed to open file");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		throw std::runtime_error("papr: failed to stat file");
+	}
+
+	uint64_t items = (uint64_t)st.st_size / item_size;
+	if (offset >= items)
+	{
+		close(fd);
+		throw std::invalid_argument("papr: offset is beyond the end of the file");
+	}
+	if ((count == 0) || (count > (items - offset)))
+		count = items - offset;
+
+	size_t map_length = (size_t)((offset + count) * item_size);
+	void* map = mmap(NULL, map_length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);	// Mapping holds its own reference
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr, "[%s<%i>] failed to map \"%s\": %s\n", name().c_str(), unique_id(), path.c_str(), strerror(errno));
+		throw std::runtime_error("papr: failed to map file");
+	}
+	madvise(map, map_length, MADV_SEQUENTIAL);
+
+	const char* data = (const char*)map + (offset * item_size);
+
+	if (threads <= 0)
+		threads = std::max((int)boost::thread::hardware_concurrency(), 1);
+
+	// Chunks start on envelope window boundaries, so windows never straddle two
+	uint64_t blocks = (count + d_envelope_window - 1) / d_envelope_window;
+	uint64_t chunk = ((blocks + threads - 1) / threads) * d_envelope_window;
+	int chunks = (int)((count + chunk - 1) / chunk);
+
+	std::vector<accumulator*> parts(chunks);
+	boost::thread_group workers;
+	for (int i = 0; i < chunks; ++i)
+	{
+		parts[i] = new accumulator(d_window, d_envelope_window, d_average, d_resolution);
+		uint64_t begin = (uint64_t)i * chunk;
+		workers.create_thread(boost::bind(&analyse_chunk, parts[i], data, format, count, begin, std::min(begin + chunk, count)));
+	}
+	workers.join_all();
+
+	munmap(map, map_length);
+
+	accumulator* result = new accumulator(d_window, d_envelope_window, d_average, d_resolution);
+	for (int i = 0; i < chunks; ++i)
+	{
+		result->append(*parts[i]);
+		delete parts[i];
+	}
+
+	gr::thread::scoped_lock guard(d_mutex);
+
+	delete d_acc;
+	d_acc = result;
+	d_windows_dropped = 0;
+
+	fprintf(stderr, "[%s<%i>] analysed %llu samples of \"%s\" in %d chunks: %lu windows\n", name().c_str(), unique_id(), (unsigned long long)count, path.c_str(), chunks, (unsigned long)d_acc->power.size());
+
+	return count;
+#endif // _WIN32
+}
+
+// Keeps the newest 'history' windows (whole envelope windows are dropped), once twice that has built up
+void baz_papr::trim_history()
+{
+	if ((d_history == 0) || (d_acc->power.size() < (size_t)(2 * d_history)))
+		return;
+
+	const size_t repeat = d_envelope_window / d_window;
+	size_t blocks = std::min((d_acc->power.size() - d_history) / repeat, d_acc->envelope.size());
+
+	d_acc->power.erase(d_acc->power.begin(), d_acc->power.begin() + (blocks * repeat));
+	d_acc->envelope.erase(d_acc->envelope.begin(), d_acc->envelope.begin() + blocks);
+	d_windows_dropped += blocks * repeat;
+}
+
+uint64_t baz_papr::sample_count()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return d_acc->count;
+}
+
+uint64_t baz_papr::windows_dropped()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return d_windows_dropped;
+}
+
+double baz_papr::mean_power()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return ((d_acc->count > 0) ? (d_acc->power_sum / (double)d_acc->count) : 0.0);
+}
+
+double baz_papr::mean_magnitude()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return ((d_acc->count > 0) ? (d_acc->magnitude_sum / (double)d_acc->count) : 0.0);
+}
+
+float baz_papr::min_magnitude()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return d_acc->min_magnitude;
+}
+
+float baz_papr::max_magnitude()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return d_acc->max_magnitude;
+}
+
+std::vector<float> baz_papr::power()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return d_acc->power;
+}
+
+std::vector<float> baz_papr::envelope()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	return d_acc->envelope;
+}
+
+std::vector<float> baz_papr::papr()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	const size_t repeat = d_envelope_window / d_window;
+	size_t n = std::min(d_acc->power.size(), d_acc->envelope.size() * repeat);
+
+	std::vector<float> ratio(n);
+	for (size_t j = 0; j < n; ++j)
+	{
+		float peak = d_acc->envelope[j / repeat];
+		ratio[j] = (peak * peak) / d_acc->power[j];	// Silent window: inf/NaN (as numpy)
+	}
+
+	return ratio;
+}
+
+std::vector<float> baz_papr::ccdf_levels()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	std::vector<float> levels;
+	if ((d_acc->count == 0) || (d_acc->power_sum <= 0))
+		return levels;
+
+	const double mean_db = 10.0 * log10(d_acc->power_sum / (double)d_acc->count);
+	const int first = std::max(0, (int)floor((mean_db - HISTOGRAM_MIN_DB) * d_acc->bin_scale));
+
+	int last = (int)d_acc->histogram.size() - 1;
+	while ((last > first) && (d_acc->histogram[last] == 0))
+		--last;
+
+	for (int b = first; b <= last; ++b)
+		levels.push_back((float)((HISTOGRAM_MIN_DB + ((double)b / d_acc->bin_scale)) - mean_db));
+
+	return levels;
+}
+
+std::vector<float> baz_papr::ccdf()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	std::vector<float> probability;
+	if ((d_acc->count == 0) || (d_acc->power_sum <= 0))
+		return probability;
+
+	const double mean_db = 10.0 * log10(d_acc->power_sum / (double)d_acc->count);
+	const int first = std::max(0, (int)floor((mean_db - HISTOGRAM_MIN_DB) * d_acc->bin_scale));
+
+	int last = (int)d_acc->histogram.size() - 1;
+	while ((last > first) && (d_acc->histogram[last] == 0))
+		--last;
+
+	probability.resize(last - first + 1);
+	uint64_t above = 0;
+	for (int b = (int)d_acc->histogram.size() - 1; b >= first; --b)
+	{
+		above += d_acc->histogram[b];
+		if (b <= last)
+			probability[b - first] = (float)((double)above / (double)d_acc->count);
+	}
+
+	return probability;
+}
+
+bool baz_papr::stop()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_acc->flush();	// Completes the last windows' moving average
+	trim_history();
+	d_acc->restart();
+
+	return true;
+}
+
+int baz_papr::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	const gr_complex* in = (const gr_complex*)input_items[0];
+
+	gr::thread::scoped_lock guard(d_mutex);
+
+	for (int i = 0; i < noutput_items; ++i)
+		d_acc->push(std::norm(in[i]));
+
+	trim_history();
+
+	return noutput_items;
+}
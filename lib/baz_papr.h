@@ -0,0 +1,136 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_PAPR_H
+#define INCLUDED_BAZ_PAPR_H
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/thread/thread.h>
+
+#include <vector>
+#include <string>
+
+class BAZ_API baz_papr;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_papr> baz_papr_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_papr.
+ *
+ * To avoid accidental use of raw pointers, baz_papr's
+ * constructor is private.  baz_make_papr is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_papr_sptr baz_make_papr (int window = 2048, int envelope_window = 0, int average = 128, double resolution = 0.05, int history = 0);
+
+/*!
+ * \brief Single-pass PAPR/CCDF analyser (native back end of apps/papr.py)
+ * \ingroup block
+ *
+ * Either runs as a complex sink on a live stream, or analyses a capture in place with
+ * analyse_file (memory-mapped, split into chunks analysed in parallel).  In one pass:
+ *  - power: mean of the moving average (length 'average', centred, zero-padded at the ends)
+ *    of |x|^2 over each 'window' samples,
+ *  - envelope: max |x| over each 'envelope_window' samples (a multiple of 'window', 0: same),
+ *  - papr: envelope^2 / power for each window (its envelope window's peak),
+ *  - CCDF of instantaneous power relative to the mean power, from a histogram of
+ *    |x|^2 in dB with 'resolution' dB bins.
+ * Incomplete windows at the end are left out.  A live stream keeps at most 'history'
+ * windows (0: everything); the moving average's last average/2 samples are zero-padded
+ * when the flowgraph stops.
+ */
+class BAZ_API baz_papr : public gr::sync_block
+{
+public:
+	enum sample_format {
+		FORMAT_COMPLEX_FLOAT = 0,        // Interleaved float I/Q (numpy 'c8')
+		FORMAT_COMPLEX_SHORT = 1         // Interleaved int16 I/Q (raw counts)
+	};
+
+	struct accumulator;
+private:
+	// The friend declaration allows baz_make_papr to
+	// access the private constructor.
+	friend BAZ_API baz_papr_sptr baz_make_papr (int window, int envelope_window, int average, double resolution, int history);
+
+	baz_papr (int window, int envelope_window, int average, double resolution, int history);  	// private constructor
+
+	int d_window;
+	int d_envelope_window;
+	int d_average;
+	double d_resolution;
+	int d_history;
+	gr::thread::mutex d_mutex;
+	accumulator* d_acc;	// Results (and live stream state)
+	uint64_t d_windows_dropped;	// Windows before the first kept (history)
+
+	void trim_history();
+public:
+	~baz_papr ();	// public destructor
+
+	int window() const
+	{ return d_window; }
+	int envelope_window() const
+	{ return d_envelope_window; }
+	int average() const
+	{ return d_average; }
+	double resolution() const
+	{ return d_resolution; }
+
+	// Replaces the results with those of 'count' items ('format') from 'offset' items into
+	// 'path' (count 0: to the end).  Returns the number of samples analysed.
+	uint64_t analyse_file(const std::string& path, int format = FORMAT_COMPLEX_FLOAT, uint64_t offset = 0, uint64_t count = 0, int threads = 0);
+	void reset();
+
+	uint64_t sample_count();
+	uint64_t windows_dropped();
+	double mean_power();
+	double mean_magnitude();
+	float min_magnitude();
+	float max_magnitude();
+	std::vector<float> power();
+	std::vector<float> envelope();
+	std::vector<float> papr();
+	std::vector<float> ccdf_levels();	// dB above mean power (bin lower edges)
+	std::vector<float> ccdf();	// Fraction of samples at or above each level
+
+	bool stop();
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_PAPR_H */
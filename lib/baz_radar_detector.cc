@@ -35,9 +35,15 @@
 #endif
 
 #include <baz_radar_detector.h>
+#include <baz_shared_page.h>
 #include <gnuradio/io_signature.h>
 
 #include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 
 /*
  * Create a new instance of baz_radar_detector and return
@@ -82,8 +88,18 @@ baz_radar_detector::baz_radar_detector (int sample_rate, gr::msg_queue::sptr msg
 	, d_skip(0)
 	, d_pulse_plateau(1.0)
 	, d_last(0.0)
+	, d_flat_sum(0.0)
+	, d_in_plateau(false)
+	, d_flat_sum_count(0)
+	, d_pdw_batch(0)
+	, d_pdw_count(0)
+	, d_pdw_ring(NULL)
+	, d_pdw_ring_length(0)
 {
 	fprintf(stderr, "[%s<%i>] sample rate: %i\n", name().c_str(), unique_id(), sample_rate);
+
+	d_pdw_port_id = pmt::mp("pdw");
+	message_port_register_out(d_pdw_port_id);
 }
 
 /*
@@ -91,6 +107,119 @@ baz_radar_detector::baz_radar_detector (int sample_rate, gr::msg_queue::sptr msg
  */
 baz_radar_detector::~baz_radar_detector ()
 {
+	close_pdw_ring();
+}
+
+bool baz_radar_detector::stop()
+{
+	gr::thread::scoped_lock guard(d_pdw_mutex);
+
+	flush_descriptors();
+
+	return true;
+}
+
+void baz_radar_detector::set_pdw_batch(int batch)
+{
+	gr::thread::scoped_lock guard(d_pdw_mutex);
+
+	d_pdw_batch = std::max(batch, 0);
+
+	if (d_pdw_batch > 0)
+		d_pdw_pending.reserve(d_pdw_batch);
+}
+
+void baz_radar_detector::close_pdw_ring()
+{
+	baz_unmap_shared_page(d_pdw_ring, d_pdw_ring_length);
+
+	d_pdw_ring = NULL;
+	d_pdw_ring_length = 0;
+	d_pdw_ring_path.clear();
+}
+
+bool baz_radar_detector::set_pdw_ring(const std::string& path, int capacity /*= 4096*/)
+{
+	gr::thread::scoped_lock guard(d_pdw_mutex);
+
+	close_pdw_ring();
+
+	if (path.empty())
+		return true;
+#ifdef _WIN32
+	fprintf(stderr, "[%s<%i>] PDW ring not supported on this platform\n", name().c_str(), unique_id());
+	return false;
+#else
+	if (capacity <= 0)
+	{
+		fprintf(stderr, "[%s<%i>] invalid PDW ring capacity: %i\n", name().c_str(), unique_id(), capacity);
+		return false;
+	}
+
+	const size_t data_offset = 64;	// Keep slots cache-line aligned
+	size_t length = data_offset + ((size_t)capacity * sizeof(pulse_descriptor));
+
+	std::string error;
+	void* p = baz_map_shared_page(path, length, error);
+	if (p == NULL)
+	{
+		fprintf(stderr, "[%s<%i>] PDW ring: %s\n", name().c_str(), unique_id(), error.c_str());
+		return false;
+	}
+
+	d_pdw_ring = (pdw_ring_header*)p;
+	d_pdw_ring->version = PDW_RING_VERSION;
+	d_pdw_ring->descriptor_size = sizeof(pulse_descriptor);
+	d_pdw_ring->capacity = capacity;
+	d_pdw_ring->data_offset = data_offset;
+	d_pdw_ring->sample_rate = d_sample_rate;
+	d_pdw_ring->write_count = 0;
+	__sync_synchronize();
+	d_pdw_ring->magic = PDW_RING_MAGIC;	// Last, so a consumer never sees a half-initialised header
+
+	d_pdw_ring_length = length;
+	d_pdw_ring_path = path;
+
+	fprintf(stderr, "[%s<%i>] PDW ring \"%s\": %i descriptors\n", name().c_str(), unique_id(), path.c_str(), capacity);
+
+	return true;
+#endif // _WIN32
+}
+
+void baz_radar_detector::emit_descriptor(const pulse_descriptor& pd)
+{
+	++d_pdw_count;
+
+	if (d_pdw_ring)
+	{
+		uint64_t count = d_pdw_ring->write_count;
+		pulse_descriptor* slots = (pulse_descriptor*)((char*)d_pdw_ring + d_pdw_ring->data_offset);
+		slots[count % d_pdw_ring->capacity] = pd;
+		__sync_synchronize();	// Slot contents must be visible before the count moves
+		d_pdw_ring->write_count = count + 1;
+	}
+
+	d_pdw_pending.push_back(pd);
+
+	if ((d_pdw_batch > 0) && ((int)d_pdw_pending.size() >= d_pdw_batch))
+		flush_descriptors();
+}
+
+void baz_radar_detector::flush_descriptors()
+{
+	if (d_pdw_pending.empty())
+		return;
+
+	pmt::pmt_t meta = pmt::make_dict();
+	meta = pmt::dict_add(meta, pmt::mp("count"), pmt::from_long(d_pdw_pending.size()));
+	meta = pmt::dict_add(meta, pmt::mp("sample_rate"), pmt::from_long(d_sample_rate));
+	meta = pmt::dict_add(meta, pmt::mp("descriptor_size"), pmt::from_long(sizeof(pulse_descriptor)));
+
+	pmt::pmt_t data = pmt::init_u8vector(d_pdw_pending.size() * sizeof(pulse_descriptor), (const uint8_t*)&d_pdw_pending[0]);
+
+	message_port_pub(d_pdw_port_id, pmt::cons(meta, data));
+
+	d_pdw_pending.clear();
 }
 
 void baz_radar_detector::set_base_level(float level)
@@ -142,8 +271,55 @@ void baz_radar_detector::skip(int skip)
 	d_skip = skip;
 }
 
+// Index of first sample at or above 'threshold' in [start, end), or 'end' if there is none
+static inline int find_crossing(const float* in, int start, int end, float threshold)
+{
+	int i = start;
+#ifdef __SSE2__
+	const __m128 t = _mm_set1_ps(threshold);
+	for (; (i + 4) <= end; i += 4)
+	{
+		__m128 cmp = _mm_cmpge_ps(_mm_loadu_ps(in + i), t);
+		int mask = _mm_movemask_ps(cmp);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif // __SSE2__
+	for (; i < end; ++i)
+	{
+		if (in[i] >= threshold)
+			break;
+	}
+	return i;
+}
+
+// As above, but against a per-sample base level scaled by 'threshold'
+static inline int find_crossing(const float* in, const float* lvl, int start, int end, float threshold)
+{
+	int i = start;
+#ifdef __SSE2__
+	const __m128 t = _mm_set1_ps(threshold);
+	for (; (i + 4) <= end; i += 4)
+	{
+		__m128 level = _mm_mul_ps(_mm_loadu_ps(lvl + i), t);
+		__m128 cmp = _mm_cmpge_ps(_mm_loadu_ps(in + i), level);
+		int mask = _mm_movemask_ps(cmp);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif // __SSE2__
+	for (; i < end; ++i)
+	{
+		if (in[i] >= (lvl[i] * threshold))
+			break;
+	}
+	return i;
+}
+
 int baz_radar_detector::general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
 {
+	gr::thread::scoped_lock guard(d_pdw_mutex);
+
 	const float *in = (const float*)input_items[0];
 	const float *lvl = NULL;
 	if (input_items.size() > 1)
@@ -158,10 +334,26 @@ int baz_radar_detector::general_work (int noutput_items, gr_vector_int &ninput_i
 	{
 		if (d_skip > 0)
 		{
-			--d_skip;
+			int n = std::min(d_skip, noutput_items - i);
+			d_skip -= n;
+			i += (n - 1);
 			continue;
 		}
 		
+		if (d_in_burst == false)	// Quiet: jump straight to the next threshold crossing
+		{
+			int next;
+			if (lvl)
+				next = find_crossing(in, lvl, i, noutput_items, d_threshold);
+			else
+				next = find_crossing(in, i, noutput_items, (d_base_level * d_threshold));
+			
+			if (next >= noutput_items)
+				break;
+			
+			i = next;
+		}
+		
 		float base_level = (lvl ? lvl[i] : d_base_level);
 		float threshold = base_level * d_threshold;
 		
@@ -257,6 +449,16 @@ int baz_radar_detector::general_work (int noutput_items, gr_vector_int &ninput_i
 				
 				double ave = d_sum / (double)len;
 				
+				pulse_descriptor pd;
+				pd.toa = d_burst_start;
+				pd.width = (uint32_t)len;
+				pd.plateau_width = d_flat_sum_count;
+				pd.peak = d_max;
+				pd.plateau = ((d_flat_sum_count > 0) ? (d_flat_sum / (double)d_flat_sum_count) : 0.0f);
+				pd.base = base_level;
+				pd.rssi = rssi;
+				emit_descriptor(pd);
+				
 				//fprintf(stderr, "[%s<%i>] triggered level: %f, (RSSI: %f), length: %i (samples: %i), ave: %f, max: %f\n", name().c_str(), unique_id(),
 				//	d_first, rssi, width, (int)len, ave, d_max);
 				
@@ -278,6 +480,9 @@ int baz_radar_detector::general_work (int noutput_items, gr_vector_int &ninput_i
 		}
 	}
 	
+	if (d_pdw_batch == 0)
+		flush_descriptors();
+	
 	consume_each(noutput_items);
 	
 	return out_count;
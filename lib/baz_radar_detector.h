@@ -30,6 +30,9 @@
 
 #include <gnuradio/block.h>
 #include <gnuradio/msg_queue.h>
+#include <gnuradio/thread/thread.h>
+
+#include <vector>
 
 class BAZ_API baz_radar_detector;
 
@@ -92,6 +95,43 @@ public:
 		uint8_t type;    // 0: WiFi frame (no error), 1: RADAR PHY error
 		uint8_t subtype; // For type 0: 0; type 1: rs_rate
 	};
+
+	// Pulse descriptor word (fixed 32-byte little-endian layout, shared by PDU payload & ring)
+	struct pulse_descriptor {
+		uint64_t toa;            // Sample index of leading edge
+		uint32_t width;          // Samples above threshold
+		uint32_t plateau_width;  // Samples that fell within the plateau
+		float peak;              // Linear
+		float plateau;           // Mean plateau level (linear, 0 if no plateau was found)
+		float base;              // Base level in use at trailing edge (linear)
+		float rssi;              // Peak above base level (dB)
+	};
+
+	// Header at the start of the memory-mapped ring (slots follow at 'data_offset')
+	struct pdw_ring_header {
+		uint32_t magic;                  // PDW_RING_MAGIC
+		uint32_t version;
+		uint32_t descriptor_size;        // sizeof(pulse_descriptor)
+		uint32_t capacity;               // Number of descriptor slots
+		uint32_t data_offset;            // Bytes from start of mapping to first slot
+		uint32_t sample_rate;
+		volatile uint64_t write_count;   // Total descriptors ever written (slot = count % capacity)
+	};
+
+	static const uint32_t PDW_RING_MAGIC = 0x30574450;	// "PDW0"
+	static const uint32_t PDW_RING_VERSION = 1;
+private:
+	gr::thread::mutex d_pdw_mutex;
+	pmt::pmt_t d_pdw_port_id;
+	int d_pdw_batch;
+	std::vector<pulse_descriptor> d_pdw_pending;
+	uint64_t d_pdw_count;
+	std::string d_pdw_ring_path;
+	pdw_ring_header* d_pdw_ring;
+	size_t d_pdw_ring_length;
+	void emit_descriptor(const pulse_descriptor& pd);
+	void flush_descriptors();
+	void close_pdw_ring();
 public:
 	~baz_radar_detector ();	// public destructor
 
@@ -101,6 +141,15 @@ public:
 	bool set_param(const std::string& param, float value);
 	void skip(int skip);
 
+	void set_pdw_batch(int batch);	// Descriptors per PDU (0: one PDU per work call)
+	bool set_pdw_ring(const std::string& path, int capacity = 4096);	// Empty path closes ring
+	int pdw_batch() const
+	{ return d_pdw_batch; }
+	uint64_t pdw_count() const
+	{ return d_pdw_count; }
+
+	bool stop();
+
 	int general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
 };
 
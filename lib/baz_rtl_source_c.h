@@ -136,6 +136,8 @@ public:	// SWIG demod params set only
 	{ m_demod_params.vid = vid; }
 	inline void set_pid(uint16_t pid)
 	{ m_demod_params.pid = pid; }
+	inline void set_device_index(int index)	// Nth compatible device (0: first found)
+	{ m_demod_params.device_index = index; }
 	inline void set_default_timeout(int timeout)	// 0: use default, -1: poll only
 	{ m_demod_params.default_timeout = timeout; }
 	inline void set_fir_coefficients(const std::vector</*uint8_t*/int>& coeffs)
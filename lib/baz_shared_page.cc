@@ -0,0 +1,96 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <baz_shared_page.h>
+
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+void* baz_map_shared_page(const std::string& path, size_t length, std::string& error)
+{
+#ifdef _WIN32
+	error = "shared pages are not supported on this platform";
+	return NULL;
+#else
+	void* p = NULL;
+
+	if (path.empty())
+	{
+		p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	}
+	else
+	{
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+		{
+			error = "failed to open \"" + path + "\": " + strerror(errno);
+			return NULL;
+		}
+
+		if (ftruncate(fd, length) < 0)	// Freshly truncated, so it reads back as zeros
+		{
+			error = "failed to size \"" + path + "\": " + strerror(errno);
+			close(fd);
+			return NULL;
+		}
+
+		p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);	// Mapping holds its own reference
+	}
+
+	if (p == MAP_FAILED)
+	{
+		error = "failed to map \"" + path + "\": " + strerror(errno);
+		return NULL;
+	}
+
+	return p;
+#endif // _WIN32
+}
+
+void baz_unmap_shared_page(void* page, size_t length)
+{
+#ifndef _WIN32
+	if (page)
+		munmap(page, length);
+#endif // _WIN32
+}
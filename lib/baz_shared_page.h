@@ -0,0 +1,49 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_SHARED_PAGE_H
+#define INCLUDED_BAZ_SHARED_PAGE_H
+
+#include <stddef.h>
+#include <string>
+
+/*!
+ * \brief Memory shared with another process through a file
+ *
+ * 'path' is created (or truncated) and sized to 'length' bytes, then mapped shared
+ * read/write. An empty 'path' gives anonymous shared memory instead. Either way the
+ * page starts out as zeros.
+ *
+ * Returns NULL on failure, with the reason in 'error' (e.g. failed to open "path": ...).
+ *
+ * Shared by baz_radar_detector (PDW ring), baz_telemetry_probe (stats page) and
+ * baz_spectrum_frames (frame buffer).
+ */
+void* baz_map_shared_page(const std::string& path, size_t length, std::string& error);
+void baz_unmap_shared_page(void* page, size_t length);
+
+#endif /* INCLUDED_BAZ_SHARED_PAGE_H */
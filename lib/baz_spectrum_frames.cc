@@ -0,0 +1,386 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_spectrum_frames.h>
+#include <baz_shared_page.h>
+#include <gnuradio/io_signature.h>
+#include <gnuradio/fft/window.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Create a new instance of baz_spectrum_frames and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_spectrum_frames_sptr baz_make_spectrum_frames (int fft_size, int overlap /*= 0*/, double sample_rate /*= 1.0*/, double frame_rate /*= 30.0*/, const std::vector<float>& window /*= std::vector<float>()*/, int bits /*= 8*/, float ref_level /*= 0.0*/, float dynamic_range /*= 100.0*/, float alpha /*= 1.0*/, bool peak_hold /*= false*/, const std::string& path /*= ""*/)
+{
+	return baz_spectrum_frames_sptr (new baz_spectrum_frames (fft_size, overlap, sample_rate, frame_rate, window, bits, ref_level, dynamic_range, alpha, peak_hold, path));
+}
+
+/*
+ * The private constructor
+ */
+baz_spectrum_frames::baz_spectrum_frames (int fft_size, int overlap, double sample_rate, double frame_rate, const std::vector<float>& window, int bits, float ref_level, float dynamic_range, float alpha, bool peak_hold, const std::string& path)
+	: gr::sync_block ("spectrum_frames",
+		gr::io_signature::make (1, 1, sizeof(gr_complex)),
+		gr::io_signature::make (0, 0, 0))
+	, d_fft_size(fft_size)
+	, d_overlap(overlap)
+	, d_sample_rate(sample_rate)
+	, d_frame_rate(frame_rate)
+	, d_bits(bits)
+	, d_ref_level(ref_level)
+	, d_dynamic_range(100.0f)
+	, d_alpha(1.0f)
+	, d_peak_hold(peak_hold)
+	, d_path(path)
+	, d_fft(NULL)
+	, d_fill(0)
+	, d_frames(0)
+	, d_frames_per_output(1)
+	, d_primed(false)
+	, d_reset_peak(false)
+	, d_overwritten(0)
+	, d_buffer(NULL)
+	, d_buffer_length(0)
+	, d_back(0)
+{
+	if (fft_size < 2)
+		throw std::invalid_argument("spectrum_frames: FFT size must be at least 2");
+	if ((overlap < 0) || (overlap >= fft_size))
+		throw std::invalid_argument("spectrum_frames: overlap must be in [0, FFT size)");
+	if ((bits != 8) && (bits != 16))
+		throw std::invalid_argument("spectrum_frames: bits must be 8 or 16");
+	if ((window.empty() == false) && ((int)window.size() != fft_size))
+		throw std::invalid_argument("spectrum_frames: window length must match FFT size");
+
+	d_window = (window.empty() ? gr::fft::window::blackman_harris(fft_size) : window);
+
+	double window_sum = 0;
+	for (int i = 0; i < fft_size; ++i)
+		window_sum += d_window[i];
+	d_norm_db = 20.0f * log10f((float)fabs(window_sum));
+
+	d_fft = new gr::fft::fft_complex(fft_size, true);
+
+	d_stage.resize(fft_size);
+	d_sum.resize(fft_size);
+	d_average.resize(fft_size);
+	d_peak.resize(fft_size);
+
+	set_dynamic_range(dynamic_range);
+	set_alpha(alpha);
+	update_frames_per_output();
+
+	// Header, then three slots of frame_info + codes, each cache-line aligned
+	const size_t header_size = 64;
+	const size_t slot_size = ((sizeof(frame_info) + ((size_t)fft_size * (bits / 8)) + 63) / 64) * 64;
+	const size_t length = header_size + (3 * slot_size);
+	void* p = NULL;
+#ifdef _WIN32
+	if (path.empty() == false)
+		throw std::runtime_error("spectrum_frames: mapping a file is not supported on this platform");
+
+	p = calloc(1, length);
+	if (p == NULL)
+		throw std::runtime_error("spectrum_frames: failed to allocate frame buffer");
+#else
+	std::string error;
+	p = baz_map_shared_page(path, length, error);	// Anonymous when there is no path
+	if (p == NULL)
+	{
+		fprintf(stderr, "[%s<%i>] frame buffer: %s\n", name().c_str(), unique_id(), error.c_str());
+		throw std::runtime_error("spectrum_frames: failed to map frame buffer");
+	}
+#endif // _WIN32
+
+	d_buffer = (frame_buffer_header*)p;
+	d_buffer_length = length;
+	d_buffer->version = FRAME_BUFFER_VERSION;
+	d_buffer->header_size = header_size;
+	d_buffer->bins = fft_size;
+	d_buffer->sample_size = bits / 8;
+	d_buffer->slot_size = slot_size;
+	d_buffer->sample_rate = sample_rate;
+	d_buffer->state = 1;	// Writer: 0, published: 1, reader: 2
+	d_buffer->reader_slot = 2;
+	d_buffer->frame_count = 0;
+	__sync_synchronize();
+	d_buffer->magic = FRAME_BUFFER_MAGIC;	// Last, so a reader never sees a half-initialised header
+
+	fprintf(stderr, "[%s<%i>] FFT size: %d, overlap: %d, sample rate: %f, frame rate: %f, bits: %d, range: [%f, %f] dB, alpha: %f, peak hold: %s, buffer: %s\n", name().c_str(), unique_id(),
+		fft_size, overlap, sample_rate, frame_rate, bits, (ref_level - d_dynamic_range), ref_level, d_alpha, (peak_hold ? "yes" : "no"), (path.empty() ? "(anonymous)" : path.c_str()));
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_spectrum_frames::~baz_spectrum_frames ()
+{
+	delete d_fft;
+
+#ifdef _WIN32
+	free(d_buffer);
+#else
+	baz_unmap_shared_page(d_buffer, d_buffer_length);
+#endif // _WIN32
+}
+
+void baz_spectrum_frames::update_frames_per_output()
+{
+	const int hop = d_fft_size - d_overlap;
+	double frames = ((d_frame_rate > 0) ? (d_sample_rate / (double)hop / d_frame_rate) : 1.0);
+
+	d_frames_per_output = std::max(1, (int)frames);
+}
+
+void baz_spectrum_frames::set_sample_rate(double sample_rate)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_sample_rate = sample_rate;
+	d_buffer->sample_rate = sample_rate;
+	update_frames_per_output();
+}
+
+void baz_spectrum_frames::set_frame_rate(double frame_rate)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_frame_rate = frame_rate;
+	update_frames_per_output();
+}
+
+void baz_spectrum_frames::set_ref_level(float ref_level)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_ref_level = ref_level;
+}
+
+void baz_spectrum_frames::set_dynamic_range(float dynamic_range)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	if (dynamic_range > 0)
+		d_dynamic_range = dynamic_range;
+}
+
+void baz_spectrum_frames::set_alpha(float alpha)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_alpha = (((alpha > 0) && (alpha <= 1)) ? alpha : 1.0f);
+}
+
+void baz_spectrum_frames::set_peak_hold(bool peak_hold)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	if (peak_hold != d_peak_hold)
+		d_reset_peak = true;
+
+	d_peak_hold = peak_hold;
+}
+
+void baz_spectrum_frames::reset_peak()
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	d_reset_peak = true;
+}
+
+uint64_t baz_spectrum_frames::frame_count() const
+{
+	return d_buffer->frame_count;
+}
+
+size_t baz_spectrum_frames::slot_offset(int slot) const
+{
+	if ((slot < 0) || (slot > 2))
+		return 0;
+
+	return (d_buffer->header_size + ((size_t)slot * d_buffer->slot_size));
+}
+
+int baz_spectrum_frames::acquire_frame()
+{
+	uint32_t state = d_buffer->state;
+	if ((state & FRAME_FRESH) == 0)
+		return -1;
+
+	uint32_t old;
+	while ((old = __sync_val_compare_and_swap(&d_buffer->state, state, d_buffer->reader_slot)) != state)
+		state = old;	// Writer published again in the meantime: still fresh
+
+	d_buffer->reader_slot = (old & 0x3);
+
+	return d_buffer->reader_slot;
+}
+
+// Adds the power of the (windowed) staged frame to d_sum
+void baz_spectrum_frames::process_frame()
+{
+	const int n = d_fft_size;
+	const int half = n / 2;
+
+	gr_complex* fft_in = d_fft->get_inbuf();
+	for (int i = 0; i < n; ++i)
+		fft_in[i] = d_stage[i] * d_window[i];
+
+	d_fft->execute();
+
+	const gr_complex* spectrum = d_fft->get_outbuf();
+	float* sum = &d_sum[0];
+	for (int k = 0; k < n - half; ++k)	// Negative frequencies first: DC ends up at 'half'
+		sum[half + k] += std::norm(spectrum[k]);
+	for (int k = n - half; k < n; ++k)
+		sum[k - (n - half)] += std::norm(spectrum[k]);
+
+	++d_frames;
+
+	if (d_frames >= d_frames_per_output)
+		publish();
+}
+
+void baz_spectrum_frames::publish()
+{
+	const int n = d_fft_size;
+	const float scale = 1.0f / (float)d_frames;
+
+	for (int k = 0; k < n; ++k)
+	{
+		float mean = d_sum[k] * scale;
+		d_average[k] = (d_primed ? ((d_alpha * mean) + ((1.0f - d_alpha) * d_average[k])) : mean);
+	}
+	d_primed = true;
+
+	std::fill(d_sum.begin(), d_sum.end(), 0.0f);
+	d_frames = 0;
+
+	const float* display = &d_average[0];
+	if (d_peak_hold)
+	{
+		if (d_reset_peak)
+		{
+			d_peak = d_average;
+			d_reset_peak = false;
+		}
+		else
+		{
+			for (int k = 0; k < n; ++k)
+				d_peak[k] = std::max(d_peak[k], d_average[k]);
+		}
+
+		display = &d_peak[0];
+	}
+
+	// Quantise into the back slot
+	char* slot = (char*)d_buffer + slot_offset(d_back);
+	frame_info* info = (frame_info*)slot;
+	info->ref_level = d_ref_level;
+	info->dynamic_range = d_dynamic_range;
+	info->sequence = d_buffer->frame_count + 1;
+
+	const float max_code = (float)((1 << d_bits) - 1);
+	const float floor_db = d_ref_level - d_dynamic_range;
+	const float code_per_db = max_code / d_dynamic_range;
+
+	if (d_bits == 8)
+	{
+		uint8_t* codes = (uint8_t*)(slot + sizeof(frame_info));
+		for (int k = 0; k < n; ++k)
+		{
+			float code = ((10.0f * log10f(display[k])) - d_norm_db - floor_db) * code_per_db;	// log10(0) is -inf: clamps to 0
+			codes[k] = (uint8_t)(std::min(std::max(code, 0.0f), max_code) + 0.5f);
+		}
+	}
+	else
+	{
+		uint16_t* codes = (uint16_t*)(slot + sizeof(frame_info));
+		for (int k = 0; k < n; ++k)
+		{
+			float code = ((10.0f * log10f(display[k])) - d_norm_db - floor_db) * code_per_db;
+			codes[k] = (uint16_t)(std::min(std::max(code, 0.0f), max_code) + 0.5f);
+		}
+	}
+
+	__sync_synchronize();	// Slot contents must be visible before it is published
+
+	uint32_t state, old = d_buffer->state;
+	do
+	{
+		state = old;
+	} while ((old = __sync_val_compare_and_swap(&d_buffer->state, state, (d_back | FRAME_FRESH))) != state);
+
+	if (old & FRAME_FRESH)
+		++d_overwritten;
+
+	d_back = (old & 0x3);
+	d_buffer->frame_count = d_buffer->frame_count + 1;
+}
+
+int baz_spectrum_frames::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	gr::thread::scoped_lock guard(d_mutex);
+
+	const gr_complex* in = (const gr_complex*)input_items[0];
+	int used = 0;
+
+	while (used < noutput_items)
+	{
+		int n = std::min(noutput_items - used, d_fft_size - d_fill);
+		memcpy(&d_stage[d_fill], in + used, n * sizeof(gr_complex));
+		d_fill += n;
+		used += n;
+
+		if (d_fill < d_fft_size)
+			break;
+
+		process_frame();
+
+		if (d_overlap > 0)
+			memmove(&d_stage[0], &d_stage[d_fft_size - d_overlap], d_overlap * sizeof(gr_complex));
+		d_fill = d_overlap;
+	}
+
+	return noutput_items;
+}
@@ -0,0 +1,186 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_SPECTRUM_FRAMES_H
+#define INCLUDED_BAZ_SPECTRUM_FRAMES_H
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/thread/thread.h>
+#include <gnuradio/fft/fft.h>
+
+#include <vector>
+#include <string>
+
+class BAZ_API baz_spectrum_frames;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_spectrum_frames> baz_spectrum_frames_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_spectrum_frames.
+ *
+ * To avoid accidental use of raw pointers, baz_spectrum_frames's
+ * constructor is private.  baz_make_spectrum_frames is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_spectrum_frames_sptr baz_make_spectrum_frames (int fft_size, int overlap = 0, double sample_rate = 1.0, double frame_rate = 30.0, const std::vector<float>& window = std::vector<float>(), int bits = 8, float ref_level = 0.0, float dynamic_range = 100.0, float alpha = 1.0, bool peak_hold = false, const std::string& path = "");
+
+/*!
+ * \brief Complex samples in, quantised spectrum display frames out (through shared memory)
+ * \ingroup block
+ *
+ * Frames of 'fft_size' samples, advancing by fft_size - 'overlap', are windowed ('window',
+ * or Blackman-Harris if empty), transformed and their power summed.  Every
+ * sample_rate / hop / frame_rate frames the mean power goes through a single-pole IIR
+ * ('alpha', 1: off) and optionally peak-hold, then to dB (a full-scale tone reads 0 dB),
+ * DC in the middle.  dB in [ref_level - dynamic_range, ref_level] is quantised to 'bits'
+ * (8 or 16) and written to a triple buffer: the writer never waits, and the one reader
+ * always gets the newest complete frame.  The buffer is a mapping of 'path' (or anonymous,
+ * if empty) laid out as frame_buffer_header then three slots, each a frame_info followed by
+ * the codes, so a GUI can view a slot in place (see baz.spectrum_frames).
+ */
+class BAZ_API baz_spectrum_frames : public gr::sync_block
+{
+public:
+	struct frame_buffer_header {
+		uint32_t magic;                  // FRAME_BUFFER_MAGIC
+		uint32_t version;
+		uint32_t header_size;            // Bytes from start of mapping to slot 0
+		uint32_t bins;
+		uint32_t sample_size;            // Bytes per code (1 or 2)
+		uint32_t slot_size;              // Bytes between slots (frame_info included)
+		double sample_rate;
+		volatile uint32_t state;         // Slot last published (bits 0-1) | FRAME_FRESH
+		uint32_t reader_slot;            // Slot the reader holds
+		volatile uint64_t frame_count;   // Frames published
+	};
+
+	// Start of each slot (codes follow)
+	struct frame_info {
+		uint64_t sequence;               // frame_count when published (from 1)
+		float ref_level;                 // dB at the highest code
+		float dynamic_range;             // dB at code 0 is ref_level - dynamic_range
+	};
+
+	static const uint32_t FRAME_BUFFER_MAGIC = 0x30465053;	// "SPF0"
+	static const uint32_t FRAME_BUFFER_VERSION = 1;
+	static const uint32_t FRAME_FRESH = 0x4;
+private:
+	// The friend declaration allows baz_make_spectrum_frames to
+	// access the private constructor.
+	friend BAZ_API baz_spectrum_frames_sptr baz_make_spectrum_frames (int fft_size, int overlap, double sample_rate, double frame_rate, const std::vector<float>& window, int bits, float ref_level, float dynamic_range, float alpha, bool peak_hold, const std::string& path);
+
+	baz_spectrum_frames (int fft_size, int overlap, double sample_rate, double frame_rate, const std::vector<float>& window, int bits, float ref_level, float dynamic_range, float alpha, bool peak_hold, const std::string& path);  	// private constructor
+
+	int d_fft_size;
+	int d_overlap;
+	double d_sample_rate;
+	double d_frame_rate;
+	int d_bits;
+	float d_ref_level;
+	float d_dynamic_range;
+	float d_alpha;
+	bool d_peak_hold;
+	std::string d_path;
+	gr::thread::mutex d_mutex;
+	gr::fft::fft_complex* d_fft;
+	std::vector<float> d_window;
+	float d_norm_db;	// 10.log10(sum(window)^2)
+	std::vector<gr_complex> d_stage;	// Samples waiting for a full frame
+	int d_fill;
+	std::vector<float> d_sum;	// Power summed over the frames so far (DC centred)
+	std::vector<float> d_average;
+	std::vector<float> d_peak;
+	int d_frames;
+	int d_frames_per_output;
+	bool d_primed;
+	bool d_reset_peak;
+	uint64_t d_overwritten;
+	frame_buffer_header* d_buffer;
+	size_t d_buffer_length;
+	int d_back;	// Slot being written
+
+	void update_frames_per_output();
+	void process_frame();
+	void publish();
+public:
+	~baz_spectrum_frames ();	// public destructor
+
+	int fft_size() const
+	{ return d_fft_size; }
+	int bits() const
+	{ return d_bits; }
+	void set_sample_rate(double sample_rate);
+	double sample_rate() const
+	{ return d_sample_rate; }
+	void set_frame_rate(double frame_rate);
+	double frame_rate() const
+	{ return d_frame_rate; }
+	void set_ref_level(float ref_level);
+	float ref_level() const
+	{ return d_ref_level; }
+	void set_dynamic_range(float dynamic_range);
+	float dynamic_range() const
+	{ return d_dynamic_range; }
+	void set_alpha(float alpha);
+	float alpha() const
+	{ return d_alpha; }
+	void set_peak_hold(bool peak_hold);
+	bool peak_hold() const
+	{ return d_peak_hold; }
+	void reset_peak();
+	int frames_per_output() const
+	{ return d_frames_per_output; }
+	uint64_t frame_count() const;
+	uint64_t overwritten_count() const	// Published frames replaced before the reader took them
+	{ return d_overwritten; }
+
+	// Reader side (one reader): newest unread frame's slot, or -1 if nothing new.  The slot
+	// is the reader's until its next call.
+	int acquire_frame();
+	size_t buffer_address() const
+	{ return (size_t)d_buffer; }
+	size_t buffer_length() const
+	{ return d_buffer_length; }
+	size_t slot_offset(int slot) const;
+	std::string path() const
+	{ return d_path; }
+
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_SPECTRUM_FRAMES_H */
@@ -0,0 +1,182 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <baz_sync_search.h>
+
+#include <stdexcept>
+#include <algorithm>
+
+baz_sync_search::baz_sync_search(uint64_t pattern, int length, int threshold /*= 0*/, int stride /*= 1*/, bool invert /*= false*/)
+	: d_pattern(pattern)
+	, d_length(length)
+	, d_stride(stride)
+	, d_invert(invert)
+	, d_errors(0)
+{
+	if ((d_length <= 0) || (d_length > MAX_LENGTH))
+		throw std::invalid_argument("sync_search: invalid pattern length");
+	if (d_stride <= 0)
+		throw std::invalid_argument("sync_search: stride must be positive");
+
+	if (d_length < MAX_LENGTH)
+		d_pattern &= ((1ULL << d_length) - 1);
+
+	d_span = ((d_length - 1) * d_stride) + 1;
+	d_lookback_words = ((d_span - 1) + 63) / 64;
+
+	set_threshold(threshold);
+}
+
+void baz_sync_search::set_threshold(int threshold)
+{
+	d_threshold = std::max(0, std::min(threshold, d_length));
+
+	d_planes = 0;
+	while ((1 << d_planes) <= d_threshold)
+		++d_planes;
+}
+
+// Bit i is the hard decision on in[i]
+uint64_t baz_sync_search::pack(const float* in, int count) const
+{
+	uint64_t word = 0;
+
+	if (d_invert)
+	{
+		for (int i = 0; i < count; ++i)
+			word |= ((uint64_t)(in[i] <= 0.0f) << i);
+	}
+	else
+	{
+		for (int i = 0; i < count; ++i)
+			word |= ((uint64_t)(in[i] >= 0.0f) << i);
+	}
+
+	return word;
+}
+
+int baz_sync_search::search(const float* in, int count, int lookback /*= 0*/)
+{
+	lookback = std::max(0, std::min(lookback, d_span - 1));
+
+	const int first = (d_span - 1) - lookback;	// Earliest sample with the whole window in view
+	if (first >= count)
+		return -1;
+
+	// Bit b of word w is the decision on in[((w - lookback words) * 64) + b] (zero before 'lookback')
+
+	const int word_count = d_lookback_words + ((count + 63) / 64);
+	d_words.resize(word_count);
+
+	for (int w = 0; w < word_count; ++w)
+	{
+		const int base = (w - d_lookback_words) * 64;
+		const int begin = std::max(base, -lookback);
+		const int end = std::min(base + 64, count);
+
+		d_words[w] = ((end > begin) ? (pack(in + begin, end - begin) << (begin - base)) : 0);
+	}
+
+	for (int block = (first / 64); (block * 64) < count; ++block)
+	{
+		const int base = block * 64;
+		const int current = d_lookback_words + block;
+
+		// Lane k is the window ending on in[base + k]
+
+		uint64_t valid = ~0ULL;
+		if (base < first)
+			valid &= (~0ULL << (first - base));
+		if ((count - base) < 64)
+			valid &= ((1ULL << (count - base)) - 1);
+
+		uint64_t planes[MAX_PLANES] = { 0 };
+		uint64_t over = 0;	// Count has passed what the planes can hold
+
+		for (int j = 0; j < d_length; ++j)
+		{
+			const int shift = j * d_stride;
+			const int q = shift / 64, r = shift % 64;
+
+			uint64_t x = (d_words[current - q] << r);	// Lane k: decision on in[base + k - shift]
+			if (r > 0)
+				x |= (d_words[current - q - 1] >> (64 - r));
+
+			if ((d_pattern >> j) & 1)
+				x = ~x;	// Now 1 where it disagrees
+
+			uint64_t carry = x;
+			for (int p = 0; p < d_planes; ++p)
+			{
+				uint64_t next = (planes[p] & carry);
+				planes[p] ^= carry;
+				carry = next;
+			}
+			over |= carry;
+
+			if ((over & valid) == valid)
+				break;
+		}
+
+		// Bit-sliced (count > threshold)
+
+		uint64_t above = over;
+		uint64_t equal = ~0ULL;
+		for (int p = d_planes - 1; p >= 0; --p)
+		{
+			if ((d_threshold >> p) & 1)
+				equal &= planes[p];
+			else
+			{
+				above |= (equal & planes[p]);
+				equal &= ~planes[p];
+			}
+		}
+
+		uint64_t match = (~above & valid);
+		if (match == 0)
+			continue;
+
+		const int k = __builtin_ctzll(match);
+
+		d_errors = 0;
+		for (int p = 0; p < d_planes; ++p)
+			d_errors |= (int)(((planes[p] >> k) & 1) << p);
+
+		return (base + k);
+	}
+
+	return -1;
+}
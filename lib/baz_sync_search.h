@@ -0,0 +1,90 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_SYNC_SEARCH_H
+#define INCLUDED_BAZ_SYNC_SEARCH_H
+
+#include <stdint.h>
+#include <vector>
+
+/*!
+ * \brief Bit-sliced search for a sync word in a stream of hard decisions
+ *
+ * Hard decisions are packed 64 to a word. Each pattern bit is checked against
+ * all 64 window positions of a word at once (shift & XOR), and the disagreements
+ * are summed per position in a bit-sliced counter, so a word of idle channel
+ * costs roughly one shift, XOR and add per pattern bit (fewer when every position
+ * is already over the threshold).
+ *
+ * Pattern bit 0 (LSB) is the last bit of the sync word to arrive (as if it were
+ * shifted into a register: state = (state << 1) | bit). Consecutive pattern bits
+ * are 'stride' samples apart, so oversampled streams can be searched directly.
+ *
+ * Shared by baz_acars_assembler and baz_fastrak_decoder.
+ */
+class baz_sync_search
+{
+public:
+	static const int MAX_LENGTH = 64;
+private:
+	static const int MAX_PLANES = 7;	// Enough to count to MAX_LENGTH
+
+	uint64_t d_pattern;
+	int d_length;
+	int d_stride;
+	int d_threshold;
+	bool d_invert;
+	int d_span;
+	int d_planes;		// Bits in the per-position disagreement counter
+	int d_lookback_words;
+	int d_errors;
+	std::vector<uint64_t> d_words;
+
+	uint64_t pack(const float* in, int count) const;
+public:
+	// Hard decision is (in >= 0), or (in <= 0) when 'invert'
+	baz_sync_search(uint64_t pattern, int length, int threshold = 0, int stride = 1, bool invert = false);
+
+	void set_threshold(int threshold);
+	inline int threshold() const
+	{ return d_threshold; }
+	inline int length() const
+	{ return d_length; }
+	inline int stride() const
+	{ return d_stride; }
+	inline int span() const	// Samples covered by the sync word
+	{ return d_span; }
+	inline int errors() const	// Disagreeing bits in the last match
+	{ return d_errors; }
+
+	// Returns the index in [0, count) of the first sample that completes the sync word
+	// with no more than 'threshold' disagreeing bits, or -1.
+	// 'lookback' samples before 'in' are valid (and may start a window): up to span() - 1 are used.
+	int search(const float* in, int count, int lookback = 0);
+};
+
+#endif /* INCLUDED_BAZ_SYNC_SEARCH_H */
@@ -37,15 +37,18 @@
 #include <baz_tag_to_msg.h>
 #include <gnuradio/io_signature.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <boost/bind.hpp>
 
 /*
  * Create a new instance of baz_tag_to_msg and return
  * a boost shared_ptr.  This is effectively the public constructor.
  */
 baz_tag_to_msg_sptr 
-baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append /*= NULL*//*, int initial_buffer_size *//*= 64*/)
+baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append /*= NULL*//*, int initial_buffer_size *//*= 64*/, int mode /*= 0*/, bool blocking /*= false*/, int table_interval /*= 100*/, int max_symbols /*= 4096*/)
 {
-	return baz_tag_to_msg_sptr (new baz_tag_to_msg (item_size, msgq, append/*, initial_buffer_size*/));
+	return baz_tag_to_msg_sptr (new baz_tag_to_msg (item_size, msgq, append/*, initial_buffer_size*/, mode, blocking, table_interval, max_symbols));
 }
 
 /*
@@ -65,20 +68,35 @@ static const int MAX_OUT = 0;	// maximum number of output streams
 /*
  * The private constructor
  */
-baz_tag_to_msg::baz_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/)
+baz_tag_to_msg::baz_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/, int mode, bool blocking, int table_interval, int max_symbols)
 	: gr::sync_block ("tag_to_msg",
 		gr::io_signature::make (MIN_IN, MAX_IN, item_size),
 		gr::io_signature::make (MIN_OUT, MAX_OUT, 0))
 	, d_msgq(msgq)
 	//, d_buffer(NULL)
 	//, d_buffer_size(initial_buffer_size)
+	, d_mode(mode)
+	, d_blocking(blocking)
+	, d_tag_count(0)
+	, d_message_count(0)
+	, d_dropped_count(0)
+	, d_port_id(pmt::mp("tags"))
+	, d_table_interval(table_interval)
+	, d_max_symbols(max_symbols)
+	, d_pdus_since_table(0)
+	, d_table_requested(false)
 {
 	/*if (initial_buffer_size <= 0)
 		d_buffer_size = 64;
 	d_buffer = (char*)malloc(d_buffer_size);
 	assert(d_buffer != NULL);*/
 	
-	d_appended = append;
+	d_appended = (append ? append : "");
+	
+	message_port_register_out(d_port_id);
+	
+	message_port_register_in(pmt::mp("table"));
+	set_msg_handler(pmt::mp("table"), boost::bind(&baz_tag_to_msg::handle_table_request, this, _1));
 }
 
 /*
@@ -95,7 +113,221 @@ void baz_tag_to_msg::set_msgq(gr::msg_queue::sptr msgq)
 
 void baz_tag_to_msg::set_appended_string(const char* append)
 {
-	d_appended = append;
+	d_appended = (append ? append : "");
+}
+
+void baz_tag_to_msg::set_blocking(bool blocking)
+{
+	d_blocking = blocking;
+}
+
+void baz_tag_to_msg::reset_counters()
+{
+	d_tag_count = 0;
+	d_message_count = 0;
+	d_dropped_count = 0;
+}
+
+void baz_tag_to_msg::set_table_interval(int table_interval)
+{
+	d_table_interval = table_interval;
+}
+
+void baz_tag_to_msg::set_max_symbols(int max_symbols)
+{
+	d_max_symbols = max_symbols;
+}
+
+void baz_tag_to_msg::request_table()
+{
+	d_table_requested = true;
+}
+
+void baz_tag_to_msg::handle_table_request(pmt::pmt_t msg)
+{
+	request_table();
+}
+
+uint32_t baz_tag_to_msg::symbol_index(const pmt::pmt_t& p)
+{
+	pmt::pmt_t symbol = (pmt::is_symbol(p) ? p : pmt::intern(pmt::write_string(p)));	// Symbols are unique, so the map is keyed on identity
+	
+	std::map<pmt::pmt_t,uint32_t>::iterator it = d_symbols.find(symbol);
+	if (it != d_symbols.end())
+		return it->second;
+	
+	uint32_t index = d_symbol_list.size();
+	d_symbols[symbol] = index;
+	d_symbol_list.push_back(symbol);
+	
+	return index;
+}
+
+template<typename T> static void append_raw(std::vector<uint8_t>& v, const T& t)
+{
+	const uint8_t* p = (const uint8_t*)&t;
+	v.insert(v.end(), p, p + sizeof(T));
+}
+
+void baz_tag_to_msg::encode_value(const pmt::pmt_t& value)
+{
+	if (pmt::is_null(value))
+	{
+		d_record.push_back(VALUE_NIL);
+	}
+	else if (pmt::is_bool(value))
+	{
+		d_record.push_back(pmt::is_true(value) ? VALUE_TRUE : VALUE_FALSE);
+	}
+	else if (pmt::is_symbol(value))
+	{
+		d_record.push_back(VALUE_SYMBOL);
+		append_raw(d_record, symbol_index(value));
+	}
+	else if (pmt::is_uint64(value))
+	{
+		d_record.push_back(VALUE_UINT64);
+		append_raw(d_record, pmt::to_uint64(value));
+	}
+	else if (pmt::is_integer(value))
+	{
+		d_record.push_back(VALUE_LONG);
+		append_raw(d_record, (int64_t)pmt::to_long(value));
+	}
+	else if (pmt::is_real(value))
+	{
+		d_record.push_back(VALUE_DOUBLE);
+		append_raw(d_record, pmt::to_double(value));
+	}
+	else if (pmt::is_complex(value))
+	{
+		std::complex<double> c = pmt::to_complex(value);
+		d_record.push_back(VALUE_COMPLEX);
+		append_raw(d_record, c.real());
+		append_raw(d_record, c.imag());
+	}
+	else if ((pmt::is_tuple(value)) && (pmt::length(value) == 2) && (pmt::is_uint64(pmt::tuple_ref(value, 0))) && (pmt::is_real(pmt::tuple_ref(value, 1))))
+	{
+		d_record.push_back(VALUE_TIME);
+		append_raw(d_record, pmt::to_uint64(pmt::tuple_ref(value, 0)));
+		append_raw(d_record, pmt::to_double(pmt::tuple_ref(value, 1)));
+	}
+	else
+	{
+		std::string str = pmt::write_string(value);
+		d_record.push_back(VALUE_STRING);
+		append_raw(d_record, (uint32_t)str.size());
+		d_record.insert(d_record.end(), str.begin(), str.end());
+	}
+}
+
+void baz_tag_to_msg::post_binary(const std::vector<gr::tag_t>& tags, uint64_t nread, int noutput_items)
+{
+	if ((d_max_symbols > 0) && (d_symbol_list.size() >= (size_t)d_max_symbols))
+	{
+		// Number from scratch rather than grow without bound (e.g. symbol values that never repeat)
+		d_symbols.clear();
+		d_symbol_list.clear();
+	}
+	
+	const size_t symbol_base = d_symbol_list.size();
+	
+	bool full_table = ((symbol_base == 0) || (d_table_requested) || ((d_table_interval > 0) && (d_pdus_since_table >= d_table_interval)));
+	if (full_table)
+		d_table_requested = false;
+	
+	d_record.clear();
+	
+	for (size_t i = 0; i < tags.size(); ++i)
+	{
+		const gr::tag_t& tag = tags[i];
+		
+		append_raw(d_record, tag.offset);
+		append_raw(d_record, symbol_index(tag.srcid));
+		append_raw(d_record, symbol_index(tag.key));
+		encode_value(tag.value);
+	}
+	
+	pmt::pmt_t meta = pmt::make_dict();
+	meta = pmt::dict_add(meta, pmt::mp("offset"), pmt::from_uint64(nread));
+	meta = pmt::dict_add(meta, pmt::mp("items"), pmt::from_long(noutput_items));
+	meta = pmt::dict_add(meta, pmt::mp("tags"), pmt::from_long(tags.size()));
+	
+	if (d_appended.empty() == false)
+		meta = pmt::dict_add(meta, pmt::mp("append"), pmt::mp(d_appended));
+	
+	const size_t first = (full_table ? 0 : symbol_base);
+	if (first < d_symbol_list.size())
+	{
+		pmt::pmt_t symbols = pmt::make_vector(d_symbol_list.size() - first, pmt::PMT_NIL);
+		for (size_t i = first; i < d_symbol_list.size(); ++i)
+			pmt::vector_set(symbols, i - first, d_symbol_list[i]);
+		
+		meta = pmt::dict_add(meta, pmt::mp("symbol_base"), pmt::from_long(first));
+		meta = pmt::dict_add(meta, pmt::mp("symbols"), symbols);
+	}
+	
+	message_port_pub(d_port_id, pmt::cons(meta, pmt::init_u8vector(d_record.size(), d_record)));
+	
+	++d_message_count;
+	
+	if (full_table)
+		d_pdus_since_table = 0;
+	++d_pdus_since_table;
+}
+
+void baz_tag_to_msg::post_strings(const std::vector<gr::tag_t>& tags)
+{
+	std::string id_str, key_str, value_str;
+	
+	for (int i = 0; i < tags.size(); ++i) {
+		if (!d_msgq)
+			break;
+		
+		if ((d_blocking == false) && (d_msgq->full_p()))	// Nothing is built for a message that can't be queued
+		{
+			++d_dropped_count;
+			continue;
+		}
+		
+		const gr::tag_t& tag = tags[i];
+		id_str = pmt::write_string(tag.srcid);
+		key_str = pmt::write_string(tag.key);
+		value_str = pmt::write_string(tag.value);
+		
+		//if (key_str == "squelch")
+		//fprintf(stderr, "[%s] Tag #%d %s %s %s %s\n", name().c_str(), i, id_str.c_str(), key_str.c_str(), value_str.c_str(), d_appended.c_str());
+
+		int message_data_length =
+			sizeof(uint64_t) +
+			id_str.size() + 1 +
+			key_str.size() + 1 +
+			value_str.size() + 1 +
+			d_appended.size() + 1;
+
+		gr::message::sptr msg = gr::message::make(0, 0.0, 0.0, message_data_length);
+		int data_index = 0;
+		
+		memcpy(msg->msg() + data_index, &tag.offset, sizeof(uint64_t));
+		data_index += sizeof(uint64_t);
+		
+		memcpy(msg->msg() + data_index, id_str.c_str(), id_str.size() + 1);
+		data_index += (id_str.size() + 1);
+		
+		memcpy(msg->msg() + data_index, key_str.c_str(), key_str.size() + 1);
+		data_index += (key_str.size() + 1);
+		
+		memcpy(msg->msg() + data_index, value_str.c_str(), value_str.size() + 1);
+		data_index += (value_str.size() + 1);
+		
+		memcpy(msg->msg() + data_index, d_appended.c_str(), d_appended.size() + 1);
+		data_index += (d_appended.size() + 1);
+		
+		d_msgq->/*insert_tail*/handle(msg);	// 'handle' blocks when full
+		++d_message_count;
+		
+		msg.reset();
+	}
 }
 
 int baz_tag_to_msg::work (int noutput_items,
@@ -111,66 +343,16 @@ int baz_tag_to_msg::work (int noutput_items,
 	std::vector<gr::tag_t> tags;
 	const uint64_t nread = nitems_read(0);
 	get_tags_in_range(tags, 0, nread, nread+noutput_items);
-	if (tags.size() > 0)
-	{
-		std::string id_str, key_str, value_str;
-//		fprintf(stderr, "[%s] Tags: %d\n", name().c_str(), tags.size());
-		
-		for (int i = 0; i < tags.size(); ++i) {
-			const gr::tag_t& tag = tags[i];
-			id_str = pmt::write_string(tag.srcid);
-			key_str = pmt::write_string(tag.key);
-			value_str = pmt::write_string(tag.value);
-			
-			//if (key_str == "squelch")
-			//fprintf(stderr, "[%s] Tag #%d %s %s %s %s\n", name().c_str(), i, id_str.c_str(), key_str.c_str(), value_str.c_str(), d_appended.c_str());
-
-			int message_data_length =
-				sizeof(uint64_t) +
-				id_str.size() + 1 +
-				key_str.size() + 1 +
-				value_str.size() + 1 +
-				d_appended.size() + 1;
-			
-			/*if (message_data_length > d_buffer_size)
-			{
-				d_buffer_size = message_data_length;
-				d_buffer = (char*)realloc(d_buffer, d_buffer_size);
-				assert(d_buffer != NULL);
-			}*/
-
-			gr::message::sptr msg = gr::message::make(0, 0.0, 0.0, message_data_length);
-			int data_index = 0;
-			
-			memcpy(msg->msg() + data_index, &tag.offset, sizeof(uint64_t));
-			data_index += sizeof(uint64_t);
-			
-			memcpy(msg->msg() + data_index, id_str.c_str(), id_str.size() + 1);
-			data_index += (id_str.size() + 1);
-			
-			memcpy(msg->msg() + data_index, key_str.c_str(), key_str.size() + 1);
-			data_index += (key_str.size() + 1);
-			
-			memcpy(msg->msg() + data_index, value_str.c_str(), value_str.size() + 1);
-			data_index += (value_str.size() + 1);
-			
-			memcpy(msg->msg() + data_index, d_appended.c_str(), d_appended.size() + 1);
-			data_index += (d_appended.size() + 1);
-			
-			if (d_msgq->full_p())
-			{
-				//fprintf(stderr, "[tag_to_msg] Queue full!\n");
-			}
-			else
-			{
-				//fprintf(stderr, "[tag_to_msg] Handling message (%i/%i in queue)\n", d_msgq->count(), d_msgq->limit());
-				d_msgq->/*insert_tail*/handle(msg);	// 'handle' blocks too
-			}
-			//if (d_msgq->full_p())
-			//	fprintf(stderr, "[tag_to_msg] Queue still full!\n");
-			msg.reset();
-		}
-	}
+	if (tags.empty())
+		return noutput_items;
+	
+//	fprintf(stderr, "[%s] Tags: %d\n", name().c_str(), tags.size());
+	d_tag_count += tags.size();
+	
+	if (d_mode == MODE_BINARY)
+		post_binary(tags, nread, noutput_items);
+	else
+		post_strings(tags);
 
 	return noutput_items;	// Tell runtime system how many output items we produced.
 }
@@ -31,6 +31,8 @@
 #include <gnuradio/sync_block.h>
 #include <gnuradio/msg_queue.h>
 #include <string>
+#include <vector>
+#include <map>
 
 class baz_tag_to_msg;
 
@@ -54,34 +56,105 @@ typedef boost::shared_ptr<baz_tag_to_msg> baz_tag_to_msg_sptr;
  * constructor is private.  baz_make_tag_to_msg is the public
  * interface for creating new instances.
  */
-baz_tag_to_msg_sptr baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append = NULL/*, int initial_buffer_size = -1*/);
+baz_tag_to_msg_sptr baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append = NULL/*, int initial_buffer_size = -1*/, int mode = 0, bool blocking = false, int table_interval = 100, int max_symbols = 4096);
 
 /*!
- * \brief square2 a stream of floats.
+ * \brief Stream tags to messages
  * \ingroup block
  *
- * This uses the preferred technique: subclassing gr::sync_block.
+ * MODE_STRING: one gr::message per tag on 'msgq' (offset, then srcid, key, value & the appended
+ * string written out as NUL-terminated strings). When 'blocking' is false a full queue drops the
+ * message (counted), otherwise work waits for room.
+ *
+ * MODE_BINARY: every tag seen in a work call goes out as a single PDU on the 'tags' message port.
+ * Metadata: 'offset' & 'items' (the range covered), 'tags' (count), 'append' (if set), and when
+ * srcids/keys (or symbol values) are seen for the first time: 'symbol_base' & 'symbols' (vector of
+ * newly numbered symbols, so the table is built up from every PDU in order).
+ * A 'symbol_base' of 0 carries the whole table, replacing any held: this is sent every
+ * 'table_interval' PDUs (0: never), on request (request_table() or any message on 'table'), and
+ * when the table reaches 'max_symbols' (0: unlimited), at which point numbering starts again.
+ * The u8vector holds one record per tag (host byte order, packed):
+ *   uint64 offset, uint32 srcid symbol, uint32 key symbol, uint8 value type, value
+ * See python/tag_pdu.py for the value encodings & a decoder.
  */
 class baz_tag_to_msg : public gr::sync_block
 {
 private:
 	// The friend declaration allows baz_make_tag_to_msg to access the private constructor.
 
-	friend baz_tag_to_msg_sptr baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/);
+	friend baz_tag_to_msg_sptr baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/, int mode, bool blocking, int table_interval, int max_symbols);
 
-	baz_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/);  	// private constructor
+	baz_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/, int mode, bool blocking, int table_interval, int max_symbols);  	// private constructor
 
 	int d_item_size;
 	gr::msg_queue::sptr d_msgq;
 	//char* d_buffer;
 	//int d_buffer_size;
 	std::string d_appended;
+	int d_mode;
+	bool d_blocking;
+	uint64_t d_tag_count;
+	uint64_t d_message_count;
+	uint64_t d_dropped_count;
+	pmt::pmt_t d_port_id;
+	std::map<pmt::pmt_t,uint32_t> d_symbols;	// Interned srcids & keys (by symbol identity)
+	std::vector<pmt::pmt_t> d_symbol_list;		// By index
+	std::vector<uint8_t> d_record;
+	int d_table_interval;
+	int d_max_symbols;
+	int d_pdus_since_table;
+	volatile bool d_table_requested;
+
+	uint32_t symbol_index(const pmt::pmt_t& p);
+	void handle_table_request(pmt::pmt_t msg);
+	void encode_value(const pmt::pmt_t& value);
+	void post_strings(const std::vector<gr::tag_t>& tags);
+	void post_binary(const std::vector<gr::tag_t>& tags, uint64_t nread, int noutput_items);
 
  public:
+	enum mode_t
+	{
+		MODE_STRING	= 0,
+		MODE_BINARY	= 1
+	};
+
+	enum value_type_t	// Binary value encodings (payload follows)
+	{
+		VALUE_STRING	= 0,	// uint32 length, then pmt::write_string (no NUL)
+		VALUE_NIL	= 1,
+		VALUE_FALSE	= 2,
+		VALUE_TRUE	= 3,
+		VALUE_LONG	= 4,	// int64
+		VALUE_UINT64	= 5,	// uint64
+		VALUE_DOUBLE	= 6,	// double
+		VALUE_COMPLEX	= 7,	// double real, double imag
+		VALUE_SYMBOL	= 8,	// uint32 symbol
+		VALUE_TIME	= 9	// uint64 seconds, double fractional seconds (e.g. rx_time)
+	};
+
 	~baz_tag_to_msg ();	// public destructor
 
 	void set_msgq(gr::msg_queue::sptr msgq);
 	void set_appended_string(const char* append);
+	void set_blocking(bool blocking);
+	inline bool blocking() const
+	{ return d_blocking; }
+	inline int mode() const
+	{ return d_mode; }
+	inline uint64_t tag_count() const
+	{ return d_tag_count; }
+	inline uint64_t message_count() const	// Messages queued or PDUs posted
+	{ return d_message_count; }
+	inline uint64_t dropped_count() const	// Messages lost to a full queue
+	{ return d_dropped_count; }
+	void reset_counters();
+	void set_table_interval(int table_interval);
+	inline int table_interval() const
+	{ return d_table_interval; }
+	void set_max_symbols(int max_symbols);
+	inline int max_symbols() const
+	{ return d_max_symbols; }
+	void request_table();	// Next PDU carries the whole symbol table
 
 	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
 };
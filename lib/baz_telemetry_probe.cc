@@ -0,0 +1,350 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+/*
+ * config.h is generated by configure.  It contains the results
+ * of probing for features, options etc.  It should be the first
+ * file included in your .cc file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <baz_telemetry_probe.h>
+#include <baz_shared_page.h>
+#include <gnuradio/io_signature.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <time.h>
+#else
+#include <boost/date_time/posix_time/posix_time.hpp>
+#endif // _WIN32
+
+static uint64_t monotonic_ns()
+{
+#ifndef _WIN32
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#else
+	static const boost::posix_time::ptime epoch(boost::posix_time::microsec_clock::universal_time());
+	return (uint64_t)(boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() * 1000ULL;
+#endif // _WIN32
+}
+
+/*
+ * Create a new instance of baz_telemetry_probe and return
+ * a boost shared_ptr.  This is effectively the public constructor.
+ */
+baz_telemetry_probe_sptr baz_make_telemetry_probe (int item_size, double interval /*= 1.0*/, const std::string& stats_page /*= ""*/)
+{
+	return baz_telemetry_probe_sptr (new baz_telemetry_probe (item_size, interval, stats_page));
+}
+
+/*
+ * The private constructor
+ */
+baz_telemetry_probe::baz_telemetry_probe (int item_size, double interval, const std::string& stats_page)
+	: gr::sync_block ("telemetry_probe",
+		gr::io_signature::make (1, 1, item_size),
+		gr::io_signature::make (0, 1, item_size))
+	, d_item_size(item_size)
+	, d_interval_ns(0)
+	, d_port_id(pmt::mp("stats"))
+	, d_sequence(0)
+	, d_next_snapshot_ns(0)
+	, d_snapshot_count(0)
+	, d_reset(false)
+	, d_stats_page(NULL)
+{
+	if (item_size <= 0)
+		throw std::invalid_argument("telemetry_probe: item size must be positive");
+
+	memset(&d_counters, 0x00, sizeof(d_counters));
+	memset(&d_last_snapshot, 0x00, sizeof(d_last_snapshot));
+
+	set_interval(interval);
+
+	message_port_register_out(d_port_id);
+
+	if (stats_page.empty() == false)
+		set_stats_page(stats_page);
+
+	fprintf(stderr, "[%s<%i>] item size: %d, interval: %f\n", name().c_str(), unique_id(), item_size, interval);
+}
+
+/*
+ * Our virtual destructor.
+ */
+baz_telemetry_probe::~baz_telemetry_probe ()
+{
+	gr::thread::scoped_lock guard(d_page_mutex);
+
+	close_stats_page();
+}
+
+void baz_telemetry_probe::set_interval(double interval)
+{
+	d_interval_ns = ((interval > 0) ? (uint64_t)(interval * 1e9) : 0);
+	d_next_snapshot_ns = 0;	// Re-armed on the next work call
+}
+
+void baz_telemetry_probe::close_stats_page()
+{
+	baz_unmap_shared_page(d_stats_page, sizeof(stats_page_header));
+
+	d_stats_page = NULL;
+	d_stats_page_path.clear();
+}
+
+bool baz_telemetry_probe::set_stats_page(const std::string& path)
+{
+	gr::thread::scoped_lock guard(d_page_mutex);
+
+	close_stats_page();
+
+	if (path.empty())
+		return true;
+#ifdef _WIN32
+	fprintf(stderr, "[%s<%i>] stats page not supported on this platform\n", name().c_str(), unique_id());
+	return false;
+#else
+	const size_t length = sizeof(stats_page_header);
+
+	std::string error;
+	void* p = baz_map_shared_page(path, length, error);
+	if (p == NULL)
+	{
+		fprintf(stderr, "[%s<%i>] stats page: %s\n", name().c_str(), unique_id(), error.c_str());
+		return false;
+	}
+
+	d_stats_page = (stats_page_header*)p;
+	d_stats_page->version = STATS_PAGE_VERSION;
+	d_stats_page->page_size = length;
+	d_stats_page->item_size = d_item_size;
+	__sync_synchronize();
+	d_stats_page->magic = STATS_PAGE_MAGIC;	// Last, so a monitor never sees a half-initialised header
+
+	d_stats_page_path = path;
+
+	fprintf(stderr, "[%s<%i>] stats page: \"%s\"\n", name().c_str(), unique_id(), path.c_str());
+
+	return true;
+#endif // _WIN32
+}
+
+baz_telemetry_probe::counters baz_telemetry_probe::get_counters() const
+{
+	counters c;
+
+	while (true)
+	{
+		uint64_t sequence = d_sequence;
+		__sync_synchronize();
+
+		if (sequence & 1)	// Work thread is mid-update
+			continue;
+
+		memcpy(&c, (const void*)&d_counters, sizeof(c));
+		__sync_synchronize();
+
+		if (d_sequence == sequence)
+			break;
+	}
+
+	return c;
+}
+
+double baz_telemetry_probe::mean_call_size() const
+{
+	counters c = get_counters();
+	if (c.work_calls == 0)
+		return 0.0;
+
+	return ((double)c.items / (double)c.work_calls);
+}
+
+double baz_telemetry_probe::mean_gap() const
+{
+	counters c = get_counters();
+	if (c.work_calls < 2)
+		return 0.0;
+
+	return ((double)c.gap_total_ns / (double)(c.work_calls - 1) / 1e9);
+}
+
+std::vector<uint64_t> baz_telemetry_probe::call_size_histogram() const
+{
+	counters c = get_counters();
+
+	return std::vector<uint64_t>(c.call_size_bins, c.call_size_bins + CALL_SIZE_BINS);
+}
+
+void baz_telemetry_probe::reset()
+{
+	d_reset = true;
+}
+
+void baz_telemetry_probe::snapshot(uint64_t now)
+{
+	const counters& c = d_counters;	// Only the work thread writes these, so no need to go through get_counters
+
+	double elapsed = (double)(now - ((d_last_snapshot.last_call_ns > 0) ? d_last_snapshot.last_call_ns : c.first_call_ns)) / 1e9;
+	double item_rate = 0.0, call_rate = 0.0, tag_rate = 0.0;
+	if (elapsed > 0)
+	{
+		item_rate = (double)(c.items - d_last_snapshot.items) / elapsed;
+		call_rate = (double)(c.work_calls - d_last_snapshot.work_calls) / elapsed;
+		tag_rate = (double)(c.tags - d_last_snapshot.tags) / elapsed;
+	}
+
+	d_last_snapshot = c;
+	d_last_snapshot.last_call_ns = now;	// Start of the next interval
+	++d_snapshot_count;
+
+	{
+		gr::thread::scoped_lock guard(d_page_mutex);
+
+		if (d_stats_page)
+		{
+			d_stats_page->sequence = d_stats_page->sequence + 1;
+			__sync_synchronize();
+
+			d_stats_page->snapshot_count = d_snapshot_count;
+			d_stats_page->snapshot_ns = now;
+			d_stats_page->interval = elapsed;
+			d_stats_page->item_rate = item_rate;
+			d_stats_page->call_rate = call_rate;
+			d_stats_page->tag_rate = tag_rate;
+			d_stats_page->totals = c;
+
+			__sync_synchronize();
+			d_stats_page->sequence = d_stats_page->sequence + 1;
+		}
+	}
+
+	uint64_t work_calls = std::max(c.work_calls, (uint64_t)1);
+
+	pmt::pmt_t meta = pmt::make_dict();
+	meta = pmt::dict_add(meta, pmt::mp("snapshot"), pmt::from_uint64(d_snapshot_count));
+	meta = pmt::dict_add(meta, pmt::mp("interval"), pmt::from_double(elapsed));
+	meta = pmt::dict_add(meta, pmt::mp("items"), pmt::from_uint64(c.items));
+	meta = pmt::dict_add(meta, pmt::mp("work_calls"), pmt::from_uint64(c.work_calls));
+	meta = pmt::dict_add(meta, pmt::mp("tags"), pmt::from_uint64(c.tags));
+	meta = pmt::dict_add(meta, pmt::mp("item_rate"), pmt::from_double(item_rate));
+	meta = pmt::dict_add(meta, pmt::mp("call_rate"), pmt::from_double(call_rate));
+	meta = pmt::dict_add(meta, pmt::mp("tag_rate"), pmt::from_double(tag_rate));
+	meta = pmt::dict_add(meta, pmt::mp("min_call"), pmt::from_uint64(c.min_call));
+	meta = pmt::dict_add(meta, pmt::mp("max_call"), pmt::from_uint64(c.max_call));
+	meta = pmt::dict_add(meta, pmt::mp("mean_call"), pmt::from_double((double)c.items / (double)work_calls));
+	meta = pmt::dict_add(meta, pmt::mp("gap_min"), pmt::from_double((double)c.gap_min_ns / 1e9));
+	meta = pmt::dict_add(meta, pmt::mp("gap_max"), pmt::from_double((double)c.gap_max_ns / 1e9));
+	meta = pmt::dict_add(meta, pmt::mp("gap_mean"), pmt::from_double((c.work_calls > 1) ? ((double)c.gap_total_ns / (double)(c.work_calls - 1) / 1e9) : 0.0));
+	meta = pmt::dict_add(meta, pmt::mp("call_sizes"), pmt::init_u64vector(CALL_SIZE_BINS, c.call_size_bins));
+
+	message_port_pub(d_port_id, pmt::cons(meta, pmt::PMT_NIL));
+}
+
+bool baz_telemetry_probe::stop()
+{
+	if (d_counters.work_calls > 0)
+		snapshot(monotonic_ns());	// Final totals
+
+	return gr::sync_block::stop();
+}
+
+int baz_telemetry_probe::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+{
+	const uint64_t now = monotonic_ns();
+
+	if (output_items.size() > 0)
+		memcpy(output_items[0], input_items[0], (size_t)noutput_items * d_item_size);
+
+	const uint64_t nread = nitems_read(0);
+	d_tags.clear();
+	get_tags_in_range(d_tags, 0, nread, nread + noutput_items);
+
+	const uint64_t n = noutput_items;
+	counters& c = d_counters;
+
+	d_sequence = d_sequence + 1;
+	__sync_synchronize();
+
+	if (d_reset)
+	{
+		memset(&c, 0x00, sizeof(c));
+		memset(&d_last_snapshot, 0x00, sizeof(d_last_snapshot));
+		d_next_snapshot_ns = 0;
+		d_reset = false;
+	}
+
+	if (c.work_calls == 0)
+	{
+		c.first_call_ns = now;
+		c.min_call = n;
+	}
+	else
+	{
+		uint64_t gap = now - c.last_call_ns;
+		c.gap_total_ns += gap;
+		if ((c.work_calls == 1) || (gap < c.gap_min_ns))
+			c.gap_min_ns = gap;
+		c.gap_max_ns = std::max(c.gap_max_ns, gap);
+		c.min_call = std::min(c.min_call, n);
+	}
+
+	c.items += n;
+	++c.work_calls;
+	c.tags += d_tags.size();
+	c.max_call = std::max(c.max_call, n);
+	c.last_call = n;
+	c.last_call_ns = now;
+	if (n > 0)
+		++c.call_size_bins[std::min(63 - __builtin_clzll(n), CALL_SIZE_BINS - 1)];
+
+	__sync_synchronize();
+	d_sequence = d_sequence + 1;
+
+	if (d_interval_ns > 0)
+	{
+		if (d_next_snapshot_ns == 0)
+			d_next_snapshot_ns = now + d_interval_ns;
+		else if (now >= d_next_snapshot_ns)
+		{
+			snapshot(now);
+			d_next_snapshot_ns = now + d_interval_ns;
+		}
+	}
+
+	return noutput_items;
+}
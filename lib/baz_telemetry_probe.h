@@ -0,0 +1,161 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * gr-baz by Balint Seeber (http://spench.net/contact)
+ * Information, documentation & samples: http://wiki.spench.net/wiki/gr-baz
+ */
+
+#ifndef INCLUDED_BAZ_TELEMETRY_PROBE_H
+#define INCLUDED_BAZ_TELEMETRY_PROBE_H
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/thread/thread.h>
+
+#include <string>
+
+class BAZ_API baz_telemetry_probe;
+
+/*
+ * We use boost::shared_ptr's instead of raw pointers for all access
+ * to gr::blocks (and many other data structures).  The shared_ptr gets
+ * us transparent reference counting, which greatly simplifies storage
+ * management issues.  This is especially helpful in our hybrid
+ * C++ / Python system.
+ *
+ * See http://www.boost.org/libs/smart_ptr/smart_ptr.htm
+ *
+ * As a convention, the _sptr suffix indicates a boost::shared_ptr
+ */
+typedef boost::shared_ptr<baz_telemetry_probe> baz_telemetry_probe_sptr;
+
+/*!
+ * \brief Return a shared_ptr to a new instance of baz_telemetry_probe.
+ *
+ * To avoid accidental use of raw pointers, baz_telemetry_probe's
+ * constructor is private.  baz_make_telemetry_probe is the public
+ * interface for creating new instances.
+ */
+BAZ_API baz_telemetry_probe_sptr baz_make_telemetry_probe (int item_size, double interval = 1.0, const std::string& stats_page = "");
+
+/*!
+ * \brief Pass-through (or sink-only, if the output is left unconnected) flowgraph probe
+ * \ingroup block
+ *
+ * Counts items, work calls (with a log2 histogram of call sizes), the time between
+ * successive work calls and tags.  The work thread is the only writer: readers take a
+ * consistent copy with a sequence lock, so nothing in the stream path ever blocks.
+ * Every 'interval' seconds (0 disables) a snapshot is posted on the 'stats' port as a
+ * PDU (dictionary, no payload) and, if one is open, copied into a memory-mapped stats
+ * page that external monitors can poll.
+ */
+class BAZ_API baz_telemetry_probe : public gr::sync_block
+{
+public:
+	static const int CALL_SIZE_BINS = 32;	// Bin n: call sizes in [2^n, 2^(n+1))
+
+	// Fixed little-endian layout, shared by PDU snapshot & stats page
+	struct counters {
+		uint64_t items;
+		uint64_t work_calls;
+		uint64_t tags;
+		uint64_t min_call;               // Items (0 until the first call)
+		uint64_t max_call;
+		uint64_t last_call;
+		uint64_t gap_total_ns;           // Sum of time between successive work calls
+		uint64_t gap_min_ns;
+		uint64_t gap_max_ns;
+		uint64_t first_call_ns;          // Monotonic clock
+		uint64_t last_call_ns;
+		uint64_t call_size_bins[CALL_SIZE_BINS];
+	};
+
+	// Memory-mapped stats page: re-read while 'sequence' is odd or changes under the copy
+	struct stats_page_header {
+		uint32_t magic;                  // STATS_PAGE_MAGIC
+		uint32_t version;
+		uint32_t page_size;              // sizeof(stats_page_header)
+		uint32_t item_size;
+		volatile uint64_t sequence;      // Odd while a snapshot is being written
+		uint64_t snapshot_count;
+		uint64_t snapshot_ns;            // Monotonic clock at snapshot
+		double interval;                 // Seconds covered by the rates below
+		double item_rate;                // Items/s over the last interval
+		double call_rate;                // Work calls/s
+		double tag_rate;                 // Tags/s
+		counters totals;
+	};
+
+	static const uint32_t STATS_PAGE_MAGIC = 0x30545350;	// "PST0"
+	static const uint32_t STATS_PAGE_VERSION = 1;
+private:
+	// The friend declaration allows baz_make_telemetry_probe to
+	// access the private constructor.
+	friend BAZ_API baz_telemetry_probe_sptr baz_make_telemetry_probe (int item_size, double interval, const std::string& stats_page);
+
+	baz_telemetry_probe (int item_size, double interval, const std::string& stats_page);  	// private constructor
+
+	int d_item_size;
+	uint64_t d_interval_ns;
+	pmt::pmt_t d_port_id;
+	volatile uint64_t d_sequence;	// Odd while the work thread is updating d_counters
+	counters d_counters;
+	counters d_last_snapshot;	// Totals at the last snapshot (for rates)
+	uint64_t d_next_snapshot_ns;
+	uint64_t d_snapshot_count;
+	volatile bool d_reset;	// Requested by reset(), carried out by the work thread
+	std::vector<gr::tag_t> d_tags;
+	gr::thread::mutex d_page_mutex;
+	std::string d_stats_page_path;
+	stats_page_header* d_stats_page;
+	void close_stats_page();
+	void snapshot(uint64_t now);
+public:
+	~baz_telemetry_probe ();	// public destructor
+
+	void set_interval(double interval);
+	double interval() const
+	{ return ((double)d_interval_ns / 1e9); }
+	bool set_stats_page(const std::string& path);	// Empty path closes page
+	std::string stats_page() const
+	{ return d_stats_page_path; }
+
+	counters get_counters() const;	// Consistent copy, safe from any thread
+	uint64_t items() const
+	{ return get_counters().items; }
+	uint64_t work_calls() const
+	{ return get_counters().work_calls; }
+	uint64_t tags() const
+	{ return get_counters().tags; }
+	double mean_call_size() const;
+	double mean_gap() const;	// Seconds between work calls
+	std::vector<uint64_t> call_size_histogram() const;
+	uint64_t snapshot_count() const
+	{ return d_snapshot_count; }
+	void reset();
+
+	bool stop();
+
+	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
+};
+
+#endif /* INCLUDED_BAZ_TELEMETRY_PROBE_H */
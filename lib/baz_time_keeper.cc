@@ -39,31 +39,40 @@
 #include <pmt/pmt.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdexcept>
 
 /*
  * Create a new instance of baz_time_keeper and return
  * a boost shared_ptr.  This is effectively the public constructor.
  */
 baz_time_keeper_sptr
-baz_make_time_keeper (int item_size, int sample_rate)
+baz_make_time_keeper (int item_size, int sample_rate, int history /*= 64*/, double max_jump /*= 0.0*/)
 {
-	return baz_time_keeper_sptr (new baz_time_keeper (item_size, sample_rate));
+	return baz_time_keeper_sptr (new baz_time_keeper (item_size, sample_rate, history, max_jump));
 }
 
 /*
  * The private constructor
  */
-baz_time_keeper::baz_time_keeper (int item_size, int sample_rate)
+baz_time_keeper::baz_time_keeper (int item_size, int sample_rate, int history, double max_jump)
 	: gr::sync_block ("baz_time_keeper",
 		gr::io_signature::make (1, 1, item_size),
 		gr::io_signature::make (0, 0, 0))
 	, d_item_size(item_size), d_sample_rate(sample_rate)
-	, d_last_time_seconds(0), d_first_time_seconds(0), d_last_time_fractional_seconds(0), d_first_time_fractional_seconds(0)
-	, d_time_offset(-1), d_seen_time(false), d_update_count(0), d_ignore_next(true)	// Ignore first update
+	, d_history_length(std::max(history, 1))
+	, d_max_jump((max_jump > 0) ? max_jump : (8.0 / (double)sample_rate))
+	, d_update_count(0), d_ignore_next(true)	// Ignore first update
+	, d_sequence(0)
 {
-	//memset(&d_last_time, 0x00, sizeof(uhd::time_spec_t));
+	if (sample_rate <= 0)
+		throw std::invalid_argument("time_keeper: sample rate must be positive");
 
-	fprintf(stderr, "[%s<%i>] item size: %d, sample rate: %d\n", name().c_str(), unique_id(), item_size, sample_rate);
+	memset(&d_model, 0x00, sizeof(d_model));
+	d_model.period = 1.0 / (double)sample_rate;
+
+	fprintf(stderr, "[%s<%i>] item size: %d, sample rate: %d, history: %d, max jump: %g s\n", name().c_str(), unique_id(), item_size, sample_rate, d_history_length, d_max_jump);
 
 	d_status_port_id = pmt::mp("status");
 	message_port_register_out(d_status_port_id);
@@ -78,15 +87,119 @@ baz_time_keeper::~baz_time_keeper ()
 
 static const pmt::pmt_t RX_TIME_KEY = pmt::string_to_symbol("rx_time");
 
-double baz_time_keeper::time(bool relative /*= false*/)
+baz_time_keeper::clock_model baz_time_keeper::model() const
 {
-	gr::thread::scoped_lock guard(d_mutex);
-	
-	double d = ((double)d_last_time_seconds + d_last_time_fractional_seconds) + ((double)d_time_offset / (double)d_sample_rate);
+	clock_model m;
+
+	while (true)
+	{
+		uint64_t sequence = d_sequence;
+		__sync_synchronize();
+
+		if (sequence & 1)	// Work thread is mid-update
+			continue;
+
+		memcpy(&m, (const void*)&d_model, sizeof(m));
+		__sync_synchronize();
+
+		if (d_sequence == sequence)
+			break;
+	}
+
+	return m;
+}
+
+void baz_time_keeper::to_time(const clock_model& m, uint64_t sample, uint64_t& seconds, double& fractional_seconds)
+{
+	double t = m.ref_fractional_seconds + m.offset + (m.period * (double)(int64_t)(sample - m.ref_sample));
+	double whole = floor(t);
+
+	seconds = m.ref_seconds + (int64_t)whole;
+	fractional_seconds = t - whole;
+}
+
+bool baz_time_keeper::sample_to_time(uint64_t sample, uint64_t& seconds, double& fractional_seconds) const
+{
+	clock_model m = model();
+	if (m.valid == false)
+		return false;
+
+	to_time(m, sample, seconds, fractional_seconds);
+
+	return true;
+}
+
+bool baz_time_keeper::time_to_sample(uint64_t seconds, double fractional_seconds, double& sample) const
+{
+	clock_model m = model();
+	if (m.valid == false)
+		return false;
+
+	double t = (double)(int64_t)(seconds - m.ref_seconds) + (fractional_seconds - m.ref_fractional_seconds);
+	sample = (double)m.ref_sample + ((t - m.offset) / m.period);
+
+	return true;
+}
+
+double baz_time_keeper::sample_time(uint64_t sample, bool relative /*= false*/) const
+{
+	clock_model m = model();
+	if (m.valid == false)
+		return 0.0;
+
+	uint64_t seconds;
+	double fractional_seconds;
+	to_time(m, sample, seconds, fractional_seconds);
+
 	if (relative)
-		d -= ((double)d_first_time_seconds + d_first_time_fractional_seconds);
-	
-	return d;
+		return ((double)(int64_t)(seconds - m.first_seconds) + (fractional_seconds - m.first_fractional_seconds));
+
+	return ((double)seconds + fractional_seconds);
+}
+
+double baz_time_keeper::time_sample(double time, bool relative /*= false*/) const
+{
+	clock_model m = model();
+	if (m.valid == false)
+		return 0.0;
+
+	double t;
+	if (relative)
+		t = (double)(int64_t)(m.first_seconds - m.ref_seconds) + (m.first_fractional_seconds - m.ref_fractional_seconds) + time;
+	else
+		t = (time - (double)m.ref_seconds) - m.ref_fractional_seconds;
+
+	return ((double)m.ref_sample + ((t - m.offset) / m.period));
+}
+
+double baz_time_keeper::time(bool relative /*= false*/)
+{
+	return sample_time(model().next_sample, relative);
+}
+
+double baz_time_keeper::sample_rate_estimate() const
+{
+	return (1.0 / model().period);
+}
+
+double baz_time_keeper::drift_ppm() const
+{
+	return ((((1.0 / model().period) / (double)d_sample_rate) - 1.0) * 1e6);
+}
+
+double baz_time_keeper::jitter() const
+{
+	return model().jitter;
+}
+
+int baz_time_keeper::history_count() const
+{
+	return model().points;
+}
+
+uint64_t baz_time_keeper::discontinuity_count() const
+{
+	return model().discontinuities;
 }
 
 void baz_time_keeper::ignore_next(bool ignore /*= true*/)
@@ -105,10 +218,100 @@ int baz_time_keeper::update_count(void)
 	return d_update_count;
 }
 
+// Called by the work thread between sequence increments: returns the stats to post once the model is published
+pmt::pmt_t baz_time_keeper::add_point(uint64_t sample, uint64_t seconds, double fractional_seconds)
+{
+	clock_model& m = d_model;
+	bool discontinuity = false;
+
+	if (m.valid)
+	{
+		uint64_t predicted_seconds;
+		double predicted_fractional_seconds;
+		to_time(m, sample, predicted_seconds, predicted_fractional_seconds);
+
+		double error = (double)(int64_t)(seconds - predicted_seconds) + (fractional_seconds - predicted_fractional_seconds);
+		if (fabs(error) > d_max_jump)
+		{
+			fprintf(stderr, "[%s<%i>] time jumped by %g s at sample %llu: starting new history\n", name().c_str(), unique_id(), error, (unsigned long long)sample);
+
+			d_history.clear();
+			++m.discontinuities;
+			discontinuity = true;
+		}
+	}
+	else
+	{
+		m.first_seconds = seconds;
+		m.first_fractional_seconds = fractional_seconds;
+	}
+
+	if (d_history.empty())	// New reference: keeps the fit's arithmetic in small numbers
+	{
+		m.ref_sample = sample;
+		m.ref_seconds = seconds;
+		m.ref_fractional_seconds = fractional_seconds;
+	}
+
+	time_point p;
+	p.sample = sample;
+	p.time = (double)(int64_t)(seconds - m.ref_seconds) + (fractional_seconds - m.ref_fractional_seconds);
+	d_history.push_back(p);
+
+	while ((int)d_history.size() > d_history_length)
+		d_history.pop_front();
+
+	// Least-squares line through the history, about its mean
+	const double n = (double)d_history.size();
+	double mean_x = 0, mean_y = 0;
+	for (std::deque<time_point>::const_iterator it = d_history.begin(); it != d_history.end(); ++it)
+	{
+		mean_x += (double)(int64_t)(it->sample - m.ref_sample);
+		mean_y += it->time;
+	}
+	mean_x /= n;
+	mean_y /= n;
+
+	double sxx = 0, sxy = 0;
+	for (std::deque<time_point>::const_iterator it = d_history.begin(); it != d_history.end(); ++it)
+	{
+		double dx = (double)(int64_t)(it->sample - m.ref_sample) - mean_x;
+		sxx += dx * dx;
+		sxy += dx * (it->time - mean_y);
+	}
+
+	m.period = ((sxx > 0) ? (sxy / sxx) : (1.0 / (double)d_sample_rate));	// Nominal rate until two distinct samples are seen
+	m.offset = mean_y - (m.period * mean_x);
+
+	double sum_squares = 0;
+	m.max_residual = 0;
+	for (std::deque<time_point>::const_iterator it = d_history.begin(); it != d_history.end(); ++it)
+	{
+		double residual = it->time - (m.offset + (m.period * (double)(int64_t)(it->sample - m.ref_sample)));
+		sum_squares += residual * residual;
+		m.max_residual = std::max(m.max_residual, fabs(residual));
+	}
+
+	m.jitter = sqrt(sum_squares / n);
+	m.points = d_history.size();
+	m.valid = true;
+
+	pmt::pmt_t stats = pmt::make_dict();
+	stats = pmt::dict_add(stats, pmt::mp("sample"), pmt::from_uint64(sample));
+	stats = pmt::dict_add(stats, pmt::mp("rx_time"), pmt::make_tuple(pmt::from_uint64(seconds), pmt::from_double(fractional_seconds)));
+	stats = pmt::dict_add(stats, pmt::mp("rate"), pmt::from_double(1.0 / m.period));
+	stats = pmt::dict_add(stats, pmt::mp("drift_ppm"), pmt::from_double((((1.0 / m.period) / (double)d_sample_rate) - 1.0) * 1e6));
+	stats = pmt::dict_add(stats, pmt::mp("jitter"), pmt::from_double(m.jitter));
+	stats = pmt::dict_add(stats, pmt::mp("max_residual"), pmt::from_double(m.max_residual));
+	stats = pmt::dict_add(stats, pmt::mp("points"), pmt::from_long(m.points));
+	stats = pmt::dict_add(stats, pmt::mp("discontinuity"), pmt::from_bool(discontinuity));
+	stats = pmt::dict_add(stats, pmt::mp("discontinuities"), pmt::from_uint64(m.discontinuities));
+
+	return pmt::cons(pmt::mp("stats"), stats);
+}
+
 int baz_time_keeper::work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
 {
-	gr::thread::scoped_lock guard(d_mutex);
-	
 	//fprintf(stderr, "[%s] Work %d\n", name().c_str(), noutput_items);
 	
 	//const char *in = (char*)input_items[0];
@@ -119,48 +322,41 @@ int baz_time_keeper::work (int noutput_items, gr_vector_const_void_star &input_i
 	
 	get_tags_in_range(tags, tag_channel, nread, (nread + noutput_items), RX_TIME_KEY);
 	
-	// 'd_ignore_next' can either be the very next tag, or all tags found in the current work
-	// [1] Next tag: expecting frequent re-tunes & less overruns
-	// [2] All tags: expecting infrequent re-tunes & more overruns
-	if (tags.size() > 0) {
-		if (d_ignore_next == false)	// [1]
-			d_update_count += tags.size() - 1;
-		//else if (tags.size() > 1)	// [1]
-		//	d_ignore_next = false;
-	}
+	std::vector<pmt::pmt_t> stats(tags.size());
 	
-	int offset = 0;
-	for (int i = /*0*/(tags.size() - 1); i < tags.size(); ++i) {
+	d_sequence = d_sequence + 1;
+	__sync_synchronize();
+	
+	for (size_t i = 0; i < tags.size(); ++i)	// Every tag feeds the fit, even if it doesn't count as an update
+	{
 		const gr::tag_t& tag = tags[i];
 		
-		//fprintf(stderr, "[%s<%i>] Tag #%d %s\n", name().c_str(), unique_id(), i, pmt::write_string(tag.key).c_str());
-		
-		d_time_offset = 0;
-		offset = tags[i].offset - nread;
-		
-		d_last_time_seconds = pmt::to_uint64(pmt::tuple_ref(tag.value, 0));
-		d_last_time_fractional_seconds = pmt::to_double(pmt::tuple_ref(tag.value, 1));
-		
-		if (d_seen_time == false) {
-			d_first_time_seconds = d_last_time_seconds;
-			d_first_time_fractional_seconds = d_last_time_fractional_seconds;
-		}
-		
-		if (d_ignore_next == false)
-		{
-			++d_update_count;
-
-			message_port_pub(d_status_port_id, pmt::string_to_symbol("update"));
-		}
-		
-		d_seen_time = true;
-		//d_ignore_next = false;	// [1]
+		stats[i] = add_point(tag.offset, pmt::to_uint64(pmt::tuple_ref(tag.value, 0)), pmt::to_double(pmt::tuple_ref(tag.value, 1)));
 	}
 	
-	if (tags.size() > 0)	// [2]
-		d_ignore_next = false;
+	d_model.next_sample = nread + noutput_items;
+	
+	__sync_synchronize();
+	d_sequence = d_sequence + 1;
+	
+	if (tags.size() == 0)
+		return noutput_items;
+	
+	for (size_t i = 0; i < stats.size(); ++i)
+		message_port_pub(d_status_port_id, stats[i]);
+	
+	gr::thread::scoped_lock guard(d_mutex);
+	
+	// 'd_ignore_next' covers all tags found in the current work
+	// (expecting infrequent re-tunes & more overruns)
+	if (d_ignore_next == false)
+	{
+		d_update_count += tags.size();
+		
+		message_port_pub(d_status_port_id, pmt::string_to_symbol("update"));
+	}
 	
-	d_time_offset += (noutput_items - offset);
+	d_ignore_next = false;
 	
 	return noutput_items;
 }
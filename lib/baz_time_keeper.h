@@ -32,6 +32,8 @@
 //#include <gnuradio/msg_queue.h>
 #include <gnuradio/thread/thread.h>
 
+#include <deque>
+
 class BAZ_API baz_time_keeper;
 
 /*
@@ -54,13 +56,18 @@ typedef boost::shared_ptr<baz_time_keeper> baz_time_keeper_sptr;
  * constructor is private.  howto_make_square2_ff is the public
  * interface for creating new instances.
  */
-BAZ_API baz_time_keeper_sptr baz_make_time_keeper (int item_size, int sample_rate);
+BAZ_API baz_time_keeper_sptr baz_make_time_keeper (int item_size, int sample_rate, int history = 64, double max_jump = 0.0);
 
 /*!
- * \brief square2 a stream of floats.
+ * \brief Tracks 'rx_time' tags and maps sample indices to time (and back)
  * \ingroup block
  *
- * This uses the preferred technique: subclassing gr::sync_block.
+ * The last 'history' (sample index, rx_time) pairs are fitted with a line, giving the
+ * actual sample clock rate & offset.  A pair that lands further than 'max_jump' seconds
+ * from the fit (e.g. after an overrun or re-tune; 0: 8 nominal sample periods) starts a
+ * new history.  The fit is published with a sequence lock, so the lookups never block
+ * and may be called from any thread.  Each new pair also posts ("stats" . dict) with the
+ * drift & jitter on the 'status' port, alongside the original 'update' symbol.
  */
 class BAZ_API baz_time_keeper : public gr::sync_block
 {
@@ -68,28 +75,66 @@ private:
 	// The friend declaration allows baz_time_keeper to
 	// access the private constructor.
 
-	friend BAZ_API baz_time_keeper_sptr baz_make_time_keeper (int item_size, int sample_rate);
+	friend BAZ_API baz_time_keeper_sptr baz_make_time_keeper (int item_size, int sample_rate, int history, double max_jump);
+
+	baz_time_keeper (int item_size, int sample_rate, int history, double max_jump);  	// private constructor
+
+	struct time_point {
+		uint64_t sample;
+		double time;	// Seconds after the model's reference time
+	};
 
-	baz_time_keeper (int item_size, int sample_rate);  	// private constructor
+	// Line through the history: time(sample) = ref + offset + (period * (sample - ref_sample))
+	struct clock_model {
+		bool valid;
+		uint64_t ref_sample;
+		uint64_t ref_seconds;
+		double ref_fractional_seconds;
+		double offset;
+		double period;	// Seconds per sample
+		uint64_t first_seconds;	// First rx_time ever seen (for relative times)
+		double first_fractional_seconds;
+		uint64_t next_sample;	// First sample not yet seen by work
+		int points;
+		double jitter;	// RMS residual (s)
+		double max_residual;
+		uint64_t discontinuities;
+	};
 
 	int d_item_size;
-	uint64_t d_last_time_seconds, d_first_time_seconds;
-	double d_last_time_fractional_seconds, d_first_time_fractional_seconds;
-	uint64_t d_time_offset;
 	int d_sample_rate;
-	bool d_seen_time;
+	int d_history_length;
+	double d_max_jump;
 	int d_update_count;
 	bool d_ignore_next;
 	gr::thread::mutex d_mutex;
 	pmt::pmt_t d_status_port_id;
+	std::deque<time_point> d_history;
+	volatile uint64_t d_sequence;	// Odd while the work thread is updating d_model
+	clock_model d_model;
+
+	clock_model model() const;
+	pmt::pmt_t add_point(uint64_t sample, uint64_t seconds, double fractional_seconds);
+	static void to_time(const clock_model& m, uint64_t sample, uint64_t& seconds, double& fractional_seconds);
 
 public:
 	~baz_time_keeper ();	// public destructor
 
-	double time(bool relative = false);
+	double time(bool relative = false);	// Time of the next sample to arrive
 	void ignore_next(bool ignore = true);
 	int update_count(void);
 
+	bool sample_to_time(uint64_t sample, uint64_t& seconds, double& fractional_seconds) const;
+	bool time_to_sample(uint64_t seconds, double fractional_seconds, double& sample) const;	// Fractional absolute sample index
+	double sample_time(uint64_t sample, bool relative = false) const;	// Relative keeps sub-microsecond precision in a double
+	double time_sample(double time, bool relative = false) const;
+
+	double sample_rate_estimate() const;
+	double drift_ppm() const;
+	double jitter() const;
+	int history_count() const;
+	uint64_t discontinuity_count() const;
+
 	int work (int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items);
 };
 
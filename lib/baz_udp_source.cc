@@ -33,6 +33,8 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <algorithm>
 
 #if defined(HAVE_NETDB_H)
 #include <netdb.h>
@@ -52,6 +54,16 @@ typedef void* optval_t;
 #include <arpa/inet.h>
 #endif
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#endif // __linux__
+
 #elif defined(HAVE_WINDOWS_H)
 // if not posix, assume winsock
 #define USING_WINSOCK
@@ -101,6 +113,60 @@ enum BorFlags
 #define USE_RCV_TIMEO 0  // non-blocking receive on all but Cygwin
 #define SRC_VERBOSE 0
 
+#if !defined(USING_WINSOCK)
+#define USE_RECVMSG   1  // ancillary data (receive timestamps)
+#if defined(__linux__)
+#define USE_RECVMMSG  1  // several datagrams per system call
+#endif // __linux__
+#endif // USING_WINSOCK
+
+#if defined(__linux__) && defined(TPACKET3_HDRLEN)
+#define USE_PACKET_RING 1  // TPACKET_V3 PACKET_MMAP receive
+#endif
+
+#define CONTROL_SIZE  64 // ancillary data room per datagram (one struct timespec)
+
+#if USE_RECVMSG
+static int64_t control_time(struct msghdr *msg)
+{
+#ifdef SO_TIMESTAMPNS
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+    }
+  }
+#endif // SO_TIMESTAMPNS
+  return 0;
+}
+
+static int64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+#endif // USE_RECVMSG
+
+#if USE_PACKET_RING
+static void add_filter(std::vector<struct sock_filter> &code, unsigned short op, unsigned int k)
+{
+  struct sock_filter insn;
+  insn.code = op;
+  insn.jt = insn.jf = 0;  // Jumps fall through unless patched
+  insn.k = k;
+  code.push_back(insn);
+}
+#endif // USE_PACKET_RING
+
+static int histogram_bin(int64_t ns)
+{
+  if (ns <= 1)
+    return 0;
+  return std::min(63 - __builtin_clzll((unsigned long long)ns), UDP_SOURCE_HISTOGRAM_BINS - 1);
+}
+
 static int is_error( int perr )
 {
   // Compare error to posix error code; return nonzero if match.
@@ -147,12 +213,26 @@ UDP_SOURCE_NAME::UDP_SOURCE_NAME(size_t itemsize, const char *host,
 		   gr::io_signature::make(1, 1, itemsize)),
     d_itemsize(itemsize), d_payload_size(payload_size),
     d_eof(eof), d_wait(wait), d_socket(-1), d_residual(0), d_temp_offset(0),
-	d_bor(bor), d_bor_counter(0), d_bor_first(false),
-	d_eos(false)
+	d_bor(bor), d_bor_counter(0), d_bor_first(false), d_verbose(verbose),
+	d_eos(false),
+#if USE_RECVMMSG
+	d_batch(UDP_SOURCE_BATCH),
+#else
+	d_batch(1),
+#endif // USE_RECVMMSG
+	d_packet_length(d_batch, 0), d_packet_time(d_batch, 0),
+	d_packet_count(0), d_packet_index(0), d_control(NULL),
+	d_bind_address(0), d_ring_socket(-1), d_ring(NULL), d_ring_block_size(0), d_ring_block_count(0), d_ring_block(0), d_ring_held(false),
+	d_timestamps(false), d_tag_interval(0), d_timing_window(0), d_packets(0),
+	d_arrival_tag(pmt::mp("arrival_time")), d_timing_port(pmt::mp("timing")),
+	d_interval_histogram(UDP_SOURCE_HISTOGRAM_BINS, 0), d_jitter_histogram(UDP_SOURCE_HISTOGRAM_BINS, 0)
 {
   if (bor)
 	d_payload_size += sizeof(BOR_PACKET_HEADER);
   
+  reset_timing_stats();
+  message_port_register_out(d_timing_port);
+  
   int ret = 0;
 
 #if defined(USING_WINSOCK) // for Windows (with MinGW)
@@ -183,7 +263,11 @@ UDP_SOURCE_NAME::UDP_SOURCE_NAME(size_t itemsize, const char *host,
 		 "can't initialize source socket" );
 
   // FIXME leaks if report_error throws below
-  d_temp_buff = new char[d_payload_size];   // allow it to hold up to payload_size bytes
+  d_temp_buff = new char[d_batch * d_payload_size];   // allow each slot to hold up to payload_size bytes
+  d_packet_data.resize(d_batch);
+  for (int i = 0; i < d_batch; ++i)
+    d_packet_data[i] = d_temp_buff + (i * d_payload_size);
+  d_control = new char[d_batch * CONTROL_SIZE];
 
   // create socket
   d_socket = socket(ip_src->ai_family, ip_src->ai_socktype,
@@ -248,6 +332,8 @@ UDP_SOURCE_NAME::UDP_SOURCE_NAME(size_t itemsize, const char *host,
   if(bind (d_socket, ip_src->ai_addr, ip_src->ai_addrlen) == -1) {
     report_error("socket bind","can't bind socket");
   }
+  if (ip_src->ai_family == AF_INET)
+    d_bind_address = ((sockaddr_in*)ip_src->ai_addr)->sin_addr.s_addr;
   freeaddrinfo(ip_src);
 
 }
@@ -262,7 +348,10 @@ UDP_SOURCE_MAKER (size_t itemsize, const char *ipaddr,
 
 UDP_SOURCE_NAME::~UDP_SOURCE_NAME ()
 {
+  close_ring();
+
   delete [] d_temp_buff;
+  delete [] d_control;
 
   if (d_socket != -1){
     shutdown(d_socket, SHUT_RDWR);
@@ -286,48 +375,155 @@ UDP_SOURCE_NAME::signal_eos() {
   d_eos = true;
 }
 
-int 
-UDP_SOURCE_NAME::work (int noutput_items,
-		     gr_vector_const_void_star &input_items,
-		     gr_vector_void_star &output_items)
+void
+UDP_SOURCE_NAME::set_timestamps(bool enable, int tag_interval /*= 0*/)
 {
-  if (d_eos)
-	return -1;
-  
-  char *out = (char *) output_items[0];
-  ssize_t r=0, nbytes=0, bytes_received=0;
-  ssize_t total_bytes = (ssize_t)(d_itemsize*noutput_items);
+#if USE_RECVMSG
+#ifdef SO_TIMESTAMPNS
+  int opt_val = (enable ? 1 : 0);
+  if (setsockopt(d_socket, SOL_SOCKET, SO_TIMESTAMPNS, (optval_t)&opt_val, sizeof(int)) == -1) {
+    report_error("SO_TIMESTAMPNS", NULL);
+    if (enable)
+      fprintf(stderr, UDP_SOURCE_STRING ": no kernel receive timestamps, using time of receive call\n");
+  }
+#else
+  if (enable)
+    fprintf(stderr, UDP_SOURCE_STRING ": no kernel receive timestamps, using time of receive call\n");
+#endif // SO_TIMESTAMPNS
+#else
+  if (enable)
+    throw std::runtime_error(UDP_SOURCE_STRING ": receive timestamps are not supported on this platform");
+#endif // USE_RECVMSG
 
-  #if SRC_VERBOSE
-  printf("\nEntered udp_source\n");
-  #endif
+  d_tag_interval = std::max(0, tag_interval);
+  d_timestamps = enable;
+}
+
+void
+UDP_SOURCE_NAME::set_timing_window(int packets)
+{
+  d_timing_window = std::max(0, packets);
+}
+
+double
+UDP_SOURCE_NAME::jitter()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+  return d_jitter * 1e-9;
+}
+
+double
+UDP_SOURCE_NAME::mean_interval()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+  return d_mean_interval * 1e-9;
+}
+
+double
+UDP_SOURCE_NAME::max_interval()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+  return (double)d_max_interval * 1e-9;
+}
+
+std::vector<uint64_t>
+UDP_SOURCE_NAME::interval_histogram()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+  return d_interval_histogram;
+}
 
-  // Remove items from temp buffer if they are in there
-  if(d_residual) {
-    nbytes = std::min(d_residual, total_bytes);
-    memcpy(out, d_temp_buff+d_temp_offset, nbytes);
-    bytes_received = nbytes;
-
-    #if SRC_VERBOSE
-    printf("\tTemp buff size: %d  offset: %d (bytes_received: %d) (noutput_items: %d)\n", 
-	   d_residual, d_temp_offset, bytes_received, noutput_items);
-    #endif
-
-    // Increment pointer
-    out += bytes_received;
-    
-    // Update indexing of amount of bytes left in the buffer
-    d_residual -= nbytes;
-    d_temp_offset += nbytes;
-
-    // Return now with what we've got.
-    assert(nbytes % d_itemsize == 0);
-    return nbytes/d_itemsize;
+std::vector<uint64_t>
+UDP_SOURCE_NAME::jitter_histogram()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+  return d_jitter_histogram;
+}
+
+void
+UDP_SOURCE_NAME::reset_timing_stats()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+
+  d_last_arrival = 0;
+  d_last_interval = -1;
+  d_jitter = 0;
+  d_mean_interval = 0;
+  d_max_interval = 0;
+  d_window_packets = 0;
+  std::fill(d_interval_histogram.begin(), d_interval_histogram.end(), 0);
+  std::fill(d_jitter_histogram.begin(), d_jitter_histogram.end(), 0);
+}
+
+// Called with d_timing_mutex held
+void
+UDP_SOURCE_NAME::publish_timing()
+{
+  pmt::pmt_t dict = pmt::make_dict();
+  dict = pmt::dict_add(dict, pmt::mp("packets"), pmt::from_uint64(d_window_packets));
+  dict = pmt::dict_add(dict, pmt::mp("jitter"), pmt::from_double(d_jitter * 1e-9));
+  dict = pmt::dict_add(dict, pmt::mp("mean_interval"), pmt::from_double(d_mean_interval * 1e-9));
+  dict = pmt::dict_add(dict, pmt::mp("max_interval"), pmt::from_double((double)d_max_interval * 1e-9));
+  dict = pmt::dict_add(dict, pmt::mp("interval_histogram"), pmt::init_u64vector(d_interval_histogram.size(), d_interval_histogram));
+  dict = pmt::dict_add(dict, pmt::mp("jitter_histogram"), pmt::init_u64vector(d_jitter_histogram.size(), d_jitter_histogram));
+  message_port_pub(d_timing_port, dict);
+
+  // Smoothed values carry over, the window restarts
+  d_window_packets = 0;
+  d_max_interval = 0;
+  std::fill(d_interval_histogram.begin(), d_interval_histogram.end(), 0);
+  std::fill(d_jitter_histogram.begin(), d_jitter_histogram.end(), 0);
+}
+
+void
+UDP_SOURCE_NAME::record_arrivals()
+{
+  gr::thread::scoped_lock guard(d_timing_mutex);
+
+  for (int i = 0; i < d_packet_count; ++i) {
+    int64_t t = d_packet_time[i];
+
+    if (d_last_arrival != 0) {
+      int64_t interval = std::max(t - d_last_arrival, (int64_t)0);
+
+      ++d_interval_histogram[histogram_bin(interval)];
+      d_max_interval = std::max(d_max_interval, interval);
+
+      if (d_last_interval < 0)
+	d_mean_interval = (double)interval;
+      else {
+	d_mean_interval += ((double)interval - d_mean_interval) / 16.0;
+
+	int64_t difference = interval - d_last_interval;
+	if (difference < 0)
+	  difference = -difference;
+	d_jitter += ((double)difference - d_jitter) / 16.0;
+	++d_jitter_histogram[histogram_bin(difference)];
+      }
+
+      d_last_interval = interval;
+    }
+
+    d_last_arrival = t;
+    ++d_window_packets;
+
+    if ((d_timing_window > 0) && (d_window_packets >= (uint64_t)d_timing_window))
+      publish_timing();
   }
+}
 
-  while(1) {
-    // get the data into our output buffer and record the number of bytes
+// Waits for, and reads, the next batch of datagrams. Returns how many, or 0 on timeout/EOF, -1 on error.
+int
+UDP_SOURCE_NAME::receive_batch()
+{
+#if USE_PACKET_RING
+  if (d_ring != NULL)
+    return receive_ring();
+#endif // USE_PACKET_RING
+
+  d_packet_count = d_packet_index = 0;
 
+  while(1) {
 #if USE_SELECT
     // RCV_TIMEO doesn't work on all systems (e.g., Cygwin)
     // use select() instead of, or in addition to RCV_TIMEO
@@ -337,7 +533,7 @@ UDP_SOURCE_NAME::work (int noutput_items,
     timeout.tv_usec = 0;
     FD_ZERO(&readfds);
     FD_SET(d_socket, &readfds);
-    r = select(FD_SETSIZE, &readfds, NULL, NULL, &timeout);
+    int r = select(FD_SETSIZE, &readfds, NULL, NULL, &timeout);
     if(r < 0) {
 	report_error("udp_source/select",NULL);
 	return -1;
@@ -349,27 +545,61 @@ UDP_SOURCE_NAME::work (int noutput_items,
 	continue;
       }
       else
-	return -1;
+	return 0;
     }
 #endif // USE_SELECT
 
-	int recvd = -1;
+    int count = -1;
+#if USE_RECVMMSG
+    // Block for the first datagram, then take whatever else is already queued
+    struct mmsghdr msgs[UDP_SOURCE_BATCH];	// d_packet_data points at these slots
+    struct iovec iovecs[UDP_SOURCE_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < d_batch; ++i) {
+      iovecs[i].iov_base = d_temp_buff + (i * d_payload_size);
+      iovecs[i].iov_len = d_payload_size;
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      if (d_timestamps) {
+	msgs[i].msg_hdr.msg_control = d_control + (i * CONTROL_SIZE);
+	msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+      }
+    }
+    count = recvmmsg(d_socket, msgs, d_batch, MSG_WAITFORONE, NULL);
+    for (int i = 0; i < count; ++i) {
+      d_packet_length[i] = msgs[i].msg_len;
+      d_packet_time[i] = (d_timestamps ? control_time(&msgs[i].msg_hdr) : 0);
+    }
+#elif USE_RECVMSG
+    struct msghdr msg;
+    struct iovec iov;
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = d_temp_buff;
+    iov.iov_len = d_payload_size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (d_timestamps) {
+      msg.msg_control = d_control;
+      msg.msg_controllen = CONTROL_SIZE;
+    }
+    ssize_t length = recvmsg(d_socket, &msg, 0);
+    if (length >= 0) {
+      count = 1;
+      d_packet_length[0] = length;
+      d_packet_time[0] = (d_timestamps ? control_time(&msg) : 0);
+    }
+#else
     // This is a non-blocking call with a timeout set in the constructor
-    recvd = r = recv(d_socket, d_temp_buff, d_payload_size, 0);  // get the entire payload or the what's available
-
-    // If r > 0, round it down to a multiple of d_itemsize 
-    // (If sender is broken, don't propagate problem)
-    if (r > 0) {
-	  if (d_bor) {
-		r -= sizeof(BOR_PACKET_HEADER);
-	  }
-	  else {
-		r = (r/d_itemsize) * d_itemsize;
-	  }
+    ssize_t length = recv(d_socket, d_temp_buff, d_payload_size, 0);  // get the entire payload or the what's available
+    if (length >= 0) {
+      count = 1;
+      d_packet_length[0] = length;
+      d_packet_time[0] = 0;
     }
+#endif // USE_RECVMMSG
 
     // Check if there was a problem; forget it if the operation just timed out
-    if(r == -1) {
+    if (count < 0) {
       if( is_error(EAGAIN) ) {  // handle non-blocking call timeout
         #if SRC_VERBOSE
 	printf("UDP receive timed out\n"); 
@@ -381,93 +611,424 @@ UDP_SOURCE_NAME::work (int noutput_items,
 	  continue;
 	}
 	else
-	  return -1;
+	  return 0;
       }
       else {
 	report_error("udp_source/recv",NULL);
 	return -1;
       }
     }
-    else if(r==0) {
-      if(d_eof) {
-	// zero-length packet interpreted as EOF
 
-	#if SNK_VERBOSE
-	printf("\tzero-length packet received; returning EOF\n");
-	#endif
+    d_packet_count = count;
+    d_packets += count;
+
+#if USE_RECVMSG
+    if (d_timestamps) {
+      int64_t now = 0;
+      for (int i = 0; i < count; ++i) {
+	if (d_packet_time[i] == 0) {	// No kernel timestamp: fall back to our own clock
+	  if (now == 0)
+	    now = now_ns();
+	  d_packet_time[i] = now;
+	}
+      }
+
+      record_arrivals();
+    }
+#endif // USE_RECVMSG
+
+    return count;
+  }
+}
+
+bool
+UDP_SOURCE_NAME::use_packet_ring(const std::string &ifname, int block_size /*= (1 << 20)*/, int block_count /*= 16*/)
+{
+  close_ring();
+
+  if (ifname.empty())
+    return false;
+
+#if USE_PACKET_RING
+  const int page_size = getpagesize();
+  block_size = std::max(((block_size + page_size - 1) / page_size) * page_size, page_size);
+  block_count = std::max(block_count, 2);
+
+  unsigned int ifindex = if_nametoindex(ifname.c_str());
+  if (ifindex == 0) {
+    fprintf(stderr, UDP_SOURCE_STRING ": unknown interface '%s', receiving from the socket\n", ifname.c_str());
+    return false;
+  }
+
+  // Not bound to a protocol yet, so nothing arrives before the filter is in place
+  int fd = socket(AF_PACKET, SOCK_DGRAM, 0);
+  if (fd == -1) {
+    report_error(UDP_SOURCE_STRING "/packet socket (needs CAP_NET_RAW)", NULL);
+    fprintf(stderr, UDP_SOURCE_STRING ": no packet ring, receiving from the socket\n");
+    return false;
+  }
+
+  // SOCK_DGRAM: the filter (and ring) see the IP header at offset 0
+  std::vector<struct sock_filter> code;
+  std::vector<std::pair<size_t, bool> > drops;  // Jumps to patch to the final 'ret #0' (true: on match)
+  add_filter(code, BPF_LD | BPF_B | BPF_ABS, 9);  // Protocol
+  drops.push_back(std::make_pair(code.size(), false));
+  add_filter(code, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP);
+  add_filter(code, BPF_LD | BPF_H | BPF_ABS, 6);  // Fragments (MF or offset) can't be taken apart here
+  drops.push_back(std::make_pair(code.size(), true));
+  add_filter(code, BPF_JMP | BPF_JSET | BPF_K, 0x3fff);
+  if (d_bind_address != 0) {
+    add_filter(code, BPF_LD | BPF_W | BPF_ABS, 16);  // Destination address
+    drops.push_back(std::make_pair(code.size(), false));
+    add_filter(code, BPF_JMP | BPF_JEQ | BPF_K, ntohl(d_bind_address));
+  }
+  add_filter(code, BPF_LDX | BPF_B | BPF_MSH, 0);  // IP header length
+  add_filter(code, BPF_LD | BPF_H | BPF_IND, 2);   // Destination port
+  drops.push_back(std::make_pair(code.size(), false));
+  add_filter(code, BPF_JMP | BPF_JEQ | BPF_K, (unsigned int)get_port());
+  add_filter(code, BPF_RET | BPF_K, 0xffff);
+  add_filter(code, BPF_RET | BPF_K, 0);
+
+  for (size_t i = 0; i < drops.size(); ++i) {
+    unsigned char skip = (unsigned char)(code.size() - 1 - (drops[i].first + 1));
+    if (drops[i].second)
+      code[drops[i].first].jt = skip;
+    else
+      code[drops[i].first].jf = skip;
+  }
+
+  struct sock_fprog program;
+  program.len = code.size();
+  program.filter = &code[0];
+
+  int version = TPACKET_V3;
+
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = block_size;
+  req.tp_block_nr = block_count;
+  req.tp_frame_size = TPACKET_ALIGNMENT << 7;  // Only a sanity check for V3 (frames are packed)
+  req.tp_frame_nr = (block_size / req.tp_frame_size) * block_count;
+  req.tp_retire_blk_tov = 4;  // ms before a part-filled block is handed over anyway
+
+  const size_t ring_size = (size_t)block_size * block_count;
+  char *ring = (char*)MAP_FAILED;
+
+  struct sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_IP);
+  address.sll_ifindex = ifindex;
+
+  const char *failed = NULL;
+  if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == -1)
+    failed = "SO_ATTACH_FILTER";
+  else if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1)
+    failed = "PACKET_VERSION";
+  else if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1)
+    failed = "PACKET_RX_RING";
+  else if ((ring = (char*)mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    failed = "packet ring mmap";
+  else if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+    failed = "packet socket bind";
+
+  if (failed != NULL) {
+    report_error(failed, NULL);
+    fprintf(stderr, UDP_SOURCE_STRING ": no packet ring, receiving from the socket\n");
+    if (ring != MAP_FAILED)
+      munmap(ring, ring_size);
+    ::close(fd);
+    return false;
+  }
+
+  // The socket keeps the port, but no longer queues anything
+  struct sock_filter drop_all;
+  drop_all.code = BPF_RET | BPF_K; drop_all.jt = drop_all.jf = 0; drop_all.k = 0;
+  struct sock_fprog drop_program;
+  drop_program.len = 1;
+  drop_program.filter = &drop_all;
+  if (setsockopt(d_socket, SOL_SOCKET, SO_ATTACH_FILTER, &drop_program, sizeof(drop_program)) == -1)
+    report_error("SO_ATTACH_FILTER", NULL);
+
+  d_ring_socket = fd;
+  d_ring = ring;
+  d_ring_block_size = block_size;
+  d_ring_block_count = block_count;
+  d_ring_block = 0;
+  d_ring_held = false;
+  d_ring_interface = ifname;
+  d_packet_count = d_packet_index = 0;
+  d_residual = 0;
+
+  if (d_packet_data.size() < (size_t)(block_size / 64)) {
+    d_packet_data.resize(block_size / 64);  // Upper bound on packets per block
+    d_packet_length.resize(d_packet_data.size());
+    d_packet_time.resize(d_packet_data.size());
+  }
+
+  fprintf(stderr, UDP_SOURCE_STRING ": receiving port %d on %s through a %d x %d byte packet ring\n", get_port(), ifname.c_str(), block_count, block_size);
+
+  return true;
+#else
+  fprintf(stderr, UDP_SOURCE_STRING ": packet ring not supported on this platform, receiving from the socket\n");
+  return false;
+#endif // USE_PACKET_RING
+}
+
+void
+UDP_SOURCE_NAME::close_ring()
+{
+#if USE_PACKET_RING
+  if (d_ring == NULL)
+    return;
+
+  munmap(d_ring, d_ring_block_size * d_ring_block_count);
+  ::close(d_ring_socket);
+  d_ring = NULL;
+  d_ring_socket = -1;
+  d_ring_held = false;
+
+  int unused = 0;
+  setsockopt(d_socket, SOL_SOCKET, SO_DETACH_FILTER, &unused, sizeof(unused));
+
+  // Pending packets pointed into the ring
+  d_packet_count = d_packet_index = 0;
+  d_residual = 0;
+  for (int i = 0; i < d_batch; ++i)
+    d_packet_data[i] = d_temp_buff + (i * d_payload_size);
+#endif // USE_PACKET_RING
+}
+
+// Hands the drained block back to the kernel and waits for the next. Same returns as receive_batch.
+int
+UDP_SOURCE_NAME::receive_ring()
+{
+#if USE_PACKET_RING
+  while (1) {
+    if (d_ring_held) {
+      struct tpacket_block_desc *done = (struct tpacket_block_desc*)(d_ring + (d_ring_block * d_ring_block_size));
+      __sync_synchronize();  // Finished reading before the kernel may refill it
+      done->hdr.bh1.block_status = TP_STATUS_KERNEL;
+      d_ring_held = false;
+      d_ring_block = (d_ring_block + 1) % d_ring_block_count;
+
+      struct tpacket_stats_v3 stats;
+      socklen_t stats_size = sizeof(stats);
+      if ((getsockopt(d_ring_socket, SOL_PACKET, PACKET_STATISTICS, &stats, &stats_size) == 0) && (stats.tp_drops > 0)) {
+	if (d_verbose)
+	  fprintf(stderr, "Packet ring dropped %u packets\n", stats.tp_drops);
+	else
+	  fprintf(stderr, "rO");
+      }
+    }
+
+    d_packet_count = d_packet_index = 0;
 
+    struct tpacket_block_desc *desc = (struct tpacket_block_desc*)(d_ring + (d_ring_block * d_ring_block_size));
+    if ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+      struct pollfd pfd;
+      pfd.fd = d_ring_socket;
+      pfd.events = POLLIN | POLLERR;
+      pfd.revents = 0;
+      int r = poll(&pfd, 1, 1000);
+      if (r < 0) {
+	if (errno == EINTR)
+	  continue;
+	report_error("udp_source/poll", NULL);
 	return -1;
       }
-      else{
-	// do we need to allow boost thread interrupt?
-	boost::this_thread::interruption_point();
-	continue;
+      else if (r == 0) {  // timed out
+	if (d_wait) {
+	  // Allow boost thread interrupt, then try again
+	  boost::this_thread::interruption_point();
+	  continue;
+	}
+	else
+	  return 0;
       }
+      continue;
     }
-    else {
-	  int offset = 0;
-	  if (d_bor) {
-		if (recvd != d_payload_size) {
-		  if (d_verbose)
-			fprintf(stderr, "Received size %d != payload %d\n", recvd, d_payload_size);
-		  else
-			fprintf(stderr, "b!");
+
+    __sync_synchronize();  // Block contents after its status
+    d_ring_held = true;
+
+    const int num_pkts = desc->hdr.bh1.num_pkts;
+    if ((size_t)num_pkts > d_packet_data.size()) {
+      d_packet_data.resize(num_pkts);
+      d_packet_length.resize(num_pkts);
+      d_packet_time.resize(num_pkts);
+    }
+
+    const char *frame = (const char*)desc + desc->hdr.bh1.offset_to_first_pkt;
+    int count = 0;
+    for (int i = 0; i < num_pkts; ++i) {
+      const struct tpacket3_hdr *hdr = (const struct tpacket3_hdr*)frame;
+      const unsigned char *ip = (const unsigned char*)frame + hdr->tp_net;
+      ssize_t captured = hdr->tp_snaplen;
+      ssize_t ip_header = (ip[0] & 0x0f) * 4;
+
+      if (captured >= (ip_header + 8)) {  // The filter only passes UDP
+	const unsigned char *udp = ip + ip_header;
+	ssize_t payload = ((udp[4] << 8) | udp[5]) - 8;
+	payload = std::min(std::min(payload, captured - ip_header - 8), (ssize_t)d_payload_size);
+	if (payload >= 0) {
+	  d_packet_data[count] = (const char*)udp + 8;
+	  d_packet_length[count] = payload;
+	  d_packet_time[count] = ((int64_t)hdr->tp_sec * 1000000000LL) + hdr->tp_nsec;
+	  ++count;
+	}
+      }
+
+      frame += hdr->tp_next_offset;
+    }
+
+    if (count == 0)
+      continue;
+
+    d_packet_count = count;
+    d_packets += count;
+
+    if (d_timestamps)
+      record_arrivals();
+
+    return count;
+  }
+#else
+  return -1;
+#endif // USE_PACKET_RING
+}
+
+// Starts draining datagram 'index': 1 if it has payload, 0 to skip it, -1 for EOF
+int
+UDP_SOURCE_NAME::open_packet(int index, ssize_t bytes_out)
+{
+  const char *buff = d_packet_data[index];
+  ssize_t recvd = d_packet_length[index];
+  ssize_t r = recvd;
+
+  if (r == 0) {
+    if (d_eof) {
+      // zero-length packet interpreted as EOF
+
+      #if SRC_VERBOSE
+      printf("\tzero-length packet received; returning EOF\n");
+      #endif
+
+      return -1;
+    }
+    return 0;
+  }
+
+  int offset = 0;
+  if (d_bor) {
+    r -= sizeof(BOR_PACKET_HEADER);
+
+	if (recvd != d_payload_size) {
+	  if (d_verbose)
+		fprintf(stderr, "Received size %d != payload %d\n", (int)recvd, d_payload_size);
+	  else
+		fprintf(stderr, "b!");
+	}
+	else {
+	  PBOR_PACKET_HEADER pHeader = (PBOR_PACKET_HEADER)buff;
+	  if (pHeader->flags & BF_HARDWARE_OVERRUN) {
+		fprintf(stderr, "uO");
+	  }
+	  if (pHeader->flags & BF_STREAM_START) {
+		fprintf(stderr, "Stream start (%d)\n", (int)pHeader->idx);
+		if (d_bor_first)
+		  d_bor_first = false;
+	  }
+	  if (pHeader->idx != d_bor_counter) {
+		if (d_bor_first == false) {
+		  if ((pHeader->flags & BF_STREAM_START) == 0) {
+		    fprintf(stderr, "First packet (%d)\n", (int)pHeader->idx);
+		  }
+		  d_bor_first = true;
 		}
 		else {
-		  PBOR_PACKET_HEADER pHeader = (PBOR_PACKET_HEADER)d_temp_buff;
-		  if (pHeader->flags & BF_HARDWARE_OVERRUN) {
-			fprintf(stderr, "uO");
-		  }
-		  if (pHeader->flags & BF_STREAM_START) {
-			fprintf(stderr, "Stream start (%d)\n", (int)pHeader->idx);
-			if (d_bor_first)
-			  d_bor_first = false;
-		  }
-		  if (pHeader->idx != d_bor_counter) {
-			if (d_bor_first == false) {
-			  if ((pHeader->flags & BF_STREAM_START) == 0) {
-			    fprintf(stderr, "First packet (%d)\n", (int)pHeader->idx);
-			  }
-			  d_bor_first = true;
-			}
-			else {
-			  if (d_verbose)
-				fprintf(stderr, "Dropped %03d packets: %05d -> %05d\n", (int)(pHeader->idx - d_bor_counter), (int)d_bor_counter, (int)pHeader->idx);
-			  else
-				fprintf(stderr, "bO");
-			}
-			d_bor_counter = pHeader->idx;
-		  }
-		  ++d_bor_counter;
-		  offset = sizeof(BOR_PACKET_HEADER);
+		  if (d_verbose)
+			fprintf(stderr, "Dropped %03d packets: %05d -> %05d\n", (int)(pHeader->idx - d_bor_counter), (int)d_bor_counter, (int)pHeader->idx);
+		  else
+			fprintf(stderr, "bO");
 		}
+		d_bor_counter = pHeader->idx;
 	  }
-	  
-      // Calculate the number of bytes we can take from the buffer in this call
-      nbytes = std::min(r, total_bytes-bytes_received);
-      
-      // adjust the total number of bytes we have to round down to nearest integer of an itemsize
-      nbytes -= ((bytes_received+nbytes) % d_itemsize);   
+	  ++d_bor_counter;
+	  offset = sizeof(BOR_PACKET_HEADER);
+	}
+  }
 
-      // copy the number of bytes we want to look at here
-      memcpy(out, (d_temp_buff + offset), nbytes);
+  // Round down to a multiple of d_itemsize
+  // (If sender is broken, don't propagate problem)
+  r = (r / (ssize_t)d_itemsize) * d_itemsize;
+  if (r <= 0)
+    return 0;
 
-      d_residual = r - nbytes;                      // save the number of bytes stored
-      d_temp_offset = nbytes + offset;              // reset buffer index
+  if ((d_timestamps) && (d_tag_interval > 0)) {
+    uint64_t sequence = d_packets - d_packet_count + index;
+    if ((sequence % d_tag_interval) == 0) {
+      int64_t t = d_packet_time[index];
+      add_item_tag(0, nitems_written(0) + (bytes_out / d_itemsize), d_arrival_tag,
+	pmt::make_tuple(pmt::from_uint64(t / 1000000000LL), pmt::from_double((double)(t % 1000000000LL) * 1e-9)),
+	pmt::mp(alias()));
+    }
+  }
+
+  d_residual = r;
+  d_temp_offset = offset;
+
+  return 1;
+}
+
+int 
+UDP_SOURCE_NAME::work (int noutput_items,
+		     gr_vector_const_void_star &input_items,
+		     gr_vector_void_star &output_items)
+{
+  if (d_eos)
+	return -1;
+  
+  char *out = (char *) output_items[0];
+  ssize_t bytes_received=0;
+  ssize_t total_bytes = (ssize_t)(d_itemsize*noutput_items);
+
+  #if SRC_VERBOSE
+  printf("\nEntered udp_source\n");
+  #endif
+
+  while(1) {
+    // Drain what has already been received (packet lengths are whole items)
+    while ((d_packet_index < d_packet_count) && (bytes_received < total_bytes)) {
+      if (d_residual == 0) {
+	int ret = open_packet(d_packet_index, bytes_received);
+	if (ret < 0)
+	  return (bytes_received ? (bytes_received / d_itemsize) : -1);	// EOF packet stays put for the next call
+	if (ret == 0) {
+	  ++d_packet_index;
+	  continue;
+	}
+      }
+
+      ssize_t nbytes = std::min(d_residual, total_bytes - bytes_received);
+      memcpy(out + bytes_received, d_packet_data[d_packet_index] + d_temp_offset, nbytes);
 
-      // keep track of the total number of bytes received
       bytes_received += nbytes;
+      d_residual -= nbytes;
+      d_temp_offset += nbytes;
 
-      // increment the pointer
-      out += nbytes;
+      if (d_residual == 0)
+	++d_packet_index;
+    }
 
-      // Immediately return when data comes in
+    // Immediately return when data comes in
+    if (bytes_received > 0)
       break;
-    }
 
-    #if SNK_VERBOSE
-    printf("\tbytes received: %d bytes (nbytes: %d)\n", bytes, nbytes);
-    #endif
+    if (receive_batch() <= 0)
+      return -1;
+
+    boost::this_thread::interruption_point();
   }
 
   #if SRC_VERBOSE
@@ -29,6 +29,8 @@
 
 #include <gnuradio/sync_block.h>
 #include <gnuradio/thread/thread.h>
+#include <vector>
+#include <string>
 
 #ifdef IN_GR_BAZ
 #define UDP_SOURCE_NAME   baz_udp_source
@@ -51,6 +53,10 @@ typedef ptrdiff_t ssize_t;
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
+
+#define UDP_SOURCE_BATCH          32  // Datagrams pulled from the socket per receive call (where recvmmsg exists)
+#define UDP_SOURCE_HISTOGRAM_BINS 40  // log2(ns) bins: bin k counts [2^k, 2^(k+1)) ns
 
 class BAZ_API UDP_SOURCE_NAME;
 typedef boost::shared_ptr<UDP_SOURCE_NAME> UDP_SOURCE_SPTR;
@@ -76,6 +82,22 @@ BAZ_API UDP_SOURCE_SPTR UDP_SOURCE_MAKER(size_t itemsize, const char *host,
  * \param wait         Wait for data if not immediately available
  *                     (default: true)
  *
+ * Datagrams are received in batches and drained into the output across work
+ * calls. With set_timestamps() each datagram's kernel receive time
+ * (SO_TIMESTAMPNS) is captured: every 'tag_interval' packets the first item of
+ * the packet carries an 'arrival_time' tag (uint64 seconds, double fractional
+ * seconds, as rx_time), and inter-arrival interval and jitter (RFC 3550 style,
+ * difference of successive intervals) histograms are kept. They are readable
+ * through the getters, and, when a timing window is set, published as a dict
+ * on the 'timing' message port every 'window' packets, after which they restart.
+ *
+ * On Linux, use_packet_ring() switches reception to a TPACKET_V3 PACKET_MMAP
+ * ring on the given interface: a BPF filter passes only UDP datagrams for this
+ * port (and address, if bound), and payloads are copied (and BorIP headers
+ * parsed) straight from the mapped ring into the output buffer. Kernel receive
+ * timestamps come for free. This needs CAP_NET_RAW (e.g. root in a network
+ * namespace); when the ring can't be set up the socket path stays in use.
+ *
 */
 
 class BAZ_API UDP_SOURCE_NAME : public gr::sync_block
@@ -101,6 +123,49 @@ class BAZ_API UDP_SOURCE_NAME : public gr::sync_block
   bool			d_verbose;
   bool			d_eos;
 
+  // Batch of received datagrams, one d_payload_size slot each in d_temp_buff
+  int d_batch;
+  std::vector<const char*> d_packet_data;  // Payload start: a d_temp_buff slot, or in the packet ring
+  std::vector<ssize_t> d_packet_length;
+  std::vector<int64_t> d_packet_time;     // Kernel receive time (ns since epoch), 0 if unknown
+  int d_packet_count;                     // Received in the current batch
+  int d_packet_index;                     // Being drained (its remainder is d_residual bytes at d_temp_offset)
+  char *d_control;                        // Ancillary data per slot
+
+  // Packet ring
+  uint32_t d_bind_address;                // Network order, 0 for any
+  int d_ring_socket;
+  char *d_ring;
+  size_t d_ring_block_size;
+  int d_ring_block_count;
+  int d_ring_block;                       // Next (or, while held, current) block
+  bool d_ring_held;                       // Current block's packets are being drained
+  std::string d_ring_interface;
+
+  // Timing
+  bool d_timestamps;
+  int d_tag_interval;
+  int d_timing_window;
+  uint64_t d_packets;                     // Received since start
+  pmt::pmt_t d_arrival_tag;
+  pmt::pmt_t d_timing_port;
+  gr::thread::mutex d_timing_mutex;       // Getters vs. work (taken once per batch)
+  int64_t d_last_arrival;
+  int64_t d_last_interval;
+  double d_jitter;                        // Smoothed |interval difference| (ns)
+  double d_mean_interval;                 // Smoothed interval (ns)
+  int64_t d_max_interval;
+  uint64_t d_window_packets;
+  std::vector<uint64_t> d_interval_histogram;
+  std::vector<uint64_t> d_jitter_histogram;
+
+  int receive_batch();
+  int receive_ring();
+  void close_ring();
+  int open_packet(int index, ssize_t bytes_out);
+  void record_arrivals();
+  void publish_timing();
+
  protected:
   /*!
    * \brief UDP Source Constructor
@@ -133,7 +198,30 @@ class BAZ_API UDP_SOURCE_NAME : public gr::sync_block
   
   void signal_eos();
 
-  // should we export anything else?
+  /*!
+   * \brief Capture kernel receive timestamps per datagram
+   * \param tag_interval Packets between 'arrival_time' tags (0: timing statistics only)
+   */
+  void set_timestamps(bool enable, int tag_interval = 0);
+  bool timestamps() const { return d_timestamps; }
+  /*! \brief Publish (and restart) timing statistics every 'packets' packets (0: never) */
+  void set_timing_window(int packets);
+  int timing_window() const { return d_timing_window; }
+
+  uint64_t packets_received() const { return d_packets; }
+  double jitter();                        // Seconds
+  double mean_interval();                 // Seconds
+  double max_interval();                  // Seconds, in the current window
+  std::vector<uint64_t> interval_histogram();
+  std::vector<uint64_t> jitter_histogram();
+  void reset_timing_stats();
+
+  /*!
+   * \brief Receive through a PACKET_MMAP ring on interface 'ifname' instead of the socket (call before starting)
+   * \return Whether the ring is in use (false: unavailable, or 'ifname' is empty, and the socket is used)
+   */
+  bool use_packet_ring(const std::string &ifname, int block_size = (1 << 20), int block_count = 16);
+  bool packet_ring() const { return (d_ring != NULL); }
 
   int work(int noutput_items,
 	   gr_vector_const_void_star &input_items,
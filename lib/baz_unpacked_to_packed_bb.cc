@@ -32,6 +32,16 @@
 #include <baz_unpacked_to_packed_bb.h>
 #include <gnuradio/io_signature.h>
 #include <assert.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define BAZ_WORD_GATHER
+#endif
 
 //static const unsigned int BITS_PER_TYPE = sizeof(unsigned char) * 8;
 
@@ -52,6 +62,13 @@ baz_unpacked_to_packed_bb::baz_unpacked_to_packed_bb (unsigned int bits_per_chun
   assert (bits_per_chunk <= bits_into_output);
   assert (bits_per_chunk > 0);
 
+  for (int i = 0; i < 256; ++i) {
+    unsigned char r = 0;
+    for (int j = 0; j < 8; ++j)
+      r |= ((i >> j) & 1) << (7 - j);
+    d_reverse[i] = r;
+  }
+
   set_relative_rate (bits_per_chunk/(1.0 * bits_into_output));
 }
 
@@ -74,6 +91,61 @@ unsigned int get_bit_be1 (const unsigned char *in_vector, unsigned int bit_addr,
   return (x >> (bits_per_chunk - 1 - residue)) & 1;
 }
 
+/*
+ * Fast paths for whole output bytes (bits_into_output == 8).
+ * Each produces MSB-first output; LSB-first output is the same byte bit-reversed.
+ */
+
+// 1 bit per chunk: 8 inputs -> 1 output
+static void pack_1_msb(const unsigned char *in, unsigned char *out, int noutput_items, const unsigned char *reverse)
+{
+  int i = 0;
+#ifdef __SSE2__
+  for (; (i + 2) <= noutput_items; i += 2) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + (i * 8)));
+    int mask = _mm_movemask_epi8(_mm_slli_epi16(x, 7));  // Bit 0 of each byte -> bit k of mask (LSB-first)
+    out[i + 0] = reverse[mask & 0xff];
+    out[i + 1] = reverse[(mask >> 8) & 0xff];
+  }
+#endif // __SSE2__
+  for (; i < noutput_items; ++i) {
+#ifdef BAZ_WORD_GATHER
+    uint64_t w;
+    memcpy(&w, in + (i * 8), sizeof(w));
+    w &= 0x0101010101010101ULL;
+    out[i] = (unsigned char)((w * 0x8040201008040201ULL) >> 56);
+#else
+    const unsigned char *p = in + (i * 8);
+    out[i] = ((p[0] & 1) << 7) | ((p[1] & 1) << 6) | ((p[2] & 1) << 5) | ((p[3] & 1) << 4) |
+             ((p[4] & 1) << 3) | ((p[5] & 1) << 2) | ((p[6] & 1) << 1) | (p[7] & 1);
+#endif // BAZ_WORD_GATHER
+  }
+}
+
+// 2 bits per chunk: 4 inputs -> 1 output
+static void pack_2_msb(const unsigned char *in, unsigned char *out, int noutput_items)
+{
+  for (int i = 0; i < noutput_items; ++i) {
+#ifdef BAZ_WORD_GATHER
+    uint32_t w;
+    memcpy(&w, in + (i * 4), sizeof(w));
+    w &= 0x03030303;
+    // Each chunk lands in the top byte without overlapping any other partial product
+    out[i] = (unsigned char)((((uint64_t)w) * 0x40100401ULL) >> 24);
+#else
+    const unsigned char *p = in + (i * 4);
+    out[i] = ((p[0] & 3) << 6) | ((p[1] & 3) << 4) | ((p[2] & 3) << 2) | (p[3] & 3);
+#endif // BAZ_WORD_GATHER
+  }
+}
+
+// 4 bits per chunk: 2 inputs -> 1 output
+static void pack_4_msb(const unsigned char *in, unsigned char *out, int noutput_items)
+{
+  for (int i = 0; i < noutput_items; ++i)
+    out[i] = ((in[(i * 2) + 0] & 0x0f) << 4) | (in[(i * 2) + 1] & 0x0f);
+}
+
 int baz_unpacked_to_packed_bb::general_work (int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
 {
   unsigned int index_tmp = d_index;
@@ -90,6 +162,26 @@ int baz_unpacked_to_packed_bb::general_work (int noutput_items, gr_vector_int &n
     // per stream processing
 
     //assert((ninput_items[m]-d_index)*d_bits_per_chunk >= noutput_items*BITS_PER_TYPE);
+
+    // Chunks that evenly divide a byte never leave a residual index
+    if ((d_bits_into_output == 8) && (d_index == 0) &&
+        ((d_bits_per_chunk == 1) || (d_bits_per_chunk == 2) || (d_bits_per_chunk == 4)))
+    {
+      switch (d_bits_per_chunk)
+      {
+        case 1: pack_1_msb(in, out, noutput_items, d_reverse); break;
+        case 2: pack_2_msb(in, out, noutput_items); break;
+        case 4: pack_4_msb(in, out, noutput_items); break;
+      }
+
+      if (d_endianness == gr::GR_LSB_FIRST) {
+        for (int i = 0; i < noutput_items; i++)
+          out[i] = d_reverse[out[i]];
+      }
+
+      index_tmp = d_index + (noutput_items * 8);
+      continue;
+    }
   
     switch (d_endianness)
 	{
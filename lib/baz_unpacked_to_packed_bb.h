@@ -70,6 +70,7 @@ class BAZ_API baz_unpacked_to_packed_bb : public gr::block
   unsigned int    d_bits_per_chunk, d_bits_into_output;
   gr::endianness_t d_endianness;
   unsigned int    d_index;
+  unsigned char   d_reverse[256];  // Bit-reversal of each byte value
 
  public:
   void forecast(int noutput_items, gr_vector_int &ninput_items_required);
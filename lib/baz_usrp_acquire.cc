@@ -25,12 +25,68 @@
 #include <gnuradio/io_signature.h>
 #include <baz_usrp_acquire.h>
 
+#include <boost/bind.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <stdio.h>
+
 namespace gr {
   namespace baz {
 
+    class multi_usrp_acquire_device : public usrp_acquire_device
+    {
+    public:
+        multi_usrp_acquire_device(::uhd::usrp::multi_usrp::sptr dev)
+            : m_dev(dev)
+        {
+        }
+    public:
+        size_t open_rx_stream(const ::uhd::stream_args_t &stream_args)
+        {
+            m_rx_stream = m_dev->get_rx_stream(stream_args);
+            return m_rx_stream->get_max_num_samps();
+        }
+        size_t recv(const std::vector<void*> &buffs, size_t nsamps, ::uhd::rx_metadata_t &metadata, double timeout)
+        {
+            return m_rx_stream->recv(buffs, nsamps, metadata, timeout);
+        }
+        void issue_stream_cmd(const ::uhd::stream_cmd_t &cmd, size_t chan)
+        {
+            m_dev->issue_stream_cmd(cmd, chan);
+        }
+        ::uhd::time_spec_t get_time_now()
+        {
+            return m_dev->get_time_now();
+        }
+        double get_rx_rate(size_t chan)
+        {
+            return m_dev->get_rx_rate(chan);
+        }
+        void set_gpio_attr(const std::string &bank, const std::string &attr, const boost::uint32_t value, const boost::uint32_t mask, const size_t mboard)
+        {
+            m_dev->set_gpio_attr(bank, attr, value, mask, mboard);
+        }
+    private:
+        ::uhd::usrp::multi_usrp::sptr m_dev;
+        ::uhd::rx_streamer::sptr m_rx_stream;
+    };
+    
+    usrp_acquire_device::sptr usrp_acquire_device::make(::uhd::usrp::multi_usrp::sptr dev)
+    {
+        return sptr(new multi_usrp_acquire_device(dev));
+    }
+    
     usrp_acquire::sptr usrp_acquire::make(::uhd::usrp::multi_usrp::sptr dev, const ::uhd::stream_args_t &stream_args)
     {
-        return sptr(new usrp_acquire(dev, stream_args));
+        return sptr(new usrp_acquire(usrp_acquire_device::make(dev), stream_args));
+    }
+    
+    usrp_acquire::sptr usrp_acquire::make_with_device(usrp_acquire_device::sptr device, const ::uhd::stream_args_t &stream_args)
+    {
+        if (not device)
+            throw std::invalid_argument("usrp_acquire: no device");
+        
+        return sptr(new usrp_acquire(device, stream_args));
     }
     
     usrp_acquire::sptr usrp_acquire::make_from_source(::gr::basic_block_sptr source, const ::uhd::stream_args_t &stream_args)
@@ -42,37 +98,65 @@ namespace gr {
             //return usrp_acquire::sptr();
         }
         
-        return sptr(new usrp_acquire(usrp_src->get_device(), stream_args));
+        return make(usrp_src->get_device(), stream_args);
     }
     
-    usrp_acquire::usrp_acquire(::uhd::usrp::multi_usrp::sptr dev, const ::uhd::stream_args_t &stream_args)
-        : m_dev(dev)
+    usrp_acquire::usrp_acquire(usrp_acquire_device::sptr device, const ::uhd::stream_args_t &stream_args)
+        : m_dev(device)
         , m_stream_args(stream_args)
+        , m_stream_open(false)
         , m_samps_per_packet(0)
+        , d_stop(false)
+        , d_cancel(false)
+        , d_sample_rate(0)
+        , d_next_id(0)
+        , d_pool_nsamps(0)
     {
     }
     
     usrp_acquire::~usrp_acquire()
     {
+        {
+            boost::mutex::scoped_lock lock(d_queue_mutex);
+            
+            d_stop = true;
+            d_requests.clear();
+            d_queue_cond.notify_all();
+        }
+        
+        if (d_worker.joinable())
+        {
+            cancel_acquisitions();
+            d_worker.join();
+        }
+        
         for (size_t i = 0; i < m_data.size(); ++i)
             delete m_data[i];
         
         m_data.clear();
     }
     
-    std::vector<size_t> usrp_acquire::finite_acquisition_v(const size_t nsamps, bool stream_now, double delay, size_t skip, double timeout)
+    void usrp_acquire::prepare_stream()
     {
-        boost::mutex::scoped_lock lock(d_mutex);
-        
-        if (m_rx_stream)
+        if (m_stream_open)
         {
             //this->stop(); // Does flush
         }
         else
         {
-            m_rx_stream = m_dev->get_rx_stream(m_stream_args);
-            m_samps_per_packet = m_rx_stream->get_max_num_samps();
+            m_samps_per_packet = m_dev->open_rx_stream(m_stream_args);
+            m_stream_open = true;
         }
+    }
+    
+    std::vector<size_t> usrp_acquire::finite_acquisition_v(const size_t nsamps, bool stream_now, double delay, size_t skip, double timeout)
+    {
+        if (pending_acquisitions() > 0)
+            throw std::runtime_error("usrp_acquire: queued acquisitions are still streaming");
+        
+        boost::mutex::scoped_lock lock(d_mutex);
+        
+        prepare_stream();
         
         size_t _nchan = m_stream_args.channels.size();
         
@@ -105,7 +189,7 @@ namespace gr {
         ::uhd::rx_metadata_t rx_metadata;
         
         // receive samples until timeout
-        const size_t actual_num_samps = m_rx_stream->recv(buffs, nsamps, rx_metadata, timeout);
+        const size_t actual_num_samps = m_dev->recv(buffs, nsamps, rx_metadata, timeout);
         
         std::vector<size_t> res;
         
@@ -130,6 +214,371 @@ namespace gr {
     {
         m_dev->set_gpio_attr(bank, attr, value, mask, mboard);
     }
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    // Caller holds d_queue_mutex, and no buffer is in use
+    void usrp_acquire::allocate_pool(size_t nsamps, size_t count)
+    {
+        const size_t alignment = 64;
+        const size_t nchan = std::max(m_stream_args.channels.size(), (size_t)1);
+        const size_t channel_size = ((nsamps * sizeof(std::complex<float>)) + alignment - 1) & ~(alignment - 1);
+        
+        d_pool.clear();
+        d_pool.resize(count);
+        d_free.clear();
+        
+        for (size_t i = 0; i < count; ++i)
+        {
+            pool_buffer &buffer = d_pool[i];
+            buffer.storage.resize((nchan * channel_size) + alignment);
+            buffer.id = 0;
+            
+            size_t base = ((size_t)&buffer.storage[0] + alignment - 1) & ~(alignment - 1);
+            for (size_t c = 0; c < nchan; ++c)
+                buffer.channels.push_back((std::complex<float>*)(base + (c * channel_size)));
+            
+            d_free.push_back(count - 1 - i); // Hand out in order
+        }
+        
+        d_pool_nsamps = nsamps;
+    }
+    
+    void usrp_acquire::set_acquisition_pool(size_t nsamps, size_t count /*= 4*/)
+    {
+        if ((nsamps == 0) || (count == 0))
+            throw std::invalid_argument("usrp_acquire: pool needs at least one buffer of one sample");
+        
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        if (d_free.size() != d_pool.size())
+            throw std::runtime_error("usrp_acquire: pool buffers are in use");
+        
+        allocate_pool(nsamps, count);
+    }
+    
+    void usrp_acquire::set_acquisition_callback(acquisition_callback callback)
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        d_callback = callback;
+    }
+    
+    /*
+     * Schedules one 'nsamps' capture (first 'skip' dropped, as finite_acquisition_v) at each of 'times'
+     * (seconds of device time, or from now if 'relative'). Returns the id of the first one: the rest follow on.
+     */
+    size_t usrp_acquire::queue_acquisitions(const std::vector<double> &times, size_t nsamps, bool relative /*= true*/, size_t skip /*= 0*/, double timeout /*= 1.0*/)
+    {
+        if (times.empty())
+            throw std::invalid_argument("usrp_acquire: no acquisition times");
+        if (nsamps <= skip)
+            throw std::invalid_argument("usrp_acquire: nothing left after skip");
+        
+        {
+            boost::mutex::scoped_lock lock(d_mutex);
+            
+            prepare_stream();
+        }
+        
+        ::uhd::time_spec_t base;
+        if (relative)
+            base = m_dev->get_time_now();
+        
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        if (d_stop)
+            throw std::runtime_error("usrp_acquire: shutting down");
+        
+        if (d_pool_nsamps < nsamps)
+        {
+            if (d_free.size() != d_pool.size())
+                throw std::runtime_error("usrp_acquire: pool buffers too small and in use");
+            
+            allocate_pool(nsamps, std::max(d_pool.size(), (size_t)4));
+        }
+        
+        d_sample_rate = m_dev->get_rx_rate(m_stream_args.channels.empty() ? 0 : m_stream_args.channels[0]);
+        
+        size_t first = d_next_id;
+        
+        for (size_t i = 0; i < times.size(); ++i)
+        {
+            request req;
+            req.id = d_next_id++;
+            req.time = base + ::uhd::time_spec_t(times[i]);
+            req.nsamps = nsamps;
+            req.skip = skip;
+            req.timeout = timeout;
+            req.buffer = 0;
+            d_requests.push_back(req);
+        }
+        
+        if (d_worker.joinable() == false)
+            d_worker = boost::thread(boost::bind(&usrp_acquire::worker, this));
+        
+        d_queue_cond.notify_all();
+        
+        return first;
+    }
+    
+    usrp_acquisition usrp_acquire::next_acquisition(double timeout /*= -1.0*/)
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds((long long)(std::max(timeout, 0.0) * 1e6));
+        
+        while (d_completed.empty())
+        {
+            if (timeout < 0)
+                d_queue_cond.wait(lock);
+            else if (d_queue_cond.timed_wait(lock, deadline) == false)
+                return usrp_acquisition();
+        }
+        
+        usrp_acquisition result = d_completed.front();
+        d_completed.pop_front();
+        
+        return result;
+    }
+    
+    void usrp_acquire::release_acquisition(size_t id)
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        for (size_t i = 0; i < d_pool.size(); ++i)
+        {
+            if ((d_pool[i].id != id) || (std::find(d_free.begin(), d_free.end(), i) != d_free.end()))
+                continue;
+            
+            bool in_flight = false;
+            for (size_t j = 0; j < d_inflight.size(); ++j)
+                in_flight |= (d_inflight[j].buffer == i);
+            if (in_flight)
+                continue;
+            
+            d_free.push_back(i);
+            d_queue_cond.notify_all();
+            
+            return;
+        }
+        
+        fprintf(stderr, "[usrp_acquire] release of unknown acquisition: %lu\n", (unsigned long)id);
+    }
+    
+    size_t usrp_acquire::pending_acquisitions()
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        return (d_requests.size() + d_inflight.size());
+    }
+    
+    size_t usrp_acquire::completed_acquisitions()
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        return d_completed.size();
+    }
+    
+    // Drops everything not yet received (completed ones stay queued), returns once the stream is quiet
+    void usrp_acquire::cancel_acquisitions()
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        d_requests.clear();
+        
+        if (d_inflight.empty())
+            return;
+        
+        d_cancel = true;
+        d_queue_cond.notify_all();
+        
+        while (d_cancel)
+            d_queue_cond.wait(lock);
+    }
+    
+    bool usrp_acquire::cancelled()
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        return d_cancel;
+    }
+    
+    // Receives one issued capture into its pool buffer
+    void usrp_acquire::receive(const request &req, usrp_acquisition &result)
+    {
+        boost::mutex::scoped_lock lock(d_mutex);
+        
+        const pool_buffer &buffer = d_pool[req.buffer];  // Only reallocated when every buffer is free
+        const size_t nchan = buffer.channels.size();
+        
+        // First packet can only arrive once the start time is reached
+        double wait = std::max((req.time - m_dev->get_time_now()).get_real_secs(), 0.0) + req.timeout;
+        
+        std::vector<void*> buffs(nchan);
+        size_t received = 0;
+        bool first = true;
+        
+        while (received < req.nsamps)
+        {
+            for (size_t c = 0; c < nchan; ++c)
+                buffs[c] = buffer.channels[c] + received;
+            
+            const double slice = std::min(wait, 0.1); // Stay responsive to cancel during long waits
+            
+            ::uhd::rx_metadata_t md;
+            size_t n = m_dev->recv(buffs, req.nsamps - received, md, slice);
+            
+            if ((n == 0) && (md.error_code == ::uhd::rx_metadata_t::ERROR_CODE_TIMEOUT) && (wait > slice))
+            {
+                if (cancelled())
+                    break;
+                
+                wait -= slice;
+                continue;
+            }
+            
+            if ((first) && (n > 0))
+            {
+                result.rx_time = md.time_spec.get_real_secs();
+                first = false;
+            }
+            
+            received += n;
+            wait = req.timeout;
+            
+            if (md.error_code != ::uhd::rx_metadata_t::ERROR_CODE_NONE)
+            {
+                result.error_code = (int)md.error_code;
+                fprintf(stderr, "[usrp_acquire] acquisition %lu: error 0x%x (received %lu of %lu)\n", (unsigned long)req.id, (int)md.error_code, (unsigned long)received, (unsigned long)req.nsamps);
+                break;
+            }
+            
+            if (md.end_of_burst)
+                break;
+        }
+        
+        const size_t to_skip = std::min(received, req.skip);
+        
+        result.nsamps = received - to_skip;
+        if (d_sample_rate > 0)
+            result.rx_time += (double)to_skip / d_sample_rate;
+        
+        for (size_t c = 0; c < nchan; ++c)
+            result.buffers.push_back((size_t)(buffer.channels[c] + to_skip));
+    }
+    
+    // After a cancel: stop the device and swallow whatever was already on its way
+    void usrp_acquire::drain()
+    {
+        boost::mutex::scoped_lock lock(d_mutex);
+        
+        ::uhd::stream_cmd_t cmd(::uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+        cmd.stream_now = true;
+        for (size_t i = 0; i < m_stream_args.channels.size(); i++)
+            m_dev->issue_stream_cmd(cmd, m_stream_args.channels[i]);
+        
+        const size_t nchan = std::max(m_stream_args.channels.size(), (size_t)1);
+        std::vector<std::complex<float> > scratch(nchan * m_samps_per_packet);
+        std::vector<void*> buffs(nchan);
+        for (size_t c = 0; c < nchan; ++c)
+            buffs[c] = &scratch[c * m_samps_per_packet];
+        
+        ::uhd::rx_metadata_t md;
+        while (m_dev->recv(buffs, m_samps_per_packet, md, 0.1) > 0)
+            ;
+    }
+    
+    void usrp_acquire::worker()
+    {
+        boost::mutex::scoped_lock lock(d_queue_mutex);
+        
+        while (true)
+        {
+            // Issue everything a buffer can be found for
+            while ((d_cancel == false) && (d_requests.empty() == false) && (d_free.empty() == false))
+            {
+                request req = d_requests.front();
+                d_requests.pop_front();
+                
+                req.buffer = d_free.back();
+                d_free.pop_back();
+                d_pool[req.buffer].id = req.id;
+                
+                d_inflight.push_back(req);  // Before the command so cancel sees it
+                
+                lock.unlock();
+                
+                ::uhd::stream_cmd_t cmd(::uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+                cmd.num_samps = req.nsamps;
+                cmd.stream_now = false;
+                cmd.time_spec = req.time;
+                
+                for (size_t i = 0; i < m_stream_args.channels.size(); i++)
+                    m_dev->issue_stream_cmd(cmd, m_stream_args.channels[i]);
+                
+                lock.lock();
+            }
+            
+            if (d_cancel)
+            {
+                lock.unlock();
+                drain();
+                lock.lock();
+                
+                for (size_t i = 0; i < d_inflight.size(); ++i)
+                    d_free.push_back(d_inflight[i].buffer);
+                d_inflight.clear();
+                
+                d_cancel = false;
+                d_queue_cond.notify_all();
+                
+                continue;
+            }
+            
+            if (d_inflight.empty())
+            {
+                if ((d_stop) && (d_requests.empty()))
+                    break;
+                
+                d_queue_cond.wait(lock);  // For requests, or a released buffer
+                continue;
+            }
+            
+            request req = d_inflight.front();
+            
+            usrp_acquisition result;
+            result.valid = true;
+            result.id = req.id;
+            result.time = req.time.get_real_secs();
+            
+            lock.unlock();
+            
+            receive(req, result);
+            
+            lock.lock();
+            
+            if (d_cancel)
+                continue; // Buffer is freed with the rest
+            
+            d_inflight.pop_front();
+            
+            if (d_callback)
+            {
+                acquisition_callback callback = d_callback;
+                
+                lock.unlock();
+                callback(result);
+                lock.lock();
+                
+                d_free.push_back(req.buffer);
+            }
+            else
+                d_completed.push_back(result);
+            
+            d_queue_cond.notify_all();
+        }
+    }
 
   } /* namespace baz */
 } /* namespace gr */
@@ -23,7 +23,11 @@
 #define INCLUDED_BAZ_USRP_ACQUIRE_H
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/function.hpp>
 #include <vector>
+#include <deque>
 
 #include <uhd/usrp/multi_usrp.hpp>
 #include <uhd/types/time_spec.hpp>
@@ -34,28 +38,126 @@ namespace gr {
   namespace baz {
 
     /*!
-     * \brief <+description+>
+     * \brief One completed capture from usrp_acquire::queue_acquisitions
      *
+     * 'buffers' holds the address of the first (post-skip) sample of each channel.
+     * The memory belongs to the capture pool: it stays valid until release_acquisition(id).
+     */
+    struct BAZ_API usrp_acquisition
+    {
+      bool valid;         // False if next_acquisition timed out
+      size_t id;          // Sequence number (first one is returned by queue_acquisitions)
+      double time;        // Requested start (device time)
+      double rx_time;     // Device time of first returned sample
+      size_t nsamps;      // Samples per channel (may be short on error)
+      int error_code;     // ::uhd::rx_metadata_t::error_code_t of the first error (0: none)
+      std::vector<size_t> buffers;
+
+      usrp_acquisition()
+        : valid(false), id(0), time(0), rx_time(0), nsamps(0), error_code(0)
+      { }
+    };
+
+    /*!
+     * \brief The device and streamer calls usrp_acquire makes
+     *
+     * make() wraps a multi_usrp and its rx_streamer. Anything else implementing it
+     * (e.g. a canned sample source in a test) can be passed to usrp_acquire::make_with_device.
+     */
+    class BAZ_API usrp_acquire_device
+    {
+    public:
+      typedef boost::shared_ptr<usrp_acquire_device> sptr;
+      static sptr make(::uhd::usrp::multi_usrp::sptr dev);
+      virtual ~usrp_acquire_device() { }
+    public:
+      virtual size_t open_rx_stream(const ::uhd::stream_args_t &stream_args) = 0; // Returns max samples per packet
+      virtual size_t recv(const std::vector<void*> &buffs, size_t nsamps, ::uhd::rx_metadata_t &metadata, double timeout) = 0;
+      virtual void issue_stream_cmd(const ::uhd::stream_cmd_t &cmd, size_t chan) = 0;
+      virtual ::uhd::time_spec_t get_time_now() = 0;
+      virtual double get_rx_rate(size_t chan) = 0;
+      virtual void set_gpio_attr(const std::string &bank, const std::string &attr, const boost::uint32_t value, const boost::uint32_t mask, const size_t mboard) = 0;
+    };
+
+    /*!
+     * \brief Finite acquisitions straight from a multi_usrp
+     *
+     * finite_acquisition_v: one blocking capture.
+     * queue_acquisitions: K timed captures that are received back to back by a worker thread
+     * into a pool of reusable buffers. Stream commands are issued ahead as soon as a buffer is
+     * free, so the next capture streams while earlier ones are being processed.
+     * Completed captures go to the callback (if set) or are collected with next_acquisition.
      */
     class BAZ_API usrp_acquire
     {
     public:
-      usrp_acquire(::uhd::usrp::multi_usrp::sptr dev, const ::uhd::stream_args_t &stream_args);
+      usrp_acquire(usrp_acquire_device::sptr device, const ::uhd::stream_args_t &stream_args);
       ~usrp_acquire();
     public:
       typedef boost::shared_ptr<usrp_acquire> sptr;
       static sptr make(::uhd::usrp::multi_usrp::sptr dev, const ::uhd::stream_args_t &stream_args);
+      static sptr make_with_device(usrp_acquire_device::sptr device, const ::uhd::stream_args_t &stream_args);
       static sptr make_from_source(/*::gr::uhd::usrp_source::sptr*/::gr::basic_block_sptr source, const ::uhd::stream_args_t &stream_args);
     public:
       std::vector<size_t> finite_acquisition_v(const size_t nsamps, bool stream_now = true, double delay = 0.0, size_t skip = 0, double timeout = 1.0);
       void set_gpio_attr(const std::string &bank, const std::string &attr, const boost::uint32_t value, const boost::uint32_t mask, const size_t mboard = 0);
+    public:
+      void set_acquisition_pool(size_t nsamps, size_t count = 4);
+      size_t queue_acquisitions(const std::vector<double> &times, size_t nsamps, bool relative = true, size_t skip = 0, double timeout = 1.0);
+      usrp_acquisition next_acquisition(double timeout = -1.0);  // Negative: wait forever
+      void release_acquisition(size_t id);
+      void cancel_acquisitions();
+      size_t pending_acquisitions();  // Queued or streaming
+      size_t completed_acquisitions();  // Waiting to be collected
+      typedef boost::function<void (const usrp_acquisition&)> acquisition_callback;
+#ifndef SWIG
+      void set_acquisition_callback(acquisition_callback callback); // Called on the worker thread, buffer is released on return
+#endif // SWIG
+    private:
+      struct pool_buffer
+      {
+        std::vector<char> storage;
+        std::vector<std::complex<float>* > channels;  // Cache-line aligned into 'storage'
+        size_t id;  // Capture using it
+      };
+      struct request
+      {
+        size_t id;
+        ::uhd::time_spec_t time;
+        size_t nsamps;
+        size_t skip;
+        double timeout;
+        size_t buffer;
+      };
+    private:
+      void prepare_stream();
+      void allocate_pool(size_t nsamps, size_t count);
+      void worker();
+      void receive(const request &req, usrp_acquisition &result);
+      void drain();
+      bool cancelled();
     private:
-      ::uhd::usrp::multi_usrp::sptr m_dev;
+      usrp_acquire_device::sptr m_dev;
       ::uhd::stream_args_t m_stream_args;
       ::boost::mutex d_mutex;
-      ::uhd::rx_streamer::sptr m_rx_stream;
+      bool m_stream_open;
       size_t m_samps_per_packet;
       std::vector<std::vector<std::complex<float> >* > m_data;
+      // Queued acquisitions (d_queue_mutex)
+      ::boost::mutex d_queue_mutex;
+      ::boost::condition_variable d_queue_cond;
+      ::boost::thread d_worker;
+      bool d_stop;
+      bool d_cancel;
+      double d_sample_rate;
+      size_t d_next_id;
+      std::vector<pool_buffer> d_pool;
+      size_t d_pool_nsamps;
+      std::vector<size_t> d_free;  // Pool indices
+      std::deque<request> d_requests; // Not yet issued
+      std::deque<request> d_inflight; // Issued to the device, received in order
+      std::deque<usrp_acquisition> d_completed;
+      acquisition_callback d_callback;
     };
 
   } // namespace baz
@@ -0,0 +1,224 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <baz_delay.h>
+
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
+#include <pmt/pmt.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+
+static const int BUFFER_LENGTH = 8192;
+static const int LENGTH = 2000;
+static const int CHUNKS[] = { 1, 7, 64, 1000 };	// Output items asked for per call
+
+typedef std::pair<int,int> change;	// Input sample, whole-sample delay
+
+// Input item i is i + 1, so a zero in the output is always padding
+template<typename T>
+static T input_item(int i)
+{
+	return (T)(i + 1);
+}
+
+// Output m is input m - delay. From a change's sample on, a longer delay repeats the item
+// before it and a shorter one drops. Before any input, the padding is zeros.
+template<typename T>
+static std::vector<T> expected_output(int initial_delay, const std::vector<change>& changes)
+{
+	std::vector<T> out(initial_delay, T());
+	T last = T();
+	int delay = initial_delay;
+	size_t next = 0;
+
+	for (int i = 0; i < LENGTH; ++i)
+	{
+		while ((next < changes.size()) && (changes[next].first <= i))
+			delay = changes[next++].second;
+
+		while ((int)out.size() < (i + delay))
+			out.push_back(last);
+
+		last = input_item<T>(i);
+		if ((int)out.size() == (i + delay))
+			out.push_back(last);
+	}
+
+	return out;
+}
+
+// Calls the block by hand until the input is used up, 'chunk' output items at a time
+template<typename T>
+struct delay_harness
+{
+	baz_delay_sptr delay;
+	gr::buffer_sptr in_buffer;
+	std::vector<T> input;
+	std::vector<T> output;
+
+	delay_harness(int initial_delay, bool fractional)
+		: delay(baz_make_delay(sizeof(T), initial_delay, fractional))
+		, input(LENGTH)
+	{
+		in_buffer = gr::make_buffer(BUFFER_LENGTH, sizeof(T));
+		gr::buffer_sptr out_buffer = gr::make_buffer(BUFFER_LENGTH, sizeof(T));
+
+		gr::block_detail_sptr detail = gr::make_block_detail(1, 1);
+		detail->set_input(0, gr::buffer_add_reader(in_buffer, 0));
+		detail->set_output(0, out_buffer);
+		delay->set_detail(detail);
+
+		for (int i = 0; i < LENGTH; ++i)
+			input[i] = input_item<T>(i);
+	}
+	void tag(uint64_t offset, double value)
+	{
+		gr::tag_t tag;
+		tag.offset = offset;
+		tag.key = pmt::string_to_symbol("delay");
+		tag.value = pmt::from_double(value);
+		tag.srcid = pmt::PMT_F;
+		in_buffer->add_item_tag(tag);
+	}
+	void run(int chunk)
+	{
+		while (true)
+		{
+			const int nread = (int)delay->nitems_read(0);
+
+			gr_vector_int ninput_items(1);
+			delay->forecast(chunk, ninput_items);
+			ninput_items[0] = LENGTH - nread;
+
+			std::vector<T> out(chunk);
+			gr_vector_const_void_star in(1, &input[0] + nread);
+			gr_vector_void_star outs(1, &out[0]);
+			const int produced = delay->general_work(chunk, ninput_items, in, outs);
+			BOOST_REQUIRE(produced >= 0);
+			BOOST_REQUIRE_LE(produced, chunk);
+			delay->detail()->produce_each(produced);
+			output.insert(output.end(), out.begin(), out.begin() + produced);
+
+			if ((produced == 0) && ((int)delay->nitems_read(0) == nread))
+				break;
+		}
+
+		BOOST_CHECK_EQUAL(delay->nitems_read(0), (uint64_t)LENGTH);
+	}
+};
+
+template<typename T>
+static void check_exact(const std::vector<T>& output, const std::vector<T>& expected)
+{
+	BOOST_REQUIRE_EQUAL(output.size(), expected.size());
+	for (size_t i = 0; i < output.size(); ++i)
+	{
+		if (output[i] != expected[i])	// One failure per run is enough to see where it went wrong
+		{
+			BOOST_ERROR("output differs at " << i);
+			break;
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(t0_whole_sample_changes)
+{
+	std::vector<change> changes;
+	changes.push_back(change(100, 40));	// Scheduled: grows by 35, filled in bulk
+	changes.push_back(change(700, 2));	// Tagged: shrinks by 38, dropped
+	changes.push_back(change(701, 300));	// Tagged, the very next sample: grows past a whole chunk
+	changes.push_back(change(1500, 0));	// Scheduled
+
+	for (size_t k = 0; k < (sizeof(CHUNKS) / sizeof(CHUNKS[0])); ++k)
+	{
+		for (int fractional = 0; fractional < 2; ++fractional)	// Whole samples bypass the interpolator
+		{
+			delay_harness<float> h(5, (fractional != 0));
+			h.delay->schedule_delay(40, 100);
+			h.tag(700, 2.0);
+			h.tag(701, 300.0);
+			h.delay->schedule_delay(0, 1500);
+
+			h.run(CHUNKS[k]);
+			check_exact(h.output, expected_output<float>(5, changes));
+			BOOST_CHECK_EQUAL(h.delay->applied_delay(), 0.0);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(t1_opaque_items_round)
+{
+	std::vector<change> changes;
+	changes.push_back(change(250, 3));	// 2.75 rounds up
+	changes.push_back(change(900, 12));	// 12.25 rounds down
+
+	for (size_t k = 0; k < (sizeof(CHUNKS) / sizeof(CHUNKS[0])); ++k)
+	{
+		delay_harness<int> h(10, false);
+		BOOST_CHECK(h.delay->fractional() == false);
+		h.delay->schedule_delay(2.75, 250);
+		h.tag(900, 12.25);
+
+		h.run(CHUNKS[k]);
+		check_exact(h.output, expected_output<int>(10, changes));
+		BOOST_CHECK_EQUAL(h.delay->applied_delay(), 12.0);
+		BOOST_CHECK_EQUAL(h.delay->fractional_delay(), 2.75);	// Last requested, as asked for
+	}
+}
+
+BOOST_AUTO_TEST_CASE(t2_fractional)
+{
+	// A ramp goes through the interpolator unchanged apart from the delay
+	for (size_t k = 0; k < (sizeof(CHUNKS) / sizeof(CHUNKS[0])); ++k)
+	{
+		delay_harness<float> h(3, true);
+		h.delay->schedule_delay(3.5, 200);
+		h.tag(1200, 6.0);
+
+		h.run(CHUNKS[k]);
+		BOOST_CHECK_EQUAL(h.delay->applied_delay(), 6.0);
+
+		std::vector<change> changes;
+		changes.push_back(change(1200, 6));
+		const std::vector<float> whole = expected_output<float>(3, changes);
+		BOOST_REQUIRE_EQUAL(h.output.size(), whole.size());
+
+		for (int m = 0; m < 200 + 3; ++m)	// Before: exact
+			BOOST_CHECK_EQUAL(h.output[m], whole[m]);
+		for (int m = 200 + 3; m < 1200; ++m)	// Half a sample later, with no step at the change
+			BOOST_CHECK_CLOSE(h.output[m], input_item<float>(m) - 3.5f, 1e-3);
+		for (int m = 1200; m < 1200 + 6; ++m)	// Grown: the last item in
+			BOOST_CHECK_EQUAL(h.output[m], input_item<float>(1199));
+		for (int m = 1200 + 6; m < (int)h.output.size(); ++m)	// Whole again: exact
+			BOOST_CHECK_EQUAL(h.output[m], whole[m]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(t3_fractional_needs_samples)
+{
+	BOOST_CHECK(baz_make_delay(sizeof(gr_complex), 0, true)->fractional());
+	BOOST_CHECK_THROW(baz_make_delay(sizeof(short), 0, true), std::invalid_argument);
+}
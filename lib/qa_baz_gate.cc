@@ -0,0 +1,441 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <baz_gate.h>
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
+#include <pmt/pmt.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+static const int BUFFER_LENGTH = 8192;
+static const int LENGTH = 5000;
+static const int SAMPLE_RATE = 1000000;
+static const int CHUNKS[] = { 1, 5, 64, 250, 1000, 17 };	// Cycled through by every run
+
+static const pmt::pmt_t RX_TIME_KEY = pmt::string_to_symbol("rx_time");
+
+// A burst tag on output 0, reduced to what can be compared
+struct burst_tag
+{
+	uint64_t offset;
+	std::string key;
+	uint64_t full_secs;	// tx_time only
+	double frac_secs;
+
+	bool operator==(const burst_tag& other) const
+	{
+		return (offset == other.offset) && (key == other.key) && (full_secs == other.full_secs) && (frac_secs == other.frac_secs);
+	}
+};
+
+static burst_tag make_burst_tag(uint64_t offset, const pmt::pmt_t& key, const pmt::pmt_t& value)
+{
+	burst_tag tag;
+	tag.offset = offset;
+	tag.key = pmt::symbol_to_string(key);
+	tag.full_secs = 0;
+	tag.frac_secs = 0.0;
+	if (tag.key == "tx_time")
+	{
+		tag.full_secs = pmt::to_uint64(pmt::tuple_ref(value, 0));
+		tag.frac_secs = pmt::to_double(pmt::tuple_ref(value, 1));
+	}
+	return tag;
+}
+
+// Downstream of output 0: keeps the tags it is handed
+class tag_recorder : public gr::sync_block
+{
+public:
+	tag_recorder(int item_size)
+		: gr::sync_block("tag_recorder",
+			gr::io_signature::make(1, 1, item_size),
+			gr::io_signature::make(0, 0, 0))
+	{
+	}
+	int work(int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+	{
+		std::vector<gr::tag_t> tags;
+		get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items);
+		for (size_t i = 0; i < tags.size(); ++i)
+			d_tags.push_back(make_burst_tag(tags[i].offset, tags[i].key, tags[i].value));
+		return noutput_items;
+	}
+	const std::vector<burst_tag>& tags() const
+	{ return d_tags; }
+private:
+	std::vector<burst_tag> d_tags;
+};
+
+struct gate_settings
+{
+	bool block;
+	float threshold;
+	int trigger_length;
+	bool tag;
+	double delay;
+	bool no_delay;
+	bool retriggerable;
+};
+
+static gate_settings default_settings()
+{
+	gate_settings s;
+	s.block = true;
+	s.threshold = 1.0f;
+	s.trigger_length = 0;
+	s.tag = true;
+	s.delay = 0.25;
+	s.no_delay = false;
+	s.retriggerable = false;
+	return s;
+}
+
+// The gate as it was before runs and staged parameters: one decision, copy or zero per item.
+// Every channel in 'ins' is gated identically into the matching entry of 'outs'.
+struct reference_gate
+{
+	gate_settings s;
+	int item_size;
+	int trigger_count;
+	uhd::time_spec_t last_time;
+	uint64_t time_offset;
+	bool in_burst;
+	uint64_t nread;
+	uint64_t nwritten;
+	std::vector<std::vector<char> > outs;
+	std::vector<burst_tag> tags;
+
+	reference_gate(const gate_settings& settings, int item_size, size_t channels)
+		: s(settings), item_size(item_size), trigger_count(0), last_time(0.0), time_offset(-1), in_burst(false)
+		, nread(0), nwritten(0), outs(channels)
+	{
+	}
+	void work(int n, const std::vector<const char*>& ins, const float* level, const std::map<uint64_t,uhd::time_spec_t>& times)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			std::map<uint64_t,uhd::time_spec_t>::const_iterator it = times.find(nread + i);
+			if (it != times.end())
+			{
+				time_offset = 0;
+				last_time = it->second;
+			}
+			else
+				++time_offset;
+
+			if ((level[i] >= s.threshold) || (trigger_count > 0))
+			{
+				if (trigger_count > 0)
+					--trigger_count;
+
+				if ((((trigger_count == 0) && (in_burst == false)) || (s.retriggerable)) && (level[i] >= s.threshold))
+				{
+					if (s.trigger_length > 0)
+						trigger_count = (s.trigger_length - 1);
+
+					if (in_burst == false)
+					{
+						if (s.tag)
+						{
+							tags.push_back(make_burst_tag(nwritten, pmt::string_to_symbol("tx_sob"), pmt::PMT_T));
+							if (s.no_delay == false)
+							{
+								uhd::time_spec_t next = (last_time + uhd::time_spec_t(0, time_offset, SAMPLE_RATE)) + uhd::time_spec_t(s.delay);
+								tags.push_back(make_burst_tag(nwritten, pmt::string_to_symbol("tx_time"), pmt::make_tuple(pmt::from_uint64(next.get_full_secs()), pmt::from_double(next.get_frac_secs()))));
+							}
+						}
+
+						in_burst = true;
+					}
+				}
+				else if (trigger_count == 0)
+				{
+					if (in_burst)
+					{
+						if (s.tag)
+							tags.push_back(make_burst_tag(nwritten, pmt::string_to_symbol("tx_eob"), pmt::PMT_T));
+
+						in_burst = false;
+					}
+				}
+
+				for (size_t c = 0; c < outs.size(); ++c)
+					outs[c].insert(outs[c].end(), ins[c] + (i * item_size), ins[c] + ((i + 1) * item_size));
+				++nwritten;
+			}
+			else if (s.block == false)
+			{
+				for (size_t c = 0; c < outs.size(); ++c)
+					outs[c].insert(outs[c].end(), item_size, 0);
+				++nwritten;
+			}
+		}
+
+		nread += n;
+	}
+};
+
+// Calls the block by hand, with the same chunks given to the reference.
+// Gated signals are random bytes; the level holds high for random stretches.
+struct gate_harness
+{
+	int item_size;
+	int channels;	// Gated streams: in multi-channel mode, or signal + thru
+	bool multi_channel;
+	int time_port;	// -1: level carries rx_time
+	baz_gate_sptr gate;
+	boost::shared_ptr<tag_recorder> recorder;
+	std::vector<gr::buffer_sptr> in_buffers;
+	std::vector<std::vector<char> > signals;	// Per gated stream
+	std::vector<float> level;
+	std::map<uint64_t,uhd::time_spec_t> times;
+	std::vector<std::vector<char> > outputs;
+	reference_gate reference;
+	size_t chunk;
+
+	gate_harness(int item_size, const gate_settings& s, int channels, bool multi_channel, bool time_input = false)
+		: item_size(item_size), channels(channels), multi_channel(multi_channel), time_port(-1)
+		, recorder(gnuradio::get_initial_sptr(new tag_recorder(item_size)))
+		, signals(channels), level(LENGTH), outputs(channels), reference(s, item_size, channels), chunk(0)
+	{
+		gate = baz_make_gate(item_size, s.block, s.threshold, s.trigger_length, s.tag, s.delay, SAMPLE_RATE, s.no_delay, false, s.retriggerable, (multi_channel ? channels : 1));
+
+		int ninputs = channels + 1;	// Signal(s) and level
+		if ((multi_channel == false) && ((time_input) || (channels > 1)))
+		{
+			time_port = 2;
+			ninputs = ((channels > 1) ? 4 : 3);	// Thru comes after time
+		}
+
+		gr::block_detail_sptr detail = gr::make_block_detail(ninputs, channels);
+		for (int i = 0; i < ninputs; ++i)
+		{
+			in_buffers.push_back(gr::make_buffer(BUFFER_LENGTH, ((i == 1) ? sizeof(float) : item_size)));
+			detail->set_input(i, gr::buffer_add_reader(in_buffers[i], 0));
+		}
+		gr::buffer_sptr out_buffer;
+		for (int c = 0; c < channels; ++c)
+		{
+			gr::buffer_sptr buffer = gr::make_buffer(BUFFER_LENGTH, item_size);
+			detail->set_output(c, buffer);
+			if (c == 0)
+				out_buffer = buffer;
+		}
+		gate->set_detail(detail);
+
+		gr::block_detail_sptr recorder_detail = gr::make_block_detail(1, 0);
+		recorder_detail->set_input(0, gr::buffer_add_reader(out_buffer, 0));
+		recorder->set_detail(recorder_detail);
+
+		for (int c = 0; c < channels; ++c)
+		{
+			signals[c].resize(LENGTH * item_size);
+			for (size_t i = 0; i < signals[c].size(); ++i)
+				signals[c][i] = (char)(rand() & 0xFF);
+		}
+
+		bool high = false;
+		for (int i = 0; i < LENGTH; ++i)
+		{
+			if ((rand() % 20) == 0)
+				high = !high;
+			level[i] = (high ? 1.0f : 0.0f) + ((float)rand() / (float)RAND_MAX);	// Low: [0, 1], high: [1, 2]
+		}
+
+		for (int i = 0; i < LENGTH; i += 1500)	// A few timestamps, one mid-stream
+			add_time(i + 10, uhd::time_spec_t(100 + i, 0.5));
+	}
+	void add_time(uint64_t offset, const uhd::time_spec_t& time)
+	{
+		gr::tag_t tag;
+		tag.offset = offset;
+		tag.key = RX_TIME_KEY;
+		tag.value = pmt::make_tuple(pmt::from_uint64(time.get_full_secs()), pmt::from_double(time.get_frac_secs()));
+		tag.srcid = pmt::PMT_F;
+		in_buffers[(time_port >= 0) ? time_port : 1]->add_item_tag(tag);
+		times[offset] = time;
+	}
+	// Input port of gated stream 'c'
+	int input_port(int c) const
+	{
+		if (c == 0)
+			return 0;
+		return (multi_channel ? (c + 1) : 3);
+	}
+	// Returns false once every input has been used
+	bool call()
+	{
+		const int nread = (int)gate->nitems_read(0);
+		if (nread >= LENGTH)
+			return false;
+		const int noutput_items = std::min(CHUNKS[chunk++ % (sizeof(CHUNKS) / sizeof(CHUNKS[0]))], LENGTH - nread);
+
+		const size_t ninputs = in_buffers.size();
+		gr_vector_int ninput_items(ninputs);
+		gate->forecast(noutput_items, ninput_items);
+		for (size_t i = 0; i < ninputs; ++i)
+		{
+			BOOST_REQUIRE_LE(ninput_items[i], LENGTH - nread);
+			ninput_items[i] = LENGTH - nread;
+		}
+
+		std::vector<char> time_signal(noutput_items * item_size);	// Content is not used
+		gr_vector_const_void_star in(ninputs, &time_signal[0]);
+		std::vector<const char*> gated(channels);
+		for (int c = 0; c < channels; ++c)
+		{
+			gated[c] = &signals[c][nread * item_size];
+			in[input_port(c)] = gated[c];
+		}
+		in[1] = &level[nread];
+
+		std::vector<std::vector<char> > out(channels, std::vector<char>(noutput_items * item_size));
+		gr_vector_void_star outs(channels);
+		for (int c = 0; c < channels; ++c)
+			outs[c] = &out[c][0];
+
+		const int produced = gate->general_work(noutput_items, ninput_items, in, outs);
+		BOOST_REQUIRE(produced >= 0);
+		BOOST_REQUIRE_LE(produced, noutput_items);
+		for (size_t i = 0; i < ninputs; ++i)
+			BOOST_REQUIRE_EQUAL(gate->nitems_read(i), (uint64_t)(nread + noutput_items));
+		gate->detail()->produce_each(produced);
+		for (int c = 0; c < channels; ++c)
+			outputs[c].insert(outputs[c].end(), out[c].begin(), out[c].begin() + (produced * item_size));
+
+		if (produced > 0)
+		{
+			gr_vector_const_void_star recorder_in(1, &out[0][0]);
+			gr_vector_void_star recorder_out;
+			BOOST_REQUIRE_EQUAL(recorder->work(produced, recorder_in, recorder_out), produced);
+			recorder->consume(0, produced);
+		}
+
+		reference.work(noutput_items, gated, &level[nread], times);
+
+		return true;
+	}
+	void run(int calls = -1)
+	{
+		while ((calls-- != 0) && call())
+			;
+	}
+	void check()
+	{
+		BOOST_CHECK(reference.outs[0].size() > 0);
+		for (int c = 0; c < channels; ++c)
+		{
+			BOOST_REQUIRE_EQUAL(outputs[c].size(), reference.outs[c].size());
+			BOOST_CHECK(memcmp(&outputs[c][0], &reference.outs[c][0], outputs[c].size()) == 0);
+		}
+
+		const std::vector<burst_tag>& tags = recorder->tags();
+		BOOST_CHECK(reference.tags.size() > 0);
+		BOOST_REQUIRE_EQUAL(tags.size(), reference.tags.size());
+		for (size_t i = 0; i < tags.size(); ++i)
+			BOOST_CHECK(tags[i] == reference.tags[i]);
+	}
+};
+
+BOOST_AUTO_TEST_CASE(t0_single_channel_matches_reference)
+{
+	srand(1);
+
+	const int item_sizes[] = { 2, 4, 8, 16 };	// 2 takes the generic copy
+	for (size_t k = 0; k < (sizeof(item_sizes) / sizeof(item_sizes[0])); ++k)
+	{
+		gate_settings s = default_settings();
+
+		gate_harness blocking(item_sizes[k], s, 1, false);
+		blocking.run();
+		blocking.check();
+
+		s.block = false;
+		s.trigger_length = 7;
+		gate_harness zeroing(item_sizes[k], s, 1, false, true);	// rx_time on the time input
+		zeroing.run();
+		zeroing.check();
+
+		s.block = true;
+		s.retriggerable = true;
+		s.no_delay = true;
+		gate_harness thru(item_sizes[k], s, 2, false);	// Signal and thru
+		thru.run();
+		thru.check();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(t1_multi_channel_matches_reference)
+{
+	srand(2);
+
+	const int item_sizes[] = { 3, 8 };
+	for (size_t k = 0; k < (sizeof(item_sizes) / sizeof(item_sizes[0])); ++k)
+	{
+		gate_settings s = default_settings();
+		s.trigger_length = 5;
+
+		gate_harness h(item_sizes[k], s, 3, true);
+		BOOST_CHECK_EQUAL(h.gate->channels(), 3);
+		h.run();
+		h.check();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(t2_setters_take_effect_at_next_call)
+{
+	srand(3);
+
+	gate_harness h(8, default_settings(), 3, true);
+
+	h.run(20);
+	h.gate->set_threshold(0.5f);	// Opens on most of the low stretches too
+	h.gate->set_trigger_length(4);
+	h.reference.s.threshold = 0.5f;
+	h.reference.s.trigger_length = 4;
+
+	h.run(20);
+	h.gate->set_blocking(false);
+	h.gate->set_delay(0.75);
+	h.reference.s.block = false;
+	h.reference.s.delay = 0.75;
+
+	h.run(20);
+	h.gate->set_threshold(1.5f);
+	h.gate->set_tagging(false);
+	h.gate->set_no_delay(true);
+	h.reference.s.threshold = 1.5f;
+	h.reference.s.tag = false;
+	h.reference.s.no_delay = true;
+
+	h.run();
+	h.check();
+}
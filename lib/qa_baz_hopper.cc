@@ -0,0 +1,270 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <baz_hopper.h>
+
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <pmt/pmt.h>
+
+#include <boost/test/unit_test.hpp>
+
+static const int SAMPLE_RATE = 100000;
+static const int CHUNK_LENGTH = 1000;
+static const int DROP_LENGTH = 100;
+static const int HOP_LENGTH = CHUNK_LENGTH + DROP_LENGTH;	// 11 ms
+static const int FIRST_HOP = SAMPLE_RATE / 100;	// Hopper starts 10 ms after the first timestamp
+static const double FREQS[] = { 1e6, 2e6, 3e6 };	// Output 0 gets the first two
+
+// Records every timed tune it is given. Each one takes 'latency' on the device's own clock
+// (so the hopper measures exactly that), and while held it takes forever.
+class fake_hopper_device : public baz_hopper_device
+{
+public:
+	fake_hopper_device(double latency = 0.0, bool hold = false)
+		: d_latency(latency), d_hold(hold), d_clock(0.0)
+	{
+	}
+	void tune_at(const uhd::time_spec_t& time, double freq)
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+		while (d_hold)
+			d_cond.wait(lock);
+		d_commands.push_back(std::make_pair(time.to_ticks(SAMPLE_RATE), freq));
+		d_clock += d_latency;
+	}
+	double clock()
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+		return d_clock;
+	}
+public:
+	void release()
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+		d_hold = false;
+		d_cond.notify_all();
+	}
+	std::vector<std::pair<long long,double> > commands()
+	{
+		boost::mutex::scoped_lock lock(d_mutex);
+		return d_commands;
+	}
+private:
+	double d_latency;
+	bool d_hold;
+	double d_clock;
+	boost::mutex d_mutex;
+	boost::condition_variable d_cond;
+	std::vector<std::pair<long long,double> > d_commands;	// Ticks, frequency
+};
+
+static gr::tag_t rx_time(uint64_t offset, uint64_t seconds)
+{
+	gr::tag_t tag;
+	tag.offset = offset;
+	tag.key = pmt::string_to_symbol("rx_time");
+	tag.value = pmt::make_tuple(pmt::from_uint64(seconds), pmt::from_double(0.0));
+	tag.srcid = pmt::PMT_F;
+	return tag;
+}
+
+static baz_hopper_sptr make_hopper(boost::shared_ptr<fake_hopper_device> device)
+{
+	std::vector<std::vector<double> > freqs(2);
+	freqs[0].push_back(FREQS[0]);
+	freqs[0].push_back(FREQS[1]);
+	freqs[1].push_back(FREQS[2]);
+
+	return baz_make_hopper_with_device(sizeof(float), SAMPLE_RATE, CHUNK_LENGTH, DROP_LENGTH, freqs, device);
+}
+
+struct hopper_flowgraph
+{
+	gr::top_block_sptr tb;
+	gr::blocks::vector_sink_f::sptr sinks[2];
+
+	// Each input sample is its own index
+	hopper_flowgraph(baz_hopper_sptr hopper, size_t length, const std::vector<gr::tag_t>& tags)
+		: tb(gr::make_top_block("qa_baz_hopper"))
+	{
+		std::vector<float> ramp(length);
+		for (size_t i = 0; i < length; ++i)
+			ramp[i] = (float)i;
+
+		gr::blocks::vector_source_f::sptr src = gr::blocks::vector_source_f::make(ramp, false, 1, tags);
+		tb->connect(src, 0, hopper, 0);
+
+		for (int i = 0; i < 2; ++i)
+		{
+			sinks[i] = gr::blocks::vector_sink_f::make();
+			tb->connect(hopper, i, sinks[i], 0);
+		}
+	}
+};
+
+// Hop k starts at 'first_sample' + k * HOP_LENGTH and was tuned for 'first_tick' + k * HOP_LENGTH
+static void check_hops(const std::vector<std::pair<long long,double> >& commands, long long first_tick, size_t min_count)
+{
+	BOOST_CHECK(commands.size() >= min_count);
+
+	for (size_t k = 0; k < commands.size(); ++k)
+	{
+		BOOST_CHECK_EQUAL(commands[k].first, first_tick + (long long)(k * HOP_LENGTH));
+		BOOST_CHECK_EQUAL(commands[k].second, FREQS[k % 3]);
+	}
+}
+
+static void check_outputs(hopper_flowgraph& fg, size_t first_sample, size_t hops)
+{
+	std::vector<float> out[2] = { fg.sinks[0]->data(), fg.sinks[1]->data() };
+	size_t produced[2] = { 0, 0 };
+
+	for (size_t k = 0; k < hops; ++k)
+	{
+		const int dest = ((k % 3) == 2) ? 1 : 0;
+		const size_t begin = first_sample + (k * HOP_LENGTH) + DROP_LENGTH;
+
+		BOOST_REQUIRE(out[dest].size() >= produced[dest] + CHUNK_LENGTH);
+		for (int i = 0; i < CHUNK_LENGTH; i += (CHUNK_LENGTH - 1))
+			BOOST_CHECK_EQUAL(out[dest][produced[dest] + i], (float)(begin + i));
+
+		produced[dest] += CHUNK_LENGTH;
+	}
+
+	BOOST_CHECK_EQUAL(out[0].size(), produced[0]);
+	BOOST_CHECK_EQUAL(out[1].size(), produced[1]);
+}
+
+BOOST_AUTO_TEST_CASE(t0_hop_schedule)
+{
+	const size_t hops = 30;
+	boost::shared_ptr<fake_hopper_device> device(new fake_hopper_device());
+	baz_hopper_sptr hopper = make_hopper(device);
+	hopper_flowgraph fg(hopper, FIRST_HOP + (hops * HOP_LENGTH), std::vector<gr::tag_t>(1, rx_time(0, 10)));
+
+	fg.tb->run();
+
+	std::vector<std::pair<long long,double> > commands = device->commands();
+	check_hops(commands, (10LL * SAMPLE_RATE) + FIRST_HOP, hops);
+	BOOST_CHECK(commands.size() <= hops + hopper->max_ahead());
+	BOOST_CHECK_EQUAL(hopper->commands_issued(), commands.size());
+	BOOST_CHECK_EQUAL(hopper->commands_dropped(), 0);
+	BOOST_CHECK_EQUAL(hopper->pending_commands(), 0);
+
+	check_outputs(fg, FIRST_HOP, hops);
+}
+
+// With the latency known up front the first hop is twice the look-ahead after the first timestamp
+static size_t first_hop(baz_hopper_sptr hopper, double latency)
+{
+	return (size_t)llround(2.0 * hopper->ahead() * latency * SAMPLE_RATE);
+}
+
+BOOST_AUTO_TEST_CASE(t1_look_ahead_follows_latency)
+{
+	const size_t hops = 30;
+	const double latency = 0.02;	// Nearly two hops per tune
+	boost::shared_ptr<fake_hopper_device> device(new fake_hopper_device(latency));
+	baz_hopper_sptr hopper = make_hopper(device);
+	hopper->set_command_latency(latency);
+
+	// Each tune has twice its latency in hand: ceil(40 ms / 11 ms) + 1
+	BOOST_CHECK_EQUAL(hopper->ahead(), 5);
+	const size_t first = first_hop(hopper, latency);
+	hopper_flowgraph fg(hopper, first + (hops * HOP_LENGTH), std::vector<gr::tag_t>(1, rx_time(0, 10)));
+
+	fg.tb->run();
+
+	BOOST_CHECK_CLOSE(hopper->command_latency(), latency, 1e-3);	// Measured on the device clock: unchanged
+	BOOST_CHECK_EQUAL(hopper->ahead(), 5);
+
+	std::vector<std::pair<long long,double> > commands = device->commands();
+	check_hops(commands, (10LL * SAMPLE_RATE) + first, hops);
+	BOOST_CHECK(commands.size() <= hops + hopper->ahead());
+	BOOST_CHECK_EQUAL(hopper->commands_dropped(), 0);
+
+	check_outputs(fg, first, hops);
+}
+
+BOOST_AUTO_TEST_CASE(t2_max_ahead_caps_look_ahead)
+{
+	const size_t hops = 30;
+	const double latency = 0.02;
+	boost::shared_ptr<fake_hopper_device> device(new fake_hopper_device(latency));
+	baz_hopper_sptr hopper = make_hopper(device);
+	hopper->set_max_ahead(2);
+	hopper->set_command_latency(latency);
+
+	BOOST_CHECK_EQUAL(hopper->ahead(), 2);
+	const size_t first = first_hop(hopper, latency);
+	hopper_flowgraph fg(hopper, first + (hops * HOP_LENGTH), std::vector<gr::tag_t>(1, rx_time(0, 10)));
+
+	fg.tb->run();
+
+	BOOST_CHECK_CLOSE(hopper->command_latency(), latency, 1e-3);
+	BOOST_CHECK_EQUAL(hopper->ahead(), 2);
+	check_hops(device->commands(), (10LL * SAMPLE_RATE) + first, hops);
+
+	check_outputs(fg, first, hops);
+}
+
+BOOST_AUTO_TEST_CASE(t3_time_reset_drops_queued_tunes)
+{
+	// Time jumps from 10 s to 20 s before the first hop: the three hops scheduled for 10 s are thrown away
+	const size_t jump = FIRST_HOP / 2;
+	const size_t hops = 5;
+	const size_t length = jump + FIRST_HOP + (hops * HOP_LENGTH);
+	std::vector<gr::tag_t> tags;
+	tags.push_back(rx_time(0, 10));
+	tags.push_back(rx_time(jump, 20));
+
+	boost::shared_ptr<fake_hopper_device> device(new fake_hopper_device(0.0, true));	// Tunes queue up until release
+	baz_hopper_sptr hopper = make_hopper(device);
+	hopper_flowgraph fg(hopper, length, tags);
+
+	fg.tb->start();
+	for (int i = 0; (i < 500) && (hopper->nitems_read(0) < length); ++i)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	BOOST_CHECK_EQUAL(hopper->nitems_read(0), length);
+	device->release();
+	fg.tb->wait();
+
+	std::vector<std::pair<long long,double> > commands = device->commands();
+	BOOST_REQUIRE(commands.empty() == false);
+
+	// The command thread may already have taken the first 10 s tune: nothing after it is issued
+	size_t stale = 0;
+	if (commands[0].first < (20LL * SAMPLE_RATE))
+	{
+		BOOST_CHECK_EQUAL(commands[0].first, (10LL * SAMPLE_RATE) + FIRST_HOP);
+		commands.erase(commands.begin());
+		stale = 1;
+	}
+	BOOST_CHECK_EQUAL(stale + hopper->commands_dropped(), 3);
+
+	check_hops(commands, (20LL * SAMPLE_RATE) + FIRST_HOP, hops);	// Frequencies start over too
+	BOOST_CHECK_EQUAL(hopper->commands_issued(), commands.size() + stale);
+
+	check_outputs(fg, jump + FIRST_HOP, hops);
+}
@@ -0,0 +1,234 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <baz_non_blocker.h>
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
+#include <pmt/pmt.h>
+
+#include <boost/test/unit_test.hpp>
+
+static const int BUFFER_LENGTH = 8192;
+
+// Downstream of the non_blocker: keeps the tags it is handed
+class tag_recorder : public gr::sync_block
+{
+public:
+	tag_recorder()
+		: gr::sync_block("tag_recorder",
+			gr::io_signature::make(1, 1, sizeof(float)),
+			gr::io_signature::make(0, 0, 0))
+	{
+	}
+	int work(int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+	{
+		std::vector<gr::tag_t> tags;
+		get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items);
+		d_tags.insert(d_tags.end(), tags.begin(), tags.end());
+		return noutput_items;
+	}
+	std::vector<std::pair<uint64_t,uint64_t> > tags(const char* key) const	// Offset, value
+	{
+		std::vector<std::pair<uint64_t,uint64_t> > result;
+		for (size_t i = 0; i < d_tags.size(); ++i)
+		{
+			if (pmt::symbol_to_string(d_tags[i].key) == key)
+				result.push_back(std::make_pair(d_tags[i].offset, pmt::to_uint64(d_tags[i].value)));
+		}
+		return result;
+	}
+private:
+	std::vector<gr::tag_t> d_tags;
+};
+
+// Calls the block by hand, so each call sees exactly the backlog the test sets up.
+// Input item i is i + 1, so a zero in the output is always fill.
+struct non_blocker_harness
+{
+	baz_non_blocker_sptr blocker;
+	boost::shared_ptr<tag_recorder> recorder;
+	std::vector<float> input;
+	std::vector<float> output;
+
+	non_blocker_harness(int high_watermark, int low_watermark, int overload_mode, int decimation = 2)
+		: blocker(baz_make_non_blocker(sizeof(float), false, high_watermark, low_watermark, overload_mode, decimation))
+		, recorder(gnuradio::get_initial_sptr(new tag_recorder()))
+	{
+		gr::buffer_sptr in_buffer = gr::make_buffer(BUFFER_LENGTH, sizeof(float));
+		gr::buffer_sptr out_buffer = gr::make_buffer(BUFFER_LENGTH, sizeof(float));
+
+		gr::block_detail_sptr detail = gr::make_block_detail(1, 1);
+		detail->set_input(0, gr::buffer_add_reader(in_buffer, 0));
+		detail->set_output(0, out_buffer);
+		blocker->set_detail(detail);
+
+		gr::block_detail_sptr recorder_detail = gr::make_block_detail(1, 0);
+		recorder_detail->set_input(0, gr::buffer_add_reader(out_buffer, 0));
+		recorder->set_detail(recorder_detail);
+
+		blocker->start();
+	}
+	void write(int count)
+	{
+		for (int i = 0; i < count; ++i)
+			input.push_back((float)(input.size() + 1));
+	}
+	int waiting()
+	{
+		return (int)(input.size() - blocker->nitems_read(0));
+	}
+	void call(int noutput_items)
+	{
+		gr_vector_int ninput_items(1);
+		blocker->forecast(noutput_items, ninput_items);
+		ninput_items[0] = waiting();
+
+		std::vector<float> out(noutput_items, -1.0f);
+		gr_vector_const_void_star in(1, (input.empty() ? NULL : (&input[0] + blocker->nitems_read(0))));
+		gr_vector_void_star outs(1, &out[0]);
+		BOOST_REQUIRE_EQUAL(blocker->general_work(noutput_items, ninput_items, in, outs), noutput_items);
+		blocker->detail()->produce_each(noutput_items);
+		output.insert(output.end(), out.begin(), out.end());
+
+		gr_vector_const_void_star recorder_in(1, &out[0]);
+		gr_vector_void_star recorder_out;
+		BOOST_REQUIRE_EQUAL(recorder->work(noutput_items, recorder_in, recorder_out), noutput_items);
+		recorder->consume(0, noutput_items);
+	}
+	// Input items in [first, last]
+	void check_output(size_t offset, int first, int last, int step = 1)
+	{
+		for (int n = first; n <= last; n += step, ++offset)
+		{
+			BOOST_REQUIRE_LT(offset, output.size());
+			BOOST_CHECK_EQUAL(output[offset], (float)n);
+		}
+	}
+	void check_fill(size_t offset, int count)
+	{
+		for (int i = 0; i < count; ++i)
+			BOOST_CHECK_EQUAL(output[offset + i], 0.0f);
+	}
+};
+
+static std::pair<uint64_t,uint64_t> tag(uint64_t offset, uint64_t value)
+{
+	return std::make_pair(offset, value);
+}
+
+BOOST_AUTO_TEST_CASE(t0_high_watermark_fits_input_buffer)
+{
+	non_blocker_harness h(1000000, 2000, baz_non_blocker::OVERLOAD_DROP_OLDEST);
+
+	const int capacity = h.blocker->detail()->input(0)->max_possible_items_available();
+	BOOST_CHECK_EQUAL(h.blocker->high_watermark(), capacity - 1);
+	BOOST_CHECK_EQUAL(h.blocker->low_watermark(), 2000);
+
+	h.blocker->set_watermarks(1000, 200);	// Fits: left alone
+	BOOST_CHECK_EQUAL(h.blocker->high_watermark(), 1000);
+	BOOST_CHECK_EQUAL(h.blocker->low_watermark(), 200);
+}
+
+BOOST_AUTO_TEST_CASE(t1_drop_oldest)
+{
+	non_blocker_harness h(1000, 200, baz_non_blocker::OVERLOAD_DROP_OLDEST);
+
+	h.write(1500);
+	h.call(100);	// Overloaded: keeps the newest 100 + 200 waiting
+	BOOST_CHECK(h.blocker->overloaded());
+	h.check_output(0, 1201, 1300);
+	BOOST_CHECK_EQUAL(h.waiting(), 200);
+
+	h.write(300);
+	h.call(100);	// Still above the low watermark
+	h.check_output(100, 1501, 1600);
+	BOOST_CHECK_EQUAL(h.waiting(), 200);
+
+	h.call(100);	// Down to the low watermark: passes through
+	BOOST_CHECK(h.blocker->overloaded() == false);
+	h.check_output(200, 1601, 1700);
+
+	h.call(150);	// Runs short: zero-filled
+	h.check_output(300, 1701, 1800);
+	h.check_fill(400, 50);
+
+	BOOST_CHECK_EQUAL(h.blocker->dropped_count(), 1400);
+	BOOST_CHECK_EQUAL(h.blocker->drop_events(), 2);
+	BOOST_CHECK_EQUAL(h.blocker->filled_count(), 50);
+	BOOST_CHECK_EQUAL(h.blocker->fill_events(), 1);
+	BOOST_CHECK_EQUAL(h.blocker->overload_count(), 1);
+
+	std::vector<std::pair<uint64_t,uint64_t> > drops = h.recorder->tags("drop");
+	BOOST_REQUIRE_EQUAL(drops.size(), 2);
+	BOOST_CHECK(drops[0] == tag(0, 1200));
+	BOOST_CHECK(drops[1] == tag(100, 200));
+
+	std::vector<std::pair<uint64_t,uint64_t> > fills = h.recorder->tags("fill");
+	BOOST_REQUIRE_EQUAL(fills.size(), 1);
+	BOOST_CHECK(fills[0] == tag(400, 50));
+}
+
+BOOST_AUTO_TEST_CASE(t2_decimate)
+{
+	non_blocker_harness h(1000, 200, baz_non_blocker::OVERLOAD_DECIMATE, 4);
+
+	h.write(1500);
+	h.call(100);	// Keeps one in four: the other 300 are tagged on the next call
+	h.check_output(0, 1, 397, 4);
+	BOOST_CHECK_EQUAL(h.waiting(), 1100);
+
+	h.call(100);
+	h.check_output(100, 401, 797, 4);
+
+	h.call(100);
+	h.check_output(200, 801, 1197, 4);
+	BOOST_CHECK_EQUAL(h.waiting(), 300);
+
+	h.call(100);	// Only 75 left after decimation, then fill
+	h.check_output(300, 1201, 1497, 4);
+	h.check_fill(375, 25);
+	BOOST_CHECK_EQUAL(h.waiting(), 0);
+
+	h.call(10);	// Nothing waiting: no longer overloaded, and the last call's discards are tagged
+	BOOST_CHECK(h.blocker->overloaded() == false);
+	h.check_fill(400, 10);
+
+	BOOST_CHECK_EQUAL(h.blocker->dropped_count(), 1125);
+	BOOST_CHECK_EQUAL(h.blocker->drop_events(), 4);
+	BOOST_CHECK_EQUAL(h.blocker->filled_count(), 35);
+	BOOST_CHECK_EQUAL(h.blocker->fill_events(), 2);
+	BOOST_CHECK_EQUAL(h.blocker->overload_count(), 1);
+
+	std::vector<std::pair<uint64_t,uint64_t> > drops = h.recorder->tags("drop");
+	BOOST_REQUIRE_EQUAL(drops.size(), 4);
+	BOOST_CHECK(drops[0] == tag(100, 300));
+	BOOST_CHECK(drops[1] == tag(200, 300));
+	BOOST_CHECK(drops[2] == tag(300, 300));
+	BOOST_CHECK(drops[3] == tag(400, 225));
+
+	std::vector<std::pair<uint64_t,uint64_t> > fills = h.recorder->tags("fill");
+	BOOST_REQUIRE_EQUAL(fills.size(), 2);
+	BOOST_CHECK(fills[0] == tag(375, 25));
+	BOOST_CHECK(fills[1] == tag(400, 10));
+}
@@ -0,0 +1,281 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <baz_usrp_acquire.h>
+
+#include <boost/test/unit_test.hpp>
+#include <set>
+
+using namespace gr::baz;
+
+static const size_t SAMPS_PER_PACKET = 100;
+static const double SAMPLE_RATE = 1e6;
+static const double TIME_NOW = 100.0;
+
+/*
+ * Streams each NUM_SAMPS_AND_DONE command back as a burst of samples that encode
+ * (burst number, sample index). With 'hold' set nothing is delivered, so captures stay in flight.
+ * A stop leaves one stray packet behind, as a real device would.
+ */
+class fake_device : public usrp_acquire_device
+{
+public:
+	fake_device(bool hold = false)
+		: hold(hold), stop_commands(0), next_burst(0), stray(0)
+	{
+	}
+public:
+	size_t open_rx_stream(const ::uhd::stream_args_t &stream_args)
+	{
+		return SAMPS_PER_PACKET;
+	}
+	size_t recv(const std::vector<void*> &buffs, size_t nsamps, ::uhd::rx_metadata_t &metadata, double timeout)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		metadata.error_code = ::uhd::rx_metadata_t::ERROR_CODE_NONE;
+		metadata.end_of_burst = false;
+
+		boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds((long long)(timeout * 1e6));
+		while ((stray == 0) && ((hold) || (bursts.empty())))
+		{
+			if (cond.timed_wait(lock, deadline) == false)
+			{
+				metadata.error_code = ::uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+				return 0;
+			}
+		}
+
+		if (stray > 0)
+		{
+			size_t n = std::min(nsamps, stray);
+			fill(buffs, n, -1.0f, 0);
+			stray -= n;
+			return n;
+		}
+
+		burst &b = bursts.front();
+		size_t n = std::min(std::min(nsamps, SAMPS_PER_PACKET), b.nsamps - b.sent);
+		fill(buffs, n, (float)b.number, b.sent);
+		metadata.time_spec = ::uhd::time_spec_t(b.time + ((double)b.sent / SAMPLE_RATE));
+		b.sent += n;
+		if (b.sent == b.nsamps)
+		{
+			metadata.end_of_burst = true;
+			bursts.pop_front();
+		}
+
+		return n;
+	}
+	void issue_stream_cmd(const ::uhd::stream_cmd_t &cmd, size_t chan)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		if (cmd.stream_mode == ::uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE)
+		{
+			burst b;
+			b.number = next_burst++;
+			b.time = cmd.time_spec.get_real_secs();
+			b.nsamps = cmd.num_samps;
+			b.sent = 0;
+			bursts.push_back(b);
+		}
+		else if (cmd.stream_mode == ::uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS)
+		{
+			++stop_commands;
+			if (bursts.empty() == false)
+				stray = SAMPS_PER_PACKET;
+			bursts.clear();
+		}
+
+		cond.notify_all();
+	}
+	::uhd::time_spec_t get_time_now()
+	{
+		return ::uhd::time_spec_t(TIME_NOW);
+	}
+	double get_rx_rate(size_t chan)
+	{
+		return SAMPLE_RATE;
+	}
+	void set_gpio_attr(const std::string &bank, const std::string &attr, const boost::uint32_t value, const boost::uint32_t mask, const size_t mboard)
+	{
+	}
+public:
+	void release()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		hold = false;
+		cond.notify_all();
+	}
+	size_t issued()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		return next_burst;
+	}
+	size_t left_over()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		return (stray + bursts.size());
+	}
+private:
+	static void fill(const std::vector<void*> &buffs, size_t n, float number, size_t first)
+	{
+		for (size_t c = 0; c < buffs.size(); ++c)
+		{
+			std::complex<float>* out = (std::complex<float>*)buffs[c];
+			for (size_t i = 0; i < n; ++i)
+				out[i] = std::complex<float>(number, (float)(first + i));
+		}
+	}
+private:
+	struct burst
+	{
+		size_t number;
+		double time;
+		size_t nsamps;
+		size_t sent;
+	};
+	boost::mutex mutex;
+	boost::condition_variable cond;
+	std::deque<burst> bursts;
+	bool hold;
+public:
+	size_t stop_commands;
+private:
+	size_t next_burst;
+	size_t stray;
+};
+
+static ::uhd::stream_args_t make_stream_args()
+{
+	::uhd::stream_args_t stream_args("fc32");
+	stream_args.channels.push_back(0);
+	return stream_args;
+}
+
+static const std::complex<float>* samples(const usrp_acquisition &acquisition)
+{
+	return (const std::complex<float>*)acquisition.buffers[0];
+}
+
+BOOST_AUTO_TEST_CASE(t0_queued_acquisitions)
+{
+	boost::shared_ptr<fake_device> device(new fake_device());
+	usrp_acquire::sptr acquire = usrp_acquire::make_with_device(device, make_stream_args());
+	acquire->set_acquisition_pool(1000, 2);
+
+	std::vector<double> times;
+	for (size_t i = 0; i < 4; ++i)
+		times.push_back(0.1 * (i + 1));
+	BOOST_CHECK_EQUAL(acquire->queue_acquisitions(times, 1000, true, 10), 0);
+
+	// Only as many captures as there are pool buffers get streamed before one is released
+	for (int i = 0; (i < 500) && (acquire->completed_acquisitions() < 2); ++i)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	BOOST_CHECK_EQUAL(acquire->completed_acquisitions(), 2);
+	BOOST_CHECK_EQUAL(acquire->pending_acquisitions(), 2);
+	BOOST_CHECK_EQUAL(device->issued(), 2);
+
+	for (size_t i = 0; i < times.size(); ++i)
+	{
+		usrp_acquisition acquisition = acquire->next_acquisition(5.0);
+		BOOST_REQUIRE(acquisition.valid);
+		BOOST_CHECK_EQUAL(acquisition.id, i);
+		BOOST_CHECK_CLOSE(acquisition.time, TIME_NOW + times[i], 1e-9);
+		BOOST_CHECK_CLOSE(acquisition.rx_time, TIME_NOW + times[i] + (10 / SAMPLE_RATE), 1e-9);
+		BOOST_CHECK_EQUAL(acquisition.nsamps, 990);
+		BOOST_CHECK_EQUAL(acquisition.error_code, 0);
+		BOOST_REQUIRE_EQUAL(acquisition.buffers.size(), 1);
+		BOOST_CHECK_EQUAL(samples(acquisition)[0], std::complex<float>((float)i, 10.0f));
+		BOOST_CHECK_EQUAL(samples(acquisition)[989], std::complex<float>((float)i, 999.0f));
+
+		acquire->release_acquisition(acquisition.id);
+	}
+
+	BOOST_CHECK_EQUAL(acquire->pending_acquisitions(), 0);
+	BOOST_CHECK_EQUAL(acquire->next_acquisition(0.05).valid, false);
+}
+
+BOOST_AUTO_TEST_CASE(t1_pool_reuse)
+{
+	boost::shared_ptr<fake_device> device(new fake_device());
+	usrp_acquire::sptr acquire = usrp_acquire::make_with_device(device, make_stream_args());
+	acquire->set_acquisition_pool(1000, 2);
+
+	std::vector<double> times(6, 0.1);
+	acquire->queue_acquisitions(times, 1000);
+
+	std::set<size_t> addresses;
+	for (size_t i = 0; i < times.size(); ++i)
+	{
+		usrp_acquisition acquisition = acquire->next_acquisition(5.0);
+		BOOST_REQUIRE(acquisition.valid);
+		BOOST_CHECK_EQUAL(acquisition.id, i);
+		BOOST_CHECK_EQUAL(acquisition.buffers[0] % 64, 0);
+		BOOST_CHECK_EQUAL(samples(acquisition)[0], std::complex<float>((float)i, 0.0f));
+		addresses.insert(acquisition.buffers[0]);
+
+		acquire->release_acquisition(acquisition.id);
+	}
+
+	BOOST_CHECK_EQUAL(addresses.size(), 2);
+
+	// Every buffer is back, so the pool can be resized
+	BOOST_CHECK_NO_THROW(acquire->set_acquisition_pool(2000, 3));
+}
+
+BOOST_AUTO_TEST_CASE(t2_cancel_and_drain)
+{
+	boost::shared_ptr<fake_device> device(new fake_device(true));
+	usrp_acquire::sptr acquire = usrp_acquire::make_with_device(device, make_stream_args());
+	acquire->set_acquisition_pool(1000, 2);
+
+	std::vector<double> times(3, 0.1);
+	acquire->queue_acquisitions(times, 1000);
+
+	for (int i = 0; (i < 500) && (device->issued() < 2); ++i)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	BOOST_REQUIRE_EQUAL(device->issued(), 2);
+	BOOST_CHECK_EQUAL(acquire->pending_acquisitions(), 3);
+
+	acquire->cancel_acquisitions();
+
+	BOOST_CHECK_EQUAL(acquire->pending_acquisitions(), 0);
+	BOOST_CHECK_EQUAL(acquire->completed_acquisitions(), 0);
+	BOOST_CHECK_EQUAL(device->stop_commands, 1);
+	BOOST_CHECK_EQUAL(device->left_over(), 0);  // Stray packet was swallowed
+	BOOST_CHECK_NO_THROW(acquire->set_acquisition_pool(1000, 2));  // Every buffer is free again
+
+	// The next capture only sees its own samples
+	device->release();
+	size_t id = acquire->queue_acquisitions(std::vector<double>(1, 0.1), 1000);
+	BOOST_CHECK_EQUAL(id, 3);
+
+	usrp_acquisition acquisition = acquire->next_acquisition(5.0);
+	BOOST_REQUIRE(acquisition.valid);
+	BOOST_CHECK_EQUAL(acquisition.id, 3);
+	BOOST_CHECK_EQUAL(acquisition.nsamps, 1000);
+	BOOST_CHECK_EQUAL(samples(acquisition)[0], std::complex<float>(2.0f, 0.0f));
+	acquire->release_acquisition(acquisition.id);
+}
@@ -362,7 +362,55 @@ int demod::find_device()
 	struct libusb_device_handle* devh = NULL;
 	DEVICE_INFO* found = NULL;
 	bool custom_id = true;
-	for (int i = 0; i < (sizeof(_rtl2832_devices)/sizeof(DEVICE_INFO)); ++i)
+
+	if (m_params.device_index > 0)	// Several identical devices: count compatible ones in bus order
+	{
+		custom_id = false;
+
+		libusb_device** list = NULL;
+		ssize_t count = libusb_get_device_list(NULL, &list);
+		int match = 0;
+
+		for (ssize_t d = 0; (d < count) && (found == NULL); ++d)
+		{
+			struct libusb_device_descriptor desc;
+			if (libusb_get_device_descriptor(list[d], &desc) < 0)
+				continue;
+
+			for (int i = 0; i < (sizeof(_rtl2832_devices)/sizeof(DEVICE_INFO)); ++i)
+			{
+				DEVICE_INFO* info = _rtl2832_devices + i;
+
+				if ((m_params.vid != 0) && (m_params.vid != info->vid))
+					continue;
+				if ((m_params.pid != 0) && (m_params.pid != info->pid))
+					continue;
+				if ((desc.idVendor != info->vid) || (desc.idProduct != info->pid))
+					continue;
+
+				if (match++ == m_params.device_index)
+				{
+					if (CHECK_LIBUSB_NEG_RESULT(libusb_open(list[d], &devh)) < 0)
+						devh = NULL;
+					else
+						found = info;
+				}
+
+				break;
+			}
+		}
+
+		if (count >= 0)
+			libusb_free_device_list(list, 1);
+
+		if (devh == NULL)
+		{
+			log("Could not open compatible device #%d (found %d)\n", m_params.device_index, match);
+			return FAILURE;
+		}
+	}
+
+	for (int i = 0; (devh == NULL) && (i < (sizeof(_rtl2832_devices)/sizeof(DEVICE_INFO))); ++i)
 	{
 		DEVICE_INFO* info = _rtl2832_devices + i;
 		
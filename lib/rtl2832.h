@@ -327,6 +327,7 @@ public:
 		tuner::PPARAMS	tuner_params;
 		uint32_t		crystal_frequency;
 		char			tuner_name[RTL2832_TUNER_NAME_LEN];
+		int				device_index;	// Open the Nth compatible device (0: first found)
 	} PARAMS, *PPARAMS;
 protected:
 	struct libusb_device_handle *m_devh;
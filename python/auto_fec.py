@@ -20,6 +20,7 @@ import numpy
 
 from gnuradio import gr, blocks, fec, filter, analog
 from grc_gnuradio import blks2 as grc_blks2
+import pmt
 import baz
 
 _puncture_matrices = [
@@ -37,11 +38,12 @@ _puncture_matrices = [
 _phase_multiplication = [
 		('0', 1),
 		('90', 1j),
-		# Others are just inverse of former - inverted stream can be fixed manually
-		#('180', -1),
-		#('270', -1j)
+		('180', -1),	# Only applied from a fec_search result
+		('270', -1j)
 	]
 
+_search_rotations = 2	# Others are just inverse of former - inverted stream can be fixed manually
+
 class auto_fec_xform():
 	#CHANGE_EVERYTHING = -1
 	#CHANGE_NOTHING = 0
@@ -101,7 +103,7 @@ class auto_fec_xform():
 		
 		changes += [auto_fec_xform.CHANGE_ROTATION]
 		# FIXME: Handle arbitrary PSK order
-		self.rotation = (self.rotation + 1) % len(_phase_multiplication)	# Not doing inversion as this takes care of it
+		self.rotation = (self.rotation + 1) % _search_rotations	# Not doing inversion as this takes care of it
 		if self.rotation != ref.rotation:
 			return (True, changes)
 		
@@ -192,10 +194,36 @@ class auto_fec_input_watcher (threading.Thread):
 			self.afb.update_matrix(_puncture_matrices[self.puncture_matrix][1])
 			self.afb.update_xform(self.xform_lock)
 			self.afb.update_lock(0)
+			self.afb.reset_search()
 			#print "    Reset."
 	def set_puncture_matrix(self, matrix):
 		# Not applying, just trigger another search
 		self.set_reset()
+	def apply_search(self, result):
+		# Jump straight to the hypothesis found by baz.fec_search (which has _puncture_matrices in order)
+		if not result.get('locked', False):
+			return
+		with self.lock:
+			if self.fec_found and self.xform_search is None:
+				return	# Already locked
+			xform = auto_fec_xform()
+			xform.conjugate = bool(result['conjugate'])
+			xform.rotation = int(result['rotation']) % len(_phase_multiplication)
+			xform.puncture_delay = int(result['puncture_delay'])
+			xform.viterbi_delay = bool(result['viterbi_delay'])
+			xform.viterbi_swap = bool(result['viterbi_swap'])
+			self.puncture_matrix = int(result['matrix']) % len(_puncture_matrices)
+			print "Applying search result:", _puncture_matrices[self.puncture_matrix][0], ", error rate:", result['error_rate']
+			self.afb.update_matrix(_puncture_matrices[self.puncture_matrix][1])
+			self.afb.update_xform(xform)
+			# Lock is confirmed by the BER as usual once settled
+			self.xform_lock = xform
+			self.xform_search = None
+			self.fec_found = False
+			self.excess_ber_count = 0
+			self.excess_ber_sum = 0
+			self.samples_since_excess = 0
+			self.skip_samples = self.settling_period
 	def run (self):
 		print "Auto-FEC thread started:", self.getName()
 		print "Skipping initial samples while MPSK receiver locks:", self.skip_samples
@@ -270,6 +298,7 @@ class auto_fec_input_watcher (threading.Thread):
 					
 					if self.xform_search is None:
 						self.afb.update_lock(0)
+						self.afb.reset_search()
 						print "Beginning search..."
 						self.xform_search = self.xform_lock.copy()
 					
@@ -333,6 +362,18 @@ class auto_fec_input_watcher (threading.Thread):
 			#self.skip_samples = self.afb.ber_sample_skip -
 		print "Auto-FEC thread exiting:", self.getName()
 
+class auto_fec_search_handler(gr.basic_block):
+	def __init__(self, callback):
+		gr.basic_block.__init__(self,
+			name="auto_fec_search_handler",
+			in_sig=None,
+			out_sig=None)
+		self.callback = callback
+		self.message_port_register_in(pmt.intern('xform'))
+		self.set_msg_handler(pmt.intern('xform'), self.handle_xform)
+	def handle_xform(self, msg):
+		self.callback(pmt.to_python(msg))
+
 class auto_fec(gr.hier_block2):
 	def __init__(self,
 		sample_rate,
@@ -343,6 +384,8 @@ class auto_fec(gr.hier_block2):
 		settling_period=0,
 		pre_lock_duration=0,
 		#ber_sample_skip=0
+		search_window=0,	# Symbols per baz.fec_search window (0 to only step through combos)
+		search_threads=0,
 		**kwargs):
 		
 		use_throttle = False
@@ -370,6 +413,7 @@ class auto_fec(gr.hier_block2):
 		print "\tber_sample_decimation:\t", ber_sample_decimation
 		print "\tsettling_period:\t", settling_period
 		print "\tpre_lock_duration:\t", pre_lock_duration
+		print "\tsearch_window:\t\t", search_window
 		print ""
 		
 		self.sample_rate = sample_rate
@@ -488,6 +532,15 @@ class auto_fec(gr.hier_block2):
 		self.msg_sink = blocks.message_sink(gr.sizeof_float, self.msg_q, False)	# Block to speed up process
 		self.connect((self.gr_keep_one_in_n_0, 0), self.msg_sink)
 		
+		self.fec_search = None
+		if search_window > 0:
+			self.fec_search = baz.fec_search(search_window, _puncture_matrices[0][1], threads=search_threads)
+			for matrix in _puncture_matrices[1:]:
+				self.fec_search.add_matrix(matrix[1])
+			self.connect((self, 0), (self.fec_search, 0))	# Input (it applies its own conjugation & rotation)
+			self.search_handler = auto_fec_search_handler(self.input_watcher.apply_search)
+			self.msg_connect(self.fec_search, 'xform', self.search_handler, 'xform')
+		
 		self.input_watcher.start()
 	def update_xform(self, xform, changes=None):
 		#with self.data_lock:
@@ -520,6 +573,9 @@ class auto_fec(gr.hier_block2):
 		#with self.data_lock:
 			print "\tApplying puncture matrix:", matrix
 			self.depuncture_ff_0.set_matrix(matrix)
+	def reset_search(self):
+		if self.fec_search is not None:
+			self.fec_search.reset()
 	def update_lock(self, locked):
 		#with self.data_lock:
 			print "\tApplying lock value:", locked
@@ -34,6 +34,8 @@ import numpy
 import threading
 import math
 
+import baz
+
 default_facsink_size = (640,240)
 default_fac_rate = gr.prefs().get_long('wxgui', 'fac_rate', 10) # was 15, 3
 
@@ -81,10 +83,10 @@ class fac_sink_base(gr.hier_block2, common.wxgui_hb):
     def set_average(self, average):
         self.average = average
         if average:
-            self.avg.set_taps(self.avg_alpha)
+            self.fac.set_alpha(self.avg_alpha)
             self.set_peak_hold(False)
         else:
-            self.avg.set_taps(1.0)
+            self.fac.set_alpha(1.0)
 
     def set_peak_hold(self, enable):
         self.peak_hold = enable
@@ -94,17 +96,20 @@ class fac_sink_base(gr.hier_block2, common.wxgui_hb):
 
     def set_avg_alpha(self, avg_alpha):
         self.avg_alpha = avg_alpha
+        if self.average:
+            self.fac.set_alpha(avg_alpha)
 
     def set_baseband_freq(self, baseband_freq):
         self.baseband_freq = baseband_freq
 
     def set_sample_rate(self, sample_rate):
         self.sample_rate = sample_rate
-        self._set_n()
+        self.fac.set_sample_rate(sample_rate)
+
+    def _make_fac(self):
+        # Native FFT -> |.| -> FFT -> |.| -> average -> dB, fed every frame (averaged, not decimated)
+        self.fac = baz.fac(self.fac_size, self.input_is_real, self.sample_rate, self.fac_rate, self.msgq)
 
-    def _set_n(self):
-        self.one_in_n.set_n(max(1, int(self.sample_rate/self.fac_size/self.fac_rate)))
-        
 
 class fac_sink_f(fac_sink_base):
     def __init__(self, parent, baseband_freq=0,
@@ -120,34 +125,12 @@ class fac_sink_f(fac_sink_base):
                                average=average, avg_alpha=avg_alpha, title=title,
                                peak_hold=peak_hold)
                                
-        s2p = blocks.stream_to_vector(gr.sizeof_float, self.fac_size)
-        self.one_in_n = blocks.keep_one_in_n(gr.sizeof_float * self.fac_size,
-                                         max(1, int(self.sample_rate/self.fac_size/self.fac_rate)))
-
-        # windowing removed... 
-
-        #fac = gr.fft_vfc(self.fac_size, True, ())
-        fac = fft.fft_vfc(self.fac_size, True, ())
-
-        c2mag = blocks.complex_to_mag(self.fac_size)
-        self.avg = filter.single_pole_iir_filter_ff_make(1.0, self.fac_size)
-
-        fac_fac   = fft.fft_vfc(self.fac_size, True, ())
-        fac_c2mag = blocks.complex_to_mag_make(fac_size)
-
-        # FIXME  We need to add 3dB to all bins but the DC bin
-        log = blocks.nlog10_ff_make(20, self.fac_size,
-                           -20*math.log10(self.fac_size) )
-        sink = blocks.message_sink(gr.sizeof_float * self.fac_size, self.msgq, True)
-
-        self.connect(s2p, self.one_in_n, fac, c2mag,  fac_fac, fac_c2mag, self.avg, log, sink)
-
-#        gr.hier_block.__init__(self, fg, s2p, sink)
+        self._make_fac()
 
         self.win = fac_window(self, parent, size=size)
         self.set_average(self.average)
 
-        self.wxgui_connect(self, s2p)
+        self.wxgui_connect(self, self.fac)
 
 
 class fac_sink_c(fac_sink_base):
@@ -164,33 +147,12 @@ class fac_sink_c(fac_sink_base):
                                average=average, avg_alpha=avg_alpha, title=title,
                                peak_hold=peak_hold)
 
-        s2p = blocks.stream_to_vector(gr.sizeof_gr_complex, self.fac_size)
-        self.one_in_n = blocks.keep_one_in_n(gr.sizeof_gr_complex * self.fac_size,
-                                         max(1, int(self.sample_rate/self.fac_size/self.fac_rate)))
-
-        # windowing removed ...
-     
-        fac =  fft.fft_vcc(self.fac_size, True, ())
-        c2mag = blocks.complex_to_mag_make(fac_size)
-
-        # Things go off into the weeds if we try for an inverse FFT so a forward FFT will have to do...
-        fac_fac   = fft.fft_vfc(self.fac_size, True, ())
-        fac_c2mag = blocks.complex_to_mag_make(fac_size)
-
-        self.avg = filter.single_pole_iir_filter_ff_make(1.0, fac_size)
-
-        log = blocks.nlog10_ff_make(20, self.fac_size, 
-                           -20*math.log10(self.fac_size)  ) #  - 20*math.log10(norm) ) # - self.avg[0] )
-        sink = blocks.message_sink_make(gr.sizeof_float * fac_size, self.msgq, True)
-
-        self.connect(s2p, self.one_in_n, fac, c2mag,  fac_fac, fac_c2mag, self.avg, log, sink)
-
-#        gr.hier_block2.__init__(self, fg, s2p, sink)
+        self._make_fac()
 
         self.win = fac_window(self, parent, size=size)
         self.set_average(self.average)
 
-        self.wxgui_connect(self, s2p)
+        self.wxgui_connect(self, self.fac)
 
 
 # ------------------------------------------------------------------------
@@ -25,13 +25,20 @@ import pmt
 
 _phase_multiplication = [
 		('0', 1),
-		('90', 1j)
+		('90', 1j),
+		('180', -1),
+		('270', -1j)
 ]
 
+_search_rotations = 2	# Stepping only tries 0/90: 180/270 invert the data of odd-weight polynomials
+
 class fec_sync_xform():
 	CHANGE_PUNCTURE_DELAY = 1
 	CHANGE_ROTATION = 2
 	CHANGE_CONJUGATION = 3
+	CHANGE_VITERBI_DELAY = 4
+	CHANGE_VITERBI_SWAP = 5
+	CHANGE_MATRIX = 6
 	#_clonable = [
 	#		'puncture_delay'
 	#		'rotation',
@@ -43,6 +50,9 @@ class fec_sync_xform():
 		self.conjugate = True
 		self.rotation = 0
 		self.puncture_delay = 0
+		self.viterbi_delay = False
+		self.viterbi_swap = False
+		self.matrix = 0
 	def copy(self):
 		clone = fec_sync_xform()
 		#for k in fec_sync_xform._clonable:
@@ -50,6 +60,9 @@ class fec_sync_xform():
 		clone.puncture_delay = self.puncture_delay
 		clone.rotation = self.rotation
 		clone.conjugate = self.conjugate
+		clone.viterbi_delay = self.viterbi_delay
+		clone.viterbi_swap = self.viterbi_swap
+		clone.matrix = self.matrix
 		return clone
 	def get_conjugation(self):
 		return self.conjugate
@@ -57,6 +70,14 @@ class fec_sync_xform():
 		return _phase_multiplication[self.rotation][1]
 	def get_puncture_delay(self):
 		return self.puncture_delay
+	def get_viterbi_delay(self):
+		if self.viterbi_delay:
+			return 1
+		return 0
+	def get_viterbi_swap(self):
+		return self.viterbi_swap
+	def get_matrix(self):
+		return self.matrix
 	def next(self, ref, depunc_length):	#, psk_order=4
 		changes = []
 		
@@ -66,7 +87,7 @@ class fec_sync_xform():
 			return (True, changes)
 		
 		changes += [fec_sync_xform.CHANGE_ROTATION]
-		self.rotation = (self.rotation + 1) % len(_phase_multiplication)	# FIXME: Handle arbitrary PSK order
+		self.rotation = (self.rotation + 1) % _search_rotations	# FIXME: Handle arbitrary PSK order
 		if self.rotation != ref.rotation:
 			return (True, changes)
 		
@@ -81,7 +102,7 @@ class fec_sync(gr.basic_block):
     """
     docstring for block fec_sync
     """
-    def __init__(self, conj, rot, depunc_delay, depunc_length, trial_duration, lock_timeout, verbose=False):	#, expected_pdu_rate
+    def __init__(self, conj, rot, depunc_delay, depunc_length, trial_duration, lock_timeout, verbose=False, viterbi_delay=None, viterbi_swap=None, depunc=None, matrices=None):	#, expected_pdu_rate
         gr.basic_block.__init__(self,
             name="fec_sync",
             in_sig=None,
@@ -96,6 +117,11 @@ class fec_sync(gr.basic_block):
         self.trial_duration = trial_duration
         self.lock_timeout = lock_timeout
         self.verbose = verbose
+        # Only needed to apply everything found by baz.fec_search ('matrices' in the order given to it)
+        self.viterbi_delay = viterbi_delay
+        self.viterbi_swap = viterbi_swap
+        self.depunc = depunc
+        self.matrices = matrices
 
         print "Depuncturer length:", depunc_length
         print "Trial duration:", trial_duration
@@ -119,6 +145,8 @@ class fec_sync(gr.basic_block):
         self.set_msg_handler(pmt.intern('pdu'), self.handle_pdu)
         self.message_port_register_in(pmt.intern('status'))
         self.set_msg_handler(pmt.intern('status'), self.handle_status)
+        self.message_port_register_in(pmt.intern('search'))	# From baz.fec_search
+        self.set_msg_handler(pmt.intern('search'), self.handle_search)
 
         self.set_unlocked()
 
@@ -139,6 +167,32 @@ class fec_sync(gr.basic_block):
     	#self.set_unlocked()
     	return
 
+    def handle_search(self, msg):
+    	# Jump straight to the hypothesis found by fec_search instead of stepping through the rest
+    	try:
+    		result = pmt.to_python(msg)
+    	except:
+    		print "[FEC] Search result is not a dict"
+    		return
+    	if self.locked or not result.get('locked', False):
+    		return
+    	xform = fec_sync_xform()
+    	xform.conjugate = bool(result['conjugate'])
+    	xform.rotation = int(result['rotation']) % len(_phase_multiplication)
+    	xform.viterbi_delay = bool(result['viterbi_delay'])
+    	xform.viterbi_swap = bool(result['viterbi_swap'])
+    	xform.matrix = int(result['matrix'])
+    	depunc_length = self.depunc_length
+    	if self.matrices is not None:
+    		if xform.matrix >= len(self.matrices):
+    			print "[FEC] Search result matrix %d is not one of the %d given" % (xform.matrix, len(self.matrices))
+    			return
+    		depunc_length = len(self.matrices[xform.matrix])
+    	xform.puncture_delay = int(result['puncture_delay']) % depunc_length
+    	if self.verbose: print "[FEC] Applying search result (error rate: %f)" % (result['error_rate'])
+    	self.xform_search = xform
+    	self.update_xform(self.xform_search)
+
     def set_unlocked(self):
     	self.locked = False
     	print "[FEC] Resetting xform"
@@ -191,6 +245,16 @@ class fec_sync(gr.basic_block):
 		if changes is None or fec_sync_xform.CHANGE_PUNCTURE_DELAY in changes:
 			if self.verbose: print "[FEC] \t[%03d] Applying puncture delay:" % (self.search_iterations), xform.get_puncture_delay()
 			self.depunc_delay.set_delay(xform.get_puncture_delay())
+		if self.viterbi_delay is not None and (changes is None or fec_sync_xform.CHANGE_VITERBI_DELAY in changes):
+			if self.verbose: print "[FEC] \t[%03d] Applying viterbi delay: " % (self.search_iterations), xform.get_viterbi_delay()
+			self.viterbi_delay.set_delay(xform.get_viterbi_delay())
+		if self.viterbi_swap is not None and (changes is None or fec_sync_xform.CHANGE_VITERBI_SWAP in changes):
+			if self.verbose: print "[FEC] \t[%03d] Applying viterbi swap:  " % (self.search_iterations), xform.get_viterbi_swap()
+			self.viterbi_swap.set_swap(xform.get_viterbi_swap())
+		if self.depunc is not None and self.matrices is not None and (changes is None or fec_sync_xform.CHANGE_MATRIX in changes):
+			if self.verbose: print "[FEC] \t[%03d] Applying matrix:        " % (self.search_iterations), self.matrices[xform.get_matrix()]
+			self.depunc.set_matrix(self.matrices[xform.get_matrix()])
+			self.depunc_length = len(self.matrices[xform.get_matrix()])
 
 		#print ""
 
@@ -23,11 +23,11 @@
 #  
 
 import sys
-from gnuradio import gr, gru
+from gnuradio import gr, gru, blocks
 from baz import message_relay
 
 class multi_channel_decoder(gr.hier_block2):
-	def __init__(self, msgq, baseband_freq, frequencies, decoder, decoder_args=None, params={}, per_freq_params={}, **kwargs):
+	def __init__(self, msgq, baseband_freq, frequencies, decoder, decoder_args=None, params={}, per_freq_params={}, channelizer=None, channel_rate_param=None, **kwargs):
 		gr.hier_block2.__init__(self, "multi_channel_decoder",
 			gr.io_signature(1, 1, gr.sizeof_gr_complex),
 			gr.io_signature(0, 0, 0))
@@ -42,6 +42,18 @@ class multi_channel_decoder(gr.hier_block2):
 		self.decoders = []
 		self.decoders_unused = []
 		
+		# Optional baz.channelizer_ccf: the wideband input is split once, and each decoder
+		# gets its own channel output (already at baseband, at the channelizer's output rate)
+		self.channelizer = channelizer
+		self.channel_rate_param = channel_rate_param	# Decoder keyword that receives the channel sample rate
+		self.channel_sinks = []
+		if self.channelizer is not None:
+			self.connect(self, self.channelizer)
+			for i in range(self.channelizer.output_count()):
+				null_sink = blocks.null_sink(gr.sizeof_gr_complex)	# Unused outputs still need to be connected
+				self.connect((self.channelizer, i), null_sink)
+				self.channel_sinks += [null_sink]
+		
 		self.set_baseband_freq(baseband_freq)
 		
 		self.set_frequencies(frequencies, True)
@@ -55,6 +67,16 @@ class multi_channel_decoder(gr.hier_block2):
 		create = [f for f in freq_list if f not in current_freqs]
 		remove = [f for f in current_freqs if f not in freq_list]
 		if not skip_lock: self.lock()
+		outputs = {}
+		if self.channelizer is not None:
+			try:
+				for f in remove:
+					decoder = map_freqs[f]
+					self.disconnect((self.channelizer, decoder._channel_output), decoder)
+					self.connect((self.channelizer, decoder._channel_output), self.channel_sinks[decoder._channel_output])
+				outputs = dict(zip(freq_list, self.channelizer.set_frequencies(freq_list)))
+			except Exception, e:
+				print "Failed to update channelizer:", e
 		try:
 			decoder_factory = self.decoder
 			if isinstance(self.decoder, str):
@@ -65,6 +87,13 @@ class multi_channel_decoder(gr.hier_block2):
 				combined_args = self.kwargs
 				combined_args['baseband_freq'] = self.baseband_freq
 				combined_args['freq'] = f
+				if self.channelizer is not None:
+					if outputs.get(f, -1) < 0:
+						print "No free channelizer output for %f" % (f)
+						continue
+					combined_args['baseband_freq'] = f	# Channel output is already centred on 'f'
+					if self.channel_rate_param is not None:
+						combined_args[self.channel_rate_param] = self.channelizer.output_rate()
 				if f in self.per_freq_params:
 					for k in self.per_freq_params[f].keys():
 						combined_args[k] = self.per_freq_params[f][k]
@@ -72,7 +101,12 @@ class multi_channel_decoder(gr.hier_block2):
 				#d = decoder_factory(baseband_freq=self.baseband_freq, freq=f, **combined_args)
 				d = decoder_factory(**combined_args)
 				d._msgq_relay = message_relay.message_relay(self.msgq, d.msg_out.msgq())
-				self.connect(self, d)
+				if self.channelizer is not None:
+					d._channel_output = outputs[f]
+					self.disconnect((self.channelizer, d._channel_output), self.channel_sinks[d._channel_output])
+					self.connect((self.channelizer, d._channel_output), d)
+				else:
+					self.connect(self, d)
 				self.decoders += [d]
 		except Exception, e:
 			print "Failed to create decoder:", e#, factory_eval_str
@@ -80,7 +114,8 @@ class multi_channel_decoder(gr.hier_block2):
 			for f in remove:
 				decoder = map_freqs[f]
 				print "Disconnecting decoder for %f" % (decoder.get_freq())
-				self.disconnect(self, decoder)
+				if self.channelizer is None:
+					self.disconnect(self, decoder)
 				self.decoders.remove(decoder)
 				#self.decoders_unused += [decoder]	# FIXME: Re-use mode
 		except Exception, e:
@@ -89,6 +124,9 @@ class multi_channel_decoder(gr.hier_block2):
 	
 	def set_baseband_freq(self, baseband_freq):
 		self.baseband_freq = baseband_freq
+		if self.channelizer is not None:
+			self.channelizer.set_baseband_freq(baseband_freq)	# Decoders stay centred on their channel
+			return
 		for decoder in self.decoders:
 			decoder.set_baseband_freq(baseband_freq)
 	
@@ -29,8 +29,11 @@ from gnuradio.wxgui import common
 from gnuradio.wxgui.pubsub import pubsub
 from gnuradio.wxgui.constants import *
 import math
+import wx
 
 import plot_window
+import spectrum_frames
+import baz
 
 ##################################################
 # Plot sink block (wrapper for old wxgui)
@@ -129,11 +132,127 @@ class plot_sink_f(gr.hier_block2, common.wxgui_hb):
 	def sample_rate(self):
 		return self._sample_rate
 
+##################################################
+# Plot sink block for complex input (native FFT & framing)
+##################################################
+class plot_sink_c(gr.hier_block2, common.wxgui_hb):
+	"""
+	A spectrum plot with complex input: windowing, FFT, averaging and dB conversion
+	happen in baz.spectrum_frames, and the window reads its frames in place.
+	"""
+	def __init__(
+		self,
+		parent,
+		y_per_div=10,
+		y_divs=8,
+		ref_level=0,
+		sample_rate=1,
+		fft_size=1024,
+		overlap=0,
+		update_rate=plot_window.DEFAULT_FRAME_RATE,
+		average=False,
+		avg_alpha=None,
+		title='',
+		size=plot_window.DEFAULT_WIN_SIZE,
+		peak_hold=False,
+		use_persistence=False,
+		persist_alpha=None,
+		win=None,
+		**kwargs #do not end with a comma
+	):
+		#ensure avg alpha
+		if avg_alpha is None:
+			avg_alpha = 2.0/update_rate
+		#ensure analog alpha
+		if persist_alpha is None:
+			analog_cutoff_freq=0.5 # Hertz
+			persist_alpha = 1.0 - math.exp(-2.0*math.pi*analog_cutoff_freq/update_rate)
+		
+		self._average = average
+		self._avg_alpha = avg_alpha
+		self._sample_rate = sample_rate
+		
+		#init
+		gr.hier_block2.__init__(
+			self,
+			"plot_sink_c",
+			gr.io_signature(1, 1, gr.sizeof_gr_complex),
+			gr.io_signature(0, 0, 0),
+		)
+		#blocks
+		if win is None: win = []
+		self.frames = baz.spectrum_frames(fft_size, overlap, sample_rate, update_rate, win, 16, ref_level, y_per_div*y_divs, (avg_alpha if average else 1.0))
+		
+		#controller
+		self.controller = pubsub()
+		self.controller.subscribe(AVERAGE_KEY, self.set_average)
+		self.controller.publish(AVERAGE_KEY, self.average)
+		self.controller.subscribe(AVG_ALPHA_KEY, self.set_avg_alpha)
+		self.controller.publish(AVG_ALPHA_KEY, self.avg_alpha)
+		self.controller.subscribe(SAMPLE_RATE_KEY, self.set_sample_rate)
+		self.controller.publish(SAMPLE_RATE_KEY, self.sample_rate)
+		#start frame poller
+		self.poller = spectrum_frames.frame_poller(self.frames, self.controller, MSG_KEY, update_rate)
+		#create window
+		self.win = plot_window.plot_window(
+			parent=parent,
+			controller=self.controller,
+			size=size,
+			title=title,
+			data_len=fft_size,
+			sample_rate_key=SAMPLE_RATE_KEY,
+			y_per_div=y_per_div,
+			y_divs=y_divs,
+			ref_level=ref_level,
+			average_key=AVERAGE_KEY,
+			avg_alpha_key=AVG_ALPHA_KEY,
+			peak_hold=peak_hold,
+			msg_key=MSG_KEY,
+			use_persistence=use_persistence,
+			persist_alpha=persist_alpha,
+		)
+		#quantise over what is on screen
+		self.win.subscribe(REF_LEVEL_KEY, self.frames.set_ref_level)
+		self.win.subscribe(Y_PER_DIV_KEY, self._update_range)
+		self.win.subscribe(Y_DIVS_KEY, self._update_range)
+		common.register_access_methods(self, self.win)
+		setattr(self.win, 'set_peak_hold', getattr(self, 'set_peak_hold')) #BACKWARDS
+		self.win.Bind(wx.EVT_WINDOW_DESTROY, self._on_destroy)
+		self.wxgui_connect(self, self.frames)
+	def _on_destroy(self, event):
+		if event.GetEventObject() is self.win:
+			self.stop()
+		event.Skip()
+	def stop(self):
+		"""Stops the frame poller (also done when the window is destroyed)"""
+		self.poller.stop()
+	def _update_range(self, *args):
+		self.frames.set_dynamic_range(self.win[Y_PER_DIV_KEY]*self.win[Y_DIVS_KEY])
+	def _update_alpha(self):
+		if self._average:
+			self.frames.set_alpha(self._avg_alpha)
+		else:
+			self.frames.set_alpha(1.0)
+	def set_average(self, ave):
+		self._average = ave
+		self._update_alpha()
+	def average(self):
+		return self._average
+	def set_avg_alpha(self, ave):
+		self._avg_alpha = ave
+		self._update_alpha()
+	def avg_alpha(self):
+		return self._avg_alpha
+	def set_sample_rate(self, rate):
+		self._sample_rate = rate
+		self.frames.set_sample_rate(rate)
+	def sample_rate(self):
+		return self._sample_rate
+
 # ----------------------------------------------------------------
 # Standalone test app
 # ----------------------------------------------------------------
 
-import wx
 from gnuradio.wxgui import stdgui2
 
 class test_app_block (stdgui2.std_top_block):
@@ -336,11 +336,14 @@ class plot_window(wx.Panel, pubsub.pubsub):
 		Handle the message from the sink message queue.
 		Plot the samples onto the grid as channel 1.
 		If peak hold is enabled, plot peak vals as channel 2.
-		@param msg the array as a character array
+		@param msg the array as a character array (or float32 numpy array)
 		"""
 		if not self[RUNNING_KEY]: return
 		#convert to floating point numbers
-		samples = numpy.fromstring(msg, numpy.float32)[:self.data_len] #only take first frame
+		if isinstance(msg, numpy.ndarray):
+			samples = msg[:self.data_len]
+		else:
+			samples = numpy.fromstring(msg, numpy.float32)[:self.data_len] #only take first frame
 		num_samps = len(samples)
 		self.samples = samples
 		#peak hold calculation
@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  qa_acars_multi_decoder.py
+#
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#
+#
+
+import numpy
+
+from gnuradio import gr, gr_unittest, blocks
+import pmt
+
+import baz_swig
+
+SAMPLE_RATE = 250e3
+BASEBAND_FREQ = 131.5e6
+BIT_RATE = 2400
+DURATION = 0.25
+PREKEY_LENGTH = 128
+PREAMBLE = 0x3FFE5C5C	# Bit sync (+ + * *) and char sync (SYN SYN) as they appear on air
+HEADER = '2.N12345H12.'	# Mode, address, ack, label, block ID
+FLAGS_ALL = 0x0F	# SOH, STX, ETX and DEL all seen
+
+def add_byte(bits, c):
+    """7 data bits LSB first, then odd parity"""
+    data = [(c >> i) & 1 for i in range(7)]
+    bits += data + [(sum(data) + 1) % 2]
+
+def air_bits(text):
+    """Pre-key, preamble and differentially encoded message of one ACARS burst"""
+    bits = []
+    for c in '\x01' + HEADER + '\x02' + text + '\x03' + 'AB' + '\x7f':
+        add_byte(bits, ord(c))
+    air = [0] * PREKEY_LENGTH
+    air += [(PREAMBLE >> i) & 1 for i in range(31, -1, -1)]
+    previous = 0
+    for b in bits:
+        air.append(b ^ previous)	# A one is a change of tone
+        previous = b
+    return air + [0] * 64
+
+def burst(n, text, lead, freq, amplitude, phase=0.0):
+    """AM (1 + 0.5 * cos) of MSK tones, 1200 Hz for a one, 2400 Hz for a zero"""
+    air = numpy.array(air_bits(text))
+    t = numpy.arange(n) / SAMPLE_RATE
+    index = numpy.floor((t - lead) * BIT_RATE).astype(int)
+    keyed = (index >= 0) & (index < len(air))
+    tone = numpy.where(air[numpy.clip(index, 0, len(air) - 1)] == 1, 1200.0, 2400.0) * keyed
+    audio = 1.0 + 0.5 * numpy.cos(numpy.cumsum(2.0 * numpy.pi * tone / SAMPLE_RATE))
+    carrier = numpy.exp(1j * ((2.0 * numpy.pi * (freq - BASEBAND_FREQ) * t) + phase))
+    return amplitude * audio * carrier * keyed
+
+class qa_acars_multi_decoder (gr_unittest.TestCase):
+
+    def setUp (self):
+        self.tb = gr.top_block ()
+
+    def tearDown (self):
+        self.tb = None
+
+    def test_001_two_channels (self):
+        messages = {	# Frequency: text, start time, amplitude, carrier offset
+            131.525e6: ('HELLO WORLD', 0.05, 1.0, 0.0),
+            131.45e6: ('SECOND CHANNEL MSG', 0.03, 0.7, 300.0),	# Overlaps the first, slightly off frequency
+        }
+        frequencies = sorted(messages.keys()) + [131.55e6]	# Plus an idle channel
+
+        n = int(SAMPLE_RATE * DURATION)
+        rng = numpy.random.RandomState(1)
+        data = 0.05 * (rng.randn(n) + 1j * rng.randn(n))
+        for freq, (text, lead, amplitude, offset) in messages.items():
+            data += burst(n, text, lead, freq + offset, amplitude, rng.uniform(0, 2 * numpy.pi))
+
+        src = blocks.vector_source_c(data.astype(numpy.complex64).tolist())
+        decoder = baz_swig.acars_multi_decoder(SAMPLE_RATE, BASEBAND_FREQ, frequencies, 2)
+        dbg = blocks.message_debug()
+        self.tb.connect(src, decoder)
+        self.tb.msg_connect(decoder, 'pdu', dbg, 'store')
+        self.tb.run()
+
+        self.assertEqual(dbg.num_messages(), len(messages))
+        decoded = {}
+        for i in range(dbg.num_messages()):
+            msg = dbg.get_message(i)
+            meta = pmt.car(msg)
+            freq = pmt.to_double(pmt.dict_ref(meta, pmt.intern('frequency'), pmt.PMT_NIL))
+            decoded[freq] = (meta, ''.join(map(chr, pmt.u8vector_elements(pmt.cdr(msg)))))
+
+        self.assertEqual(sorted(decoded.keys()), sorted(messages.keys()))
+        for freq, (text, lead, amplitude, offset) in messages.items():
+            meta, payload = decoded[freq]
+            self.assertEqual(payload, '\x01' + HEADER + '\x02' + text + '\x03' + 'AB')
+            self.assertEqual(pmt.to_long(pmt.dict_ref(meta, pmt.intern('flags'), pmt.PMT_NIL)), FLAGS_ALL)
+            self.assertEqual(pmt.to_long(pmt.dict_ref(meta, pmt.intern('parity_error_count'), pmt.PMT_NIL)), 0)
+            # Preamble level is averaged over exactly the matched sync bits, so it tracks the carrier
+            self.assertAlmostEqual(pmt.to_double(pmt.dict_ref(meta, pmt.intern('reference_level'), pmt.PMT_NIL)), amplitude, 1)
+
+if __name__ == '__main__':
+    gr_unittest.main ()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  qa_channelizer.py
+#  
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#  
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#  
+#  
+
+import numpy
+
+from gnuradio import gr, gr_unittest, blocks, filter
+
+import baz_swig
+
+SAMPLE_RATE = 800e3
+CHANNELS = 8
+DECIMATION = 4
+SPACING = SAMPLE_RATE / CHANNELS
+BASEBAND_FREQ = 100e6
+
+class qa_channelizer (gr_unittest.TestCase):
+
+    def setUp (self):
+        self.tb = gr.top_block ()
+        self.taps = filter.firdes.low_pass(1.0, SAMPLE_RATE, 40e3, 20e3)
+        self.skip = (len(self.taps) / DECIMATION) + 1	# Start-up transient, where the two paths see different zero history
+
+    def tearDown (self):
+        self.tb = None
+
+    def run_both (self, data, offsets):
+        """Channelizer outputs, and what each decoder's own freq_xlating filter makes of the full-rate input"""
+        src = blocks.vector_source_c(data)
+        channelizer = baz_swig.channelizer_ccf(SAMPLE_RATE, CHANNELS, DECIMATION, self.taps, len(offsets), BASEBAND_FREQ)
+        self.tb.connect(src, channelizer)
+
+        # Channelizer's n'th output ends on the last sample of its decimation period, the filter's on the first
+        skip = blocks.skiphead(gr.sizeof_gr_complex, DECIMATION - 1)
+        self.tb.connect(src, skip)
+
+        channel_sinks, reference_sinks = [], []
+        for i, offset in enumerate(offsets):
+            channelizer.set_channel(i, BASEBAND_FREQ + offset)
+            channel_sinks += [blocks.vector_sink_c()]
+            self.tb.connect((channelizer, i), channel_sinks[-1])
+
+            xlating = filter.freq_xlating_fir_filter_ccf(DECIMATION, self.taps, offset, SAMPLE_RATE)
+            reference_sinks += [blocks.vector_sink_c()]
+            self.tb.connect(skip, xlating, reference_sinks[-1])
+
+        self.tb.run()
+
+        results = []
+        for i, offset in enumerate(offsets):
+            actual = numpy.array(channel_sinks[i].data())
+            # Skipping D-1 inputs also moves the filter's mixer phase on by that many samples
+            expected = numpy.array(reference_sinks[i].data()) * numpy.exp(-2j * numpy.pi * offset * (DECIMATION - 1) / SAMPLE_RATE)
+            n = min(len(actual), len(expected))
+            results += [(actual[self.skip:n], expected[self.skip:n])]
+        return results
+
+    def test_001_on_grid_matches_per_channel_path (self):
+        rng = numpy.random.RandomState(1234)
+        data = (rng.randn(8000) + 1j * rng.randn(8000)).astype(numpy.complex64)
+        offsets = [0, 2 * SPACING, -3 * SPACING, (CHANNELS / 2) * SPACING]
+
+        for actual, expected in self.run_both(data, offsets):
+            self.assertTrue(len(actual) > 1900)
+            self.assertComplexTuplesAlmostEqual2(tuple(expected), tuple(actual), 1e-4, 1e-4)
+
+    def test_002_off_grid_tone (self):
+        # Residual is removed after the filterbank: the tone still lands on DC at full passband gain
+        offset = (2 * SPACING) + 5e3
+        t = numpy.arange(8000)
+        data = numpy.exp(2j * numpy.pi * offset * t / SAMPLE_RATE).astype(numpy.complex64)
+
+        [(actual, expected)] = self.run_both(data, [offset])
+
+        numpy.testing.assert_allclose(numpy.abs(actual), numpy.abs(expected), rtol=1e-2)
+        numpy.testing.assert_allclose(numpy.abs(actual), 1.0, rtol=1e-2)
+        drift = actual[1:] / actual[:-1]	# No rotation left over
+        numpy.testing.assert_allclose(numpy.angle(drift), 0.0, atol=1e-3)
+
+if __name__ == '__main__':
+    gr_unittest.main ()
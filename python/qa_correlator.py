@@ -0,0 +1,111 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  qa_correlator.py
+#  
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#  
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#  
+#  
+
+import numpy
+
+from gnuradio import gr, gr_unittest, blocks
+import pmt
+
+import baz_swig
+from correlator import find_peak	# Python reference implementation
+
+WINDOW_LENGTH = 2000
+WIDTH = 256
+THRESHOLD = 40.0
+SYNC_WINDOW_LENGTH = 32
+SYNC_LENGTH = 63
+FIRST_SYNC = 1000
+JITTER = [0, 7, -12, 3, 15, -5, 0, -9, 21, -17]
+
+def qpsk(rng, n):
+    return ((rng.randint(0, 2, n) * 2 - 1) + 1j * (rng.randint(0, 2, n) * 2 - 1)) / numpy.sqrt(2)
+
+def reference_peaks(data, sync):
+    """Follow the burst train the way correlator.py does: acquire, then search each predicted window"""
+    corr = numpy.abs(numpy.correlate(data, sync, mode='same'))
+    half = len(sync) / 2
+
+    peak, mag = find_peak(corr, THRESHOLD, SYNC_WINDOW_LENGTH)
+    first = peak
+    peaks = []
+    while True:
+        start = peak + WINDOW_LENGTH - WIDTH / 2
+        if (start - half + WIDTH + len(sync)) > len(data):
+            break
+        peak, mag = find_peak(corr[:start + WIDTH + 1], THRESHOLD, SYNC_WINDOW_LENGTH, start)
+        if peak is None:
+            break
+        peaks.append(peak)
+    return corr, first, peaks
+
+class qa_correlator (gr_unittest.TestCase):
+
+    def setUp (self):
+        self.tb = gr.top_block ()
+
+    def tearDown (self):
+        self.tb = None
+
+    def test_001_burst_train (self):
+        rng = numpy.random.RandomState(1234)
+        sync = qpsk(rng, SYNC_LENGTH)
+        data = 0.05 * qpsk(rng, FIRST_SYNC + len(JITTER) * WINDOW_LENGTH)
+        for i, jitter in enumerate(JITTER):
+            start = FIRST_SYNC + (i * WINDOW_LENGTH) + jitter
+            data[start:start + SYNC_LENGTH] = sync
+        data = data.astype(numpy.complex64)
+        sync = sync.astype(numpy.complex64)
+
+        corr, first, expected_peaks = reference_peaks(data, sync)
+
+        # Sanity check the reference itself: peaks sit on the sync centres and follow the jitter
+        self.assertEqual(first, FIRST_SYNC + JITTER[0] + SYNC_LENGTH / 2)
+        self.assertEqual(len(expected_peaks), len(JITTER) - 1)
+        expected_offsets = [JITTER[i] - JITTER[i - 1] for i in range(1, len(JITTER))]
+        previous = [first] + expected_peaks[:-1]
+        self.assertEqual([p - q - WINDOW_LENGTH for p, q in zip(expected_peaks, previous)], expected_offsets)
+
+        src = blocks.vector_source_c(data.tolist())
+        correlator = baz_swig.correlator(WINDOW_LENGTH, sync.tolist(), THRESHOLD, WIDTH, SYNC_WINDOW_LENGTH)
+        dst = blocks.vector_sink_f()
+        self.tb.connect(src, correlator, dst)
+        self.tb.run()
+
+        tags = [tag for tag in dst.tags() if pmt.symbol_to_string(tag.key) == 'corr_peak']
+        peaks = [pmt.to_uint64(pmt.tuple_ref(tag.value, 0)) for tag in tags]
+        self.assertEqual(peaks, expected_peaks)
+        self.assertEqual([tag.offset for tag in tags], [(i * WIDTH) + (WIDTH / 2) for i in range(len(peaks))])
+        self.assertEqual([p - q - WINDOW_LENGTH for p, q in zip(peaks, previous)], expected_offsets)
+        for tag, peak in zip(tags, expected_peaks):
+            self.assertAlmostEqual(pmt.to_double(pmt.tuple_ref(tag.value, 1)) / corr[peak], 1.0, 3)
+
+        # Each scanline is the reference correlation magnitude centred on its peak
+        result = dst.data()
+        self.assertEqual(len(result), WIDTH * len(expected_peaks))
+        for i, peak in enumerate(expected_peaks):
+            expected = corr[peak - WIDTH / 2:peak + WIDTH / 2]
+            self.assertFloatTuplesAlmostEqual2(tuple(expected), result[i * WIDTH:(i + 1) * WIDTH], 1e-2, 1e-3)
+
+if __name__ == '__main__':
+    gr_unittest.main ()
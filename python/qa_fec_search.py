@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  qa_fec_search.py
+#  
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#  
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#  
+#  
+
+import time
+import numpy
+
+from gnuradio import gr, gr_unittest, blocks
+import pmt
+
+import baz_swig
+from fec_sync import fec_sync
+
+WINDOW_LENGTH = 2048
+MATRICES = [[1,1], [1,1,0,1,1,0]]	# 1/2, 3/4
+
+def parity(x):
+    x ^= (x >> 4)
+    x ^= (x >> 2)
+    x ^= (x >> 1)
+    return (x & 1)
+
+def transmit(poly_a, poly_b, matrix, rotation, viterbi_delay, viterbi_swap):
+    """Encode random data and undo what the receive chain will do for this hypothesis"""
+    rng = numpy.random.RandomState(5678)
+    state = 0
+    soft = []
+    for bit in rng.randint(0, 2, 2 * WINDOW_LENGTH):
+        reg = ((state << 1) | bit) & 0x7f
+        state = reg & 0x3f
+        soft += [(parity(reg & poly_a) * 2 - 1), (parity(reg & poly_b) * 2 - 1)]	# Positive soft symbol is a 1
+
+    if viterbi_swap:
+        soft[0::2], soft[1::2] = soft[1::2], soft[0::2]
+    if viterbi_delay:
+        soft = soft[1:]	# Receiver delays by one, so first pair is only half there
+    punctured = [x for i, x in enumerate(soft) if matrix[i % len(matrix)]]
+
+    punctured = numpy.array(punctured[:2 * WINDOW_LENGTH], dtype=numpy.float32)
+    symbols = punctured[0::2] + 1j * punctured[1::2]
+    return (symbols * ((-1j) ** rotation)).astype(numpy.complex64)	# Receiver rotates by j^rotation
+
+class fake_block():
+    def __init__(self):
+        self.calls = {}
+    def __getattr__(self, name):
+        if name.startswith('set'):
+            return lambda *args: self.calls.__setitem__(name, args)
+        raise AttributeError(name)
+
+class qa_fec_search (gr_unittest.TestCase):
+
+    def setUp (self):
+        self.tb = gr.top_block ()
+
+    def tearDown (self):
+        self.tb = None
+
+    def search (self, poly_a, poly_b, symbols):
+        src = blocks.vector_source_c(symbols.tolist(), True)	# Every window is the same
+        search = baz_swig.fec_search(WINDOW_LENGTH, MATRICES[0], 0.5, 2, False, poly_a, poly_b)
+        search.add_matrix(MATRICES[1])
+        dbg = blocks.message_debug()
+        self.tb.connect(src, search)
+        self.tb.msg_connect(search, 'xform', dbg, 'store')
+        self.tb.start()
+        timeout = time.time() + 30
+        while (dbg.num_messages() == 0) and (time.time() < timeout):
+            time.sleep(0.01)
+        self.tb.stop()
+        self.tb.wait()
+        self.assertTrue(dbg.num_messages() > 0)
+        return search, pmt.to_python(dbg.get_message(0))
+
+    def check (self, poly_a, poly_b, matrix, rotation, viterbi_delay, viterbi_swap):
+        symbols = transmit(poly_a, poly_b, MATRICES[matrix], rotation, viterbi_delay, viterbi_swap)
+        search, result = self.search(poly_a, poly_b, symbols)
+        self.assertTrue(result['locked'])
+        self.assertEqual(result['error_rate'], 0.0)
+        self.assertEqual(result['matrix'], matrix)
+        self.assertEqual(result['conjugate'], False)
+        self.assertEqual(result['rotation'], rotation)
+        self.assertEqual(result['puncture_delay'], 0)
+        self.assertEqual(result['viterbi_delay'], viterbi_delay)
+        self.assertEqual(result['viterbi_swap'], viterbi_swap)
+        return search
+
+    def test_001_odd_weight_polynomials (self):
+        # 180/270 would only invert the data, so just 0/90 are tried
+        search = self.check(0x4f, 0x6d, 0, 1, True, True)
+        self.assertEqual(search.rotation_count(), 2)
+        self.assertEqual(search.hypothesis_count(), (2 + 6) * 2 * 2 * 2 * 2)
+        self.check(0x4f, 0x6d, 1, 1, True, True)
+        self.check(0x4f, 0x6d, 1, 0, True, False)
+
+    def test_002_even_weight_polynomial (self):
+        search = self.check(0x47, 0x6d, 0, 3, True, True)
+        self.assertEqual(search.rotation_count(), 4)
+        self.assertEqual(search.hypothesis_count(), (2 + 6) * 2 * 4 * 2 * 2)
+        self.check(0x47, 0x6d, 0, 2, False, False)
+        self.check(0x47, 0x6d, 1, 2, True, False)
+        self.check(0x47, 0x6d, 1, 3, False, True)
+
+    def test_003_fec_sync_applies_result (self):
+        conj, rot, depunc_delay = fake_block(), fake_block(), fake_block()
+        viterbi_delay, viterbi_swap, depunc = fake_block(), fake_block(), fake_block()
+        sync = fec_sync(conj, rot, depunc_delay, len(MATRICES[0]), 1.0, 1.0,
+            viterbi_delay=viterbi_delay, viterbi_swap=viterbi_swap, depunc=depunc, matrices=MATRICES)
+
+        result = pmt.make_dict()
+        for key, value in [('matrix', pmt.from_long(1)), ('conjugate', pmt.PMT_F), ('rotation', pmt.from_long(3)),
+                ('puncture_delay', pmt.from_long(4)), ('viterbi_delay', pmt.PMT_T), ('viterbi_swap', pmt.PMT_T),
+                ('error_rate', pmt.from_double(0.0)), ('locked', pmt.PMT_T)]:
+            result = pmt.dict_add(result, pmt.intern(key), value)
+        sync.handle_search(result)
+
+        self.assertEqual(conj.calls['set'], (False,))
+        self.assertEqual(rot.calls['set_k'], ((-1j,),))
+        self.assertEqual(depunc_delay.calls['set_delay'], (4,))
+        self.assertEqual(viterbi_delay.calls['set_delay'], (1,))
+        self.assertEqual(viterbi_swap.calls['set_swap'], (True,))
+        self.assertEqual(depunc.calls['set_matrix'], (MATRICES[1],))
+        self.assertEqual(sync.depunc_length, len(MATRICES[1]))
+
+if __name__ == '__main__':
+    gr_unittest.main ()
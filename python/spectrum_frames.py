@@ -0,0 +1,87 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  spectrum_frames.py
+#  
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#  
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#  
+#  
+
+# Zero-copy views of the triple buffer of baz.spectrum_frames, and a poller that feeds them to a wxgui window
+
+import struct, ctypes, threading, time
+import numpy
+
+FRAME_BUFFER_MAGIC = 0x30465053	# "SPF0"
+FRAME_BUFFER_VERSION = 1
+
+_header = struct.Struct("=IIIIIId")	# magic, version, header size, bins, sample size, slot size, sample rate
+_frame_info = struct.Struct("=Qff")	# sequence, ref level, dynamic range
+
+class frame_reader():
+	def __init__(self, block):
+		"""'block' is a baz.spectrum_frames: this must be its only reader"""
+		self.block = block
+		self.map = (ctypes.c_char * block.buffer_length()).from_address(block.buffer_address())
+		(magic, version, header_size, self.bins, sample_size, slot_size, sample_rate) = _header.unpack_from(self.map, 0)
+		if magic != FRAME_BUFFER_MAGIC or version != FRAME_BUFFER_VERSION:
+			raise ValueError("unsupported frame buffer (magic 0x%08x, version %d)" % (magic, version))
+		self.max_code = float((1 << (8 * sample_size)) - 1)
+		dtype = {1: numpy.uint8, 2: numpy.uint16}[sample_size]
+		self.slots = []
+		for slot in range(3):
+			offset = block.slot_offset(slot)
+			codes = numpy.frombuffer(self.map, dtype=dtype, count=self.bins, offset=offset + _frame_info.size)
+			self.slots.append((offset, codes))
+	def acquire(self):
+		"""Returns (sequence, ref level, dynamic range, codes) for the newest unread frame, or None.
+		'codes' views the slot in place and stays valid until the next call."""
+		slot = self.block.acquire_frame()
+		if slot < 0:
+			return None
+		(offset, codes) = self.slots[slot]
+		(sequence, ref_level, dynamic_range) = _frame_info.unpack_from(self.map, offset)
+		return (sequence, ref_level, dynamic_range, codes)
+	def to_db(self, frame):
+		(sequence, ref_level, dynamic_range, codes) = frame
+		return (codes * numpy.float32(dynamic_range / self.max_code)) + numpy.float32(ref_level - dynamic_range)
+
+class frame_poller(threading.Thread):
+	"""Publishes each new frame (in dB, float32) to controller[msg_key], checking 'rate' times a second"""
+	def __init__(self, block, controller, msg_key, rate):
+		threading.Thread.__init__(self)
+		self.setDaemon(1)
+		self.reader = frame_reader(block)
+		self._controller = controller
+		self._msg_key = msg_key
+		self.set_rate(rate)
+		self.keep_running = True
+		self.start()
+	def set_rate(self, rate):
+		self._period = 1.0 / max(rate, 1.0)
+	def stop(self):
+		"""Waits for the thread to finish, after which the block's buffer can be released"""
+		self.keep_running = False
+		if self.is_alive() and threading.current_thread() is not self:
+			self.join()
+	def run(self):
+		while self.keep_running:
+			frame = self.reader.acquire()
+			if frame is not None:
+				self._controller[self._msg_key] = self.reader.to_db(frame)	# Window keeps it, so it's a copy
+			time.sleep(self._period / 2)
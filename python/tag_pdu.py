@@ -0,0 +1,108 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  tag_pdu.py
+#  
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#  
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#  
+#  
+
+# Decoder for baz.tag_to_msg binary PDUs (MODE_BINARY)
+
+import struct
+
+VALUE_STRING	= 0
+VALUE_NIL	= 1
+VALUE_FALSE	= 2
+VALUE_TRUE	= 3
+VALUE_LONG	= 4
+VALUE_UINT64	= 5
+VALUE_DOUBLE	= 6
+VALUE_COMPLEX	= 7
+VALUE_SYMBOL	= 8
+VALUE_TIME	= 9
+
+_header = struct.Struct("=QIIB")	# offset, srcid, key, value type
+
+class tag_pdu_decoder():
+	"""Keeps the symbol table built up from consecutive PDUs of one tag_to_msg block"""
+	def __init__(self):
+		self.symbols = []
+	def decode(self, pdu):
+		"""Returns a list of (offset, srcid, key, value) from a PDU (pmt pair)"""
+		import pmt
+		meta = pmt.car(pdu)
+		symbols = pmt.dict_ref(meta, pmt.intern("symbols"), pmt.PMT_NIL)
+		if not pmt.is_null(symbols):
+			base = pmt.to_long(pmt.dict_ref(meta, pmt.intern("symbol_base"), pmt.from_long(0)))
+			self.add_symbols(base, [pmt.symbol_to_string(pmt.vector_ref(symbols, i)) for i in range(pmt.length(symbols))])
+		data = bytes(bytearray(pmt.u8vector_elements(pmt.cdr(pdu))))
+		return self.decode_records(data)
+	def add_symbols(self, base, names):
+		if base == 0:
+			self.symbols = names	# Whole table (sent periodically, on request, or when renumbered)
+			return
+		if base != len(self.symbols):
+			raise ValueError("symbol table out of step: have %d, PDU starts at %d (missed a PDU? the next whole table will fix it)" % (len(self.symbols), base))
+		self.symbols += names
+	def decode_records(self, data):
+		tags = []
+		i = 0
+		while i < len(data):
+			(offset, srcid, key, value_type) = _header.unpack_from(data, i)
+			i += _header.size
+			if value_type == VALUE_STRING:
+				(length,) = struct.unpack_from("=I", data, i)
+				value = data[i+4:i+4+length].decode('utf-8', 'replace')
+				i += 4 + length
+			elif value_type == VALUE_NIL:
+				value = None
+			elif value_type == VALUE_FALSE:
+				value = False
+			elif value_type == VALUE_TRUE:
+				value = True
+			elif value_type == VALUE_LONG:
+				(value,) = struct.unpack_from("=q", data, i)
+				i += 8
+			elif value_type == VALUE_UINT64:
+				(value,) = struct.unpack_from("=Q", data, i)
+				i += 8
+			elif value_type == VALUE_DOUBLE:
+				(value,) = struct.unpack_from("=d", data, i)
+				i += 8
+			elif value_type == VALUE_COMPLEX:
+				(re, im) = struct.unpack_from("=dd", data, i)
+				value = complex(re, im)
+				i += 16
+			elif value_type == VALUE_SYMBOL:
+				(index,) = struct.unpack_from("=I", data, i)
+				value = self.symbols[index]
+				i += 4
+			elif value_type == VALUE_TIME:
+				value = struct.unpack_from("=Qd", data, i)
+				i += 16
+			else:
+				raise ValueError("unknown value type %d at byte %d" % (value_type, i - 1))
+			tags += [(offset, self.symbols[srcid], self.symbols[key], value)]
+		return tags
+
+def main():
+	return 0
+
+if __name__ == '__main__':
+	main()
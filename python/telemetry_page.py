@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#  telemetry_page.py
+#  
+#  Copyright 2014 Balint Seeber <balint256@gmail.com>
+#  
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+#  
+#  
+
+# Reader for the memory-mapped stats page of baz.telemetry_probe (set_stats_page)
+
+import struct, mmap, time
+
+STATS_PAGE_MAGIC = 0x30545350	# "PST0"
+STATS_PAGE_VERSION = 1
+CALL_SIZE_BINS = 32
+
+_header = struct.Struct("=IIIIQQQdddd")	# magic, version, page size, item size, sequence, snapshot count, snapshot ns, interval, item/call/tag rates
+_counters = struct.Struct("=11Q%dQ" % (CALL_SIZE_BINS))
+_counter_names = ["items", "work_calls", "tags", "min_call", "max_call", "last_call", "gap_total_ns", "gap_min_ns", "gap_max_ns", "first_call_ns", "last_call_ns"]
+
+class telemetry_page():
+	def __init__(self, path):
+		f = open(path, "rb")
+		try:
+			self.map = mmap.mmap(f.fileno(), _header.size + _counters.size, access=mmap.ACCESS_READ)
+		finally:
+			f.close()
+	def close(self):
+		self.map.close()
+	def read(self, retries=1000):
+		"""Returns the latest snapshot as a dict, or None if the page isn't ready"""
+		for i in range(retries):
+			header = _header.unpack_from(self.map, 0)
+			(magic, version, page_size, item_size, sequence) = header[:5]
+			if magic != STATS_PAGE_MAGIC:
+				return None
+			if version != STATS_PAGE_VERSION or page_size != (_header.size + _counters.size):
+				raise ValueError("unsupported stats page (version %d, size %d)" % (version, page_size))
+			if sequence & 1:
+				continue
+			counters = _counters.unpack_from(self.map, _header.size)
+			if _header.unpack_from(self.map, 0)[4] != sequence:
+				continue
+			stats = dict(zip(_counter_names, counters[:len(_counter_names)]))
+			stats['call_sizes'] = list(counters[len(_counter_names):])
+			stats['item_size'] = item_size
+			stats['snapshot'] = header[5]
+			stats['snapshot_ns'] = header[6]
+			stats['interval'] = header[7]
+			stats['item_rate'] = header[8]
+			stats['call_rate'] = header[9]
+			stats['tag_rate'] = header[10]
+			return stats
+		return None
+
+def main():
+	from optparse import OptionParser
+	parser = OptionParser(usage="%prog: [options] <stats page>...")
+	parser.add_option("-p", "--period", type="float", default=1.0, help="poll period (s) [default=%default]")
+	(options, args) = parser.parse_args()
+	if len(args) == 0:
+		parser.print_help()
+		return 1
+	pages = [(path, telemetry_page(path)) for path in args]
+	print("%-24s %12s %10s %10s %10s %10s" % ("page", "items/s", "calls/s", "tags/s", "mean call", "max gap"))
+	while True:
+		for (path, page) in pages:
+			stats = page.read()
+			if stats is None:
+				continue
+			mean_call = 0.0
+			if stats['work_calls'] > 0:
+				mean_call = float(stats['items']) / stats['work_calls']
+			print("%-24s %12.1f %10.1f %10.1f %10.1f %9.3fms" % (path[-24:], stats['item_rate'], stats['call_rate'], stats['tag_rate'], mean_call, stats['gap_max_ns'] / 1e6))
+		time.sleep(options.period)
+	return 0
+
+if __name__ == '__main__':
+	main()
@@ -23,12 +23,15 @@
 # Imports
 ##################################################
 import waterfall_window
+import spectrum_frames
+import baz
 from gnuradio.wxgui import common
 from gnuradio import gr
 from gnuradio import analog
 from gnuradio import blocks
 from gnuradio.wxgui.pubsub import pubsub
 from gnuradio.wxgui.constants import *
+import wx
 
 ##################################################
 # Waterfall sink block (wrapper for old wxgui)
@@ -104,3 +107,90 @@ class waterfall_sink_f(gr.hier_block2, common.wxgui_hb):
 
 	def set_callback(self,callb):
 		self.win.set_callback(callb)
+
+##################################################
+# Waterfall sink block for complex input (native FFT & framing)
+##################################################
+
+class waterfall_sink_c(gr.hier_block2, common.wxgui_hb):
+	"""
+	A waterfall with complex input: windowing, FFT, averaging and dB conversion
+	happen in baz.spectrum_frames, and the window reads its frames in place.
+	"""
+
+	def __init__(
+		self,
+		parent,
+		x_offset=0,
+		ref_level=0,
+		sample_rate=1,
+		fft_size=512,
+		overlap=0,
+		fft_rate=waterfall_window.DEFAULT_FRAME_RATE,
+		average=False,
+		avg_alpha=None,
+		title='',
+		size=waterfall_window.DEFAULT_WIN_SIZE,
+		dynamic_range=80,
+		num_lines=256,
+		win=None,
+		always_run=False,
+		**kwargs #do not end with a comma
+	):
+		#ensure avg alpha
+		if avg_alpha is None: avg_alpha = 2.0/fft_rate
+		#init
+		gr.hier_block2.__init__(
+			self,
+			"waterfall_sink_c",
+			gr.io_signature(1, 1, gr.sizeof_gr_complex),
+			gr.io_signature(0, 0, 0),
+		)
+		#blocks (8 bits is as fine as the colour table)
+		if win is None: win = []
+		self.frames = baz.spectrum_frames(fft_size, overlap, sample_rate, fft_rate, win, 8, ref_level, dynamic_range, (avg_alpha if average else 1.0))
+		#controller
+		self.controller = pubsub()
+		#start frame poller
+		self.poller = spectrum_frames.frame_poller(self.frames, self.controller, MSG_KEY, fft_rate)
+		#create window
+		self.win = waterfall_window.waterfall_window(
+			parent=parent,
+			controller=self.controller,
+			size=size,
+			title=title,
+			data_len=fft_size,
+			num_lines=num_lines,
+			x_offset=x_offset,
+			dynamic_range=dynamic_range,
+			ref_level=ref_level,
+			msg_key=MSG_KEY,
+		)
+		#quantise over what is on screen
+		self.win.subscribe(REF_LEVEL_KEY, self.frames.set_ref_level)
+		self.win.subscribe(DYNAMIC_RANGE_KEY, self.frames.set_dynamic_range)
+		common.register_access_methods(self, self.win)
+		setattr(self.win, 'set_baseband_freq', getattr(self, 'set_baseband_freq')) #BACKWARDS	# FIXME
+		#connect
+		if always_run:
+			connect_fn = self.connect
+		else:
+			connect_fn = self.wxgui_connect
+		
+		connect_fn(self, self.frames)
+		self.win.Bind(wx.EVT_WINDOW_DESTROY, self._on_destroy)
+
+	def _on_destroy(self, event):
+		if event.GetEventObject() is self.win:
+			self.stop()
+		event.Skip()
+
+	def stop(self):
+		"""Stops the frame poller (also done when the window is destroyed)"""
+		self.poller.stop()
+
+	def set_callback(self,callb):
+		self.win.set_callback(callb)
+
+	def set_sample_rate(self, rate):
+		self.frames.set_sample_rate(rate)
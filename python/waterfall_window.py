@@ -262,11 +262,14 @@ class waterfall_window(wx.Panel, pubsub.pubsub):
 		Send the data to the plotter.
 		
 		Args:
-		    msg: the fft array as a character array
+		    msg: the fft array as a character array (or float32 numpy array)
 		"""
 		if not self[RUNNING_KEY]: return
 		#convert to floating point numbers
-		self.samples = samples = numpy.fromstring(msg, numpy.float32)[:self.data_len] #only take first frame
+		if isinstance(msg, numpy.ndarray):
+			self.samples = samples = msg[:self.data_len]
+		else:
+			self.samples = samples = numpy.fromstring(msg, numpy.float32)[:self.data_len] #only take first frame
 		num_samps = len(samples)
 		#plot the fft
 		self.plotter.set_samples(
@@ -36,6 +36,7 @@
 #include "baz_native_callback.h"
 #include "baz_native_mux.h"
 #include "baz_block_status.h"
+#include "baz_telemetry_probe.h"
 #include "baz_non_blocker.h"
 #include "baz_acars_decoder.h"
 #include "baz_tag_to_msg.h"
@@ -53,6 +54,13 @@
 #include "baz_peak_detector.h"
 #include "baz_burst_tagger.h"
 #include "baz_burst_buffer.h"
+#include "baz_correlator.h"
+#include "baz_fac.h"
+#include "baz_spectrum_frames.h"
+#include "baz_papr.h"
+#include "baz_channelizer_ccf.h"
+#include "baz_fec_search.h"
+#include "baz_acars_multi_decoder.h"
 
 #ifdef UHD_FOUND
 #include "baz_gate.h"
@@ -64,6 +72,78 @@
 #include "baz_music_doa.h"
 #endif // ARMADILLO_FOUND
 
+GR_SWIG_BLOCK_MAGIC(baz,spectrum_frames);
+
+baz_spectrum_frames_sptr baz_make_spectrum_frames (int fft_size, int overlap = 0, double sample_rate = 1.0, double frame_rate = 30.0, const std::vector<float>& window = std::vector<float>(), int bits = 8, float ref_level = 0.0, float dynamic_range = 100.0, float alpha = 1.0, bool peak_hold = false, const std::string& path = "");
+
+class baz_spectrum_frames : public gr::sync_block
+{
+private:
+	baz_spectrum_frames (int fft_size, int overlap, double sample_rate, double frame_rate, const std::vector<float>& window, int bits, float ref_level, float dynamic_range, float alpha, bool peak_hold, const std::string& path);
+public:
+	~baz_spectrum_frames();
+	int fft_size() const;
+	int bits() const;
+	void set_sample_rate(double sample_rate);
+	double sample_rate() const;
+	void set_frame_rate(double frame_rate);
+	double frame_rate() const;
+	void set_ref_level(float ref_level);
+	float ref_level() const;
+	void set_dynamic_range(float dynamic_range);
+	float dynamic_range() const;
+	void set_alpha(float alpha);
+	float alpha() const;
+	void set_peak_hold(bool peak_hold);
+	bool peak_hold() const;
+	void reset_peak();
+	int frames_per_output() const;
+	uint64_t frame_count() const;
+	uint64_t overwritten_count() const;
+	int acquire_frame();
+	size_t buffer_address() const;
+	size_t buffer_length() const;
+	size_t slot_offset(int slot) const;
+	std::string path() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+GR_SWIG_BLOCK_MAGIC(baz,papr);
+
+baz_papr_sptr baz_make_papr (int window = 2048, int envelope_window = 0, int average = 128, double resolution = 0.05, int history = 0);
+
+class baz_papr : public gr::sync_block
+{
+private:
+	baz_papr (int window, int envelope_window, int average, double resolution, int history);
+public:
+	enum sample_format {
+		FORMAT_COMPLEX_FLOAT = 0,
+		FORMAT_COMPLEX_SHORT = 1
+	};
+	~baz_papr();
+	int window() const;
+	int envelope_window() const;
+	int average() const;
+	double resolution() const;
+	uint64_t analyse_file(const std::string& path, int format = FORMAT_COMPLEX_FLOAT, uint64_t offset = 0, uint64_t count = 0, int threads = 0);
+	void reset();
+	uint64_t sample_count();
+	uint64_t windows_dropped();
+	double mean_power();
+	double mean_magnitude();
+	float min_magnitude();
+	float max_magnitude();
+	std::vector<float> power();
+	std::vector<float> envelope();
+	std::vector<float> papr();
+	std::vector<float> ccdf_levels();
+	std::vector<float> ccdf();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 #endif // GR_BAZ_WITH_CMAKE
 
 // Somehow SWIG is missing this, and refuses to include pycontainer.swg
@@ -105,6 +185,7 @@ public:
 public:
 	void set_vid(/*uint16_t*/int vid);
 	void set_pid(/*uint16_t*/int pid);
+	void set_device_index(int index);
 	void set_default_timeout(int timeout);	// 0: use default, -1: poll only
 	void set_fir_coefficients(const std::vector</*uint8_t*/int>& coeffs);
 	void set_crystal_frequency(/*uint32_t*/int freq);
@@ -209,16 +290,21 @@ public:
 
 GR_SWIG_BLOCK_MAGIC(baz,delay)
 
-baz_delay_sptr baz_make_delay (size_t itemsize, int delay);
+baz_delay_sptr baz_make_delay (size_t itemsize, int delay, bool fractional = false);
 
 class baz_delay : public gr::block
 {
  private:
-  baz_delay (size_t itemsize, int delay);
+  baz_delay (size_t itemsize, int delay, bool fractional);
 
  public:
   int  delay() const;
+  double fractional_delay() const;
+  double applied_delay() const;
   void set_delay (int delay);
+  void set_fractional_delay (double delay);
+  void schedule_delay (double delay, uint64_t sample);
+  bool fractional() const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -341,6 +427,22 @@ class baz_udp_source : public gr::sync_block
   int payload_size() { return d_payload_size; }
   int get_port();
   void signal_eos();
+
+  void set_timestamps(bool enable, int tag_interval = 0);
+  bool timestamps() const;
+  void set_timing_window(int packets);
+  int timing_window() const;
+
+  uint64_t packets_received() const;
+  double jitter();
+  double mean_interval();
+  double max_interval();
+  std::vector<uint64_t> interval_histogram();
+  std::vector<uint64_t> jitter_histogram();
+  void reset_timing_stats();
+
+  bool use_packet_ring(const std::string &ifname, int block_size = (1 << 20), int block_count = 16);
+  bool packet_ring() const;
 };
 ///////////////////////////////////////////////////////////////////////////////
 /*
@@ -413,6 +515,7 @@ class baz_native_callback_target
 {
 public:
   virtual void callback(float f, unsigned long samples_processed)=0; // FIXME: Item size
+  virtual void callback_batch(const float* f, int count, unsigned long samples_processed);
 };
 
 typedef boost::shared_ptr<baz_native_callback_target> baz_native_callback_target_sptr;
@@ -473,16 +576,60 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+GR_SWIG_BLOCK_MAGIC(baz,telemetry_probe)
+
+baz_telemetry_probe_sptr baz_make_telemetry_probe (int item_size, double interval = 1.0, const std::string& stats_page = "");
+
+class baz_telemetry_probe : public gr::sync_block
+{
+private:
+	baz_telemetry_probe (int item_size, double interval, const std::string& stats_page);  	// private constructor
+public:
+	void set_interval(double interval);
+	double interval() const;
+	bool set_stats_page(const std::string& path);
+	std::string stats_page() const;
+	uint64_t items() const;
+	uint64_t work_calls() const;
+	uint64_t tags() const;
+	double mean_call_size() const;
+	double mean_gap() const;
+	uint64_t snapshot_count() const;
+	void reset();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 GR_SWIG_BLOCK_MAGIC(baz,non_blocker)
 
-baz_non_blocker_sptr baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking = false);
+baz_non_blocker_sptr baz_make_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking = false, int high_watermark = 0, int low_watermark = 0, int overload_mode = 0, int decimation = 2);
 
 class baz_non_blocker : public gr::block
 {
 private:
-  baz_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking);  	// private constructor
+  baz_non_blocker (int item_size, /*gr::msg_queue::sptr queue, */bool blocking, int high_watermark, int low_watermark, int overload_mode, int decimation);  	// private constructor
 public:
+  enum overload_mode_t
+  {
+    OVERLOAD_DROP_OLDEST  = 0,
+    OVERLOAD_DECIMATE     = 1
+  };
+
   void set_blocking(bool enable = true);
+  void set_watermarks(int high, int low);
+  void set_overload_mode(int mode);
+  void set_decimation(int decimation);
+  int high_watermark() const;
+  int low_watermark() const;
+  int overload_mode() const;
+  int decimation() const;
+  bool overloaded() const;
+  uint64_t dropped_count() const;
+  uint64_t drop_events() const;
+  uint64_t filled_count() const;
+  uint64_t fill_events() const;
+  uint64_t overload_count() const;
+  void reset_stats();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -491,12 +638,12 @@ public:
 
 GR_SWIG_BLOCK_MAGIC(baz,gate)
 
-baz_gate_sptr baz_make_gate (int item_size, bool block = true, float threshold = 1.0, int trigger_length = 0, bool tag = false, double delay = 0.0, int sample_rate = 0, bool no_delay = false, bool verbose = true, bool retriggerable = false);
+baz_gate_sptr baz_make_gate (int item_size, bool block = true, float threshold = 1.0, int trigger_length = 0, bool tag = false, double delay = 0.0, int sample_rate = 0, bool no_delay = false, bool verbose = true, bool retriggerable = false, int channels = 1);
 
 class baz_gate : public gr::sync_block
 {
 private:
-  baz_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable);  	// private constructor
+  baz_gate (int item_size, bool block, float threshold, int trigger_length, bool tag, double delay, int sample_rate, bool no_delay, bool verbose, bool retriggerable, int channels);  	// private constructor
 public:
   void set_blocking(bool enable);
   void set_threshold(float threshold);
@@ -505,16 +652,32 @@ public:
   void set_delay(double delay);
   void set_sample_rate(int sample_rate);
   void set_no_delay(bool no_delay);
+  int channels() const;
 };
 
 ////////////////////////////////////////
 
+%template(usrp_acquire_device_sptr) boost::shared_ptr<gr::baz::usrp_acquire_device>;
 %template(usrp_acquire_sptr) boost::shared_ptr<gr::baz::usrp_acquire>;
 
 %include "baz_usrp_acquire.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
+class baz_hopper_device
+{
+public:
+	virtual ~baz_hopper_device();
+	virtual void tune_at(const uhd::time_spec_t& time, double freq) = 0;
+	virtual double clock();
+};
+
+typedef boost::shared_ptr<baz_hopper_device> baz_hopper_device_sptr;
+%template(baz_hopper_device_sptr) boost::shared_ptr<baz_hopper_device>;
+
+%rename(hopper_device) baz_make_hopper_device;
+baz_hopper_device_sptr baz_make_hopper_device(::uhd::usrp::multi_usrp::sptr dev);
+
 GR_SWIG_BLOCK_MAGIC(baz,hopper);
 
 baz_hopper_sptr baz_make_hopper (
@@ -527,12 +690,32 @@ baz_hopper_sptr baz_make_hopper (
 	bool verbose = false
 );
 
+%rename(hopper_with_device) baz_make_hopper_with_device;
+baz_hopper_sptr baz_make_hopper_with_device (
+	size_t item_size,
+	int sample_rate,
+	int chunk_length,
+	int drop_length,
+	std::vector<std::vector<double> > freqs,
+	baz_hopper_device_sptr dev,
+	bool verbose = false
+);
+
 class baz_hopper : public gr::block
 {
 //protected:
 //	baz_hopper (int itemsize, ..., bool verbose = false);
 public:
 	~baz_hopper();
+
+	void set_max_ahead(int max_ahead);
+	int max_ahead() const;
+	int ahead() const;
+	double command_latency() const;
+	void set_command_latency(double latency);
+	uint64_t commands_issued() const;
+	uint64_t commands_dropped() const;
+	int pending_commands() const;
 };
 
 #endif // UHD_FOUND
@@ -577,33 +760,75 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+GR_SWIG_BLOCK_MAGIC(baz,acars_multi_decoder)
+
+baz_acars_multi_decoder_sptr baz_make_acars_multi_decoder(double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads = 1, bool verbose = false);
+
+class baz_acars_multi_decoder : public gr::sync_block
+{
+private:
+	baz_acars_multi_decoder(double sample_rate, double baseband_freq, const std::vector<double>& frequencies, int threads, bool verbose);
+public:
+	void set_frequencies(const std::vector<double>& frequencies);
+	std::vector<double> frequencies();
+	void set_baseband_freq(double baseband_freq);
+	void set_preamble_threshold(int threshold);
+	void set_station_name(const char* station_name);
+public:
+	double baseband_freq() const;
+	double channel_rate() const;
+	int preamble_threshold() const;
+	const char* station_name() const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 GR_SWIG_BLOCK_MAGIC(baz,tag_to_msg)
 
-baz_tag_to_msg_sptr baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append = NULL/*, int initial_buffer_size = -1*/);
+baz_tag_to_msg_sptr baz_make_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append = NULL/*, int initial_buffer_size = -1*/, int mode = 0, bool blocking = false, int table_interval = 100, int max_symbols = 4096);
 
 class baz_tag_to_msg : public gr::sync_block
 {
 private:
-	baz_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/);
+	baz_tag_to_msg (int item_size, gr::msg_queue::sptr msgq, const char* append/*, int initial_buffer_size*/, int mode, bool blocking, int table_interval, int max_symbols);
 public:
 	void set_msgq(gr::msg_queue::sptr msgq);
 	void set_appended_string(const char* append);
+	void set_blocking(bool blocking);
+	bool blocking() const;
+	int mode() const;
+	uint64_t tag_count() const;
+	uint64_t message_count() const;
+	uint64_t dropped_count() const;
+	void reset_counters();
+	void set_table_interval(int table_interval);
+	int table_interval() const;
+	void set_max_symbols(int max_symbols);
+	int max_symbols() const;
+	void request_table();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
 GR_SWIG_BLOCK_MAGIC(baz,time_keeper)
 
-baz_time_keeper_sptr baz_make_time_keeper (int item_size, int sample_rate);
+baz_time_keeper_sptr baz_make_time_keeper (int item_size, int sample_rate, int history = 64, double max_jump = 0.0);
 
 class baz_time_keeper : public gr::sync_block
 {
 private:
-	baz_time_keeper (int item_size, int sample_rate);  	// private constructor
+	baz_time_keeper (int item_size, int sample_rate, int history, double max_jump);  	// private constructor
 public:
 	double time(bool relative = false);
 	void ignore_next(bool ignore = true);
 	int update_count(void);
+	double sample_time(uint64_t sample, bool relative = false) const;
+	double time_sample(double time, bool relative = false) const;
+	double sample_rate_estimate() const;
+	double drift_ppm() const;
+	double jitter() const;
+	int history_count() const;
+	uint64_t discontinuity_count() const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -737,6 +962,10 @@ public:
 	void set_pulse_plateau(float level);
 	bool set_param(const std::string& param, float value);
 	void skip(int skip);
+	void set_pdw_batch(int batch);
+	bool set_pdw_ring(const std::string& path, int capacity = 4096);
+	int pdw_batch() const;
+	uint64_t pdw_count() const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -891,5 +1120,100 @@ public:
 
 ////////////////////////////////////////////////////////////////////////////////
 
+GR_SWIG_BLOCK_MAGIC(baz,correlator);
+
+baz_correlator_sptr baz_make_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold = 0.5, int width = 1024, int sync_window_length = 500, bool verbose = false);
+
+class baz_correlator : public gr::block
+{
+protected:
+	baz_correlator (int window_length, const std::vector<gr_complex>& sync, float threshold, int width, int sync_window_length, bool verbose);
+public:
+	~baz_correlator();
+	void set_threshold(float threshold);
+	float threshold() const;
+	bool synced() const;
+	uint64_t scanline_count() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+GR_SWIG_BLOCK_MAGIC(baz,channelizer_ccf);
+
+baz_channelizer_ccf_sptr baz_make_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq = 0.0);
+
+class baz_channelizer_ccf : public gr::sync_decimator
+{
+protected:
+	baz_channelizer_ccf (double sample_rate, int channels, int decimation, const std::vector<float>& taps, int outputs, double baseband_freq);
+public:
+	~baz_channelizer_ccf();
+	void set_baseband_freq(double baseband_freq);
+	double baseband_freq() const;
+	double output_rate() const;
+	double channel_spacing() const;
+	int output_count() const;
+	void set_channel(int output, double freq);
+	void clear_channel(int output);
+	double channel_freq(int output) const;
+	bool channel_enabled(int output) const;
+	std::vector<int> set_frequencies(const std::vector<double>& freqs);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+GR_SWIG_BLOCK_MAGIC(baz,fec_search);
+
+baz_fec_search_sptr baz_make_fec_search (int window_length, const std::vector<int>& matrix, float threshold = 0.5, int threads = 0, bool continuous = false, int poly_a = 0x4f, int poly_b = 0x6d, bool verbose = false);
+
+class baz_fec_search : public gr::sync_block
+{
+protected:
+	baz_fec_search (int window_length, const std::vector<int>& matrix, float threshold, int threads, bool continuous, int poly_a, int poly_b, bool verbose);
+public:
+	~baz_fec_search();
+	void add_matrix(const std::vector<int>& matrix);
+	void clear_matrices();
+	int matrix_count();
+	int hypothesis_count();
+	int rotation_count() const;
+	void set_threshold(float threshold);
+	float threshold() const;
+	void set_continuous(bool continuous);
+	bool continuous() const;
+	void reset();
+	bool locked() const;
+	uint64_t search_count() const;
+	uint64_t windows_skipped() const;
+	float last_error_rate() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+GR_SWIG_BLOCK_MAGIC(baz,fac);
+
+baz_fac_sptr baz_make_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha = 1.0);
+
+class baz_fac : public gr::sync_block
+{
+private:
+	baz_fac (int fac_size, bool input_is_real, double sample_rate, double fac_rate, gr::msg_queue::sptr msgq, float alpha);
+public:
+	~baz_fac();
+	void set_sample_rate(double sample_rate);
+	double sample_rate() const;
+	void set_fac_rate(double fac_rate);
+	double fac_rate() const;
+	void set_alpha(float alpha);
+	float alpha() const;
+	int frames_per_output() const;
+	uint64_t frame_count() const;
+	uint64_t output_count() const;
+	uint64_t dropped_count() const;
+	void reset();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 #endif // GR_BAZ_WITH_CMAKE
 